@@ -163,6 +163,8 @@ SOURCES += \
     src/amount.cpp \
     src/arith_uint256.cpp \
     src/base58.cpp \
+    src/blockindexmap.cpp \
+    src/bufferpool.cpp \
     src/chain.cpp \
     src/chainparams.cpp \
     src/chainparamsbase.cpp \
@@ -175,6 +177,7 @@ SOURCES += \
     src/ecwrapper.cpp \
     src/leveldbwrapper.cpp \
     src/merkleblock.cpp \
+    src/messagedispatch.cpp \
     src/obfuscation.cpp \
     src/obfuscation-relay.cpp \
     src/pow.cpp \
@@ -193,11 +196,14 @@ SOURCES += \
     src/rpcservicenode.cpp \
     src/rpcservicenode-budget.cpp \
     src/rpcwallet.cpp \
+    src/scheduler.cpp \
+    src/sectionfile.cpp \
     src/servicenode.cpp \
     src/servicenode-budget.cpp \
     src/servicenodeconfig.cpp \
     src/servicenodeman.cpp \
     src/servicenode-payments.cpp \
+    src/servicenode-sigcheck.cpp \
     src/servicenode-sync.cpp \
     src/spork.cpp \
     src/swifttx.cpp \
@@ -249,6 +255,7 @@ SOURCES += \
     src/crypto/cubehash.c \
     src/crypto/echo.c \
     src/crypto/groestl.c \
+    src/crypto/groestl_aesni.cpp \
     src/crypto/jh.c \
     src/crypto/keccak.c \
     src/crypto/luffa.c \
@@ -366,6 +373,7 @@ HEADERS += \
     src/alert.h \
     src/addrman.h \
     src/base58.h \
+    src/blockindexmap.h \
     src/checkpoints.h \
     src/compat.h \
     src/coincontrol.h \
@@ -422,6 +430,7 @@ HEADERS += \
     src/netbase.h \
     src/clientversion.h \
     src/bloom.h \
+    src/bufferpool.h \
     src/checkqueue.h \
     src/hash.h \
     src/limitedmap.h \
@@ -443,6 +452,7 @@ HEADERS += \
     src/ecwrapper.h \
     src/leveldbwrapper.h \
     src/merkleblock.h \
+    src/messagedispatch.h \
     src/noui.h \
     src/obfuscation.h \
     src/obfuscation-relay.h \
@@ -452,11 +462,14 @@ HEADERS += \
     src/rpcclient.h \
     src/rpcprotocol.h \
     src/rpcserver.h \
+    src/scheduler.h \
+    src/sectionfile.h \
     src/servicenode.h \
     src/servicenode-budget.h \
     src/servicenodeconfig.h \
     src/servicenodeman.h \
     src/servicenode-payments.h \
+    src/servicenode-sigcheck.h \
     src/servicenode-sync.h \
     src/spork.h \
     src/streams.h \
@@ -469,6 +482,7 @@ HEADERS += \
     src/utiltime.h \
     src/validationinterface.h \
     src/wallet_ismine.h \
+    src/workqueue.h \
     src/qt/bip38tooldialog.h \
     src/qt/blockexplorer.h \
     src/qt/intro.h \
@@ -505,6 +519,7 @@ HEADERS += \
     src/crypto/sph_bmw.h \
     src/crypto/sph_cubehash.h \
     src/crypto/sph_echo.h \
+    src/crypto/groestl_aesni.h \
     src/crypto/sph_groestl.h \
     src/crypto/sph_jh.h \
     src/crypto/sph_keccak.h \
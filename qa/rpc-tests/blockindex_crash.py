@@ -0,0 +1,64 @@
+#!/usr/bin/env python2
+# Copyright (c) 2015-2017 The BlocknetDX developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test that the block index and transaction index, which are only written
+# when the chain state is flushed, are consistent after the node is killed
+# in the middle of a sync.
+#
+from test_framework import BitcoinTestFramework
+from bitcoinrpc.authproxy import AuthServiceProxy, JSONRPCException
+from util import *
+import signal
+import time
+
+class BlockIndexCrashTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 2)
+
+    def setup_network(self):
+        self.nodes = []
+        self.is_network_split = False
+        self.nodes.append(start_node(0, self.options.tmpdir))
+        self.nodes.append(start_node(1, self.options.tmpdir, ["-dbcache=4", "-checkblockindex=1"]))
+
+    def kill_node(self, i):
+        bitcoind_processes[i].send_signal(signal.SIGKILL)
+        bitcoind_processes[i].wait()
+        del bitcoind_processes[i]
+
+    def run_test(self):
+        self.nodes[0].setgenerate(True, 400)
+        tip = self.nodes[0].getbestblockhash()
+
+        # Kill node 1 without a clean shutdown while it is still syncing
+        connect_nodes(self.nodes[1], 0)
+        while self.nodes[1].getblockcount() < 100:
+            time.sleep(0.1)
+        self.kill_node(1)
+
+        # The node has to come back with a usable index and finish the sync
+        self.nodes[1] = start_node(1, self.options.tmpdir, ["-dbcache=4", "-checkblockindex=1"])
+        connect_nodes(self.nodes[1], 0)
+        sync_blocks(self.nodes)
+        assert_equal(self.nodes[1].getbestblockhash(), tip)
+
+        # Every transaction must be found through the transaction index
+        for height in range(1, self.nodes[1].getblockcount() + 1):
+            block = self.nodes[1].getblock(self.nodes[1].getblockhash(height))
+            for txid in block["tx"]:
+                tx = self.nodes[1].getrawtransaction(txid, 1)
+                assert_equal(tx["blockhash"], block["hash"])
+
+        # A clean restart must load the flushed index as well
+        stop_node(self.nodes[1], 1)
+        self.nodes[1] = start_node(1, self.options.tmpdir, ["-checkblockindex=1"])
+        assert_equal(self.nodes[1].getbestblockhash(), tip)
+        print "Success"
+
+if __name__ == '__main__':
+    BlockIndexCrashTest().main()
@@ -0,0 +1,117 @@
+#!/usr/bin/env python2
+# Copyright (c) 2015-2017 The BlocknetDX developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test many inbound connections with both -socketevents modes
+#
+
+from test_framework import BitcoinTestFramework
+from util import *
+import hashlib
+import random
+import resource
+import socket
+import struct
+
+REGTEST_MAGIC = b"\xa1\xcf\x7e\xac"
+PROTOCOL_VERSION = 70710
+
+def message(command, payload):
+    checksum = hashlib.sha256(hashlib.sha256(payload).digest()).digest()[:4]
+    return REGTEST_MAGIC + command.ljust(12, b"\x00") + struct.pack("<I", len(payload)) + checksum + payload
+
+def address():
+    return struct.pack("<Q", 1) + b"\x00" * 10 + b"\xff\xff" + socket.inet_aton("127.0.0.1") + struct.pack(">H", 0)
+
+def version_message():
+    subver = b"/inbound_load:0.1/"
+    payload = struct.pack("<iQq", PROTOCOL_VERSION, 1, int(time.time()))
+    payload += address() + address()
+    payload += struct.pack("<Q", random.getrandbits(64))
+    payload += struct.pack("<B", len(subver)) + subver
+    payload += struct.pack("<i", 0)
+    return message(b"version", payload)
+
+def read_command(sock):
+    header = b""
+    while len(header) < 24:
+        data = sock.recv(24 - len(header))
+        if not data:
+            raise AssertionError("connection closed by node")
+        header += data
+    assert_equal(header[:4], REGTEST_MAGIC)
+    length = struct.unpack("<I", header[16:20])[0]
+    while length > 0:
+        data = sock.recv(min(length, 65536))
+        if not data:
+            raise AssertionError("connection closed by node")
+        length -= len(data)
+    return header[4:16].rstrip(b"\x00")
+
+class InboundLoadTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 1)
+
+    def setup_network(self):
+        self.nodes = []
+        self.is_network_split = False
+
+    def wait_for_connections(self, count):
+        for i in range(600):
+            if self.nodes[0].getconnectioncount() == count:
+                return
+            time.sleep(0.1)
+        assert_equal(self.nodes[0].getconnectioncount(), count)
+
+    def run_peers(self, mode, num_peers):
+        print("Testing %d inbound peers with -socketevents=%s" % (num_peers, mode))
+        self.nodes = [start_node(0, self.options.tmpdir, ["-socketevents=" + mode, "-maxconnections=%d" % (num_peers + 20)])]
+
+        peers = []
+        start = time.time()
+        for i in range(num_peers):
+            sock = socket.create_connection(("127.0.0.1", p2p_port(0)))
+            sock.settimeout(60)
+            sock.sendall(version_message() + message(b"verack", b""))
+            peers.append(sock)
+        self.wait_for_connections(num_peers)
+
+        # every peer gets the handshake answered
+        for sock in peers:
+            commands = set()
+            while b"version" not in commands or b"verack" not in commands:
+                commands.add(read_command(sock))
+        print("  %d peers connected and answered in %.2fs" % (num_peers, time.time() - start))
+
+        # RPC stays responsive with all of them connected
+        start = time.time()
+        assert_equal(len(self.nodes[0].getpeerinfo()), num_peers)
+        print("  getpeerinfo took %.3fs" % (time.time() - start))
+
+        # half of the peers hang up
+        for sock in peers[:num_peers // 2]:
+            sock.close()
+        self.wait_for_connections(num_peers - num_peers // 2)
+
+        for sock in peers[num_peers // 2:]:
+            sock.close()
+        self.wait_for_connections(0)
+
+        stop_nodes(self.nodes)
+        wait_bitcoinds()
+
+    def run_test(self):
+        soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+        if soft < 1024 and (hard == resource.RLIM_INFINITY or hard >= 1024):
+            resource.setrlimit(resource.RLIMIT_NOFILE, (1024, hard))
+
+        # select() cannot watch sockets numbered FD_SETSIZE or above
+        self.run_peers("select", 100)
+        self.run_peers("epoll", 500)
+
+if __name__ == '__main__':
+    InboundLoadTest().main()
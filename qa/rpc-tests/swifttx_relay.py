@@ -0,0 +1,95 @@
+#!/usr/bin/env python2
+# Copyright (c) 2015-2017 The BlocknetDX developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Compare the bandwidth of relaying transaction lock requests with both -swifttxinv modes
+#
+
+from test_framework import BitcoinTestFramework
+from util import *
+
+NUM_TXS = 10
+RELAY_COMMANDS = ["ix", "inv", "getdata"]
+HEADER_SIZE = 24
+
+class SwiftTXRelayTest(BitcoinTestFramework):
+
+    def setup_network(self):
+        self.nodes = []
+        self.is_network_split = False
+
+    def start_mesh(self, inv):
+        self.nodes = start_nodes(4, self.options.tmpdir, [["-swifttxinv=%d" % inv]] * 4)
+        for a in range(4):
+            for b in range(a + 1, 4):
+                connect_nodes(self.nodes[a], b)
+        # the cached chain is too old for lock requests to be relayed, a block of now makes the nodes synced
+        self.nodes[0].setgenerate(True, 1)
+        sync_blocks(self.nodes)
+
+    def node_bytes(self, node, field):
+        # bytes of each relay command a node sent or received over all its peers
+        totals = dict((command, 0) for command in RELAY_COMMANDS)
+        for peer in node.getpeerinfo():
+            for command in RELAY_COMMANDS:
+                totals[command] += peer[field].get(command, 0)
+        return totals
+
+    def snapshot(self):
+        return [(self.node_bytes(node, "bytessent_per_msg"), self.node_bytes(node, "bytesrecv_per_msg")) for node in self.nodes]
+
+    def peer_bytes(self, node):
+        # lock requests sent to and getdata received from each peer of a node
+        return dict((peer["id"], (peer["bytessent_per_msg"].get("ix", 0), peer["bytesrecv_per_msg"].get("getdata", 0))) for peer in node.getpeerinfo())
+
+    def run_mode(self, inv):
+        self.start_mesh(inv)
+        before = self.snapshot()
+        peers_before = self.peer_bytes(self.nodes[0])
+
+        address = self.nodes[1].getnewaddress()
+        txids = [self.nodes[0].sendtoaddressix(address, 1) for i in range(NUM_TXS)]
+        sync_mempools(self.nodes)
+        for node in self.nodes:
+            assert_equal(set(txids) - set(node.getrawmempool()), set())
+
+        after = self.snapshot()
+        peers_after = self.peer_bytes(self.nodes[0])
+        sent = [dict((command, after[n][0][command] - before[n][0][command]) for command in RELAY_COMMANDS) for n in range(4)]
+        received = [dict((command, after[n][1][command] - before[n][1][command]) for command in RELAY_COMMANDS) for n in range(4)]
+        total = dict((command, sum(sent[n][command] for n in range(4))) for command in RELAY_COMMANDS)
+        print("-swifttxinv=%d: %s, %d bytes in all" % (inv, ", ".join("%s %d" % (command, total[command]) for command in RELAY_COMMANDS), sum(total.values())))
+
+        # every other node gets each lock request exactly once, the sender none back
+        request_bytes = sum(HEADER_SIZE + len(self.nodes[0].getrawtransaction(txid)) // 2 for txid in txids)
+        assert_equal(received[0]["ix"], 0)
+        for n in range(1, 4):
+            assert_equal(received[n]["ix"], request_bytes)
+        assert_equal(total["ix"], 3 * request_bytes)
+
+        # announcing, the sender writes no lock request to a peer that did not ask for one
+        if inv:
+            assert_greater_than(sent[0]["inv"], 0)
+            for id in peers_after:
+                ix = peers_after[id][0] - peers_before[id][0]
+                getdata = peers_after[id][1] - peers_before[id][1]
+                if getdata == 0:
+                    assert_equal(ix, 0)
+        else:
+            # pushing, the sender writes every lock request to every peer
+            assert_equal(sent[0]["ix"], 3 * request_bytes)
+
+        # mine the transactions so the next mode starts from the same wallets
+        self.nodes[0].setgenerate(True, 1)
+        sync_blocks(self.nodes)
+        stop_nodes(self.nodes)
+        wait_bitcoinds()
+
+    def run_test(self):
+        self.run_mode(0)
+        self.run_mode(1)
+
+if __name__ == '__main__':
+    SwiftTXRelayTest().main()
@@ -183,12 +183,12 @@ bool CActiveServicenode::SendServicenodePing(std::string& errorMessage)
         }
 
         pmn->lastPing = mnp;
-        mnodeman.mapSeenServicenodePing.insert(make_pair(mnp.GetHash(), mnp));
+        mnodeman.AddSeenPing(mnp);
 
         //mnodeman.mapSeenServicenodeBroadcast.lastPing is probably outdated, so we'll update it
         CServicenodeBroadcast mnb(*pmn);
         uint256 hash = mnb.GetHash();
-        if (mnodeman.mapSeenServicenodeBroadcast.count(hash)) mnodeman.mapSeenServicenodeBroadcast[hash].lastPing = mnp;
+        mnodeman.UpdateSeenBroadcastPing(hash, mnp);
 
         mnp.Relay();
 
@@ -288,7 +288,7 @@ bool CActiveServicenode::Register(CTxIn vin, CService service, CKey keyCollatera
         LogPrintf("CActiveServicenode::Register() -  %s\n", errorMessage);
         return false;
     }
-    mnodeman.mapSeenServicenodePing.insert(make_pair(mnp.GetHash(), mnp));
+    mnodeman.AddSeenPing(mnp);
 
     LogPrintf("CActiveServicenode::Register() - Adding to Servicenode list\n    service: %s\n    vin: %s\n", service.ToString(), vin.ToString());
     mnb = CServicenodeBroadcast(service, vin, pubKeyCollateralAddress, pubKeyServicenode, PROTOCOL_VERSION);
@@ -298,7 +298,7 @@ bool CActiveServicenode::Register(CTxIn vin, CService service, CKey keyCollatera
         LogPrintf("CActiveServicenode::Register() - %s\n", errorMessage);
         return false;
     }
-    mnodeman.mapSeenServicenodeBroadcast.insert(make_pair(mnb.GetHash(), mnb));
+    mnodeman.AddSeenBroadcast(mnb);
     servicenodeSync.AddedServicenodeList(mnb.GetHash());
 
     CServicenode* pmn = mnodeman.Find(vin);
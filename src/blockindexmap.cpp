@@ -0,0 +1,116 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockindexmap.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <limits>
+#include <new>
+
+using namespace std;
+
+/** Approximate size of a heap block for an allocation of nAlloc bytes (64-bit malloc). */
+static size_t MallocUsage(size_t nAlloc)
+{
+    return ((nAlloc + 31) >> 4) << 4;
+}
+
+CBlockIndexMap::CBlockIndexMap() : nEntries(0)
+{
+}
+
+CBlockIndexMap::~CBlockIndexMap()
+{
+    clear();
+}
+
+size_t CBlockIndexMap::Find(const uint256& hash) const
+{
+    if (vTable.empty())
+        return nEntries;
+    for (size_t nSlot = Slot(hash);; nSlot = (nSlot + 1) & (vTable.size() - 1)) {
+        if (!vTable[nSlot])
+            return nEntries;
+        if (At(vTable[nSlot] - 1).item.first == hash)
+            return vTable[nSlot] - 1;
+    }
+}
+
+void CBlockIndexMap::Rehash(size_t nSlots)
+{
+    vTable.assign(nSlots, 0);
+    for (size_t nPos = 0; nPos < nEntries; nPos++) {
+        size_t nSlot = Slot(At(nPos).item.first);
+        while (vTable[nSlot])
+            nSlot = (nSlot + 1) & (vTable.size() - 1);
+        vTable[nSlot] = nPos + 1;
+    }
+}
+
+void CBlockIndexMap::reserve(size_t n)
+{
+    // keep the load factor at or below 3/4
+    size_t nSlots = 16;
+    while (nSlots * 3 < n * 4)
+        nSlots <<= 1;
+    if (nSlots > vTable.size())
+        Rehash(nSlots);
+}
+
+CBlockIndexMap::iterator CBlockIndexMap::find(const uint256& hash) const
+{
+    return iterator(this, Find(hash));
+}
+
+CBlockIndex* CBlockIndexMap::operator[](const uint256& hash) const
+{
+    size_t nPos = Find(hash);
+    return nPos == nEntries ? NULL : At(nPos).item.second;
+}
+
+CBlockIndex* CBlockIndexMap::insert(const uint256& hash, const CBlockIndex& index)
+{
+    assert(Find(hash) == nEntries);
+    assert(nEntries < std::numeric_limits<uint32_t>::max());
+    // double the table once the load factor would exceed 3/4
+    if ((nEntries + 1) * 4 > vTable.size() * 3)
+        Rehash(std::max((size_t)16, vTable.size() * 2));
+
+    if (nEntries == vSlabs.size() * SLAB_ENTRIES)
+        vSlabs.push_back(static_cast<Entry*>(::operator new(sizeof(Entry) * SLAB_ENTRIES)));
+    Entry* entry = new (&At(nEntries)) Entry(hash, index);
+    nEntries++;
+
+    size_t nSlot = Slot(hash);
+    while (vTable[nSlot])
+        nSlot = (nSlot + 1) & (vTable.size() - 1);
+    vTable[nSlot] = nEntries;
+    return &entry->index;
+}
+
+void CBlockIndexMap::clear()
+{
+    for (size_t nPos = 0; nPos < nEntries; nPos++)
+        At(nPos).~Entry();
+    for (size_t nSlab = 0; nSlab < vSlabs.size(); nSlab++)
+        ::operator delete(vSlabs[nSlab]);
+    vSlabs.clear();
+    nEntries = 0;
+    vector<uint32_t>().swap(vTable);
+}
+
+size_t CBlockIndexMap::DynamicMemoryUsage() const
+{
+    return vSlabs.size() * MallocUsage(sizeof(Entry) * SLAB_ENTRIES) +
+           MallocUsage(vSlabs.capacity() * sizeof(Entry*)) +
+           MallocUsage(vTable.capacity() * sizeof(uint32_t));
+}
+
+size_t CBlockIndexMap::NodeBasedMemoryUsage() const
+{
+    // one CBlockIndex and one map node (entry plus two link pointers) per
+    // entry, and about one bucket pointer per entry
+    return nEntries * (MallocUsage(sizeof(CBlockIndex)) + MallocUsage(sizeof(value_type) + 2 * sizeof(void*)) + sizeof(void*));
+}
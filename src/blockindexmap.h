@@ -0,0 +1,126 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKINDEXMAP_H
+#define BITCOIN_BLOCKINDEXMAP_H
+
+#include "chain.h"
+#include "uint256.h"
+
+#include <iterator>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+/**
+ * Hash -> CBlockIndex map that also owns the entries.
+ *
+ * Entries are constructed in large contiguous slabs in insertion order (which
+ * is height order when the index is loaded at startup) and never move, so
+ * CBlockIndex pointers and phashBlock stay valid until clear(). Lookups go
+ * through an open-addressing table of 32-bit entry positions instead of one
+ * heap node per entry.
+ *
+ * The interface follows the subset of boost::unordered_map that callers of
+ * mapBlockIndex use, except that entries are only added through insert(), and
+ * operator[] returns NULL for unknown hashes instead of adding an entry.
+ */
+class CBlockIndexMap
+{
+public:
+    typedef std::pair<const uint256, CBlockIndex*> value_type;
+
+private:
+    /** One slab slot: the map entry, and the block index it points to. */
+    struct Entry {
+        value_type item;
+        CBlockIndex index;
+
+        Entry(const uint256& hash, const CBlockIndex& indexIn) : item(hash, &index), index(indexIn)
+        {
+            index.phashBlock = &item.first;
+        }
+    };
+
+    //! entries per slab
+    static const size_t SLAB_ENTRIES = 4096;
+
+    std::vector<Entry*> vSlabs;
+    size_t nEntries;
+    //! open-addressing table with linear probing, holding entry position + 1
+    //! (0 marks a free slot); its size is zero or a power of two
+    std::vector<uint32_t> vTable;
+
+    Entry& At(size_t nPos) const { return vSlabs[nPos / SLAB_ENTRIES][nPos % SLAB_ENTRIES]; }
+    size_t Slot(const uint256& hash) const { return hash.GetLow64() & (vTable.size() - 1); }
+    void Rehash(size_t nSlots);
+    /** Position of the entry for hash, or size() if it is unknown. */
+    size_t Find(const uint256& hash) const;
+
+public:
+    /** Forward iterator over the entries in insertion order. */
+    class iterator
+    {
+    private:
+        const CBlockIndexMap* map;
+        size_t nPos;
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef CBlockIndexMap::value_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef value_type* pointer;
+        typedef value_type& reference;
+
+        iterator() : map(NULL), nPos(0) {}
+        iterator(const CBlockIndexMap* mapIn, size_t nPosIn) : map(mapIn), nPos(nPosIn) {}
+
+        reference operator*() const { return map->At(nPos).item; }
+        pointer operator->() const { return &**this; }
+        iterator& operator++()
+        {
+            nPos++;
+            return *this;
+        }
+        iterator operator++(int)
+        {
+            iterator ret = *this;
+            nPos++;
+            return ret;
+        }
+        bool operator==(const iterator& other) const { return nPos == other.nPos && map == other.map; }
+        bool operator!=(const iterator& other) const { return !(*this == other); }
+    };
+    typedef iterator const_iterator;
+
+    CBlockIndexMap();
+    ~CBlockIndexMap();
+
+    iterator begin() const { return iterator(this, 0); }
+    iterator end() const { return iterator(this, nEntries); }
+    bool empty() const { return nEntries == 0; }
+    size_t size() const { return nEntries; }
+
+    iterator find(const uint256& hash) const;
+    size_t count(const uint256& hash) const { return Find(hash) == nEntries ? 0 : 1; }
+    /** The entry for hash, or NULL if it is unknown. */
+    CBlockIndex* operator[](const uint256& hash) const;
+
+    /**
+     * Add an entry for hash, which must not be present yet, as a copy of
+     * index. Returns the stored entry, whose phashBlock points to its key.
+     */
+    CBlockIndex* insert(const uint256& hash, const CBlockIndex& index);
+    /** Make room for n entries without growing the table. */
+    void reserve(size_t n);
+    /** Destroy all entries. Every CBlockIndex pointer obtained before is invalidated. */
+    void clear();
+
+    /** Bytes held by the slabs and the table. */
+    size_t DynamicMemoryUsage() const;
+    /** Estimated bytes the same entries took as individually allocated objects in a node-based hash map. */
+    size_t NodeBasedMemoryUsage() const;
+};
+
+#endif // BITCOIN_BLOCKINDEXMAP_H
@@ -0,0 +1,145 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bufferpool.h"
+
+#include <algorithm>
+
+CBufferPool& GetBufferPool()
+{
+    static CBufferPool* pool = new CBufferPool();
+    return *pool;
+}
+
+CBufferPool::CBufferPool() : nDepotBytes(0), nAcquired(0), nReused(0), nReleased(0), nFreed(0)
+{
+}
+
+CBufferPool::CThreadCache& CBufferPool::GetThreadCache()
+{
+    if (!threadCache.get())
+        threadCache.reset(new CThreadCache());
+    return *threadCache;
+}
+
+size_t CBufferPool::GetCacheBuffers(int nClass)
+{
+    return std::min((size_t)64, std::max((size_t)1, THREAD_CACHE_BYTES / GetClassSize(nClass)));
+}
+
+int CBufferPool::GetClass(size_t nSize)
+{
+    for (int nClass = 0; nClass < SIZE_CLASSES; nClass++) {
+        if (GetClassSize(nClass) >= nSize)
+            return nClass;
+    }
+    return -1;
+}
+
+bool CBufferPool::Acquire(CSerializeData& data, size_t nSize)
+{
+    Release(data);
+    nAcquired++;
+
+    int nClass = GetClass(nSize);
+    if (nClass < 0) {
+        data.reserve(nSize);
+        return false;
+    }
+
+    CThreadCache& cache = GetThreadCache();
+    std::vector<CSerializeData>& vCache = cache.vBuffers[nClass];
+    if (vCache.empty()) {
+        // refill half of the cache from the depot
+        boost::unique_lock<boost::mutex> lock(mutex);
+        std::vector<CSerializeData>& vBuffers = vDepot[nClass];
+        for (size_t n = std::max((size_t)1, GetCacheBuffers(nClass) / 2); n > 0 && !vBuffers.empty(); n--) {
+            nDepotBytes -= vBuffers.back().capacity();
+            cache.nBytes += vBuffers.back().capacity();
+            vCache.push_back(CSerializeData());
+            vCache.back().swap(vBuffers.back());
+            vBuffers.pop_back();
+        }
+    }
+
+    if (vCache.empty()) {
+        // a new buffer gets the full size of its class, so it can be recycled for any size of it
+        data.reserve(GetClassSize(nClass));
+        return false;
+    }
+
+    data.swap(vCache.back());
+    vCache.pop_back();
+    cache.nBytes -= data.capacity();
+    nReused++;
+    return true;
+}
+
+void CBufferPool::Release(CSerializeData& data)
+{
+    if (data.capacity() == 0)
+        return;
+    nReleased++;
+    data.clear();
+
+    // the largest class this buffer has room for
+    int nClass = SIZE_CLASSES - 1;
+    while (nClass >= 0 && GetClassSize(nClass) > data.capacity())
+        nClass--;
+    if (nClass < 0 || data.capacity() >= 2 * GetClassSize(SIZE_CLASSES - 1)) {
+        nFreed++;
+        CSerializeData().swap(data);
+        return;
+    }
+
+    CThreadCache& cache = GetThreadCache();
+    std::vector<CSerializeData>& vCache = cache.vBuffers[nClass];
+    cache.nBytes += data.capacity();
+    vCache.push_back(CSerializeData());
+    vCache.back().swap(data);
+
+    // hand half of the size class over when it is full, and the largest buffers when the whole cache is
+    if (vCache.size() > GetCacheBuffers(nClass))
+        Flush(cache, nClass, (vCache.size() + 1) / 2);
+    for (int n = SIZE_CLASSES - 1; n >= 0 && cache.nBytes > THREAD_CACHE_MAX_BYTES; n--)
+        Flush(cache, n, (cache.nBytes - THREAD_CACHE_MAX_BYTES + GetClassSize(n) - 1) / GetClassSize(n));
+}
+
+void CBufferPool::Flush(CThreadCache& cache, int nClass, size_t nBuffers)
+{
+    std::vector<CSerializeData>& vCache = cache.vBuffers[nClass];
+    if (vCache.empty())
+        return;
+
+    // the buffers that do not fit are freed outside the lock
+    std::vector<CSerializeData> vFree;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        for (size_t n = std::min(nBuffers, vCache.size()); n > 0; n--) {
+            cache.nBytes -= vCache.back().capacity();
+            if (nDepotBytes + vCache.back().capacity() <= DEPOT_MAX_BYTES) {
+                nDepotBytes += vCache.back().capacity();
+                vDepot[nClass].push_back(CSerializeData());
+                vDepot[nClass].back().swap(vCache.back());
+            } else {
+                vFree.push_back(CSerializeData());
+                vFree.back().swap(vCache.back());
+            }
+            vCache.pop_back();
+        }
+    }
+    nFreed += vFree.size();
+}
+
+CBufferPoolStats CBufferPool::GetStats() const
+{
+    CBufferPoolStats stats;
+    stats.nAcquired = nAcquired;
+    stats.nReused = nReused;
+    stats.nReleased = nReleased;
+    stats.nFreed = nFreed;
+    boost::unique_lock<boost::mutex> lock(mutex);
+    stats.nDepotBytes = nDepotBytes;
+    return stats;
+}
@@ -0,0 +1,95 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include "allocators.h"
+
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+/** Counters of the buffer pool
+ */
+class CBufferPoolStats
+{
+public:
+    // buffers handed out, and how many of them were recycled instead of allocated
+    uint64_t nAcquired;
+    uint64_t nReused;
+    // buffers given back, and how many of them were freed instead of kept
+    uint64_t nReleased;
+    uint64_t nFreed;
+    // bytes of the buffers waiting in the shared depot
+    uint64_t nDepotBytes;
+
+    CBufferPoolStats() : nAcquired(0), nReused(0), nReleased(0), nFreed(0), nDepotBytes(0) {}
+};
+
+/** Recycles the payload buffers of P2P messages instead of freeing them.
+ *  Buffers are kept by size class, from 256 bytes up to 4 MiB, in a small cache per thread
+ *  with a shared depot behind it. The socket thread takes the buffers of received messages
+ *  and the message handler threads give them back, so caches that run dry or overflow trade
+ *  buffers with the depot in batches, and a cache that grows past THREAD_CACHE_MAX_BYTES hands
+ *  its largest buffers over. Pooled buffers only ever hold network data, they are not cleansed
+ *  while they are recycled.
+ */
+class CBufferPool
+{
+public:
+    static const size_t MIN_BUFFER_SIZE = 256;
+    static const int SIZE_CLASSES = 15;
+    // bytes a thread keeps of one size class, at least one buffer
+    static const size_t THREAD_CACHE_BYTES = 1024 * 1024;
+    // bytes a thread keeps of all size classes together
+    static const size_t THREAD_CACHE_MAX_BYTES = 4 * 1024 * 1024;
+    static const size_t DEPOT_MAX_BYTES = 32 * 1024 * 1024;
+
+private:
+    struct CThreadCache {
+        std::vector<CSerializeData> vBuffers[SIZE_CLASSES];
+        size_t nBytes;
+
+        CThreadCache() : nBytes(0) {}
+    };
+
+    boost::thread_specific_ptr<CThreadCache> threadCache;
+
+    mutable boost::mutex mutex;
+    std::vector<CSerializeData> vDepot[SIZE_CLASSES];
+    size_t nDepotBytes;
+
+    std::atomic<uint64_t> nAcquired;
+    std::atomic<uint64_t> nReused;
+    std::atomic<uint64_t> nReleased;
+    std::atomic<uint64_t> nFreed;
+
+    CThreadCache& GetThreadCache();
+    /// Hand up to nBuffers of a size class over to the depot, those that do not fit are freed
+    void Flush(CThreadCache& cache, int nClass, size_t nBuffers);
+    static size_t GetClassSize(int nClass) { return MIN_BUFFER_SIZE << nClass; }
+    static size_t GetCacheBuffers(int nClass);
+
+public:
+    CBufferPool();
+
+    /// Size class whose buffers have room for nSize bytes, -1 when nSize is too large to pool
+    static int GetClass(size_t nSize);
+    /// Replace data with an empty buffer with room for at least nSize bytes. Returns true when it was recycled.
+    bool Acquire(CSerializeData& data, size_t nSize);
+    /// Take back the buffer of data, which is left without one
+    void Release(CSerializeData& data);
+
+    CBufferPoolStats GetStats() const;
+};
+
+/** The pool of the P2P messages. It is never destroyed, so it outlives the threads and the statics
+ *  still releasing buffers during shutdown.
+ */
+CBufferPool& GetBufferPool();
+
+#endif
@@ -401,7 +401,7 @@ public:
         hashNext = uint256();
     }
 
-    explicit CDiskBlockIndex(CBlockIndex* pindex) : CBlockIndex(*pindex)
+    explicit CDiskBlockIndex(const CBlockIndex* pindex) : CBlockIndex(*pindex)
     {
         hashPrev = (pprev ? pprev->GetBlockHash() : uint256());
     }
@@ -450,6 +450,11 @@ public:
 
     uint256 GetBlockHash() const
     {
+        // Known when built from an in-memory entry; only entries read back
+        // from disk need to hash their header
+        if (phashBlock)
+            return *phashBlock;
+
         CBlockHeader block;
         block.nVersion = nVersion;
         block.hashPrevBlock = hashPrev;
@@ -208,6 +208,7 @@ public:
         //! Modify the testnet genesis block so the timestamp is valid for a later start.
         genesis.nTime = 1503571000;
         genesis.nNonce = 2158962;
+        genesis.InvalidateHash();
 
         hashGenesisBlock = genesis.GetHash();
         assert(hashGenesisBlock == uint256("0x00000f90ac260859e4515356719d94c9fb8cadb1a3dda186a64ac41ce4c3c7a7"));
@@ -277,6 +278,7 @@ public:
         genesis.nTime = 1454124731;
         genesis.nBits = 0x207fffff;
         genesis.nNonce = 12345;
+        genesis.InvalidateHash();
 
         hashGenesisBlock = genesis.GetHash();
         nDefaultPort = 51476;
@@ -0,0 +1,198 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/groestl_aesni.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GROESTL_AESNI 1
+#include <cpuid.h>
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+#ifdef GROESTL_AESNI
+namespace
+{
+/**
+ * The Groestl-1024 state is kept as 8 rows of 16 bytes, one register per row.
+ *
+ * SubBytes is AESENCLAST with a zero key, which also applies the AES
+ * ShiftRows permutation. Each mask below undoes that permutation and rotates
+ * the row left by its ShiftBytes distance in the same PSHUFB.
+ */
+const unsigned char SHUFFLE_P[8][16] = {
+    {0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3},
+    {1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10, 7, 4},
+    {2, 15, 12, 9, 6, 3, 0, 13, 10, 7, 4, 1, 14, 11, 8, 5},
+    {3, 0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6},
+    {4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10, 7},
+    {5, 2, 15, 12, 9, 6, 3, 0, 13, 10, 7, 4, 1, 14, 11, 8},
+    {6, 3, 0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9},
+    {11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10, 7, 4, 1, 14},
+};
+
+const unsigned char SHUFFLE_Q[8][16] = {
+    {1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10, 7, 4},
+    {3, 0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6},
+    {5, 2, 15, 12, 9, 6, 3, 0, 13, 10, 7, 4, 1, 14, 11, 8},
+    {11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10, 7, 4, 1, 14},
+    {0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3},
+    {2, 15, 12, 9, 6, 3, 0, 13, 10, 7, 4, 1, 14, 11, 8, 5},
+    {4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10, 7},
+    {6, 3, 0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9},
+};
+
+//! column index j in the high nibble of byte j, for the round constants
+const unsigned char COLUMNS[16] = {0x00, 0x10, 0x20, 0x30, 0x40, 0x50, 0x60, 0x70, 0x80, 0x90, 0xa0, 0xb0, 0xc0, 0xd0, 0xe0, 0xf0};
+
+const int ROUNDS = 14;
+
+/** Multiply every byte by 2 in GF(2^8) modulo the AES polynomial. */
+__attribute__((target("ssse3"), always_inline)) inline __m128i XTime(__m128i x)
+{
+    __m128i hi = _mm_cmplt_epi8(x, _mm_setzero_si128());
+    return _mm_xor_si128(_mm_add_epi8(x, x), _mm_and_si128(hi, _mm_set1_epi8(0x1b)));
+}
+
+/**
+ * MixBytes on all 16 columns: row i becomes sum_j b[(j - i) mod 8] * a[j]
+ * with b = (02, 02, 03, 04, 05, 03, 05, 07), factored so that only two
+ * doublings per row are needed.
+ */
+__attribute__((target("ssse3"), always_inline)) inline void MixBytes(__m128i a[8])
+{
+    __m128i t[8], x[8], y[8], w[8], b[8];
+#pragma GCC unroll 8
+    for (int i = 0; i < 8; i++)
+        t[i] = _mm_xor_si128(a[i], a[(i + 1) & 7]);
+#pragma GCC unroll 8
+    for (int i = 0; i < 8; i++) {
+        x[i] = _mm_xor_si128(t[i], t[(i + 3) & 7]);
+        y[i] = _mm_xor_si128(_mm_xor_si128(t[i], t[(i + 2) & 7]), a[(i + 6) & 7]);
+    }
+#pragma GCC unroll 8
+    for (int i = 0; i < 8; i++)
+        w[i] = _mm_xor_si128(XTime(x[i]), y[(i + 4) & 7]);
+#pragma GCC unroll 8
+    for (int i = 0; i < 8; i++)
+        b[i] = _mm_xor_si128(XTime(w[(i + 3) & 7]), y[(i + 4) & 7]);
+#pragma GCC unroll 8
+    for (int i = 0; i < 8; i++)
+        a[i] = b[i];
+}
+
+/** SubBytes and ShiftBytes of one row. */
+__attribute__((target("ssse3,aes"), always_inline)) inline __m128i SubShift(__m128i row, const unsigned char mask[16])
+{
+    return _mm_aesenclast_si128(_mm_shuffle_epi8(row, _mm_loadu_si128((const __m128i*)mask)), _mm_setzero_si128());
+}
+
+/** The P and Q permutations, run interleaved on two independent states. */
+__attribute__((target("ssse3,aes"))) void PermutePQ(__m128i p[8], __m128i q[8])
+{
+    const __m128i columns = _mm_loadu_si128((const __m128i*)COLUMNS);
+    const __m128i ones = _mm_set1_epi8((char)0xff);
+    for (int r = 0; r < ROUNDS; r++) {
+        const __m128i round = _mm_xor_si128(columns, _mm_set1_epi8((char)r));
+        p[0] = _mm_xor_si128(p[0], round);
+#pragma GCC unroll 8
+        for (int i = 0; i < 7; i++)
+            q[i] = _mm_xor_si128(q[i], ones);
+        q[7] = _mm_xor_si128(q[7], _mm_xor_si128(ones, round));
+#pragma GCC unroll 8
+        for (int i = 0; i < 8; i++) {
+            p[i] = SubShift(p[i], SHUFFLE_P[i]);
+            q[i] = SubShift(q[i], SHUFFLE_Q[i]);
+        }
+        MixBytes(p);
+        MixBytes(q);
+    }
+}
+
+/** The P permutation alone, for the output transformation. */
+__attribute__((target("ssse3,aes"))) void PermuteP(__m128i p[8])
+{
+    const __m128i columns = _mm_loadu_si128((const __m128i*)COLUMNS);
+    for (int r = 0; r < ROUNDS; r++) {
+        p[0] = _mm_xor_si128(p[0], _mm_xor_si128(columns, _mm_set1_epi8((char)r)));
+#pragma GCC unroll 8
+        for (int i = 0; i < 8; i++)
+            p[i] = SubShift(p[i], SHUFFLE_P[i]);
+        MixBytes(p);
+    }
+}
+
+/** Load 128 column-major bytes as 8 rows. */
+__attribute__((target("ssse3"))) void LoadRows(const unsigned char in[128], __m128i rows[8])
+{
+    unsigned char buf[8][16];
+    for (int j = 0; j < 16; j++)
+        for (int i = 0; i < 8; i++)
+            buf[i][j] = in[8 * j + i];
+    for (int i = 0; i < 8; i++)
+        rows[i] = _mm_loadu_si128((const __m128i*)buf[i]);
+}
+
+__attribute__((target("ssse3,aes"))) void Hash64AESNI(const unsigned char in[64], unsigned char out[64])
+{
+    // A 64-byte message fits in one padded 128-byte block: 0x80, zeros and
+    // the big-endian block count (1)
+    unsigned char block[128];
+    memcpy(block, in, 64);
+    memset(block + 64, 0, 64);
+    block[64] = 0x80;
+    block[127] = 0x01;
+
+    // The initial value is zero except for the output size (512) in the
+    // last two bytes, which only leaves 0x02 in row 6, column 15
+    __m128i h[8], p[8], q[8];
+    for (int i = 0; i < 8; i++)
+        h[i] = _mm_setzero_si128();
+    h[6] = _mm_insert_epi16(h[6], 0x0200, 7);
+
+    LoadRows(block, q);
+    for (int i = 0; i < 8; i++)
+        p[i] = _mm_xor_si128(h[i], q[i]);
+    PermutePQ(p, q);
+    for (int i = 0; i < 8; i++) {
+        h[i] = _mm_xor_si128(h[i], _mm_xor_si128(p[i], q[i]));
+        p[i] = h[i];
+    }
+
+    // Output transformation: the last 512 bits (columns 8-15) of P(h) ^ h
+    PermuteP(p);
+    unsigned char rows[8][16];
+    for (int i = 0; i < 8; i++)
+        _mm_storeu_si128((__m128i*)rows[i], _mm_xor_si128(p[i], h[i]));
+    for (int j = 8; j < 16; j++)
+        for (int i = 0; i < 8; i++)
+            out[8 * (j - 8) + i] = rows[i][j];
+}
+} // anon namespace
+#endif
+
+namespace groestl_aesni
+{
+bool Available()
+{
+#ifdef GROESTL_AESNI
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return false;
+    return (ecx & bit_SSSE3) && (ecx & bit_AES);
+#else
+    return false;
+#endif
+}
+
+void Hash64(const unsigned char in[64], unsigned char out[64])
+{
+#ifdef GROESTL_AESNI
+    Hash64AESNI(in, out);
+#endif
+}
+} // namespace groestl_aesni
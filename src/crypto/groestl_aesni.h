@@ -0,0 +1,17 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_GROESTL_AESNI_H
+#define BITCOIN_CRYPTO_GROESTL_AESNI_H
+
+/** Groestl-512 using AES-NI, for the fixed 64-byte messages hashed inside Quark. */
+namespace groestl_aesni
+{
+/** Whether this build and the CPU support the AES-NI implementation. */
+bool Available();
+/** Groestl-512 of a 64-byte message. Only call this if Available() returned true. */
+void Hash64(const unsigned char in[64], unsigned char out[64]);
+} // namespace groestl_aesni
+
+#endif // BITCOIN_CRYPTO_GROESTL_AESNI_H
@@ -6,6 +6,8 @@
 
 #include "crypto/common.h"
 
+#include <algorithm>
+#include <assert.h>
 #include <string.h>
 
 // Internal implementation code.
@@ -127,6 +129,70 @@ void Transform(uint32_t* s, const unsigned char* chunk)
     s[7] += h;
 }
 
+/** Round constants, for the lane-interleaved transform below. */
+const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+/** Number of messages processed side by side by TransformLanes. */
+const int LANES = 8;
+
+/** Initialize LANES SHA-256 states. */
+void inline InitializeLanes(uint32_t s[8][LANES])
+{
+    uint32_t init[8];
+    Initialize(init);
+    for (int i = 0; i < 8; i++)
+        for (int l = 0; l < LANES; l++)
+            s[i][l] = init[i];
+}
+
+/** Perform one SHA-256 transformation on LANES independent chunks at once.
+ *  The chunks are given as already decoded big-endian words, word-major, so
+ *  that each step is a plain loop over the lanes. w is clobbered. */
+void TransformLanes(uint32_t s[8][LANES], uint32_t w[16][LANES])
+{
+    uint32_t a[LANES], b[LANES], c[LANES], d[LANES], e[LANES], f[LANES], g[LANES], h[LANES];
+    for (int l = 0; l < LANES; l++) {
+        a[l] = s[0][l]; b[l] = s[1][l]; c[l] = s[2][l]; d[l] = s[3][l];
+        e[l] = s[4][l]; f[l] = s[5][l]; g[l] = s[6][l]; h[l] = s[7][l];
+    }
+
+    for (int i = 0; i < 64; i++) {
+        uint32_t* wi = w[i & 15];
+        if (i >= 16) {
+            const uint32_t* w2 = w[(i + 14) & 15];
+            const uint32_t* w7 = w[(i + 9) & 15];
+            const uint32_t* w15 = w[(i + 1) & 15];
+            for (int l = 0; l < LANES; l++)
+                wi[l] += sigma1(w2[l]) + w7[l] + sigma0(w15[l]);
+        }
+        for (int l = 0; l < LANES; l++) {
+            uint32_t t1 = h[l] + Sigma1(e[l]) + Ch(e[l], f[l], g[l]) + K[i] + wi[l];
+            uint32_t t2 = Sigma0(a[l]) + Maj(a[l], b[l], c[l]);
+            h[l] = g[l];
+            g[l] = f[l];
+            f[l] = e[l];
+            e[l] = d[l] + t1;
+            d[l] = c[l];
+            c[l] = b[l];
+            b[l] = a[l];
+            a[l] = t1 + t2;
+        }
+    }
+
+    for (int l = 0; l < LANES; l++) {
+        s[0][l] += a[l]; s[1][l] += b[l]; s[2][l] += c[l]; s[3][l] += d[l];
+        s[4][l] += e[l]; s[5][l] += f[l]; s[6][l] += g[l]; s[7][l] += h[l];
+    }
+}
+
 } // namespace sha256
 } // namespace
 
@@ -187,3 +253,43 @@ CSHA256& CSHA256::Reset()
     sha256::Initialize(s);
     return *this;
 }
+
+void SHA256DShort(unsigned char* out, const unsigned char* in, size_t len, size_t count)
+{
+    assert(len <= 55);
+    uint32_t s[8][sha256::LANES];
+    uint32_t w[16][sha256::LANES];
+    unsigned char block[64];
+
+    for (size_t first = 0; first < count; first += sha256::LANES) {
+        // Load one padded block per lane. A short final group repeats its
+        // last message in the spare lanes; their results are discarded.
+        for (int l = 0; l < sha256::LANES; l++) {
+            size_t n = std::min(first + l, count - 1);
+            memset(block, 0, sizeof(block));
+            memcpy(block, in + n * len, len);
+            block[len] = 0x80;
+            WriteBE64(block + 56, (uint64_t)len << 3);
+            for (int i = 0; i < 16; i++)
+                w[i][l] = ReadBE32(block + 4 * i);
+        }
+        sha256::InitializeLanes(s);
+        sha256::TransformLanes(s, w);
+
+        // The first digest is itself a single padded 32-byte message.
+        for (int l = 0; l < sha256::LANES; l++) {
+            for (int i = 0; i < 8; i++)
+                w[i][l] = s[i][l];
+            w[8][l] = 0x80000000ul;
+            for (int i = 9; i < 15; i++)
+                w[i][l] = 0;
+            w[15][l] = 256;
+        }
+        sha256::InitializeLanes(s);
+        sha256::TransformLanes(s, w);
+
+        for (int l = 0; l < sha256::LANES && first + l < count; l++)
+            for (int i = 0; i < 8; i++)
+                WriteBE32(out + (first + l) * CSHA256::OUTPUT_SIZE + 4 * i, s[i][l]);
+    }
+}
@@ -25,4 +25,12 @@ public:
     CSHA256& Reset();
 };
 
+/** Compute the double SHA-256 of count independent messages of len bytes each
+ *  (len must be at most 55, so every message fits in a single block). The
+ *  messages are stored back to back in in, and the 32-byte digests are written
+ *  back to back to out. Messages are hashed several at a time in interleaved
+ *  lanes so the compiler can vectorize the rounds across them.
+ */
+void SHA256DShort(unsigned char* out, const unsigned char* in, size_t len, size_t count);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
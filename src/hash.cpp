@@ -3,9 +3,12 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "hash.h"
+#include "crypto/groestl_aesni.h"
 #include "crypto/hmac_sha512.h"
 #include "crypto/scrypt.h"
 
+#include <string.h>
+
 inline uint32_t ROTL32(uint32_t x, int8_t r)
 {
     return (x << r) | (x >> (32 - r));
@@ -83,3 +86,40 @@ void scrypt_hash(const char* pass, unsigned int pLen, const char* salt, unsigned
 {
     scrypt(pass, pLen, salt, sLen, output, N, r, p, dkLen);
 }
+
+/** Set by QuarkSelfTest() */
+static bool fQuarkGroestlAESNI = false;
+
+void QuarkGroestl512(const void* in, void* out)
+{
+    if (fQuarkGroestlAESNI) {
+        groestl_aesni::Hash64(static_cast<const unsigned char*>(in), static_cast<unsigned char*>(out));
+        return;
+    }
+    sph_groestl512_context ctx_groestl;
+    sph_groestl512_init(&ctx_groestl);
+    sph_groestl512(&ctx_groestl, in, 64);
+    sph_groestl512_close(&ctx_groestl, out);
+}
+
+bool QuarkSelfTest()
+{
+    fQuarkGroestlAESNI = false;
+    if (!groestl_aesni::Available())
+        return true;
+
+    // Chain the outputs, so each input after the first looks like a real
+    // intermediate hash
+    unsigned char in[64], expected[64], result[64];
+    for (int i = 0; i < 64; i++)
+        in[i] = i;
+    for (int n = 0; n < 64; n++) {
+        QuarkGroestl512(in, expected);
+        groestl_aesni::Hash64(in, result);
+        if (memcmp(expected, result, sizeof(result)) != 0)
+            return false;
+        memcpy(in, result, sizeof(in));
+    }
+    fQuarkGroestlAESNI = true;
+    return true;
+}
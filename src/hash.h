@@ -331,13 +331,22 @@ void BIP32Hash(const ChainCode &chainCode, unsigned int nChild, unsigned char he
 //int HMAC_SHA512_Final(unsigned char *pmd, HMAC_SHA512_CTX *pctx);
 
 /* ----------- Quark Hash ------------------------------------------------ */
+/** Groestl-512 of a 64-byte Quark intermediate hash, using AES-NI once QuarkSelfTest() enabled it. */
+void QuarkGroestl512(const void* in, void* out);
+
+/**
+ * Compare the accelerated Quark kernels with the sph reference code and use
+ * them from then on if they agree. Call once at startup, before other threads
+ * hash. Returns false if a kernel is supported but gave a wrong result.
+ */
+bool QuarkSelfTest();
+
 template <typename T1>
 inline uint256 HashQuark(const T1 pbegin, const T1 pend)
 
 {
     sph_blake512_context ctx_blake;
     sph_bmw512_context ctx_bmw;
-    sph_groestl512_context ctx_groestl;
     sph_jh512_context ctx_jh;
     sph_keccak512_context ctx_keccak;
     sph_skein512_context ctx_skein;
@@ -359,10 +368,8 @@ inline uint256 HashQuark(const T1 pbegin, const T1 pend)
     sph_bmw512_close(&ctx_bmw, static_cast<void*>(&hash[1]));
 
     if ((hash[1] & mask) != zero) {
-        sph_groestl512_init(&ctx_groestl);
         // ZGROESTL;
-        sph_groestl512(&ctx_groestl, static_cast<const void*>(&hash[1]), 64);
-        sph_groestl512_close(&ctx_groestl, static_cast<void*>(&hash[2]));
+        QuarkGroestl512(static_cast<const void*>(&hash[1]), static_cast<void*>(&hash[2]));
     } else {
         sph_skein512_init(&ctx_skein);
         // ZSKEIN;
@@ -370,10 +377,8 @@ inline uint256 HashQuark(const T1 pbegin, const T1 pend)
         sph_skein512_close(&ctx_skein, static_cast<void*>(&hash[2]));
     }
 
-    sph_groestl512_init(&ctx_groestl);
     // ZGROESTL;
-    sph_groestl512(&ctx_groestl, static_cast<const void*>(&hash[2]), 64);
-    sph_groestl512_close(&ctx_groestl, static_cast<void*>(&hash[3]));
+    QuarkGroestl512(static_cast<const void*>(&hash[2]), static_cast<void*>(&hash[3]));
 
     sph_jh512_init(&ctx_jh);
     // ZJH;
@@ -6,6 +6,7 @@
 #include <boost/assign/list_of.hpp>
 #include <boost/lexical_cast.hpp>
 
+#include "crypto/common.h"
 #include "db.h"
 #include "kernel.h"
 #include "script/interpreter.h"
@@ -239,34 +240,147 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
     return true;
 }
 
+// Origins older than this many blocks below the tip are no longer resolved
+// incrementally; GetKernelStakeModifier() falls back to walking for them
+static const int STAKE_MODIFIER_CACHE_WINDOW = 1000;
+
+CStakeModifierCache stakeModifierCache;
+
+CStakeModifierCache::CStakeModifierCache()
+{
+    Clear();
+}
+
+void CStakeModifierCache::Clear()
+{
+    LOCK(cs);
+    vModifierBlock.clear();
+    nFirstPending = 0;
+    nHits = 0;
+    nMisses = 0;
+}
+
+void CStakeModifierCache::UpdateTip(const CBlockIndex* pindexNew)
+{
+    LOCK(cs);
+    if (!pindexNew) {
+        vModifierBlock.clear();
+        nFirstPending = 0;
+        return;
+    }
+
+    int nHeight = pindexNew->nHeight;
+    int nWindowStart = std::max(0, nHeight - STAKE_MODIFIER_CACHE_WINDOW);
+    if ((int)vModifierBlock.size() > nHeight) {
+        // Tip moved back: origins above it are gone, and recent origins that
+        // were resolved by a disconnected block become pending again
+        vModifierBlock.resize(nHeight + 1);
+        for (int h = nHeight; h >= nWindowStart; h--) {
+            if (vModifierBlock[h] && vModifierBlock[h]->nHeight > nHeight) {
+                vModifierBlock[h] = NULL;
+                nFirstPending = std::min(nFirstPending, h);
+            }
+        }
+        return;
+    }
+
+    if ((int)vModifierBlock.size() < nHeight) {
+        // First tip seen, or a jump: only origins from here on are followed
+        vModifierBlock.resize(nHeight + 1);
+        nFirstPending = nHeight;
+        return;
+    }
+
+    vModifierBlock.push_back(NULL);
+    nFirstPending = std::max(nFirstPending, nWindowStart);
+    if (!pindexNew->GeneratedStakeModifier())
+        return;
+
+    // The new tip is the modifier block of every pending origin whose
+    // selection interval it is the first to cover
+    int64_t nStakeModifierSelectionInterval = GetStakeModifierSelectionInterval();
+    for (int h = nFirstPending; h < nHeight; h++) {
+        if (vModifierBlock[h])
+            continue;
+        const CBlockIndex* pindexFrom = chainActive[h];
+        if (pindexFrom && pindexNew->GetBlockTime() >= pindexFrom->GetBlockTime() + nStakeModifierSelectionInterval)
+            vModifierBlock[h] = pindexNew;
+    }
+    while (nFirstPending < nHeight && vModifierBlock[nFirstPending])
+        nFirstPending++;
+}
+
+bool CStakeModifierCache::Lookup(const CBlockIndex* pindexFrom, const CBlockIndex*& pindexModifier)
+{
+    LOCK(cs);
+    int nHeight = pindexFrom->nHeight;
+    if (nHeight < (int)vModifierBlock.size() && vModifierBlock[nHeight]) {
+        // the walk between two blocks of the active chain is still the same walk
+        const CBlockIndex* pindex = vModifierBlock[nHeight];
+        if (chainActive[nHeight] == pindexFrom && chainActive[pindex->nHeight] == pindex) {
+            pindexModifier = pindex;
+            nHits++;
+            return true;
+        }
+    }
+    nMisses++;
+    return false;
+}
+
+void CStakeModifierCache::Store(const CBlockIndex* pindexFrom, const CBlockIndex* pindexModifier)
+{
+    LOCK(cs);
+    int nHeight = pindexFrom->nHeight;
+    if (nHeight < (int)vModifierBlock.size() && chainActive[nHeight] == pindexFrom)
+        vModifierBlock[nHeight] = pindexModifier;
+}
+
+void CStakeModifierCache::GetStats(uint64_t& nHitsRet, uint64_t& nMissesRet, size_t& nEntriesRet) const
+{
+    LOCK(cs);
+    nHitsRet = nHits;
+    nMissesRet = nMisses;
+    nEntriesRet = 0;
+    BOOST_FOREACH (const CBlockIndex* pindex, vModifierBlock) {
+        if (pindex)
+            nEntriesRet++;
+    }
+}
+
 // The stake modifier used to hash for a stake kernel is chosen as the stake
 // modifier about a selection interval later than the coin generating the kernel
 bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight, int64_t& nStakeModifierTime, bool /*fPrintProofOfStake*/)
 {
     nStakeModifier = 0;
-    if (!mapBlockIndex.count(hashBlockFrom))
+    BlockMap::iterator mi = mapBlockIndex.find(hashBlockFrom);
+    if (mi == mapBlockIndex.end())
         return error("GetKernelStakeModifier() : block not indexed");
-    const CBlockIndex* pindexFrom = mapBlockIndex[hashBlockFrom];
-    nStakeModifierHeight = pindexFrom->nHeight;
-    nStakeModifierTime = pindexFrom->GetBlockTime();
-    int64_t nStakeModifierSelectionInterval = GetStakeModifierSelectionInterval();
+    const CBlockIndex* pindexFrom = mi->second;
     const CBlockIndex* pindex = pindexFrom;
-    CBlockIndex* pindexNext = chainActive[pindexFrom->nHeight + 1];
 
-    // loop to find the stake modifier later by a selection interval
-    while (nStakeModifierTime < pindexFrom->GetBlockTime() + nStakeModifierSelectionInterval) {
-        if (!pindexNext) {
-            // Should never happen
-            return error("Null pindexNext\n");
-        }
-
-        pindex = pindexNext;
-        pindexNext = chainActive[pindexNext->nHeight + 1];
-        if (pindex->GeneratedStakeModifier()) {
-            nStakeModifierHeight = pindex->nHeight;
-            nStakeModifierTime = pindex->GetBlockTime();
+    if (!stakeModifierCache.Lookup(pindexFrom, pindex)) {
+        nStakeModifierTime = pindexFrom->GetBlockTime();
+        int64_t nStakeModifierSelectionInterval = GetStakeModifierSelectionInterval();
+        CBlockIndex* pindexNext = chainActive[pindexFrom->nHeight + 1];
+
+        // loop to find the stake modifier later by a selection interval
+        while (nStakeModifierTime < pindexFrom->GetBlockTime() + nStakeModifierSelectionInterval) {
+            if (!pindexNext) {
+                // Should never happen
+                return error("Null pindexNext\n");
+            }
+
+            pindex = pindexNext;
+            pindexNext = chainActive[pindexNext->nHeight + 1];
+            if (pindex->GeneratedStakeModifier())
+                nStakeModifierTime = pindex->GetBlockTime();
         }
+        stakeModifierCache.Store(pindexFrom, pindex);
     }
+
+    // the walk always ends on the block that generated the modifier
+    nStakeModifierHeight = pindex->nHeight;
+    nStakeModifierTime = pindex->GetBlockTime();
     nStakeModifier = pindex->nStakeModifier;
     return true;
 }
@@ -289,11 +403,10 @@ bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTarget
 }
 
 //instead of looping outside and reinitializing variables many times, we will give a nTimeTx and also search interval so that we can do all the hashing here
-bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTransaction txPrev, const COutPoint prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake)
+bool CheckStakeKernelHash(unsigned int nBits, const CBlockIndex* pindexFrom, int64_t nValueIn, const COutPoint& prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake)
 {
     //assign new variables to make it easier to read
-    int64_t nValueIn = txPrev.vout[prevout.n].nValue;
-    unsigned int nTimeBlockFrom = blockFrom.GetBlockTime();
+    unsigned int nTimeBlockFrom = pindexFrom->GetBlockTime();
 
     if (nTimeTx < nTimeBlockFrom) // Transaction timestamp violation
         return error("CheckStakeKernelHash() : nTime violation");
@@ -309,7 +422,7 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
     uint64_t nStakeModifier = 0;
     int nStakeModifierHeight = 0;
     int64_t nStakeModifierTime = 0;
-    if (!GetKernelStakeModifier(blockFrom.GetHash(), nStakeModifier, nStakeModifierHeight, nStakeModifierTime, fPrintProofOfStake)) {
+    if (!GetKernelStakeModifier(pindexFrom->GetBlockHash(), nStakeModifier, nStakeModifierHeight, nStakeModifierTime, fPrintProofOfStake)) {
         LogPrintf("CheckStakeKernelHash(): failed to get kernel stake modifier \n");
         return false;
     }
@@ -344,8 +457,8 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
             LogPrintf("CheckStakeKernelHash() : using modifier %s at height=%d timestamp=%s for block from height=%d timestamp=%s\n",
                 boost::lexical_cast<std::string>(nStakeModifier).c_str(), nStakeModifierHeight,
                 DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nStakeModifierTime).c_str(),
-                mapBlockIndex[blockFrom.GetHash()]->nHeight,
-                DateTimeStrFormat("%Y-%m-%d %H:%M:%S", blockFrom.GetBlockTime()).c_str());
+                pindexFrom->nHeight,
+                DateTimeStrFormat("%Y-%m-%d %H:%M:%S", pindexFrom->GetBlockTime()).c_str());
             LogPrintf("CheckStakeKernelHash() : pass protocol=%s modifier=%s nTimeBlockFrom=%u prevoutHash=%s nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
                 "0.3",
                 boost::lexical_cast<std::string>(nStakeModifier).c_str(),
@@ -360,41 +473,182 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
     return fSuccess;
 }
 
+// Number of (input x timestamp) kernels hashed per SHA256DShort call
+static const size_t STAKE_SEARCH_BATCH = 1024;
+
+CStakeKernelSearch::CStakeKernelSearch()
+{
+    Clear();
+}
+
+void CStakeKernelSearch::Clear()
+{
+    vInputs.clear();
+    hashPrepared = 0;
+    nBitsPrepared = 0;
+    bnTargetPerCoinDay = 0;
+}
+
+void CStakeKernelSearch::Prepare(const uint256& hashTip, unsigned int nBits)
+{
+    vInputs.clear();
+    hashPrepared = hashTip;
+    nBitsPrepared = nBits;
+    bnTargetPerCoinDay.SetCompact(nBits);
+}
+
+bool CStakeKernelSearch::IsPrepared(const uint256& hashTip, unsigned int nBits) const
+{
+    return hashPrepared != 0 && hashPrepared == hashTip && nBitsPrepared == nBits;
+}
+
+bool CStakeKernelSearch::AddInput(const COutPoint& prevout, int64_t nValueIn, const CBlockIndex* pindexFrom)
+{
+    CStakeKernelInput input;
+    int nStakeModifierHeight = 0;
+    int64_t nStakeModifierTime = 0;
+    if (!GetKernelStakeModifier(pindexFrom->GetBlockHash(), input.nStakeModifier, nStakeModifierHeight, nStakeModifierTime, false))
+        return false;
+
+    input.prevout = prevout;
+    input.nTimeBlockFrom = pindexFrom->GetBlockTime();
+    // same arithmetic as stakeTargetHit(), done once instead of per hash
+    input.bnTarget = (uint256(nValueIn) / 100) * bnTargetPerCoinDay;
+
+    // same layout as stakeHash(): modifier, nTimeBlockFrom, prevout.n, prevout.hash
+    WriteLE64(input.vchKernel, input.nStakeModifier);
+    WriteLE32(input.vchKernel + 8, input.nTimeBlockFrom);
+    WriteLE32(input.vchKernel + 12, prevout.n);
+    memcpy(input.vchKernel + 16, prevout.hash.begin(), 32);
+
+    vInputs.push_back(input);
+    return true;
+}
+
+bool CStakeKernelSearch::Search(unsigned int nTimeTx, unsigned int nHashDrift, size_t nStart, size_t& nInputRet, unsigned int& nTimeTxRet, uint256& hashProofOfStakeRet) const
+{
+    static const size_t KERNEL_SIZE = sizeof(((CStakeKernelInput*)0)->vchKernel) + 4;
+    if (nHashDrift == 0)
+        return false;
+
+    std::vector<unsigned char> vchBatch;
+    std::vector<unsigned char> vchHashes;
+    std::vector<size_t> vBatchInputs;
+    size_t nPerBatch = std::max((size_t)1, STAKE_SEARCH_BATCH / nHashDrift);
+
+    for (size_t nFirst = nStart; nFirst < vInputs.size(); nFirst += nPerBatch) {
+        size_t nLast = std::min(vInputs.size(), nFirst + nPerBatch);
+
+        // Serialize every kernel of this batch; inputs that violate the
+        // timestamp or min age rules are skipped like CheckStakeKernelHash does
+        vBatchInputs.clear();
+        vchBatch.resize((nLast - nFirst) * nHashDrift * KERNEL_SIZE);
+        unsigned char* p = vchBatch.empty() ? NULL : &vchBatch[0];
+        for (size_t n = nFirst; n < nLast; n++) {
+            const CStakeKernelInput& input = vInputs[n];
+            if (nTimeTx < input.nTimeBlockFrom || input.nTimeBlockFrom + nStakeMinAge > nTimeTx)
+                continue;
+            vBatchInputs.push_back(n);
+            for (unsigned int i = 0; i < nHashDrift; i++) {
+                memcpy(p, input.vchKernel, sizeof(input.vchKernel));
+                WriteLE32(p + sizeof(input.vchKernel), nTimeTx + nHashDrift - i);
+                p += KERNEL_SIZE;
+            }
+        }
+        if (vBatchInputs.empty())
+            continue;
+
+        size_t nKernels = vBatchInputs.size() * nHashDrift;
+        vchHashes.resize(nKernels * CSHA256::OUTPUT_SIZE);
+        SHA256DShort(&vchHashes[0], &vchBatch[0], KERNEL_SIZE, nKernels);
+
+        for (size_t k = 0; k < nKernels; k++) {
+            uint256 hashProofOfStake;
+            memcpy(hashProofOfStake.begin(), &vchHashes[k * CSHA256::OUTPUT_SIZE], CSHA256::OUTPUT_SIZE);
+            const CStakeKernelInput& input = vInputs[vBatchInputs[k / nHashDrift]];
+            if (!(hashProofOfStake < input.bnTarget))
+                continue;
+
+            nInputRet = vBatchInputs[k / nHashDrift];
+            nTimeTxRet = nTimeTx + nHashDrift - (k % nHashDrift);
+            hashProofOfStakeRet = hashProofOfStake;
+            LogPrintf("CStakeKernelSearch::Search() : pass protocol=%s modifier=%s nTimeBlockFrom=%u prevoutHash=%s nPrevout=%u nTimeTx=%u hashProof=%s\n",
+                "0.3",
+                boost::lexical_cast<std::string>(input.nStakeModifier).c_str(),
+                input.nTimeBlockFrom, input.prevout.hash.ToString().c_str(), input.prevout.n, nTimeTxRet,
+                hashProofOfStake.ToString().c_str());
+            return true;
+        }
+    }
+    return false;
+}
+
+static int64_t nTimeStakeInput = 0;
+static int64_t nStakeInputsFromCoins = 0;
+static int64_t nStakeInputsFromDisk = 0;
+
+// Find the output spent by a coinstake kernel and the index of the block that
+// created it, reading block data only if the output is no longer unspent
+static bool GetStakeInput(const COutPoint& prevout, CTxOut& txoutPrev, const CBlockIndex*& pindexFrom)
+{
+    {
+        LOCK(cs_main);
+        const CCoins* coins = pcoinsTip->AccessCoins(prevout.hash);
+        if (coins && coins->IsAvailable(prevout.n)) {
+            pindexFrom = chainActive[coins->nHeight];
+            if (pindexFrom) {
+                txoutPrev = coins->vout[prevout.n];
+                nStakeInputsFromCoins++;
+                return true;
+            }
+        }
+    }
+
+    // Already spent on the active chain (e.g. a block on a fork): look the
+    // transaction up in the database instead
+    uint256 hashBlock;
+    CTransaction txPrev;
+    if (!GetTransaction(prevout.hash, txPrev, hashBlock, true))
+        return error("CheckProofOfStake() : INFO: read txPrev failed");
+    if (prevout.n >= txPrev.vout.size())
+        return error("CheckProofOfStake() : prevout %s out of range", prevout.ToString());
+
+    BlockMap::iterator it = mapBlockIndex.find(hashBlock);
+    if (it == mapBlockIndex.end())
+        return error("CheckProofOfStake() : read block failed");
+
+    txoutPrev = txPrev.vout[prevout.n];
+    pindexFrom = it->second;
+    nStakeInputsFromDisk++;
+    return true;
+}
+
 // Check kernel hash target and coinstake signature
-bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake)
+bool CheckProofOfStake(const CBlock& block, uint256& hashProofOfStake)
 {
-    const CTransaction tx = block.vtx[1];
+    const CTransaction& tx = block.vtx[1];
     if (!tx.IsCoinStake())
         return error("CheckProofOfStake() : called on non-coinstake %s", tx.GetHash().ToString().c_str());
 
     // Kernel (input 0) must match the stake hash target per coin age (nBits)
     const CTxIn& txin = tx.vin[0];
 
-    // First try finding the previous transaction in database
-    uint256 hashBlock;
-    CTransaction txPrev;
-    if (!GetTransaction(txin.prevout.hash, txPrev, hashBlock, true))
-        return error("CheckProofOfStake() : INFO: read txPrev failed");
+    int64_t nTimeStart = GetTimeMicros();
+    CTxOut txoutPrev;
+    const CBlockIndex* pindexFrom = NULL;
+    if (!GetStakeInput(txin.prevout, txoutPrev, pindexFrom))
+        return false;
+    nTimeStakeInput += GetTimeMicros() - nTimeStart;
+    LogPrint("bench", "    - Stake input: %.2fms [%.2fs, %d from coins, %d from disk]\n",
+        (GetTimeMicros() - nTimeStart) * 0.001, nTimeStakeInput * 0.000001, nStakeInputsFromCoins, nStakeInputsFromDisk);
 
     //verify signature and script
-    if (!VerifyScript(txin.scriptSig, txPrev.vout[txin.prevout.n].scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, 0)))
+    if (!VerifyScript(txin.scriptSig, txoutPrev.scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, 0)))
         return error("CheckProofOfStake() : VerifySignature failed on coinstake %s", tx.GetHash().ToString().c_str());
 
-    CBlockIndex* pindex = NULL;
-    BlockMap::iterator it = mapBlockIndex.find(hashBlock);
-    if (it != mapBlockIndex.end())
-        pindex = it->second;
-    else
-        return error("CheckProofOfStake() : read block failed");
-
-    // Read block header
-    CBlock blockprev;
-    if (!ReadBlockFromDisk(blockprev, pindex->GetBlockPos()))
-        return error("CheckProofOfStake(): INFO: failed to find block");
-
     unsigned int nInterval = 0;
     unsigned int nTime = block.nTime;
-    if (!CheckStakeKernelHash(block.nBits, blockprev, txPrev, txin.prevout, nTime, nInterval, true, hashProofOfStake, fDebug))
+    if (!CheckStakeKernelHash(block.nBits, pindexFrom, txoutPrev.nValue, txin.prevout, nTime, nInterval, true, hashProofOfStake, fDebug))
         return error("CheckProofOfStake() : INFO: check kernel failed on coinstake %s, hashProof=%s \n", tx.GetHash().ToString().c_str(), hashProofOfStake.ToString().c_str()); // may occur during initial download or if behind on block chain sync
 
     return true;
@@ -24,11 +24,99 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
 // Sets hashProofOfStake on success return
 uint256 stakeHash(unsigned int nTimeTx, CDataStream ss, unsigned int prevoutIndex, uint256 prevoutHash, unsigned int nTimeBlockFrom);
 bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTargetPerCoinDay);
-bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTransaction txPrev, const COutPoint prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake = false);
+bool CheckStakeKernelHash(unsigned int nBits, const CBlockIndex* pindexFrom, int64_t nValueIn, const COutPoint& prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake = false);
+
+/** Kernel inputs of one stakeable output that stay fixed for a given tip and nBits. */
+struct CStakeKernelInput {
+    COutPoint prevout;
+    unsigned int nTimeBlockFrom;
+    uint64_t nStakeModifier;
+    //! coin-day weighted target the kernel hash must stay below
+    uint256 bnTarget;
+    //! serialized kernel (modifier, nTimeBlockFrom, prevout), nTimeTx is appended per try
+    unsigned char vchKernel[48];
+};
+
+/**
+ * Batched stake kernel search over many stakeable outputs.
+ *
+ * Prepare() resolves the stake modifier, origin block time and weighted target
+ * of every candidate once per chain tip and difficulty; Search() then hashes
+ * whole batches of (output x timestamp) pairs of the hash drift window with the
+ * multi-lane SHA256D kernel instead of one CheckStakeKernelHash() per output.
+ * Results are identical to calling CheckStakeKernelHash() on each input in
+ * turn: inputs are tried in the order they were added, and within an input
+ * timestamps are tried from nTimeTx + nHashDrift down to nTimeTx + 1.
+ */
+class CStakeKernelSearch
+{
+private:
+    std::vector<CStakeKernelInput> vInputs;
+    uint256 hashPrepared;
+    unsigned int nBitsPrepared;
+    uint256 bnTargetPerCoinDay;
+
+public:
+    CStakeKernelSearch();
+
+    /** Drop all inputs and require a new Prepare(). */
+    void Clear();
+    /** Start a new input set for the given tip and difficulty. */
+    void Prepare(const uint256& hashTip, unsigned int nBits);
+    /** Whether the current input set was prepared for this tip and difficulty. */
+    bool IsPrepared(const uint256& hashTip, unsigned int nBits) const;
+    /** Add a candidate. Returns false if its stake modifier is not known yet. */
+    bool AddInput(const COutPoint& prevout, int64_t nValueIn, const CBlockIndex* pindexFrom);
+
+    size_t size() const { return vInputs.size(); }
+    const CStakeKernelInput& operator[](size_t i) const { return vInputs[i]; }
+
+    /**
+     * Find the first input at or after nStart whose kernel meets the target.
+     * On success nInputRet, nTimeTxRet and hashProofOfStakeRet describe the kernel.
+     */
+    bool Search(unsigned int nTimeTx, unsigned int nHashDrift, size_t nStart, size_t& nInputRet, unsigned int& nTimeTxRet, uint256& hashProofOfStakeRet) const;
+};
+
+/**
+ * Kernel stake modifiers by origin block height.
+ *
+ * GetKernelStakeModifier() walks the active chain forward from the origin of
+ * a stake until a selection interval is covered. The block that walk stops at
+ * only depends on the origin and the active chain after it, so it is kept per
+ * origin height: new origins are resolved incrementally as blocks connect,
+ * entries are dropped as blocks disconnect, and every hit is re-checked
+ * against chainActive so a reorg can never return a stale modifier.
+ */
+class CStakeModifierCache
+{
+private:
+    mutable CCriticalSection cs;
+    //! block holding the modifier for a stake from each origin height, NULL if not resolved
+    std::vector<const CBlockIndex*> vModifierBlock;
+    //! lowest origin height that is still resolved incrementally by UpdateTip()
+    int nFirstPending;
+    uint64_t nHits;
+    uint64_t nMisses;
+
+public:
+    CStakeModifierCache();
+
+    void Clear();
+    /** Follow chainActive after its tip changed to pindexNew. */
+    void UpdateTip(const CBlockIndex* pindexNew);
+    /** Find the modifier block of a stake from pindexFrom, counting a hit or a miss. */
+    bool Lookup(const CBlockIndex* pindexFrom, const CBlockIndex*& pindexModifier);
+    /** Remember a modifier block computed after a miss. */
+    void Store(const CBlockIndex* pindexFrom, const CBlockIndex* pindexModifier);
+    void GetStats(uint64_t& nHitsRet, uint64_t& nMissesRet, size_t& nEntriesRet) const;
+};
+
+extern CStakeModifierCache stakeModifierCache;
 
 // Check kernel hash target and coinstake signature
 // Sets hashProofOfStake on success return
-bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake);
+bool CheckProofOfStake(const CBlock& block, uint256& hashProofOfStake);
 
 // Check whether the coinstake timestamp meets protocol
 bool CheckCoinStakeTimestamp(int64_t nTimeBlock, int64_t nTimeTx);
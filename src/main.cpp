@@ -16,11 +16,15 @@
 #include "kernel.h"
 #include "servicenode-budget.h"
 #include "servicenode-payments.h"
+#include "servicenode-sigcheck.h"
+#include "servicenode-sync.h"
 #include "servicenodeman.h"
 #include "merkleblock.h"
+#include "messagedispatch.h"
 #include "net.h"
 #include "obfuscation.h"
 #include "pow.h"
+#include "scheduler.h"
 #include "spork.h"
 #include "swifttx.h"
 #include "txdb.h"
@@ -33,6 +37,7 @@
 #include <sstream>
 
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/lexical_cast.hpp>
@@ -173,6 +178,9 @@ set<CBlockIndex*> setDirtyBlockIndex;
 
 /** Dirty block file entries. */
 set<int> setDirtyFileInfo;
+
+/** Transaction index entries not yet written to the block tree database. */
+map<uint256, CDiskTxPos> mapDirtyTxIndex;
 } // anon namespace
 
 //////////////////////////////////////////////////////////////////////////////
@@ -551,8 +559,57 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats)
     return true;
 }
 
+void static RegisterMessageHandlers()
+{
+    // handled by ProcessMessage itself, registered for their statistics
+    static const char* ppszCoreCommands[] = {"version", "verack", "addr", "inv", "getdata", "getblocks", "getheaders", "headers",
+        "tx", "dstx", "block", "getaddr", "mempool", "alert", "filterload", "filteradd", "filterclear"};
+    for (unsigned int i = 0; i < ARRAYLEN(ppszCoreCommands); i++)
+        messageDispatcher.Register(ppszCoreCommands[i]);
+    // these only touch the sending peer, so they are not held up by block processing
+    messageDispatcher.Register("ping", CMessageDispatcher::Handler(), true);
+    messageDispatcher.Register("pong", CMessageDispatcher::Handler(), true);
+    messageDispatcher.Register("reject", CMessageDispatcher::Handler(), true);
+
+    CMessageDispatcher::Handler handler = boost::bind(&CObfuscationPool::ProcessMessageObfuscation, &obfuScationPool, _1, _2, _3);
+    messageDispatcher.Register("dsa", handler);
+    messageDispatcher.Register("dsq", handler);
+    messageDispatcher.Register("dsi", handler);
+    messageDispatcher.Register("dssu", handler);
+    messageDispatcher.Register("dss", handler);
+    messageDispatcher.Register("dsf", handler);
+    messageDispatcher.Register("dsc", handler);
+
+    // the servicenode, budget and SwiftTX handlers take their own locks, and cs_main only where they read the chain
+    handler = boost::bind(&CServicenodeMan::ProcessMessage, &mnodeman, _1, _2, _3);
+    messageDispatcher.Register("mnb", handler, true);
+    messageDispatcher.Register("mnp", handler, true);
+    messageDispatcher.Register("dseg", handler, true);
+    messageDispatcher.Register("dsee", handler, true);
+    messageDispatcher.Register("dseep", handler, true);
+
+    handler = boost::bind(&CBudgetManager::ProcessMessage, &budget, _1, _2, _3);
+    messageDispatcher.Register("mnvs", handler, true);
+    messageDispatcher.Register("mprop", handler, true);
+    messageDispatcher.Register("mvote", handler, true);
+    messageDispatcher.Register("fbs", handler, true);
+    messageDispatcher.Register("fbvote", handler, true);
+
+    handler = boost::bind(&CServicenodePayments::ProcessMessageServicenodePayments, &servicenodePayments, _1, _2, _3);
+    messageDispatcher.Register("mnget", handler);
+    messageDispatcher.Register("mnw", handler);
+
+    messageDispatcher.Register("ix", &ProcessMessageSwiftTX, true);
+    messageDispatcher.Register("txlvote", &ProcessMessageSwiftTX, true);
+    messageDispatcher.Register("spork", &ProcessSpork);
+    messageDispatcher.Register("getsporks", &ProcessSpork);
+    messageDispatcher.Register("ssc", boost::bind(&CServicenodeSync::ProcessMessage, &servicenodeSync, _1, _2, _3));
+}
+
 void RegisterNodeSignals(CNodeSignals& nodeSignals)
 {
+    RegisterMessageHandlers();
+
     nodeSignals.GetHeight.connect(&GetHeight);
     nodeSignals.ProcessMessages.connect(&ProcessMessages);
     nodeSignals.SendMessages.connect(&SendMessages);
@@ -1482,7 +1539,13 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
 
         if (fTxIndex) {
             CDiskTxPos postx;
-            if (pblocktree->ReadTxIndex(hash, postx)) {
+            map<uint256, CDiskTxPos>::const_iterator itPos = mapDirtyTxIndex.find(hash);
+            bool fFound = itPos != mapDirtyTxIndex.end();
+            if (fFound)
+                postx = itPos->second;
+            else
+                fFound = pblocktree->ReadTxIndex(hash, postx);
+            if (fFound) {
                 CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
                 if (file.IsNull())
                     return error("%s: OpenBlockFile failed", __func__);
@@ -1768,6 +1831,8 @@ void Misbehaving(NodeId pnode, int howmuch)
     if (howmuch == 0)
         return;
 
+    // the message handlers punish their peers without holding cs_main
+    LOCK(cs_main);
     CNodeState* state = State(pnode);
     if (state == NULL)
         return;
@@ -2232,9 +2297,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     pindex->nMint = nValueOut - nValueIn + nFees;
     pindex->nMoneySupply = (pindex->pprev ? pindex->pprev->nMoneySupply : 0) + nValueOut - nValueIn;
 
-    if (!pblocktree->WriteBlockIndex(CDiskBlockIndex(pindex)))
-        return error("Connect() : WriteBlockIndex for pindex failed");
-
     int64_t nTime1 = GetTimeMicros();
     nTimeConnect += nTime1 - nTimeStart;
     LogPrint("bench", "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n", (unsigned)block.vtx.size(), 0.001 * (nTime1 - nTimeStart), 0.001 * (nTime1 - nTimeStart) / block.vtx.size(), nInputs <= 1 ? 0 : 0.001 * (nTime1 - nTimeStart) / (nInputs - 1), nTimeConnect * 0.000001);
@@ -2256,6 +2318,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     if (fJustCheck)
         return true;
 
+    // nMint and nMoneySupply changed; the entry is written with the next flush
+    setDirtyBlockIndex.insert(pindex);
+
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull() || !pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
         if (pindex->GetUndoPos().IsNull()) {
@@ -2275,8 +2340,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     }
 
     if (fTxIndex)
-        if (!pblocktree->WriteTxIndex(vPos))
-            return state.Abort("Failed to write transaction index");
+        for (std::vector<std::pair<uint256, CDiskTxPos> >::const_iterator it = vPos.begin(); it != vPos.end(); ++it)
+            mapDirtyTxIndex[it->first] = it->second;
 
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
@@ -2313,8 +2378,11 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
     LOCK(cs_main);
     static int64_t nLastWrite = 0;
     try {
+        // pending txindex entries count against the coins cache, where an entry takes around 300 bytes
+        size_t nCacheSize = pcoinsTip->GetCacheSize() +
+                            mapDirtyTxIndex.size() * (sizeof(pair<const uint256, CDiskTxPos>) + 4 * sizeof(void*)) / 300;
         if ((mode == FLUSH_STATE_ALWAYS) ||
-            ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->GetCacheSize() > nCoinCacheSize) ||
+            ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && nCacheSize > nCoinCacheSize) ||
             (mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000)) {
             // Typical CCoins structures on disk are around 100 bytes in size.
             // Pushing a new one to the database can cause it to be written
@@ -2325,25 +2393,26 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
                 return state.Error("out of disk space");
             // First make sure all block and undo data is flushed to disk.
             FlushBlockFile();
-            // Then update all block file information (which may refer to block and undo files).
-            bool fileschanged = false;
+            // Then update all block file information (which may refer to block and undo files),
+            // the block index and the transaction index in a single synced batch.
+            std::vector<std::pair<int, const CBlockFileInfo*> > vFiles;
+            vFiles.reserve(setDirtyFileInfo.size());
             for (set<int>::iterator it = setDirtyFileInfo.begin(); it != setDirtyFileInfo.end();) {
-                if (!pblocktree->WriteBlockFileInfo(*it, vinfoBlockFile[*it])) {
-                    return state.Abort("Failed to write to block index");
-                }
-                fileschanged = true;
+                vFiles.push_back(make_pair(*it, &vinfoBlockFile[*it]));
                 setDirtyFileInfo.erase(it++);
             }
-            if (fileschanged && !pblocktree->WriteLastBlockFile(nLastBlockFile)) {
-                return state.Abort("Failed to write to block index");
-            }
+            std::vector<const CBlockIndex*> vBlocks;
+            vBlocks.reserve(setDirtyBlockIndex.size());
             for (set<CBlockIndex*>::iterator it = setDirtyBlockIndex.begin(); it != setDirtyBlockIndex.end();) {
-                if (!pblocktree->WriteBlockIndex(CDiskBlockIndex(*it))) {
-                    return state.Abort("Failed to write to block index");
-                }
+                vBlocks.push_back(*it);
                 setDirtyBlockIndex.erase(it++);
             }
-            pblocktree->Sync();
+            int64_t nTimeWrite = GetTimeMicros();
+            if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks, mapDirtyTxIndex)) {
+                return state.Abort("Failed to write to block index");
+            }
+            LogPrint("bench", "  - Block index write: %u files, %u blocks, %u txs: %.2fms\n", vFiles.size(), vBlocks.size(), mapDirtyTxIndex.size(), 0.001 * (GetTimeMicros() - nTimeWrite));
+            mapDirtyTxIndex.clear();
             // Finally flush the chainstate (which may refer to block index entries).
             if (!pcoinsTip->Flush())
                 return state.Abort("Failed to write to coin database");
@@ -2369,6 +2438,7 @@ void FlushStateToDisk()
 void static UpdateTip(CBlockIndex* pindexNew)
 {
     chainActive.SetTip(pindexNew);
+    stakeModifierCache.UpdateTip(pindexNew);
 
     // New best block
     nTimeBestReceived = GetTime();
@@ -2889,19 +2959,16 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
-    assert(pindexNew);
+    CBlockIndex* pindexNew = mapBlockIndex.insert(hash, CBlockIndex(block));
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
     pindexNew->nSequenceId = 0;
-    BlockMap::iterator mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
 
     //mark as PoS seen
     if (pindexNew->IsProofOfStake())
         setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
 
-    pindexNew->phashBlock = &((*mi).first);
     BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
     if (miPrev != mapBlockIndex.end()) {
         pindexNew->pprev = (*miPrev).second;
@@ -3084,23 +3151,18 @@ bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool f
     return true;
 }
 
-bool CheckBlock(const CBlock& block, CValidationState& state, bool /*fCheckPOW*/, bool fCheckMerkleRoot, bool /*fCheckSig*/)
+/**
+ * The checks of CheckBlock that only depend on the block itself. They need no
+ * lock, so PreCheckBlocks can run them on several threads ahead of time.
+ */
+static bool CheckBlockContextFree(const CBlock& block, CValidationState& state, bool fCheckMerkleRoot)
 {
-    // These are checks that are independent of context.
-
     // Check that the header is valid (particularly PoW).  This is mostly
     // redundant with the call in AcceptBlockHeader.
     if (!CheckBlockHeader(block, state, block.IsProofOfWork()))
         return state.DoS(100, error("CheckBlock() : CheckBlockHeader failed"),
             REJECT_INVALID, "bad-header", true);
 
-    // Check timestamp
-    LogPrint("debug", "%s: block=%s  is proof of stake=%d\n", __func__, block.GetHash().ToString().c_str(), block.IsProofOfStake());
-    if (block.GetBlockTime() > GetAdjustedTime() + (block.IsProofOfStake() ? 180 : 7200)) // 3 minute future drift for PoS
-        return state.Invalid(error("CheckBlock() : block timestamp too far in the future"),
-            REJECT_INVALID, "time-too-new");
-
-
     // Check the merkle root.
     if (fCheckMerkleRoot) {
         bool mutated;
@@ -3148,6 +3210,40 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool /*fCheckPOW*/
                 return state.DoS(100, error("CheckBlock() : more than one coinstake"));
     }
 
+    // Check transactions
+    BOOST_FOREACH (const CTransaction& tx, block.vtx)
+        if (!CheckTransaction(tx, state))
+            return error("CheckBlock() : CheckTransaction failed");
+
+    unsigned int nSigOps = 0;
+    BOOST_FOREACH (const CTransaction& tx, block.vtx) {
+        nSigOps += GetLegacySigOpCount(tx);
+    }
+    if (nSigOps > MAX_BLOCK_SIGOPS)
+        return state.DoS(100, error("CheckBlock() : out-of-bounds SigOpCount"),
+            REJECT_INVALID, "bad-blk-sigops", true);
+
+    // Without the merkle root check the transactions may not belong to the
+    // header, so only a full check is remembered
+    if (fCheckMerkleRoot)
+        block.fChecked = true;
+
+    return true;
+}
+
+bool CheckBlock(const CBlock& block, CValidationState& state, bool /*fCheckPOW*/, bool fCheckMerkleRoot, bool /*fCheckSig*/)
+{
+    // These are checks that are independent of context, unless an earlier
+    // call (or PreCheckBlocks) already did them for this block.
+    if (!block.fChecked && !CheckBlockContextFree(block, state, fCheckMerkleRoot))
+        return false;
+
+    // Check timestamp
+    LogPrint("debug", "%s: block=%s  is proof of stake=%d\n", __func__, block.GetHash().ToString().c_str(), block.IsProofOfStake());
+    if (block.GetBlockTime() > GetAdjustedTime() + (block.IsProofOfStake() ? 180 : 7200)) // 3 minute future drift for PoS
+        return state.Invalid(error("CheckBlock() : block timestamp too far in the future"),
+            REJECT_INVALID, "time-too-new");
+
     // ----------- swiftTX transaction scanning -----------
 
     if (IsSporkActive(SPORK_3_SWIFTTX_BLOCK_FILTERING)) {
@@ -3197,19 +3293,6 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool /*fCheckPOW*/
 
     // -------------------------------------------
 
-    // Check transactions
-    BOOST_FOREACH (const CTransaction& tx, block.vtx)
-        if (!CheckTransaction(tx, state))
-            return error("CheckBlock() : CheckTransaction failed");
-
-    unsigned int nSigOps = 0;
-    BOOST_FOREACH (const CTransaction& tx, block.vtx) {
-        nSigOps += GetLegacySigOpCount(tx);
-    }
-    if (nSigOps > MAX_BLOCK_SIGOPS)
-        return state.DoS(100, error("CheckBlock() : out-of-bounds SigOpCount"),
-            REJECT_INVALID, "bad-blk-sigops", true);
-
     return true;
 }
 
@@ -3544,6 +3627,9 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
             servicenodePayments.ProcessBlock(GetHeight() + 10);
             budget.NewBlock();
         }
+
+        // a recent block may complete the blockchain sync the servicenode sync is waiting for
+        if (!servicenodeSync.IsSynced() && pblock->GetBlockTime() + 60 * 60 >= GetAdjustedTime()) scheduler.Wake("mnsync");
     }
 
     if (pwalletMain) {
@@ -3657,39 +3743,107 @@ CBlockIndex* InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw runtime_error("LoadBlockIndex() : new CBlockIndex failed");
-    mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
+    CBlockIndex* pindexNew = mapBlockIndex.insert(hash, CBlockIndex());
 
     //mark as PoS seen
     if (pindexNew->IsProofOfStake())
         setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
 
-    pindexNew->phashBlock = &((*mi).first);
-
     return pindexNew;
 }
 
+// Work of each block in vSortedByHeight[nBegin, nEnd), for the parallel part of LoadBlockIndexDB
+static void LoadBlockProofs(const vector<pair<int, CBlockIndex*> >& vSortedByHeight, vector<uint256>& vBlockProof, size_t nBegin, size_t nEnd)
+{
+    for (size_t i = nBegin; i < nEnd; i++)
+        vBlockProof[i] = GetBlockProof(*vSortedByHeight[i].second);
+}
+
 bool static LoadBlockIndexDB()
 {
+    int64_t nTimeStart = GetTimeMicros();
+
+    // Load block file info first, so the block count is known up front
+    pblocktree->ReadLastBlockFile(nLastBlockFile);
+    vinfoBlockFile.resize(nLastBlockFile + 1);
+    LogPrintf("%s: last block file = %i\n", __func__, nLastBlockFile);
+    for (int nFile = 0; nFile <= nLastBlockFile; nFile++) {
+        pblocktree->ReadBlockFileInfo(nFile, vinfoBlockFile[nFile]);
+    }
+    LogPrintf("%s: last block file info: %s\n", __func__, vinfoBlockFile[nLastBlockFile].ToString());
+    for (int nFile = nLastBlockFile + 1; true; nFile++) {
+        CBlockFileInfo info;
+        if (pblocktree->ReadBlockFileInfo(nFile, info)) {
+            vinfoBlockFile.push_back(info);
+        } else {
+            break;
+        }
+    }
+    size_t nBlocksExpected = 0;
+    BOOST_FOREACH (const CBlockFileInfo& info, vinfoBlockFile)
+        nBlocksExpected += info.nBlocks;
+    mapBlockIndex.reserve(nBlocksExpected);
+
+    int64_t nTime1 = GetTimeMicros();
+    LogPrint("bench", "%s: read block file info: %.2fms\n", __func__, (nTime1 - nTimeStart) * 0.001);
+
     if (!pblocktree->LoadBlockIndexGuts())
         return false;
 
     boost::this_thread::interruption_point();
+    int64_t nTime2 = GetTimeMicros();
+    LogPrint("bench", "%s: load block index entries: %.2fms (%u entries)\n", __func__, (nTime2 - nTime1) * 0.001, (unsigned int)mapBlockIndex.size());
+
+    // Order entries by height. Heights are dense, so bucket them instead of
+    // sorting the whole index; each bucket is then sorted on its own so the
+    // order is the same as sorting (height, pointer) pairs
+    vector<pair<int, CBlockIndex*> > vSortedByHeight(mapBlockIndex.size());
+    {
+        vector<size_t> vHeightStart;
+        BOOST_FOREACH (const PAIRTYPE(uint256, CBlockIndex*) & item, mapBlockIndex) {
+            int nHeight = item.second->nHeight;
+            if (nHeight + 2 > (int)vHeightStart.size())
+                vHeightStart.resize(nHeight + 2, 0);
+            vHeightStart[nHeight + 1]++;
+        }
+        for (size_t i = 1; i < vHeightStart.size(); i++)
+            vHeightStart[i] += vHeightStart[i - 1];
+        vector<size_t> vNext(vHeightStart);
+        BOOST_FOREACH (const PAIRTYPE(uint256, CBlockIndex*) & item, mapBlockIndex) {
+            CBlockIndex* pindex = item.second;
+            vSortedByHeight[vNext[pindex->nHeight]++] = make_pair(pindex->nHeight, pindex);
+        }
+        for (size_t i = 0; i + 1 < vHeightStart.size(); i++) {
+            if (vHeightStart[i + 1] - vHeightStart[i] > 1)
+                sort(vSortedByHeight.begin() + vHeightStart[i], vSortedByHeight.begin() + vHeightStart[i + 1]);
+        }
+    }
+    int64_t nTime3 = GetTimeMicros();
+    LogPrint("bench", "%s: order by height: %.2fms\n", __func__, (nTime3 - nTime2) * 0.001);
+
+    // The work of each block only depends on its own nBits, so compute it on
+    // all cores before the serial pass that accumulates it along the chain
+    vector<uint256> vBlockProof(vSortedByHeight.size());
+    {
+        size_t nThreads = std::max(1, std::min((int)boost::thread::hardware_concurrency(), 8));
+        size_t nChunk = (vSortedByHeight.size() + nThreads - 1) / nThreads;
+        boost::thread_group threadGroup;
+        for (size_t nBegin = 0; nBegin < vSortedByHeight.size(); nBegin += nChunk) {
+            size_t nEnd = std::min(vSortedByHeight.size(), nBegin + nChunk);
+            threadGroup.create_thread(boost::bind(&LoadBlockProofs, boost::cref(vSortedByHeight), boost::ref(vBlockProof), nBegin, nEnd));
+        }
+        threadGroup.join_all();
+    }
+    int64_t nTime4 = GetTimeMicros();
+    LogPrint("bench", "%s: compute block proofs: %.2fms\n", __func__, (nTime4 - nTime3) * 0.001);
 
     // Calculate nChainWork
-    vector<pair<int, CBlockIndex*> > vSortedByHeight;
-    vSortedByHeight.reserve(mapBlockIndex.size());
-    BOOST_FOREACH (const PAIRTYPE(uint256, CBlockIndex*) & item, mapBlockIndex) {
-        CBlockIndex* pindex = item.second;
-        vSortedByHeight.push_back(make_pair(pindex->nHeight, pindex));
-    }
-    sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    BOOST_FOREACH (const PAIRTYPE(int, CBlockIndex*) & item, vSortedByHeight) {
-        CBlockIndex* pindex = item.second;
-        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
+    set<int> setBlkDataFiles;
+    for (size_t i = 0; i < vSortedByHeight.size(); i++) {
+        CBlockIndex* pindex = vSortedByHeight[i].second;
+        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + vBlockProof[i];
         if (pindex->nStatus & BLOCK_HAVE_DATA) {
+            setBlkDataFiles.insert(pindex->nFile);
             if (pindex->pprev) {
                 if (pindex->pprev->nChainTx) {
                     pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
@@ -3710,39 +3864,18 @@ bool static LoadBlockIndexDB()
         if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
     }
-
-    // Load block file info
-    pblocktree->ReadLastBlockFile(nLastBlockFile);
-    vinfoBlockFile.resize(nLastBlockFile + 1);
-    LogPrintf("%s: last block file = %i\n", __func__, nLastBlockFile);
-    for (int nFile = 0; nFile <= nLastBlockFile; nFile++) {
-        pblocktree->ReadBlockFileInfo(nFile, vinfoBlockFile[nFile]);
-    }
-    LogPrintf("%s: last block file info: %s\n", __func__, vinfoBlockFile[nLastBlockFile].ToString());
-    for (int nFile = nLastBlockFile + 1; true; nFile++) {
-        CBlockFileInfo info;
-        if (pblocktree->ReadBlockFileInfo(nFile, info)) {
-            vinfoBlockFile.push_back(info);
-        } else {
-            break;
-        }
-    }
+    int64_t nTime5 = GetTimeMicros();
+    LogPrint("bench", "%s: link chain work, skip pointers and candidates: %.2fms\n", __func__, (nTime5 - nTime4) * 0.001);
 
     // Check presence of blk files
     LogPrintf("Checking all blk files are present...\n");
-    set<int> setBlkDataFiles;
-    BOOST_FOREACH (const PAIRTYPE(uint256, CBlockIndex*) & item, mapBlockIndex) {
-        CBlockIndex* pindex = item.second;
-        if (pindex->nStatus & BLOCK_HAVE_DATA) {
-            setBlkDataFiles.insert(pindex->nFile);
-        }
-    }
     for (std::set<int>::iterator it = setBlkDataFiles.begin(); it != setBlkDataFiles.end(); it++) {
         CDiskBlockPos pos(*it, 0);
         if (CAutoFile(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION).IsNull()) {
             return false;
         }
     }
+    LogPrint("bench", "%s: check block files: %.2fms [total %.2fms]\n", __func__, (GetTimeMicros() - nTime5) * 0.001, (GetTimeMicros() - nTimeStart) * 0.001);
 
     //Check if the shutdown procedure was followed on last client exit
     bool fLastShutdownWasPrepared = true;
@@ -3946,10 +4079,16 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
 
 void UnloadBlockIndex()
 {
-    mapBlockIndex.clear();
+    // mapBlockIndex owns the entries, so drop every pointer into it first
     setBlockIndexCandidates.clear();
+    mapBlocksUnlinked.clear();
+    setDirtyBlockIndex.clear();
+    mapDirtyTxIndex.clear();
     chainActive.SetTip(NULL);
+    stakeModifierCache.Clear();
     pindexBestInvalid = NULL;
+    pindexBestHeader = NULL;
+    mapBlockIndex.clear();
 }
 
 bool LoadBlockIndex()
@@ -4001,96 +4140,171 @@ bool InitBlockIndex()
 }
 
 
+static CCheckQueue<CBlockPreCheck> blockprecheckqueue(4);
+
+void ThreadBlockPreCheck()
+{
+    RenameThread("blocknetdx-blkprech");
+    blockprecheckqueue.Thread();
+}
+
+bool CBlockPreCheck::operator()()
+{
+    CValidationState state;
+    CheckBlockContextFree(*pblock, state, true);
+    return true;
+}
+
+void PreCheckBlocks(const vector<CBlock>& vBlocks)
+{
+    // the workers are started with the script check threads, without them the blocks are checked here
+    CCheckQueueControl<CBlockPreCheck> control(nScriptCheckThreads ? &blockprecheckqueue : NULL);
+    vector<CBlockPreCheck> vChecks;
+    vChecks.reserve(vBlocks.size());
+    BOOST_FOREACH (const CBlock& block, vBlocks)
+        vChecks.push_back(CBlockPreCheck(block));
+    if (nScriptCheckThreads) {
+        control.Add(vChecks);
+        control.Wait();
+    } else {
+        BOOST_FOREACH (CBlockPreCheck& check, vChecks)
+            check();
+    }
+}
+
 bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
 {
     // Map of disk positions for blocks with unknown parent (only used for reindex)
     static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
+    int64_t nTimePreCheck = 0;
 
     int nLoaded = 0;
     try {
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
         CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE, MAX_BLOCK_SIZE + 8, SER_DISK, CLIENT_VERSION);
         uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+        bool fDone = false;
+        while (!fDone && !blkdat.eof()) {
             boost::this_thread::interruption_point();
 
-            blkdat.SetPos(nRewind);
-            nRewind++;         // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[MESSAGE_START_SIZE];
-                blkdat.FindByte(Params().MessageStart()[0]);
-                nRewind = blkdat.GetPos() + 1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
-            }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != Params().HashGenesisBlock() && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                        block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
+            // Read a batch of blocks ahead, so their context-free checks run in
+            // parallel and only the contextual work is left for ConnectBlock
+            vector<CBlock> vBlocks;
+            vector<CDiskBlockPos> vBlockPos;
+            unsigned int nBatchSize = 0;
+            while (!blkdat.eof() && vBlocks.size() < PRECHECK_BATCH_BLOCKS && nBatchSize < PRECHECK_BATCH_SIZE) {
+                blkdat.SetPos(nRewind);
+                nRewind++;         // start one byte further next time, in case of failure
+                blkdat.SetLimit(); // remove former limit
+                unsigned int nSize = 0;
+                try {
+                    // locate a header
+                    unsigned char buf[MESSAGE_START_SIZE];
+                    blkdat.FindByte(Params().MessageStart()[0]);
+                    nRewind = blkdat.GetPos() + 1;
+                    blkdat >> FLATDATA(buf);
+                    if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
+                        continue;
+                    // read size
+                    blkdat >> nSize;
+                    if (nSize < 80 || nSize > MAX_BLOCK_SIZE)
+                        continue;
+                } catch (const std::exception&) {
+                    // no valid block header found; don't complain
+                    fDone = true;
+                    break;
                 }
-
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    CValidationState state;
-                    if (ProcessNewBlock(state, NULL, &block, dbp))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != Params().HashGenesisBlock() && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+                try {
+                    // read block
+                    uint64_t nBlockPos = blkdat.GetPos();
+                    CDiskBlockPos pos;
+                    if (dbp) {
+                        pos = *dbp;
+                        pos.nPos = nBlockPos;
+                    }
+                    blkdat.SetLimit(nBlockPos + nSize);
+                    blkdat.SetPos(nBlockPos);
+                    CBlock block;
+                    blkdat >> block;
+                    nRewind = blkdat.GetPos();
+                    vBlocks.push_back(block);
+                    vBlockPos.push_back(pos);
+                    nBatchSize += nSize;
+                } catch (std::exception& e) {
+                    LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
                 }
+            }
+
+            int64_t nTimeBatch = GetTimeMicros();
+            PreCheckBlocks(vBlocks);
+            nTimePreCheck += GetTimeMicros() - nTimeBatch;
+
+            for (size_t i = 0; i < vBlocks.size(); i++) {
+                boost::this_thread::interruption_point();
+                CBlock& block = vBlocks[i];
+                CDiskBlockPos* pblockPos = dbp ? &vBlockPos[i] : NULL;
+                try {
+                    // detect out of order blocks, and store them for later
+                    uint256 hash = block.GetHash();
+                    if (hash != Params().HashGenesisBlock() && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+                        LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                            block.hashPrevBlock.ToString());
+                        if (dbp)
+                            mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *pblockPos));
+                        continue;
+                    }
+
+                    // process in case the block isn't known yet
+                    if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+                        CValidationState state;
+                        if (ProcessNewBlock(state, NULL, &block, pblockPos))
+                            nLoaded++;
+                        if (state.IsError()) {
+                            fDone = true;
+                            break;
+                        }
+                    } else if (hash != Params().HashGenesisBlock() && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+                        LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+                    }
+
+                    // Recursively process earlier encountered successors of this block
+                    deque<uint256> queue;
+                    queue.push_back(hash);
+                    while (!queue.empty()) {
+                        uint256 head = queue.front();
+                        queue.pop_front();
+                        std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+                        vector<CBlock> vChildren;
+                        vector<CDiskBlockPos> vChildPos;
+                        while (range.first != range.second) {
+                            std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+                            vChildren.push_back(CBlock());
+                            if (ReadBlockFromDisk(vChildren.back(), it->second))
+                                vChildPos.push_back(it->second);
+                            else
+                                vChildren.pop_back();
+                            range.first++;
+                            mapBlocksUnknownParent.erase(it);
+                        }
+
+                        nTimeBatch = GetTimeMicros();
+                        PreCheckBlocks(vChildren);
+                        nTimePreCheck += GetTimeMicros() - nTimeBatch;
 
-                // Recursively process earlier encountered successors of this block
-                deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(block, it->second)) {
-                            LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
+                        for (size_t j = 0; j < vChildren.size(); j++) {
+                            LogPrintf("%s: Processing out of order child %s of %s\n", __func__, vChildren[j].GetHash().ToString(),
                                 head.ToString());
                             CValidationState dummy;
-                            if (ProcessNewBlock(dummy, NULL, &block, &it->second)) {
+                            if (ProcessNewBlock(dummy, NULL, &vChildren[j], &vChildPos[j])) {
                                 nLoaded++;
-                                queue.push_back(block.GetHash());
+                                queue.push_back(vChildren[j].GetHash());
                             }
                         }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
                     }
+                } catch (std::exception& e) {
+                    LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
                 }
-            } catch (std::exception& e) {
-                LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
             }
         }
     } catch (std::runtime_error& e) {
@@ -4098,6 +4312,7 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
     }
     if (nLoaded > 0)
         LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
+    LogPrint("bench", "%s: context-free block checks: %.2fms\n", __func__, nTimePreCheck * 0.001);
     return nLoaded > 0;
 }
 
@@ -4353,19 +4568,46 @@ bool static AlreadyHave(const CInv& inv)
         }
         return false;
     case MSG_SERVICENODE_ANNOUNCE:
-        if (mnodeman.mapSeenServicenodeBroadcast.count(inv.hash)) {
+        if (mnodeman.IsBroadcastSeen(inv.hash)) {
             servicenodeSync.AddedServicenodeList(inv.hash);
             return true;
         }
         return false;
     case MSG_SERVICENODE_PING:
-        return mnodeman.mapSeenServicenodePing.count(inv.hash);
+        return mnodeman.IsPingSeen(inv.hash);
     }
     // Don't know what it is, just say we already got one
     return true;
 }
 
 
+/** Push an object requested by getdata. The serialized object is shared through getDataCache,
+ *  so an object requested by many peers is only serialized again once its version changes.
+ */
+template <typename T>
+void static PushGetDataPayload(CNode* pfrom, const char* pszCommand, const CInv& inv, const T& obj, const uint256& nVersion = 0)
+{
+    boost::shared_ptr<const CDataStream> payload = getDataCache.Get(inv, nVersion);
+    if (!payload) {
+        boost::shared_ptr<CDataStream> ss(new CDataStream(SER_NETWORK, PROTOCOL_VERSION));
+        ss->reserve(1000);
+        *ss << obj;
+        payload = ss;
+        getDataCache.Add(inv, nVersion, payload);
+    }
+    pfrom->PushMessage(pszCommand, *payload);
+}
+
+/** Push an object from getDataCache only, for objects that are costly to copy out of their map */
+bool static PushCachedGetDataPayload(CNode* pfrom, const char* pszCommand, const CInv& inv, const uint256& nVersion = 0)
+{
+    boost::shared_ptr<const CDataStream> payload = getDataCache.Get(inv, nVersion);
+    if (!payload)
+        return false;
+    pfrom->PushMessage(pszCommand, *payload);
+    return true;
+}
+
 void static ProcessGetData(CNode* pfrom)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
@@ -4463,108 +4705,98 @@ void static ProcessGetData(CNode* pfrom)
                     }
                 }
                 if (!pushed && inv.type == MSG_TXLOCK_VOTE) {
-                    if (mapTxLockVote.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapTxLockVote[inv.hash];
-                        pfrom->PushMessage("txlvote", ss);
+                    map<uint256, CConsensusVote>::iterator mi = mapTxLockVote.find(inv.hash);
+                    if (mi != mapTxLockVote.end()) {
+                        PushGetDataPayload(pfrom, "txlvote", inv, mi->second);
                         pushed = true;
                     }
                 }
                 if (!pushed && inv.type == MSG_TXLOCK_REQUEST) {
-                    if (mapTxLockReq.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapTxLockReq[inv.hash];
-                        pfrom->PushMessage("ix", ss);
+                    map<uint256, CTransaction>::iterator mi = mapTxLockReq.find(inv.hash);
+                    if (mi != mapTxLockReq.end()) {
+                        PushGetDataPayload(pfrom, "ix", inv, mi->second);
                         pushed = true;
                     }
                 }
                 if (!pushed && inv.type == MSG_SPORK) {
-                    if (mapSporks.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapSporks[inv.hash];
-                        pfrom->PushMessage("spork", ss);
+                    map<uint256, CSporkMessage>::iterator mi = mapSporks.find(inv.hash);
+                    if (mi != mapSporks.end()) {
+                        PushGetDataPayload(pfrom, "spork", inv, mi->second);
                         pushed = true;
                     }
                 }
                 if (!pushed && inv.type == MSG_SERVICENODE_WINNER) {
-                    if (servicenodePayments.mapServicenodePayeeVotes.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << servicenodePayments.mapServicenodePayeeVotes[inv.hash];
-                        pfrom->PushMessage("mnw", ss);
+                    map<uint256, CServicenodePaymentWinner>::iterator mi = servicenodePayments.mapServicenodePayeeVotes.find(inv.hash);
+                    if (mi != servicenodePayments.mapServicenodePayeeVotes.end()) {
+                        PushGetDataPayload(pfrom, "mnw", inv, mi->second);
                         pushed = true;
                     }
                 }
+                // the budget messages are handled next to this one, under cs_budget
                 if (!pushed && inv.type == MSG_BUDGET_VOTE) {
-                    if (budget.mapSeenServicenodeBudgetVotes.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenServicenodeBudgetVotes[inv.hash];
-                        pfrom->PushMessage("mvote", ss);
+                    LOCK(cs_budget);
+                    map<uint256, CBudgetVote>::iterator mi = budget.mapSeenServicenodeBudgetVotes.find(inv.hash);
+                    if (mi != budget.mapSeenServicenodeBudgetVotes.end()) {
+                        PushGetDataPayload(pfrom, "mvote", inv, mi->second);
                         pushed = true;
                     }
                 }
 
                 if (!pushed && inv.type == MSG_BUDGET_PROPOSAL) {
-                    if (budget.mapSeenServicenodeBudgetProposals.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenServicenodeBudgetProposals[inv.hash];
-                        pfrom->PushMessage("mprop", ss);
+                    LOCK(cs_budget);
+                    map<uint256, CBudgetProposalBroadcast>::iterator mi = budget.mapSeenServicenodeBudgetProposals.find(inv.hash);
+                    if (mi != budget.mapSeenServicenodeBudgetProposals.end()) {
+                        PushGetDataPayload(pfrom, "mprop", inv, mi->second);
                         pushed = true;
                     }
                 }
 
                 if (!pushed && inv.type == MSG_BUDGET_FINALIZED_VOTE) {
-                    if (budget.mapSeenFinalizedBudgetVotes.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenFinalizedBudgetVotes[inv.hash];
-                        pfrom->PushMessage("fbvote", ss);
+                    LOCK(cs_budget);
+                    map<uint256, CFinalizedBudgetVote>::iterator mi = budget.mapSeenFinalizedBudgetVotes.find(inv.hash);
+                    if (mi != budget.mapSeenFinalizedBudgetVotes.end()) {
+                        PushGetDataPayload(pfrom, "fbvote", inv, mi->second);
                         pushed = true;
                     }
                 }
 
                 if (!pushed && inv.type == MSG_BUDGET_FINALIZED) {
-                    if (budget.mapSeenFinalizedBudgets.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenFinalizedBudgets[inv.hash];
-                        pfrom->PushMessage("fbs", ss);
+                    LOCK(cs_budget);
+                    map<uint256, CFinalizedBudgetBroadcast>::iterator mi = budget.mapSeenFinalizedBudgets.find(inv.hash);
+                    if (mi != budget.mapSeenFinalizedBudgets.end()) {
+                        PushGetDataPayload(pfrom, "fbs", inv, mi->second);
                         pushed = true;
                     }
                 }
 
+                // the servicenode messages are handled next to this one, under mnodeman.cs
+                // both are only copied out of mnodeman when the cache misses
                 if (!pushed && inv.type == MSG_SERVICENODE_ANNOUNCE) {
-                    if (mnodeman.mapSeenServicenodeBroadcast.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mnodeman.mapSeenServicenodeBroadcast[inv.hash];
-                        pfrom->PushMessage("mnb", ss);
-                        pushed = true;
+                    // the last ping of a broadcast is replaced in place
+                    uint256 nPingHash;
+                    if (mnodeman.GetSeenBroadcastPingHash(inv.hash, nPingHash)) {
+                        pushed = PushCachedGetDataPayload(pfrom, "mnb", inv, nPingHash);
+                        CServicenodeBroadcast mnb;
+                        if (!pushed && mnodeman.GetSeenBroadcast(inv.hash, mnb)) {
+                            PushGetDataPayload(pfrom, "mnb", inv, mnb, mnb.lastPing.GetHash());
+                            pushed = true;
+                        }
                     }
                 }
 
-                if (!pushed && inv.type == MSG_SERVICENODE_PING) {
-                    if (mnodeman.mapSeenServicenodePing.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mnodeman.mapSeenServicenodePing[inv.hash];
-                        pfrom->PushMessage("mnp", ss);
+                if (!pushed && inv.type == MSG_SERVICENODE_PING && mnodeman.IsPingSeen(inv.hash)) {
+                    pushed = PushCachedGetDataPayload(pfrom, "mnp", inv);
+                    CServicenodePing mnp;
+                    if (!pushed && mnodeman.GetSeenPing(inv.hash, mnp)) {
+                        PushGetDataPayload(pfrom, "mnp", inv, mnp);
                         pushed = true;
                     }
                 }
 
                 if (!pushed && inv.type == MSG_DSTX) {
-                    if (mapObfuscationBroadcastTxes.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapObfuscationBroadcastTxes[inv.hash].tx << mapObfuscationBroadcastTxes[inv.hash].vin << mapObfuscationBroadcastTxes[inv.hash].vchSig << mapObfuscationBroadcastTxes[inv.hash].sigTime;
-
-                        pfrom->PushMessage("dstx", ss);
+                    map<uint256, CObfuscationBroadcastTx>::iterator mi = mapObfuscationBroadcastTxes.find(inv.hash);
+                    if (mi != mapObfuscationBroadcastTxes.end()) {
+                        PushGetDataPayload(pfrom, "dstx", inv, mi->second);
                         pushed = true;
                     }
                 }
@@ -5446,13 +5678,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     else
     {
         //probably one the extensions
-        obfuScationPool.ProcessMessageObfuscation(pfrom, strCommand, vRecv);
-        mnodeman.ProcessMessage(pfrom, strCommand, vRecv);
-        budget.ProcessMessage(pfrom, strCommand, vRecv);
-        servicenodePayments.ProcessMessageServicenodePayments(pfrom, strCommand, vRecv);
-        ProcessMessageSwiftTX(pfrom, strCommand, vRecv);
-        ProcessSpork(pfrom, strCommand, vRecv);
-        servicenodeSync.ProcessMessage(pfrom, strCommand, vRecv);
+        messageDispatcher.Dispatch(pfrom, strCommand, vRecv);
     }
 
 
@@ -5469,6 +5695,10 @@ int ActiveProtocol()
     return MIN_PEER_PROTO_VERSION_BEFORE_ENFORCEMENT;
 }
 
+/** Runs the commands that are not concurrent one at a time across the handler threads.
+ *  Taken before cs_main, the handlers take cs_main themselves where they need it. */
+static CCriticalSection cs_msgproc;
+
 // requires LOCK(cs_vRecvMsg)
 bool ProcessMessages(CNode* pfrom)
 {
@@ -5491,6 +5721,9 @@ bool ProcessMessages(CNode* pfrom)
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty()) return fOk;
 
+    // recover servicenode signatures of queued messages in parallel, they are processed one by one below
+    PrecheckServicenodeSignatures(pfrom);
+
     std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
     while (!pfrom->fDisconnect && it != pfrom->vRecvMsg.end()) {
         // Don't bother if send buffer is too full to respond anyway
@@ -5543,8 +5776,16 @@ bool ProcessMessages(CNode* pfrom)
 
         // Process message
         bool fRet = false;
+        int64_t nTimeStart = GetTimeMicros();
         try {
-            fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
+            // messages of a peer without a version are rejected by ProcessMessage under cs_msgproc
+            if (pfrom->nVersion != 0 && messageDispatcher.IsConcurrent(strCommand)) {
+                fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
+            } else {
+                // the handler threads run these one at a time
+                LOCK(cs_msgproc);
+                fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
+            }
             boost::this_thread::interruption_point();
         } catch (std::ios_base::failure& e) {
             pfrom->PushMessage("reject", strCommand, REJECT_MALFORMED, string("error parsing message"));
@@ -5564,6 +5805,7 @@ bool ProcessMessages(CNode* pfrom)
         } catch (...) {
             PrintExceptionContinue(NULL, "ProcessMessages()");
         }
+        messageDispatcher.Record(strCommand, nMessageSize, GetTimeMicros() - nTimeStart);
 
         if (!fRet)
             LogPrintf("ProcessMessage(%s, %u bytes) FAILED peer=%d\n", SanitizeString(strCommand), nMessageSize, pfrom->id);
@@ -5872,9 +6114,6 @@ public:
     ~CMainCleanup()
     {
         // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
         mapBlockIndex.clear();
 
         // orphan transactions
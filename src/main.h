@@ -13,6 +13,7 @@
 #endif
 
 #include "amount.h"
+#include "blockindexmap.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "coins.h"
@@ -92,6 +93,10 @@ static const unsigned int MAX_HEADERS_RESULTS = 2000;
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
  *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** Maximum number of blocks LoadExternalBlockFile reads ahead to check them in parallel. */
+static const unsigned int PRECHECK_BATCH_BLOCKS = 128;
+/** Maximum total size of the blocks read ahead by LoadExternalBlockFile. */
+static const unsigned int PRECHECK_BATCH_SIZE = 8 * MAX_BLOCK_SIZE;
 /** Time to wait (in seconds) between writing blockchain state to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 3600;
 /** Maximum length of reject messages. */
@@ -107,14 +112,10 @@ static const unsigned char REJECT_DUST = 0x41;
 static const unsigned char REJECT_INSUFFICIENTFEE = 0x42;
 static const unsigned char REJECT_CHECKPOINT = 0x43;
 
-struct BlockHasher {
-    size_t operator()(const uint256& hash) const { return hash.GetLow64(); }
-};
-
 extern CScript COINBASE_FLAGS;
 extern CCriticalSection cs_main;
 extern CTxMemPool mempool;
-typedef boost::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
+typedef CBlockIndexMap BlockMap;
 extern BlockMap mapBlockIndex;
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockSize;
@@ -184,6 +185,8 @@ FILE* OpenBlockFile(const CDiskBlockPos& pos, bool fReadOnly = false);
 FILE* OpenUndoFile(const CDiskBlockPos& pos, bool fReadOnly = false);
 /** Translation to a filesystem path */
 boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos& pos, const char* prefix);
+/** Run the context-free checks of CheckBlock on several threads, so later CheckBlock calls skip them */
+void PreCheckBlocks(const std::vector<CBlock>& vBlocks);
 /** Import blocks from an external file */
 bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp = NULL);
 /** Initialize a new block tree database + block data on disk */
@@ -205,6 +208,8 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the block pre-check thread */
+void ThreadBlockPreCheck();
 
 // ***TODO*** probably not the right place for these 2
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
@@ -406,6 +411,28 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure running the context-free checks of CheckBlock on a block read
+ * ahead by LoadExternalBlockFile. A block that fails is left unmarked and
+ * checked again when it is connected, so the closure always succeeds.
+ */
+class CBlockPreCheck
+{
+private:
+    const CBlock* pblock;
+
+public:
+    CBlockPreCheck() : pblock(NULL) {}
+    CBlockPreCheck(const CBlock& blockIn) : pblock(&blockIn) {}
+
+    bool operator()();
+
+    void swap(CBlockPreCheck& check)
+    {
+        std::swap(pblock, check.pblock);
+    }
+};
+
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos);
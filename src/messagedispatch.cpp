@@ -0,0 +1,113 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "messagedispatch.h"
+#include "streams.h"
+
+CMessageDispatcher messageDispatcher;
+
+CMessageStats::CMessageStats()
+{
+    nCount = 0;
+    nBytes = 0;
+    nTimeTotal = 0;
+    nTimeMax = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+        vHistogram[i] = 0;
+    nBuffers = 0;
+    nBuffersReused = 0;
+}
+
+void CMessageStats::Add(unsigned int nMessageSize, int64_t nTime)
+{
+    nCount++;
+    nBytes += nMessageSize;
+    nTimeTotal += nTime;
+    if (nTime > nTimeMax)
+        nTimeMax = nTime;
+    vHistogram[GetBucket(nTime)]++;
+}
+
+int CMessageStats::GetBucket(int64_t nTime)
+{
+    int nBucket = 0;
+    for (int64_t nLimit = 10; nBucket < HISTOGRAM_BUCKETS - 1 && nTime >= nLimit; nLimit *= 10)
+        nBucket++;
+    return nBucket;
+}
+
+std::string CMessageStats::GetBucketName(int nBucket)
+{
+    static const char* ppszBucketNames[HISTOGRAM_BUCKETS] = {"<10us", "<100us", "<1ms", "<10ms", "<100ms", "<1s", ">=1s"};
+    return ppszBucketNames[nBucket];
+}
+
+void CMessageDispatcher::Register(const std::string& strCommand, const Handler& handler, bool fConcurrent)
+{
+    LOCK(cs);
+    CCommand& command = mapCommands[strCommand];
+    command.handler = handler;
+    command.fConcurrent = fConcurrent;
+}
+
+bool CMessageDispatcher::IsRegistered(const std::string& strCommand) const
+{
+    LOCK(cs);
+    return mapCommands.count(strCommand);
+}
+
+bool CMessageDispatcher::IsConcurrent(const std::string& strCommand) const
+{
+    LOCK(cs);
+    boost::unordered_map<std::string, CCommand>::const_iterator it = mapCommands.find(strCommand);
+    return it != mapCommands.end() && it->second.fConcurrent;
+}
+
+bool CMessageDispatcher::Dispatch(CNode* pfrom, std::string& strCommand, CDataStream& vRecv) const
+{
+    Handler handler;
+    {
+        LOCK(cs);
+        boost::unordered_map<std::string, CCommand>::const_iterator it = mapCommands.find(strCommand);
+        if (it == mapCommands.end() || it->second.handler.empty())
+            return false;
+        handler = it->second.handler;
+    }
+
+    handler(pfrom, strCommand, vRecv);
+    return true;
+}
+
+void CMessageDispatcher::Record(const std::string& strCommand, unsigned int nMessageSize, int64_t nTime)
+{
+    LOCK(cs);
+    boost::unordered_map<std::string, CCommand>::iterator it = mapCommands.find(strCommand);
+    if (it != mapCommands.end())
+        it->second.stats.Add(nMessageSize, nTime);
+    else
+        statsUnknown.Add(nMessageSize, nTime);
+}
+
+void CMessageDispatcher::RecordBuffer(const std::string& strCommand, bool fReused)
+{
+    LOCK(cs);
+    boost::unordered_map<std::string, CCommand>::iterator it = mapCommands.find(strCommand);
+    CMessageStats& stats = it != mapCommands.end() ? it->second.stats : statsUnknown;
+    stats.nBuffers++;
+    if (fReused)
+        stats.nBuffersReused++;
+}
+
+std::map<std::string, CMessageStats> CMessageDispatcher::GetStats() const
+{
+    LOCK(cs);
+    std::map<std::string, CMessageStats> mapStats;
+    for (boost::unordered_map<std::string, CCommand>::const_iterator it = mapCommands.begin(); it != mapCommands.end(); ++it) {
+        if (it->second.stats.nCount || it->second.stats.nBuffers)
+            mapStats[it->first] = it->second.stats;
+    }
+    if (statsUnknown.nCount || statsUnknown.nBuffers)
+        mapStats["unknown"] = statsUnknown;
+    return mapStats;
+}
@@ -0,0 +1,88 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef MESSAGEDISPATCH_H
+#define MESSAGEDISPATCH_H
+
+#include "sync.h"
+
+#include <map>
+#include <stdint.h>
+#include <string>
+
+#include <boost/function.hpp>
+#include <boost/unordered_map.hpp>
+
+class CDataStream;
+class CNode;
+
+/** Counters of the messages received for one P2P command
+ */
+class CMessageStats
+{
+public:
+    // processing time below 10us, 100us, 1ms, 10ms, 100ms, 1s, and 1s or more
+    static const int HISTOGRAM_BUCKETS = 7;
+
+    uint64_t nCount;
+    uint64_t nBytes;
+    // microseconds
+    int64_t nTimeTotal;
+    int64_t nTimeMax;
+    uint64_t vHistogram[HISTOGRAM_BUCKETS];
+    // payload buffers taken from the buffer pool, and how many of them were recycled
+    uint64_t nBuffers;
+    uint64_t nBuffersReused;
+
+    CMessageStats();
+
+    void Add(unsigned int nMessageSize, int64_t nTime);
+    static int GetBucket(int64_t nTime);
+    static std::string GetBucketName(int nBucket);
+};
+
+/** Routes P2P commands to the handler registered for them and keeps statistics per command.
+ *  Handlers are registered at startup, before the message handler threads run. Commands run
+ *  under cs_msgproc, one at a time across the handler threads, unless they are registered as
+ *  concurrent: those only touch the sending peer and state with its own lock. Both kinds take
+ *  cs_main themselves where they read the chain.
+ */
+class CMessageDispatcher
+{
+public:
+    typedef boost::function<void(CNode*, std::string&, CDataStream&)> Handler;
+
+private:
+    struct CCommand {
+        Handler handler;
+        bool fConcurrent;
+        CMessageStats stats;
+
+        CCommand() : fConcurrent(false) {}
+    };
+
+    mutable CCriticalSection cs;
+    boost::unordered_map<std::string, CCommand> mapCommands;
+    // commands nobody registered, kept apart so peers cannot grow mapCommands
+    CMessageStats statsUnknown;
+
+public:
+    /// Register the handler of a command. Commands handled by ProcessMessage itself are registered without one, for their statistics.
+    void Register(const std::string& strCommand, const Handler& handler = Handler(), bool fConcurrent = false);
+    /// Whether a command was registered, with or without a handler
+    bool IsRegistered(const std::string& strCommand) const;
+    /// Whether a command may run without cs_msgproc, next to other commands
+    bool IsConcurrent(const std::string& strCommand) const;
+    /// Run the handler of a command, returns false when it has none
+    bool Dispatch(CNode* pfrom, std::string& strCommand, CDataStream& vRecv) const;
+    /// Account a processed message
+    void Record(const std::string& strCommand, unsigned int nMessageSize, int64_t nTime);
+    /// Account a payload buffer taken for a message being received
+    void RecordBuffer(const std::string& strCommand, bool fReused);
+    /// Statistics of the commands received so far, unregistered commands are summed up as "unknown"
+    std::map<std::string, CMessageStats> GetStats() const;
+};
+
+extern CMessageDispatcher messageDispatcher;
+
+#endif
@@ -387,6 +387,7 @@ void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int&
 
     pblock->vtx[0] = txCoinbase;
     pblock->hashMerkleRoot = pblock->BuildMerkleTree();
+    pblock->InvalidateHash();
 }
 
 #ifdef ENABLE_WALLET
@@ -529,7 +530,8 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
 
             uint256 hash;
             while (true) {
-                hash = pblock->GetHash();
+                // every try has another nonce, so hash the header without the cache of CBlock
+                hash = pblock->CBlockHeader::GetHash();
                 if (hash <= hashTarget) {
                     // Found a solution
                     SetThreadPriority(THREAD_PRIORITY_NORMAL);
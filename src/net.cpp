@@ -12,18 +12,26 @@
 #include "net.h"
 
 #include "addrman.h"
+#include "bufferpool.h"
 #include "chainparams.h"
 #include "clientversion.h"
+#include "messagedispatch.h"
 #include "miner.h"
 #include "obfuscation.h"
 #include "primitives/transaction.h"
 #include "ui_interface.h"
 #include "wallet.h"
+#include "workqueue.h"
 
 #ifdef WIN32
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
+#endif
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
 #endif
 
 #ifdef USE_UPNP
@@ -86,11 +94,25 @@ CAddrMan addrman;
 int nMaxConnections = 125;
 bool fAddressesInitialized = false;
 
+SocketEventsMode socketEventsMode = SOCKETEVENTS_SELECT;
+#ifdef HAVE_SYS_EPOLL_H
+static const int SOCKET_READY_RECV = 1;
+static const int SOCKET_READY_SEND = 2;
+
+static int hEpoll = -1;
+// nodes whose socket is in hEpoll, protected by cs_vNodes
+static std::set<CNode*> setNodesRegistered;
+// readiness reported by hEpoll and not used up yet, only touched by the socket thread
+static std::map<CNode*, int> mapNodesReady;
+static bool fListenReady = false;
+#endif
+
 vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
 map<CInv, CDataStream> mapRelay;
 deque<pair<int64_t, CInv> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
+CGetDataCache getDataCache;
 limitedmap<CInv, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
 
 static deque<string> vOneShots;
@@ -108,10 +130,45 @@ CCriticalSection cs_nLastNodeId;
 static CSemaphore* semOutbound = NULL;
 boost::condition_variable messageHandlerCondition;
 
+int nMessageHandlerThreads = DEFAULT_MSGHANDLER_THREADS;
+bool fBatchSends = DEFAULT_BATCHSENDS;
+bool fSwiftTXInv = DEFAULT_SWIFTTX_INV;
+// peers waiting for a message handler thread, each queued peer holds a reference
+static CSerialWorkQueue<CNode*> messageQueue;
+// the peer that trickles its inventory in this round, cleared once it did
+static CNode* pnodeTrickle = NULL;
+static CCriticalSection cs_pnodeTrickle;
+
 // Signals for message handling
 static CNodeSignals g_signals;
 CNodeSignals& GetNodeSignals() { return g_signals; }
 
+// requires LOCK(cs_vNodes)
+static void RegisterNodeSocket(CNode* pnode)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (socketEventsMode != SOCKETEVENTS_EPOLL || pnode->hSocket == INVALID_SOCKET)
+        return;
+
+    // edge-triggered: an event is reported once per change, the socket thread remembers it until recv/send would block
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = pnode;
+    if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, pnode->hSocket, &event) == SOCKET_ERROR) {
+        LogPrintf("epoll_ctl failed for peer=%d: %s\n", pnode->id, NetworkErrorString(WSAGetLastError()));
+        pnode->fDisconnect = true;
+        return;
+    }
+    setNodesRegistered.insert(pnode);
+#endif
+}
+
+static bool IsUsableSocket(SOCKET hSocket)
+{
+    // epoll has no limit on the descriptor number
+    return socketEventsMode != SOCKETEVENTS_SELECT || IsSelectableSocket(hSocket);
+}
+
 void AddOneShot(string strDest)
 {
     LOCK(cs_vOneShots);
@@ -404,7 +461,7 @@ CNode* ConnectNode(CAddress addrConnect, const char* pszDest, bool obfuScationMa
     bool proxyConnectionFailed = false;
     if (pszDest ? ConnectSocketByName(addrConnect, hSocket, pszDest, Params().GetDefaultPort(), nConnectTimeout, &proxyConnectionFailed) :
                   ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed)) {
-        if (!IsSelectableSocket(hSocket)) {
+        if (!IsUsableSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return NULL;
@@ -419,6 +476,7 @@ CNode* ConnectNode(CAddress addrConnect, const char* pszDest, bool obfuScationMa
         {
             LOCK(cs_vNodes);
             vNodes.push_back(pnode);
+            RegisterNodeSocket(pnode);
         }
 
         pnode->nTimeConnected = GetTime();
@@ -536,6 +594,17 @@ void CNode::copyStats(CNodeStats& stats)
     X(nStartingHeight);
     X(nSendBytes);
     X(nRecvBytes);
+    X(nSendMsgs);
+    X(nSendCalls);
+    X(nRecvCalls);
+    {
+        LOCK(cs_mapRecvBytesPerCmd);
+        X(mapRecvBytesPerCmd);
+    }
+    {
+        LOCK(cs_mapSendBytesPerCmd);
+        X(mapSendBytesPerCmd);
+    }
     X(fWhitelisted);
 
     // It is common for nodes with good ping times to suddenly become lagged,
@@ -589,6 +658,12 @@ bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes)
 
         if (msg.complete()) {
             msg.nTime = GetTimeMicros();
+            // commands nobody registered are summed up, so peers cannot grow the map
+            std::string strCommand = msg.hdr.GetCommand();
+            if (!messageDispatcher.IsRegistered(strCommand))
+                strCommand = "unknown";
+            LOCK(cs_mapRecvBytesPerCmd);
+            mapRecvBytesPerCmd[strCommand] += CMessageHeader::HEADER_SIZE + msg.hdr.nMessageSize;
             messageHandlerCondition.notify_one();
         }
     }
@@ -596,6 +671,14 @@ bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes)
     return true;
 }
 
+CNetMessage::~CNetMessage()
+{
+    // the payload buffer goes to the pool of the thread dropping the message
+    CSerializeData data;
+    vRecv.swap(data);
+    GetBufferPool().Release(data);
+}
+
 int CNetMessage::readHeader(const char* pch, unsigned int nBytes)
 {
     // copy data to temporary parsing buffer
@@ -631,38 +714,78 @@ int CNetMessage::readData(const char* pch, unsigned int nBytes)
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
-    if (vRecv.size() < nDataPos + nCopy) {
-        // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+    if (vRecv.capacity() < nDataPos + nCopy) {
+        // Take a pooled buffer for up to 256 KiB ahead, but never more than the total message size.
+        CSerializeData data;
+        bool fReused = GetBufferPool().Acquire(data, std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+        data.insert(data.end(), vRecv.begin(), vRecv.end());
+        vRecv.swap(data);
+        GetBufferPool().Release(data);
+        messageDispatcher.RecordBuffer(hdr.GetCommand(), fReused);
     }
 
-    memcpy(&vRecv[nDataPos], pch, nCopy);
+    // appended within the capacity, so the payload is neither zeroed first nor moved later
+    vRecv.write(pch, nCopy);
     nDataPos += nCopy;
 
     return nCopy;
 }
 
 
+#ifndef WIN32
+/** Messages gathered into one sendmsg() call */
+static const int SEND_IOV_MAX = 64;
+#endif
+
+// requires LOCK(cs_vSend), writes as much of the queue as the socket takes from it
+static int SendQueuedData(CNode* pnode, std::deque<CSerializeData>::iterator it)
+{
+#ifdef WIN32
+    const CSerializeData& data = *it;
+    return send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+    struct iovec vIov[SEND_IOV_MAX];
+    int nIov = 0;
+    for (size_t nOffset = pnode->nSendOffset; it != pnode->vSendMsg.end() && nIov < SEND_IOV_MAX; ++it, nOffset = 0) {
+        vIov[nIov].iov_base = &(*it)[nOffset];
+        vIov[nIov].iov_len = it->size() - nOffset;
+        nIov++;
+    }
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = vIov;
+    msg.msg_iovlen = nIov;
+    return sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
+}
+
 // requires LOCK(cs_vSend)
 void SocketSendData(CNode* pnode)
 {
     std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
 
     while (it != pnode->vSendMsg.end()) {
-        const CSerializeData& data = *it;
-        assert(data.size() > pnode->nSendOffset);
-        int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+        assert(it->size() > pnode->nSendOffset);
+        int nBytes = SendQueuedData(pnode, it);
+        pnode->nSendCalls++;
         if (nBytes > 0) {
             pnode->nLastSend = GetTime();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             pnode->RecordBytesSent(nBytes);
-            if (pnode->nSendOffset == data.size()) {
+
+            // step over the messages that were written completely
+            size_t nLeft = nBytes;
+            while (it != pnode->vSendMsg.end() && nLeft >= it->size() - pnode->nSendOffset) {
+                nLeft -= it->size() - pnode->nSendOffset;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
+                pnode->nSendSize -= it->size();
+                pnode->nSendMsgs++;
                 it++;
-            } else {
+            }
+            if (nLeft > 0) {
                 // could not send full message; stop sending more
+                pnode->nSendOffset += nLeft;
                 break;
             }
         } else {
@@ -683,284 +806,460 @@ void SocketSendData(CNode* pnode)
         assert(pnode->nSendOffset == 0);
         assert(pnode->nSendSize == 0);
     }
+    for (std::deque<CSerializeData>::iterator itSent = pnode->vSendMsg.begin(); itSent != it; ++itSent)
+        GetBufferPool().Release(*itSent);
     pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
 }
 
 static list<CNode*> vNodesDisconnected;
 
-void ThreadSocketHandler()
+static void DisconnectNodes(unsigned int& nPrevNodeCount)
 {
-    unsigned int nPrevNodeCount = 0;
-    while (true) {
-        //
-        // Disconnect nodes
-        //
-        {
-            LOCK(cs_vNodes);
-            // Disconnect unused nodes
-            vector<CNode*> vNodesCopy = vNodes;
-            BOOST_FOREACH (CNode* pnode, vNodesCopy) {
-                if (pnode->fDisconnect ||
-                    (pnode->GetRefCount() <= 0 && pnode->vRecvMsg.empty() && pnode->nSendSize == 0 && pnode->ssSend.empty())) {
-                    // remove from vNodes
-                    vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
+    //
+    // Disconnect nodes
+    //
+    {
+        LOCK(cs_vNodes);
+        // Disconnect unused nodes
+        vector<CNode*> vNodesCopy = vNodes;
+        BOOST_FOREACH (CNode* pnode, vNodesCopy) {
+            if (pnode->fDisconnect ||
+                (pnode->GetRefCount() <= 0 && pnode->vRecvMsg.empty() && pnode->nSendSize == 0 && pnode->ssSend.empty())) {
+                // remove from vNodes
+                vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
 
-                    // release outbound grant (if any)
-                    pnode->grantOutbound.Release();
+                // release outbound grant (if any)
+                pnode->grantOutbound.Release();
 
-                    // close socket and cleanup
-                    pnode->CloseSocketDisconnect();
+                // close socket and cleanup, closing also removes it from hEpoll
+                pnode->CloseSocketDisconnect();
 
-                    // hold in disconnected pool until all refs are released
-                    if (pnode->fNetworkNode || pnode->fInbound)
-                        pnode->Release();
-                    vNodesDisconnected.push_back(pnode);
-                }
+                // hold in disconnected pool until all refs are released
+                if (pnode->fNetworkNode || pnode->fInbound)
+                    pnode->Release();
+                vNodesDisconnected.push_back(pnode);
             }
         }
-        {
-            // Delete disconnected nodes
-            list<CNode*> vNodesDisconnectedCopy = vNodesDisconnected;
-            BOOST_FOREACH (CNode* pnode, vNodesDisconnectedCopy) {
-                // wait until threads are done using it
-                if (pnode->GetRefCount() <= 0) {
-                    bool fDelete = false;
-                    {
-                        TRY_LOCK(pnode->cs_vSend, lockSend);
-                        if (lockSend) {
-                            TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                            if (lockRecv) {
-                                TRY_LOCK(pnode->cs_inventory, lockInv);
-                                if (lockInv)
-                                    fDelete = true;
-                            }
+    }
+    {
+        // Delete disconnected nodes
+        list<CNode*> vNodesDisconnectedCopy = vNodesDisconnected;
+        BOOST_FOREACH (CNode* pnode, vNodesDisconnectedCopy) {
+            // wait until threads are done using it
+            if (pnode->GetRefCount() <= 0) {
+                bool fDelete = false;
+                {
+                    TRY_LOCK(pnode->cs_vSend, lockSend);
+                    if (lockSend) {
+                        TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                        if (lockRecv) {
+                            TRY_LOCK(pnode->cs_inventory, lockInv);
+                            if (lockInv)
+                                fDelete = true;
                         }
                     }
-                    if (fDelete) {
-                        vNodesDisconnected.remove(pnode);
-                        delete pnode;
+                }
+                if (fDelete) {
+                    vNodesDisconnected.remove(pnode);
+#ifdef HAVE_SYS_EPOLL_H
+                    {
+                        LOCK(cs_vNodes);
+                        setNodesRegistered.erase(pnode);
                     }
+                    mapNodesReady.erase(pnode);
+#endif
+                    delete pnode;
                 }
             }
         }
-        if (vNodes.size() != nPrevNodeCount) {
-            nPrevNodeCount = vNodes.size();
-            uiInterface.NotifyNumConnectionsChanged(nPrevNodeCount);
-        }
+    }
+    if (vNodes.size() != nPrevNodeCount) {
+        nPrevNodeCount = vNodes.size();
+        uiInterface.NotifyNumConnectionsChanged(nPrevNodeCount);
+    }
+}
 
-        //
-        // Find which sockets have data to receive
-        //
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
+// returns false when there is no connection left to accept
+static bool AcceptConnection(const ListenSocket& hListenSocket)
+{
+    struct sockaddr_storage sockaddr;
+    socklen_t len = sizeof(sockaddr);
+    SOCKET hSocket = accept(hListenSocket.socket, (struct sockaddr*)&sockaddr, &len);
+    CAddress addr;
+    int nInbound = 0;
 
-        BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
+    if (hSocket == INVALID_SOCKET) {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK)
+            LogPrintf("socket error accept failed: %s\n", NetworkErrorString(nErr));
+        return false;
+    }
+
+    if (!addr.SetSockAddr((const struct sockaddr*)&sockaddr))
+        LogPrintf("Warning: Unknown socket family\n");
+
+    bool whitelisted = hListenSocket.whitelisted || CNode::IsWhitelistedRange(addr);
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH (CNode* pnode, vNodes)
+            if (pnode->fInbound)
+                nInbound++;
+    }
+
+    if (!IsUsableSocket(hSocket)) {
+        LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
+        CloseSocket(hSocket);
+    } else if (nInbound >= nMaxConnections - MAX_OUTBOUND_CONNECTIONS) {
+        LogPrint("net", "connection from %s dropped (full)\n", addr.ToString());
+        CloseSocket(hSocket);
+    } else if (CNode::IsBanned(addr) && !whitelisted) {
+        LogPrintf("connection from %s dropped (banned)\n", addr.ToString());
+        CloseSocket(hSocket);
+    } else {
+        CNode* pnode = new CNode(hSocket, addr, "", true);
+        pnode->AddRef();
+        pnode->fWhitelisted = whitelisted;
 
         {
             LOCK(cs_vNodes);
-            BOOST_FOREACH (CNode* pnode, vNodes) {
-                if (pnode->hSocket == INVALID_SOCKET)
+            vNodes.push_back(pnode);
+            RegisterNodeSocket(pnode);
+        }
+    }
+    return true;
+}
+
+// requires LOCK(cs_vRecvMsg), returns true when the socket may hold more data
+static bool ReceiveSocketData(CNode* pnode)
+{
+    // typical socket buffer is 8K-64K
+    char pchBuf[0x10000];
+    int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+    pnode->nRecvCalls++;
+    if (nBytes > 0) {
+        if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
+            pnode->CloseSocketDisconnect();
+        pnode->nLastRecv = GetTime();
+        pnode->nRecvBytes += nBytes;
+        pnode->RecordBytesRecv(nBytes);
+        // a short read emptied the socket buffer, data arriving later is reported again
+        return nBytes == sizeof(pchBuf);
+    } else if (nBytes == 0) {
+        // socket closed gracefully
+        if (!pnode->fDisconnect)
+            LogPrint("net", "socket closed\n");
+        pnode->CloseSocketDisconnect();
+    } else if (nBytes < 0) {
+        // error
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
+            if (!pnode->fDisconnect)
+                LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
+            pnode->CloseSocketDisconnect();
+        }
+    }
+    return false;
+}
+
+static void InactivityCheck(CNode* pnode)
+{
+    int64_t nTime = GetTime();
+    if (nTime - pnode->nTimeConnected > 60) {
+        if (pnode->nLastRecv == 0 || pnode->nLastSend == 0) {
+            LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
+            pnode->fDisconnect = true;
+        } else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL) {
+            LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
+            pnode->fDisconnect = true;
+        } else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90 * 60)) {
+            LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
+            pnode->fDisconnect = true;
+        } else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros()) {
+            LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
+            pnode->fDisconnect = true;
+        }
+    }
+}
+
+static void SocketHandlerSelect()
+{
+    //
+    // Find which sockets have data to receive
+    //
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 50000; // frequency to poll pnode->vSend
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+
+    BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
+        FD_SET(hListenSocket.socket, &fdsetRecv);
+        hSocketMax = max(hSocketMax, hListenSocket.socket);
+        have_fds = true;
+    }
+
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH (CNode* pnode, vNodes) {
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            FD_SET(pnode->hSocket, &fdsetError);
+            hSocketMax = max(hSocketMax, pnode->hSocket);
+            have_fds = true;
+
+            // Implement the following logic:
+            // * If there is data to send, select() for sending data. As this only
+            //   happens when optimistic write failed, we choose to first drain the
+            //   write buffer in this case before receiving more. This avoids
+            //   needlessly queueing received data, if the remote peer is not themselves
+            //   receiving data. This means properly utilizing TCP flow control signalling.
+            // * Otherwise, if there is no (complete) message in the receive buffer,
+            //   or there is space left in the buffer, select() for receiving data.
+            // * (if neither of the above applies, there is certainly one message
+            //   in the receiver buffer ready to be processed).
+            // Together, that means that at least one of the following is always possible,
+            // so we don't deadlock:
+            // * We send some data.
+            // * We wait for data to be received (and disconnect after timeout).
+            // * We process a message in the buffer (message handler thread).
+            {
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                if (lockSend && !pnode->vSendMsg.empty()) {
+                    FD_SET(pnode->hSocket, &fdsetSend);
                     continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
-                // * (if neither of the above applies, there is certainly one message
-                //   in the receiver buffer ready to be processed).
-                // Together, that means that at least one of the following is always possible,
-                // so we don't deadlock:
-                // * We send some data.
-                // * We wait for data to be received (and disconnect after timeout).
-                // * We process a message in the buffer (message handler thread).
-                {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                        continue;
-                    }
-                }
-                {
-                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                                        pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
                 }
             }
+            {
+                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                if (lockRecv && (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+                                    pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
+                    FD_SET(pnode->hSocket, &fdsetRecv);
+            }
+        }
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+        &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    boost::this_thread::interruption_point();
+
+    if (nSelect == SOCKET_ERROR) {
+        if (have_fds) {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (unsigned int i = 0; i <= hSocketMax; i++)
+                FD_SET(i, &fdsetRecv);
         }
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        MilliSleep(timeout.tv_usec / 1000);
+    }
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-            &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    //
+    // Accept new connections
+    //
+    BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
+        if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            AcceptConnection(hListenSocket);
+    }
+
+    //
+    // Service each socket
+    //
+    vector<CNode*> vNodesCopy;
+    {
+        LOCK(cs_vNodes);
+        vNodesCopy = vNodes;
+        BOOST_FOREACH (CNode* pnode, vNodesCopy)
+            pnode->AddRef();
+    }
+    BOOST_FOREACH (CNode* pnode, vNodesCopy) {
         boost::this_thread::interruption_point();
 
-        if (nSelect == SOCKET_ERROR) {
-            if (have_fds) {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec / 1000);
+        //
+        // Receive
+        //
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+        if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError)) {
+            TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+            if (lockRecv)
+                ReceiveSocketData(pnode);
         }
 
         //
-        // Accept new connections
+        // Send
         //
-        BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv)) {
-                struct sockaddr_storage sockaddr;
-                socklen_t len = sizeof(sockaddr);
-                SOCKET hSocket = accept(hListenSocket.socket, (struct sockaddr*)&sockaddr, &len);
-                CAddress addr;
-                int nInbound = 0;
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+        if (FD_ISSET(pnode->hSocket, &fdsetSend)) {
+            TRY_LOCK(pnode->cs_vSend, lockSend);
+            if (lockSend)
+                SocketSendData(pnode);
+        }
 
-                if (hSocket != INVALID_SOCKET)
-                    if (!addr.SetSockAddr((const struct sockaddr*)&sockaddr))
-                        LogPrintf("Warning: Unknown socket family\n");
+        //
+        // Inactivity checking
+        //
+        InactivityCheck(pnode);
+    }
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH (CNode* pnode, vNodesCopy)
+            pnode->Release();
+    }
+}
 
-                bool whitelisted = hListenSocket.whitelisted || CNode::IsWhitelistedRange(addr);
-                {
-                    LOCK(cs_vNodes);
-                    BOOST_FOREACH (CNode* pnode, vNodes)
-                        if (pnode->fInbound)
-                            nInbound++;
-                }
+#ifdef HAVE_SYS_EPOLL_H
+static void SocketHandlerEpoll()
+{
+    static int64_t nLastInactivityCheck = 0;
+    static bool fMoreData = false;
+
+    //
+    // Wait for sockets changing state, unless some are known to hold more data
+    //
+    struct epoll_event vEvents[256];
+    int nEvents = epoll_wait(hEpoll, vEvents, sizeof(vEvents) / sizeof(vEvents[0]), fMoreData ? 0 : 50);
+    boost::this_thread::interruption_point();
 
-                if (hSocket == INVALID_SOCKET) {
-                    int nErr = WSAGetLastError();
-                    if (nErr != WSAEWOULDBLOCK)
-                        LogPrintf("socket error accept failed: %s\n", NetworkErrorString(nErr));
-                } else if (!IsSelectableSocket(hSocket)) {
-                    LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
-                    CloseSocket(hSocket);
-                } else if (nInbound >= nMaxConnections - MAX_OUTBOUND_CONNECTIONS) {
-                    LogPrint("net", "connection from %s dropped (full)\n", addr.ToString());
-                    CloseSocket(hSocket);
-                } else if (CNode::IsBanned(addr) && !whitelisted) {
-                    LogPrintf("connection from %s dropped (banned)\n", addr.ToString());
-                    CloseSocket(hSocket);
-                } else {
-                    CNode* pnode = new CNode(hSocket, addr, "", true);
-                    pnode->AddRef();
-                    pnode->fWhitelisted = whitelisted;
+    if (nEvents == SOCKET_ERROR) {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR) {
+            LogPrintf("socket epoll error %s\n", NetworkErrorString(nErr));
+            MilliSleep(50);
+        }
+        nEvents = 0;
+    }
 
-                    {
-                        LOCK(cs_vNodes);
-                        vNodes.push_back(pnode);
-                    }
-                }
+    vector<CNode*> vNodesReady;
+    {
+        LOCK(cs_vNodes);
+        for (int i = 0; i < nEvents; i++) {
+            if (vEvents[i].data.ptr == NULL) {
+                fListenReady = true;
+                continue;
             }
+            // an event may still be in flight for a node whose socket another thread just closed
+            CNode* pnode = (CNode*)vEvents[i].data.ptr;
+            if (!setNodesRegistered.count(pnode))
+                continue;
+            int& nReady = mapNodesReady[pnode];
+            if (vEvents[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                nReady |= SOCKET_READY_RECV;
+            if (vEvents[i].events & EPOLLOUT)
+                nReady |= SOCKET_READY_SEND;
+        }
+        for (std::map<CNode*, int>::iterator it = mapNodesReady.begin(); it != mapNodesReady.end(); ++it) {
+            it->first->AddRef();
+            vNodesReady.push_back(it->first);
         }
+    }
 
-        //
-        // Service each socket
-        //
-        vector<CNode*> vNodesCopy;
-        {
-            LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            BOOST_FOREACH (CNode* pnode, vNodesCopy)
-                pnode->AddRef();
+    //
+    // Accept new connections, until the backlog is empty
+    //
+    if (fListenReady) {
+        fListenReady = false;
+        BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
+            if (hListenSocket.socket != INVALID_SOCKET)
+                while (AcceptConnection(hListenSocket)) {}
         }
-        BOOST_FOREACH (CNode* pnode, vNodesCopy) {
-            boost::this_thread::interruption_point();
+    }
 
-            //
-            // Receive
-            //
-            if (pnode->hSocket == INVALID_SOCKET)
-                continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError)) {
-                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                if (lockRecv) {
-                    {
-                        // typical socket buffer is 8K-64K
-                        char pchBuf[0x10000];
-                        int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
-                        if (nBytes > 0) {
-                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
-                                pnode->CloseSocketDisconnect();
-                            pnode->nLastRecv = GetTime();
-                            pnode->nRecvBytes += nBytes;
-                            pnode->RecordBytesRecv(nBytes);
-                        } else if (nBytes == 0) {
-                            // socket closed gracefully
-                            if (!pnode->fDisconnect)
-                                LogPrint("net", "socket closed\n");
-                            pnode->CloseSocketDisconnect();
-                        } else if (nBytes < 0) {
-                            // error
-                            int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
-                                if (!pnode->fDisconnect)
-                                    LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
-                                pnode->CloseSocketDisconnect();
-                            }
-                        }
-                    }
-                }
+    //
+    // Service the sockets that reported readiness, with the same flow control as the select loop
+    //
+    fMoreData = false;
+    BOOST_FOREACH (CNode* pnode, vNodesReady) {
+        boost::this_thread::interruption_point();
+
+        int& nReady = mapNodesReady[pnode];
+        if (pnode->hSocket == INVALID_SOCKET) {
+            nReady = 0;
+            continue;
+        }
+
+        if (nReady & SOCKET_READY_SEND) {
+            TRY_LOCK(pnode->cs_vSend, lockSend);
+            if (lockSend) {
+                // whatever is left waits for the next EPOLLOUT, the socket buffer is full
+                SocketSendData(pnode);
+                nReady &= ~SOCKET_READY_SEND;
             }
+        }
 
-            //
-            // Send
-            //
-            if (pnode->hSocket == INVALID_SOCKET)
-                continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend)) {
+        if (nReady & SOCKET_READY_RECV) {
+            {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
-                if (lockSend)
-                    SocketSendData(pnode);
+                if (lockSend && !pnode->vSendMsg.empty())
+                    continue;
             }
-
-            //
-            // Inactivity checking
-            //
-            int64_t nTime = GetTime();
-            if (nTime - pnode->nTimeConnected > 60) {
-                if (pnode->nLastRecv == 0 || pnode->nLastSend == 0) {
-                    LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
-                    pnode->fDisconnect = true;
-                } else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL) {
-                    LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
-                    pnode->fDisconnect = true;
-                } else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90 * 60)) {
-                    LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
-                    pnode->fDisconnect = true;
-                } else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros()) {
-                    LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
-                    pnode->fDisconnect = true;
-                }
+            TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+            if (lockRecv && (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+                                pnode->GetTotalRecvSize() <= ReceiveFloodSize())) {
+                if (ReceiveSocketData(pnode) && pnode->hSocket != INVALID_SOCKET)
+                    fMoreData = true;
+                else
+                    nReady &= ~SOCKET_READY_RECV;
             }
         }
-        {
-            LOCK(cs_vNodes);
+    }
+    for (std::map<CNode*, int>::iterator it = mapNodesReady.begin(); it != mapNodesReady.end();) {
+        if (it->second == 0)
+            mapNodesReady.erase(it++);
+        else
+            ++it;
+    }
+
+    //
+    // Inactivity checking, once a second for all nodes
+    //
+    vector<CNode*> vNodesCopy;
+    int64_t nTime = GetTime();
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH (CNode* pnode, vNodesReady)
+            pnode->Release();
+        if (nTime != nLastInactivityCheck) {
+            nLastInactivityCheck = nTime;
+            vNodesCopy = vNodes;
             BOOST_FOREACH (CNode* pnode, vNodesCopy)
-                pnode->Release();
+                pnode->AddRef();
         }
     }
+    if (vNodesCopy.empty())
+        return;
+    BOOST_FOREACH (CNode* pnode, vNodesCopy)
+        InactivityCheck(pnode);
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH (CNode* pnode, vNodesCopy)
+            pnode->Release();
+    }
+}
+#endif
+
+void ThreadSocketHandler()
+{
+    unsigned int nPrevNodeCount = 0;
+    while (true) {
+        DisconnectNodes(nPrevNodeCount);
+
+#ifdef HAVE_SYS_EPOLL_H
+        if (socketEventsMode == SOCKETEVENTS_EPOLL) {
+            SocketHandlerEpoll();
+            continue;
+        }
+#endif
+        SocketHandlerSelect();
+    }
 }
 
 
@@ -1350,17 +1649,38 @@ void ThreadMessageHandler()
             }
         }
 
-        // Poll the connected nodes for messages
-        CNode* pnodeTrickle = NULL;
-        if (!vNodesCopy.empty())
-            pnodeTrickle = vNodesCopy[GetRand(vNodesCopy.size())];
-
-        bool fSleep = true;
+        {
+            LOCK(cs_pnodeTrickle);
+            pnodeTrickle = vNodesCopy.empty() ? NULL : vNodesCopy[GetRand(vNodesCopy.size())];
+        }
 
+        // Hand the connected nodes to the handler threads, the ones that keep their reference
+        // are released by the thread that processes them last
+        vector<CNode*> vNodesRelease;
         BOOST_FOREACH (CNode* pnode, vNodesCopy) {
-            if (pnode->fDisconnect)
-                continue;
+            if (pnode->fDisconnect || !messageQueue.Push(pnode))
+                vNodesRelease.push_back(pnode);
+        }
 
+        {
+            LOCK(cs_vNodes);
+            BOOST_FOREACH (CNode* pnode, vNodesRelease)
+                pnode->Release();
+        }
+
+        // a node with more messages is queued again by its thread, so this only waits for new ones
+        messageHandlerCondition.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(100));
+    }
+}
+
+void ThreadMessageWorker()
+{
+    SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
+    while (true) {
+        CNode* pnode = messageQueue.Pop();
+        bool fMore = false;
+
+        if (!pnode->fDisconnect) {
             // Receive messages
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
@@ -1370,7 +1690,7 @@ void ThreadMessageHandler()
 
                     if (pnode->nSendSize < SendBufferSize()) {
                         if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete())) {
-                            fSleep = false;
+                            fMore = true;
                         }
                     }
                 }
@@ -1380,21 +1700,29 @@ void ThreadMessageHandler()
             // Send messages
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
-                if (lockSend)
-                    g_signals.SendMessages(pnode, pnode == pnodeTrickle || pnode->fWhitelisted);
+                if (lockSend) {
+                    bool fSendTrickle = pnode->fWhitelisted;
+                    {
+                        LOCK(cs_pnodeTrickle);
+                        if (pnode == pnodeTrickle) {
+                            fSendTrickle = true;
+                            pnodeTrickle = NULL;
+                        }
+                    }
+                    // the messages of one pass leave together, in as few writes as the socket allows
+                    if (fBatchSends)
+                        pnode->CorkSend();
+                    g_signals.SendMessages(pnode, fSendTrickle);
+                    pnode->UncorkSend();
+                }
             }
             boost::this_thread::interruption_point();
         }
 
-
-        {
+        if (!messageQueue.Done(pnode, fMore && !pnode->fDisconnect)) {
             LOCK(cs_vNodes);
-            BOOST_FOREACH (CNode* pnode, vNodesCopy)
-                pnode->Release();
+            pnode->Release();
         }
-
-        if (fSleep)
-            messageHandlerCondition.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(100));
     }
 }
 
@@ -1569,6 +1897,28 @@ void StartNode(boost::thread_group& threadGroup)
     if (pnodeLocalHost == NULL)
         pnodeLocalHost = new CNode(INVALID_SOCKET, CAddress(CService("127.0.0.1", 0), nLocalServices));
 
+#ifdef HAVE_SYS_EPOLL_H
+    if (socketEventsMode == SOCKETEVENTS_EPOLL && hEpoll == -1) {
+        hEpoll = epoll_create1(EPOLL_CLOEXEC);
+        if (hEpoll == -1) {
+            LogPrintf("epoll_create1 failed: %s, falling back to select\n", NetworkErrorString(WSAGetLastError()));
+            socketEventsMode = SOCKETEVENTS_SELECT;
+        }
+        BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
+            if (hEpoll == -1)
+                break;
+            // listening sockets are the events without a node
+            struct epoll_event event;
+            event.events = EPOLLIN | EPOLLET;
+            event.data.ptr = NULL;
+            if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, hListenSocket.socket, &event) == SOCKET_ERROR)
+                LogPrintf("epoll_ctl failed for listening socket: %s\n", NetworkErrorString(WSAGetLastError()));
+        }
+        // connections queued before the registration are not reported as a change
+        fListenReady = true;
+    }
+#endif
+
     Discover(threadGroup);
 
     //
@@ -1594,6 +1944,8 @@ void StartNode(boost::thread_group& threadGroup)
 
     // Process messages
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
+    for (int i = 0; i < nMessageHandlerThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msgwork", &ThreadMessageWorker));
 
     // Dump network addresses
     threadGroup.create_thread(boost::bind(&LoopForever<void (*)()>, "dumpaddr", &DumpAddresses, DUMP_ADDRESSES_INTERVAL * 1000));
@@ -1643,6 +1995,11 @@ public:
         vNodes.clear();
         vNodesDisconnected.clear();
         vhListenSocket.clear();
+#ifdef HAVE_SYS_EPOLL_H
+        if (hEpoll != -1)
+            close(hEpoll);
+        hEpoll = -1;
+#endif
         delete semOutbound;
         semOutbound = NULL;
         delete pnodeLocalHost;
@@ -1703,16 +2060,68 @@ void RelayTransactionLockReq(const CTransaction& tx, bool relayToAll)
 {
     CInv inv(MSG_TXLOCK_REQUEST, tx.GetHash());
 
-    //broadcast the new lock
+    if (!fSwiftTXInv) {
+        //broadcast the new lock
+        LOCK(cs_vNodes);
+        BOOST_FOREACH (CNode* pnode, vNodes) {
+            if (!relayToAll && !pnode->fRelayTxes)
+                continue;
+
+            pnode->PushMessage("ix", tx);
+        }
+        return;
+    }
+
+    // Announce the lock request and serve it on getdata, serialized once for all peers that ask.
+    // Peers that already have it, from us or from another peer, do not download it again.
+    boost::shared_ptr<CDataStream> ss(new CDataStream(SER_NETWORK, PROTOCOL_VERSION));
+    ss->reserve(1000);
+    *ss << tx;
+    getDataCache.Add(inv, 0, ss);
+
     LOCK(cs_vNodes);
     BOOST_FOREACH (CNode* pnode, vNodes) {
         if (!relayToAll && !pnode->fRelayTxes)
             continue;
 
-        pnode->PushMessage("ix", tx);
+        pnode->PushInventory(inv);
     }
 }
 
+boost::shared_ptr<const CDataStream> CGetDataCache::Get(const CInv& inv, const uint256& nVersion)
+{
+    LOCK(cs);
+    std::map<CInv, CPayload>::iterator mi = mapPayloads.find(inv);
+    if (mi == mapPayloads.end() || mi->second.nVersion != nVersion)
+        return boost::shared_ptr<const CDataStream>();
+    return mi->second.payload;
+}
+
+void CGetDataCache::Add(const CInv& inv, const uint256& nVersion, const boost::shared_ptr<const CDataStream>& payload)
+{
+    LOCK(cs);
+    int64_t nNow = GetTime();
+    // Expire old payloads, unless they were added again since
+    while (!vExpiration.empty() && vExpiration.front().first < nNow) {
+        std::map<CInv, CPayload>::iterator mi = mapPayloads.find(vExpiration.front().second);
+        if (mi != mapPayloads.end() && mi->second.nExpire == vExpiration.front().first)
+            mapPayloads.erase(mi);
+        vExpiration.pop_front();
+    }
+
+    CPayload& entry = mapPayloads[inv];
+    entry.nVersion = nVersion;
+    entry.payload = payload;
+    entry.nExpire = nNow + GETDATA_CACHE_SECONDS;
+    vExpiration.push_back(std::make_pair(entry.nExpire, inv));
+}
+
+size_t CGetDataCache::size()
+{
+    LOCK(cs);
+    return mapPayloads.size();
+}
+
 void RelayInv(CInv& inv)
 {
     LOCK(cs_vNodes);
@@ -1885,6 +2294,11 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
     nLastRecv = 0;
     nSendBytes = 0;
     nRecvBytes = 0;
+    nSendMsgs = 0;
+    nSendCalls = 0;
+    nRecvCalls = 0;
+    fSendCorked = false;
+    fSendHeld = false;
     nTimeConnected = GetTime();
     addr = addrIn;
     addrName = addrNameIn == "" ? addr.ToStringIPPort() : addrNameIn;
@@ -2015,13 +2429,33 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
 
     LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
 
+    const char* pchCommand = &ssSend[MESSAGE_START_SIZE];
+    {
+        LOCK(cs_mapSendBytesPerCmd);
+        mapSendBytesPerCmd[std::string(pchCommand, strnlen_int(pchCommand, CMessageHeader::COMMAND_SIZE))] += ssSend.size();
+    }
+
     std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
+    GetBufferPool().Acquire(*it, ssSend.size());
     ssSend.GetAndClear(*it);
     nSendSize += (*it).size();
 
     // If write queue empty, attempt "optimistic write"
-    if (it == vSendMsg.begin())
-        SocketSendData(this);
+    if (it == vSendMsg.begin()) {
+        if (fSendCorked)
+            fSendHeld = true;
+        else
+            SocketSendData(this);
+    }
 
     LEAVE_CRITICAL_SECTION(cs_vSend);
 }
+
+void CNode::UncorkSend()
+{
+    fSendCorked = false;
+    if (fSendHeld) {
+        fSendHeld = false;
+        SocketSendData(this);
+    }
+}
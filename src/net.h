@@ -28,6 +28,7 @@
 
 #include <boost/filesystem/path.hpp>
 #include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/signals2/signal.hpp>
 
 class CAddrMan;
@@ -57,8 +58,23 @@ static const bool DEFAULT_UPNP = USE_UPNP;
 #else
 static const bool DEFAULT_UPNP = false;
 #endif
+/** -socketevents default */
+#ifdef HAVE_SYS_EPOLL_H
+static const char* const DEFAULT_SOCKETEVENTS = "epoll";
+#else
+static const char* const DEFAULT_SOCKETEVENTS = "select";
+#endif
+/** -msghandlerthreads default and maximum */
+static const int DEFAULT_MSGHANDLER_THREADS = 4;
+static const int MAX_MSGHANDLER_THREADS = 16;
+/** -batchsends default */
+static const bool DEFAULT_BATCHSENDS = true;
+/** -swifttxinv default */
+static const bool DEFAULT_SWIFTTX_INV = true;
 /** The maximum number of entries in mapAskFor */
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
+/** How long a serialized getdata payload is kept for other peers asking for it */
+static const int64_t GETDATA_CACHE_SECONDS = 5 * 60;
 
 unsigned int ReceiveFloodSize();
 unsigned int SendBufferSize();
@@ -126,6 +142,16 @@ extern uint64_t nLocalHostNonce;
 extern CAddrMan addrman;
 extern int nMaxConnections;
 
+/** How ThreadSocketHandler waits for sockets to become ready */
+enum SocketEventsMode {
+    SOCKETEVENTS_SELECT,
+    SOCKETEVENTS_EPOLL,
+};
+extern SocketEventsMode socketEventsMode;
+extern int nMessageHandlerThreads;
+extern bool fBatchSends;
+extern bool fSwiftTXInv;
+
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
 extern std::map<CInv, CDataStream> mapRelay;
@@ -133,6 +159,30 @@ extern std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
 extern CCriticalSection cs_mapRelay;
 extern limitedmap<CInv, int64_t> mapAlreadyAskedFor;
 
+/** Serialized objects served to getdata, shared by every peer that asks for the same inventory.
+ *  Objects that change in place are stored with a version, a payload of another version is a miss.
+ */
+class CGetDataCache
+{
+private:
+    struct CPayload {
+        uint256 nVersion;
+        boost::shared_ptr<const CDataStream> payload;
+        int64_t nExpire;
+    };
+
+    CCriticalSection cs;
+    std::map<CInv, CPayload> mapPayloads;
+    // an inventory added again has several entries, only the one matching nExpire of its payload removes it
+    std::deque<std::pair<int64_t, CInv> > vExpiration;
+
+public:
+    boost::shared_ptr<const CDataStream> Get(const CInv& inv, const uint256& nVersion);
+    void Add(const CInv& inv, const uint256& nVersion, const boost::shared_ptr<const CDataStream>& payload);
+    size_t size();
+};
+extern CGetDataCache getDataCache;
+
 extern std::vector<std::string> vAddedNodes;
 extern CCriticalSection cs_vAddedNodes;
 
@@ -162,6 +212,11 @@ public:
     int nStartingHeight;
     uint64_t nSendBytes;
     uint64_t nRecvBytes;
+    uint64_t nSendMsgs;
+    uint64_t nSendCalls;
+    uint64_t nRecvCalls;
+    std::map<std::string, uint64_t> mapSendBytesPerCmd;
+    std::map<std::string, uint64_t> mapRecvBytesPerCmd;
     bool fWhitelisted;
     double dPingTime;
     double dPingWait;
@@ -183,6 +238,8 @@ public:
 
     int64_t nTime; // time (in microseconds) of message receipt.
 
+    bool fSigPrechecked; // seen by PrecheckServicenodeSignatures
+
     CNetMessage(int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), vRecv(nTypeIn, nVersionIn)
     {
         hdrbuf.resize(24);
@@ -190,8 +247,11 @@ public:
         nHdrPos = 0;
         nDataPos = 0;
         nTime = 0;
+        fSigPrechecked = false;
     }
 
+    ~CNetMessage();
+
     bool complete() const
     {
         if (!in_data)
@@ -221,13 +281,22 @@ public:
     size_t nSendSize;   // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
+    uint64_t nSendMsgs;  // messages written to the socket
+    uint64_t nSendCalls; // send system calls, one may write several messages
+    bool fSendCorked;    // EndMessage only queues, UncorkSend writes the queue at once
+    bool fSendHeld;      // a message was queued while corked
     std::deque<CSerializeData> vSendMsg;
+    std::map<std::string, uint64_t> mapSendBytesPerCmd; // bytes queued per command, header included
+    CCriticalSection cs_mapSendBytesPerCmd;              // taken last, copyStats reads the map under cs_vNodes
     CCriticalSection cs_vSend;
 
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
     CCriticalSection cs_vRecvMsg;
     uint64_t nRecvBytes;
+    uint64_t nRecvCalls;
+    std::map<std::string, uint64_t> mapRecvBytesPerCmd; // bytes of the complete messages per command, header included
+    CCriticalSection cs_mapRecvBytesPerCmd;              // taken last, copyStats reads the map under cs_vNodes
     int nRecvVersion;
 
     int64_t nLastSend;
@@ -414,6 +483,11 @@ public:
     // TODO: Document the precondition of this function.  Is cs_vSend locked?
     void EndMessage() UNLOCK_FUNCTION(cs_vSend);
 
+    // requires LOCK(cs_vSend)
+    void CorkSend() { fSendCorked = true; }
+    // requires LOCK(cs_vSend), writes what was queued while corked
+    void UncorkSend();
+
     void PushVersion();
 
 
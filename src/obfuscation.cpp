@@ -8,6 +8,7 @@
 #include "init.h"
 #include "main.h"
 #include "servicenodeman.h"
+#include "scheduler.h"
 #include "script/sign.h"
 #include "swifttx.h"
 #include "ui_interface.h"
@@ -144,6 +145,7 @@ void CObfuscationPool::ProcessMessageObfuscation(CNode* pfrom, std::string& strC
                 return;
             }
             mnodeman.nDsqCount++;
+            mnodeman.versionDsqCount.Changed();
             pmn->nLastDsq = mnodeman.nDsqCount;
             pmn->allowFreeTx = true;
 
@@ -2161,21 +2163,91 @@ bool CObfuScationSigner::SignMessage(std::string strMessage, std::string& errorM
 }
 
 bool CObfuScationSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage)
+{
+    CKeyID keyID;
+    if (!RecoverMessageKey(vchSig, strMessage, keyID)) {
+        errorMessage = _("Error recovering public key.");
+        return false;
+    }
+
+    if (fDebug && keyID != pubkey.GetID())
+        LogPrintf("CObfuScationSigner::VerifyMessage -- keys don't match: %s %s\n", keyID.ToString(), pubkey.GetID().ToString());
+
+    return (keyID == pubkey.GetID());
+}
+
+namespace
+{
+/**
+ * Keys recovered from servicenode message signatures, by hash of (message hash, signature).
+ * Filled ahead of the message handler by the servicenode signature check queue.
+ */
+class CMessageKeyCache
+{
+private:
+    std::map<uint256, CKeyID> mapKeys;
+    CCriticalSection cs;
+
+public:
+    bool Get(const uint256& hash, CKeyID& keyIDRet)
+    {
+        LOCK(cs);
+        std::map<uint256, CKeyID>::const_iterator it = mapKeys.find(hash);
+        if (it == mapKeys.end()) return false;
+        keyIDRet = it->second;
+        return true;
+    }
+
+    void Set(const uint256& hash, const CKeyID& keyID)
+    {
+        LOCK(cs);
+        // evict random entries, same as the script signature cache
+        while (mapKeys.size() >= 50000) {
+            std::map<uint256, CKeyID>::iterator it = mapKeys.lower_bound(GetRandHash());
+            if (it == mapKeys.end()) it = mapKeys.begin();
+            mapKeys.erase(it);
+        }
+        mapKeys[hash] = keyID;
+    }
+};
+
+CMessageKeyCache messageKeyCache;
+} // anon namespace
+
+static uint256 MessageKeyCacheHash(const std::vector<unsigned char>& vchSig, const uint256& hashMessage)
+{
+    CHashWriter ssCache(SER_GETHASH, 0);
+    ssCache << hashMessage;
+    ssCache << vchSig;
+    return ssCache.GetHash();
+}
+
+static uint256 MessageHash(const std::string& strMessage)
 {
     CHashWriter ss(SER_GETHASH, 0);
     ss << strMessageMagic;
     ss << strMessage;
+    return ss.GetHash();
+}
 
-    CPubKey pubkey2;
-    if (!pubkey2.RecoverCompact(ss.GetHash(), vchSig)) {
-        errorMessage = _("Error recovering public key.");
-        return false;
-    }
+bool CObfuScationSigner::RecoverMessageKey(const std::vector<unsigned char>& vchSig, const std::string& strMessage, CKeyID& keyIDRet)
+{
+    uint256 hashMessage = MessageHash(strMessage);
+    uint256 hashCache = MessageKeyCacheHash(vchSig, hashMessage);
+    if (messageKeyCache.Get(hashCache, keyIDRet)) return true;
 
-    if (fDebug && pubkey2.GetID() != pubkey.GetID())
-        LogPrintf("CObfuScationSigner::VerifyMessage -- keys don't match: %s %s\n", pubkey2.GetID().ToString(), pubkey.GetID().ToString());
+    CPubKey pubkey;
+    if (!pubkey.RecoverCompact(hashMessage, vchSig)) return false;
 
-    return (pubkey2.GetID() == pubkey.GetID());
+    keyIDRet = pubkey.GetID();
+    messageKeyCache.Set(hashCache, keyIDRet);
+    return true;
+}
+
+bool CObfuScationSigner::IsMessageKeyCached(const std::vector<unsigned char>& vchSig, const std::string& strMessage)
+{
+    CKeyID keyID;
+    return messageKeyCache.Get(MessageKeyCacheHash(vchSig, MessageHash(strMessage)), keyID);
 }
 
 bool CObfuscationQueue::Sign()
@@ -2279,44 +2351,87 @@ void CObfuscationPool::RelayCompletedTransaction(const int sessionID, const bool
 }
 
 //TODO: Rename/move to core
-void ThreadCheckObfuScationPool()
+static void ProcessServicenodeSync()
 {
-    if (fLiteMode) return; //disable all Obfuscation/Servicenode related functionality
+    static bool fBlockchainSynced = false;
+
+    // try to sync from all available nodes, one step at a time
+    servicenodeSync.Process();
+
+    // check if we should activate or ping right after sync is considered to be done
+    bool fSynced = servicenodeSync.IsBlockchainSynced();
+    if (fSynced && !fBlockchainSynced) scheduler.Wake("mnstatus");
+    fBlockchainSynced = fSynced;
+
+    // once synced only a lost servicenode list needs attention, new blocks wake the sync while the chain catches up
+    int64_t nDelay = 1;
+    if (servicenodeSync.IsSynced())
+        nDelay = 60;
+    else if (!fBlockchainSynced && servicenodeSync.RequestedServicenodeAssets > SERVICENODE_SYNC_SPORKS)
+        nDelay = SERVICENODE_SYNC_TIMEOUT;
+    scheduler.Schedule("mnsync", &ProcessServicenodeSync, nDelay);
+}
 
-    // Make this thread recognisable as the wallet flushing thread
-    RenameThread("blocknetdx-obfuscation");
+static void ManageServicenodeStatus()
+{
+    if (!servicenodeSync.IsBlockchainSynced()) return;
+    activeServicenode.ManageStatus();
+}
 
-    unsigned int c = 0;
+static void CheckServicenodes()
+{
+    if (!servicenodeSync.IsBlockchainSynced()) return;
+    mnodeman.CheckAndRemove();
+}
 
-    while (true) {
-        MilliSleep(1000);
-        //LogPrintf("ThreadCheckObfuScationPool::check timeout\n");
+static void ProcessServicenodeConnections()
+{
+    if (!servicenodeSync.IsBlockchainSynced()) return;
+    mnodeman.ProcessServicenodeConnections();
+}
 
-        // try to sync from all available nodes, one step at a time
-        servicenodeSync.Process();
+static void CleanServicenodePayments()
+{
+    if (!servicenodeSync.IsBlockchainSynced()) return;
+    servicenodePayments.CleanPaymentList();
+}
 
-        if (servicenodeSync.IsBlockchainSynced()) {
-            c++;
+static void CleanTransactionLocks()
+{
+    if (!servicenodeSync.IsBlockchainSynced()) return;
+    CleanTransactionLocksList();
+}
+
+static void CheckObfuScationPool()
+{
+    if (servicenodeSync.IsBlockchainSynced()) {
+        obfuScationPool.CheckTimeout();
+        obfuScationPool.CheckForCompleteQueue();
+    }
 
-            // check if we should activate or ping every few minutes,
-            // start right after sync is considered to be done
-            if (c % SERVICENODE_PING_SECONDS == 1) activeServicenode.ManageStatus();
+    // mixing can be turned on at runtime, check for it now and then
+    scheduler.Schedule("obfuscation", &CheckObfuScationPool, fEnableObfuscation || fServiceNode ? 1 : 15);
+}
 
-            if (c % 60 == 0) {
-                mnodeman.CheckAndRemove();
-                mnodeman.ProcessServicenodeConnections();
-                servicenodePayments.CleanPaymentList();
-                CleanTransactionLocksList();
-            }
+static void DoAutomaticDenominating()
+{
+    if (!servicenodeSync.IsBlockchainSynced()) return;
+    if (obfuScationPool.GetState() == POOL_STATUS_IDLE) obfuScationPool.DoAutomaticDenominating();
+}
+
+void ScheduleObfuScationTasks()
+{
+    if (fLiteMode) return; //disable all Obfuscation/Servicenode related functionality
 
-            //if(c % SERVICENODES_DUMP_SECONDS == 0) DumpServicenodes();
+    scheduler.Schedule("mnsync", &ProcessServicenodeSync, 1);
+    scheduler.ScheduleEvery("mnstatus", &ManageServicenodeStatus, SERVICENODE_PING_SECONDS, SERVICENODE_PING_SECONDS);
 
-            obfuScationPool.CheckTimeout();
-            obfuScationPool.CheckForCompleteQueue();
+    // the cleanups take mnodeman.cs and friends, spread them over the minute instead of running them in one go
+    scheduler.ScheduleEvery("mncheck", &CheckServicenodes, 60, 60);
+    scheduler.ScheduleEvery("mnconnections", &ProcessServicenodeConnections, 60, 75);
+    scheduler.ScheduleEvery("mnpayments", &CleanServicenodePayments, 60, 90);
+    scheduler.ScheduleEvery("txlocks", &CleanTransactionLocks, 60, 105);
 
-            if (obfuScationPool.GetState() == POOL_STATUS_IDLE && c % 15 == 0) {
-                obfuScationPool.DoAutomaticDenominating();
-            }
-        }
-    }
+    scheduler.Schedule("obfuscation", &CheckObfuScationPool, 1);
+    scheduler.ScheduleEvery("obfuscationdenominate", &DoAutomaticDenominating, 15, 15);
 }
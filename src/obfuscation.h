@@ -240,6 +240,17 @@ public:
     CTxIn vin;
     vector<unsigned char> vchSig;
     int64_t sigTime;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(tx);
+        READWRITE(vin);
+        READWRITE(vchSig);
+        READWRITE(sigTime);
+    }
 };
 
 /** Helper object for signing and checking signatures
@@ -257,6 +268,10 @@ public:
     bool SignMessage(std::string strMessage, std::string& errorMessage, std::vector<unsigned char>& vchSig, CKey key);
     /// Verify the message, returns true if succcessful
     bool VerifyMessage(CPubKey pubkey, std::vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage);
+    /// Recover the key that signed the message, returns true if successful. Recovered keys are cached.
+    bool RecoverMessageKey(const std::vector<unsigned char>& vchSig, const std::string& strMessage, CKeyID& keyIDRet);
+    /// Whether the key that signed the message was already recovered
+    bool IsMessageKeyCached(const std::vector<unsigned char>& vchSig, const std::string& strMessage);
 };
 
 /** Used to keep track of current status of Obfuscation pool
@@ -511,6 +526,6 @@ public:
     void RelayCompletedTransaction(const int sessionID, const bool error, const int errorID);
 };
 
-void ThreadCheckObfuScationPool();
+void ScheduleObfuScationTasks();
 
 #endif
@@ -17,6 +17,21 @@ uint256 CBlockHeader::GetHash() const
     return HashQuark(BEGIN(nVersion), END(nNonce));
 }
 
+uint256 CBlock::GetHash() const
+{
+    if (hashCached.IsNull()) {
+        hashCached = CBlockHeader::GetHash();
+#ifdef DEBUG
+        static_assert(sizeof(CBlockHeader) == sizeof(vchHeaderCached), "the header is not 80 contiguous bytes");
+        memcpy(vchHeaderCached, BEGIN(nVersion), sizeof(vchHeaderCached));
+    } else {
+        // a header field changed without InvalidateHash()
+        assert(memcmp(BEGIN(nVersion), vchHeaderCached, sizeof(vchHeaderCached)) == 0);
+#endif
+    }
+    return hashCached;
+}
+
 uint256 CBlock::BuildMerkleTree(bool* fMutated) const
 {
     /* WARNING! If you're reading this because you're learning about crypto
@@ -87,7 +87,17 @@ public:
     // memory only
     mutable CScript payee;
     mutable std::vector<uint256> vMerkleTree;
+    mutable bool fChecked; //! the context-free checks of CheckBlock passed
 
+private:
+    //! hash of the header, null until GetHash() computed it
+    mutable uint256 hashCached;
+#ifdef DEBUG
+    //! header bytes the cached hash belongs to, to catch changes that were not followed by InvalidateHash()
+    mutable unsigned char vchHeaderCached[80];
+#endif
+
+public:
     CBlock()
     {
         SetNull();
@@ -104,6 +114,8 @@ public:
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
         READWRITE(*(CBlockHeader*)this);
+        if (ser_action.ForRead())
+            hashCached.SetNull();
         READWRITE(vtx);
 	if(vtx.size() > 1 && vtx[1].IsCoinStake())
 		READWRITE(vchBlockSig);
@@ -116,6 +128,22 @@ public:
         vMerkleTree.clear();
         payee = CScript();
         vchBlockSig.clear();
+        fChecked = false;
+        hashCached.SetNull();
+    }
+
+    /**
+     * Quark hash of the header. It is computed once and cached, so callers
+     * (and log statements) can ask for it as often as they like. Code that
+     * changes a header field after the hash was taken must call
+     * InvalidateHash(); debug builds assert that it did.
+     */
+    uint256 GetHash() const;
+
+    /** Forget the cached hash after a header field changed in place. */
+    void InvalidateHash() const
+    {
+        hashCached.SetNull();
     }
 
     CBlockHeader GetBlockHeader() const
@@ -496,6 +496,12 @@ Value getblockchaininfo(const Array& params, bool fHelp)
             "  \"difficulty\": xxxxxx,     (numeric) the current difficulty\n"
             "  \"verificationprogress\": xxxx, (numeric) estimate of verification progress [0..1]\n"
             "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
+            "  \"blockindex\": {            (object) memory used by the block index\n"
+            "    \"entries\": xxxxxx,       (numeric) number of block index entries\n"
+            "    \"usage\": xxxxxx,         (numeric) bytes used by the entries and the hash table\n"
+            "    \"nodebasedusage\": xxxxxx, (numeric) estimated bytes the same entries take as individually allocated map nodes\n"
+            "    \"saved\": xxxxxx          (numeric) difference between the two\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getblockchaininfo", "") + HelpExampleRpc("getblockchaininfo", ""));
@@ -508,6 +514,18 @@ Value getblockchaininfo(const Array& params, bool fHelp)
     obj.push_back(Pair("difficulty", (double)GetDifficulty()));
     obj.push_back(Pair("verificationprogress", Checkpoints::GuessVerificationProgress(chainActive.Tip())));
     obj.push_back(Pair("chainwork", chainActive.Tip()->nChainWork.GetHex()));
+
+    Object blockindex;
+    {
+        LOCK(cs_main);
+        size_t nUsage = mapBlockIndex.DynamicMemoryUsage();
+        size_t nNodeBasedUsage = mapBlockIndex.NodeBasedMemoryUsage();
+        blockindex.push_back(Pair("entries", (uint64_t)mapBlockIndex.size()));
+        blockindex.push_back(Pair("usage", (uint64_t)nUsage));
+        blockindex.push_back(Pair("nodebasedusage", (uint64_t)nNodeBasedUsage));
+        blockindex.push_back(Pair("saved", (int64_t)nNodeBasedUsage - (int64_t)nUsage));
+    }
+    obj.push_back(Pair("blockindex", blockindex));
     return obj;
 }
 
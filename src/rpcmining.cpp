@@ -172,7 +172,7 @@ Value setgenerate(const Array& params, bool fHelp)
                 LOCK(cs_main);
                 IncrementExtraNonce(pblock, chainActive.Tip(), nExtraNonce);
             }
-            while (!CheckProofOfWork(pblock->GetHash(), pblock->nBits)) {
+            while (!CheckProofOfWork(pblock->CBlockHeader::GetHash(), pblock->nBits)) {
                 // Yes, there is a chance every nonce could fail to satisfy the -regtest
                 // target -- 1 in 2^(2^32). That ain't gonna happen.
                 ++pblock->nNonce;
@@ -504,6 +504,7 @@ Value getblocktemplate(const Array& params, bool fHelp)
     // Update nTime
     UpdateTime(pblock, pindexPrev);
     pblock->nNonce = 0;
+    pblock->InvalidateHash();
 
     static const Array aCaps = boost::assign::list_of("proposal");
 
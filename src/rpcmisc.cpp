@@ -8,11 +8,13 @@
 #include "base58.h"
 #include "clientversion.h"
 #include "init.h"
+#include "kernel.h"
 #include "main.h"
 #include "servicenode-sync.h"
 #include "net.h"
 #include "netbase.h"
 #include "rpcserver.h"
+#include "scheduler.h"
 #include "spork.h"
 #include "timedata.h"
 #include "util.h"
@@ -144,17 +146,83 @@ Value mnsync(const Array& params, bool fHelp)
         obj.push_back(Pair("RequestedServicenodeAssets", servicenodeSync.RequestedServicenodeAssets));
         obj.push_back(Pair("RequestedServicenodeAttempt", servicenodeSync.RequestedServicenodeAttempt));
 
+        int nItems, nExpected;
+        servicenodeSync.GetAssetProgress(nItems, nExpected);
+        obj.push_back(Pair("syncItems", nItems));
+        obj.push_back(Pair("syncItemsExpected", nExpected));
+
+        // peers asked for the current asset
+        std::map<NodeId, CServicenodeSyncPeer> mapSyncPeers = servicenodeSync.GetSyncPeers();
+        Array peers;
+        BOOST_FOREACH (const PAIRTYPE(const NodeId, CServicenodeSyncPeer) & item, mapSyncPeers) {
+            const CServicenodeSyncPeer& peer = item.second;
+            Object objPeer;
+            objPeer.push_back(Pair("id", item.first));
+            {
+                LOCK(cs_vNodes);
+                BOOST_FOREACH (CNode* pnode, vNodes) {
+                    if (pnode->GetId() == item.first) objPeer.push_back(Pair("addr", pnode->addrName));
+                }
+            }
+            objPeer.push_back(Pair("requested", peer.nTimeRequested));
+            objPeer.push_back(Pair("reported", peer.nReported));
+            objPeer.push_back(Pair("reports", peer.nReports));
+            objPeer.push_back(Pair("items", peer.nItems));
+            int64_t nElapsed = GetTime() - peer.nTimeRequested;
+            objPeer.push_back(Pair("itemspersec", nElapsed > 0 ? (double)peer.nItems / nElapsed : (double)peer.nItems));
+            peers.push_back(objPeer);
+        }
+        obj.push_back(Pair("peers", peers));
 
         return obj;
     }
 
     if (strMode == "reset") {
         servicenodeSync.Reset();
+        scheduler.Wake("mnsync");
         return "success";
     }
     return "failure";
 }
 
+Value getschedulerinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 0)
+        throw runtime_error(
+            "getschedulerinfo\n"
+            "\nReturns the maintenance tasks queued in the scheduler and their run times.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"name\": \"xxxx\",       (string) The task name\n"
+            "    \"interval\": n,        (numeric) Seconds between runs, 0 for a task scheduled once\n"
+            "    \"nextrun\": ttt,       (numeric) Time of the next run, 0 when the task is not queued\n"
+            "    \"lastrun\": ttt,       (numeric) Time of the last run\n"
+            "    \"runs\": n,            (numeric) Number of runs\n"
+            "    \"timemicros\": n,      (numeric) Total run time in microseconds\n"
+            "    \"maxtimemicros\": n    (numeric) Longest run time in microseconds\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getschedulerinfo", "") + HelpExampleRpc("getschedulerinfo", ""));
+
+    Array ret;
+    std::vector<CSchedulerTaskInfo> vTasks = scheduler.GetTasks();
+    BOOST_FOREACH (const CSchedulerTaskInfo& task, vTasks) {
+        Object obj;
+        obj.push_back(Pair("name", task.strName));
+        obj.push_back(Pair("interval", task.nInterval));
+        obj.push_back(Pair("nextrun", task.nNextRun));
+        obj.push_back(Pair("lastrun", task.nLastRun));
+        obj.push_back(Pair("runs", task.nRuns));
+        obj.push_back(Pair("timemicros", task.nTimeTotal));
+        obj.push_back(Pair("maxtimemicros", task.nTimeMax));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
 #ifdef ENABLE_WALLET
 class DescribeAddressVisitor : public boost::static_visitor<Object>
 {
@@ -476,6 +544,11 @@ Value getstakingstatus(const Array& params, bool fHelp)
             "  \"enoughcoins\": true|false,        (boolean) if available coins are greater than reserve balance\n"
             "  \"mnsync\": true|false,             (boolean) if servicenode data is synced\n"
             "  \"staking status\": true|false,     (boolean) if the wallet is staking or not\n"
+            "  \"stakemodifiercache\": {           (object) kernel stake modifier cache\n"
+            "    \"entries\": n,                   (numeric) resolved origin heights\n"
+            "    \"hits\": n,                      (numeric) lookups answered from the cache\n"
+            "    \"misses\": n                     (numeric) lookups that walked the chain\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getstakingstatus", "") + HelpExampleRpc("getstakingstatus", ""));
@@ -497,6 +570,15 @@ Value getstakingstatus(const Array& params, bool fHelp)
         nStaking = true;
     obj.push_back(Pair("staking status", nStaking));
 
+    uint64_t nHits = 0, nMisses = 0;
+    size_t nEntries = 0;
+    stakeModifierCache.GetStats(nHits, nMisses, nEntries);
+    Object cache;
+    cache.push_back(Pair("entries", (uint64_t)nEntries));
+    cache.push_back(Pair("hits", nHits));
+    cache.push_back(Pair("misses", nMisses));
+    obj.push_back(Pair("stakemodifiercache", cache));
+
     return obj;
 }
 #endif // ENABLE_WALLET
@@ -6,8 +6,10 @@
 
 #include "rpcserver.h"
 
+#include "bufferpool.h"
 #include "clientversion.h"
 #include "main.h"
+#include "messagedispatch.h"
 #include "net.h"
 #include "netbase.h"
 #include "protocol.h"
@@ -88,6 +90,17 @@ Value getpeerinfo(const Array& params, bool fHelp)
             "    \"lastrecv\": ttt,           (numeric) The time in seconds since epoch (Jan 1 1970 GMT) of the last receive\n"
             "    \"bytessent\": n,            (numeric) The total bytes sent\n"
             "    \"bytesrecv\": n,            (numeric) The total bytes received\n"
+            "    \"msgssent\": n,             (numeric) The messages written to the socket\n"
+            "    \"sendsyscalls\": n,         (numeric) The send system calls, one call may write several messages\n"
+            "    \"recvsyscalls\": n,         (numeric) The receive system calls\n"
+            "    \"bytessent_per_msg\": {     (json object) The bytes sent for each command, message headers included\n"
+            "       \"cmd\": n,                (numeric) The bytes sent of this command\n"
+            "       ...\n"
+            "    },\n"
+            "    \"bytesrecv_per_msg\": {     (json object) The bytes received for each command, message headers included\n"
+            "       \"cmd\": n,                (numeric) The bytes received of this command, unregistered commands are summed up as \"unknown\"\n"
+            "       ...\n"
+            "    },\n"
             "    \"conntime\": ttt,           (numeric) The connection time in seconds since epoch (Jan 1 1970 GMT)\n"
             "    \"pingtime\": n,             (numeric) ping time\n"
             "    \"pingwait\": n,             (numeric) ping wait\n"
@@ -126,6 +139,17 @@ Value getpeerinfo(const Array& params, bool fHelp)
         obj.push_back(Pair("lastrecv", stats.nLastRecv));
         obj.push_back(Pair("bytessent", stats.nSendBytes));
         obj.push_back(Pair("bytesrecv", stats.nRecvBytes));
+        obj.push_back(Pair("msgssent", stats.nSendMsgs));
+        obj.push_back(Pair("sendsyscalls", stats.nSendCalls));
+        obj.push_back(Pair("recvsyscalls", stats.nRecvCalls));
+        Object sendPerCmd;
+        for (std::map<std::string, uint64_t>::const_iterator it = stats.mapSendBytesPerCmd.begin(); it != stats.mapSendBytesPerCmd.end(); ++it)
+            sendPerCmd.push_back(Pair(it->first, it->second));
+        obj.push_back(Pair("bytessent_per_msg", sendPerCmd));
+        Object recvPerCmd;
+        for (std::map<std::string, uint64_t>::const_iterator it = stats.mapRecvBytesPerCmd.begin(); it != stats.mapRecvBytesPerCmd.end(); ++it)
+            recvPerCmd.push_back(Pair(it->first, it->second));
+        obj.push_back(Pair("bytesrecv_per_msg", recvPerCmd));
         obj.push_back(Pair("conntime", stats.nTimeConnected));
         obj.push_back(Pair("pingtime", stats.dPingTime));
         if (stats.dPingWait > 0.0)
@@ -313,7 +337,20 @@ Value getnettotals(const Array& params, bool fHelp)
             "{\n"
             "  \"totalbytesrecv\": n,   (numeric) Total bytes received\n"
             "  \"totalbytessent\": n,   (numeric) Total bytes sent\n"
-            "  \"timemillis\": t        (numeric) Total cpu time\n"
+            "  \"timemillis\": t,       (numeric) Total cpu time\n"
+            "  \"buffers\": {           (json object) Message payload buffers\n"
+            "    \"acquired\": n,       (numeric) Buffers taken for messages\n"
+            "    \"reused\": n,         (numeric) Buffers recycled from the pool instead of allocated\n"
+            "    \"released\": n,       (numeric) Buffers given back\n"
+            "    \"freed\": n,          (numeric) Buffers freed because the pool was full\n"
+            "    \"pooledbytes\": n,    (numeric) Bytes waiting in the shared pool\n"
+            "    \"received\": {        (json object) Buffers taken for received messages, per command\n"
+            "      \"command\": {\n"
+            "        \"allocated\": n,  (numeric) Buffers allocated\n"
+            "        \"reused\": n      (numeric) Buffers recycled\n"
+            "      }, ...\n"
+            "    }\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getnettotals", "") + HelpExampleRpc("getnettotals", ""));
@@ -322,9 +359,75 @@ Value getnettotals(const Array& params, bool fHelp)
     obj.push_back(Pair("totalbytesrecv", CNode::GetTotalBytesRecv()));
     obj.push_back(Pair("totalbytessent", CNode::GetTotalBytesSent()));
     obj.push_back(Pair("timemillis", GetTimeMillis()));
+
+    Object received;
+    std::map<std::string, CMessageStats> mapStats = messageDispatcher.GetStats();
+    for (std::map<std::string, CMessageStats>::iterator it = mapStats.begin(); it != mapStats.end(); ++it) {
+        const CMessageStats& stats = it->second;
+        if (!stats.nBuffers)
+            continue;
+        Object command;
+        command.push_back(Pair("allocated", stats.nBuffers - stats.nBuffersReused));
+        command.push_back(Pair("reused", stats.nBuffersReused));
+        received.push_back(Pair(it->first, command));
+    }
+
+    CBufferPoolStats poolStats = GetBufferPool().GetStats();
+    Object buffers;
+    buffers.push_back(Pair("acquired", poolStats.nAcquired));
+    buffers.push_back(Pair("reused", poolStats.nReused));
+    buffers.push_back(Pair("released", poolStats.nReleased));
+    buffers.push_back(Pair("freed", poolStats.nFreed));
+    buffers.push_back(Pair("pooledbytes", poolStats.nDepotBytes));
+    buffers.push_back(Pair("received", received));
+    obj.push_back(Pair("buffers", buffers));
     return obj;
 }
 
+Value getmessagestats(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 0)
+        throw runtime_error(
+            "getmessagestats\n"
+            "\nReturns statistics of the P2P messages processed so far, per command.\n"
+            "Commands without a handler are summed up as \"unknown\".\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"command\": {            (string) The P2P command\n"
+            "    \"count\": n,           (numeric) Number of messages processed\n"
+            "    \"bytes\": n,           (numeric) Total payload size\n"
+            "    \"timemicros\": n,      (numeric) Total processing time in microseconds\n"
+            "    \"maxtimemicros\": n,   (numeric) Longest processing time in microseconds\n"
+            "    \"histogram\": {        (json object) Number of messages per processing time\n"
+            "      \"<10us\": n,\n"
+            "      ...\n"
+            "      \">=1s\": n\n"
+            "    }\n"
+            "  },\n"
+            "  ...\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getmessagestats", "") + HelpExampleRpc("getmessagestats", ""));
+
+    Object ret;
+    std::map<std::string, CMessageStats> mapStats = messageDispatcher.GetStats();
+    for (std::map<std::string, CMessageStats>::iterator it = mapStats.begin(); it != mapStats.end(); ++it) {
+        const CMessageStats& stats = it->second;
+        Object histogram;
+        for (int i = 0; i < CMessageStats::HISTOGRAM_BUCKETS; i++)
+            histogram.push_back(Pair(CMessageStats::GetBucketName(i), stats.vHistogram[i]));
+
+        Object obj;
+        obj.push_back(Pair("count", stats.nCount));
+        obj.push_back(Pair("bytes", stats.nBytes));
+        obj.push_back(Pair("timemicros", stats.nTimeTotal));
+        obj.push_back(Pair("maxtimemicros", stats.nTimeMax));
+        obj.push_back(Pair("histogram", histogram));
+        ret.push_back(Pair(it->first, obj));
+    }
+    return ret;
+}
+
 static Array GetNetworksInfo()
 {
     Array networks;
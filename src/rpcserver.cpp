@@ -248,6 +248,7 @@ static const CRPCCommand vRPCCommands[] =
         {"network", "getaddednodeinfo", &getaddednodeinfo, true, true, false},
         {"network", "getconnectioncount", &getconnectioncount, true, false, false},
         {"network", "getnettotals", &getnettotals, true, true, false},
+        {"network", "getmessagestats", &getmessagestats, true, true, false},
         {"network", "getpeerinfo", &getpeerinfo, true, false, false},
         {"network", "ping", &ping, true, false, false},
 
@@ -310,6 +311,7 @@ static const CRPCCommand vRPCCommands[] =
         {"blocknetdx", "mnbudgetvoteraw", &mnbudgetvoteraw, true, true, false},
         {"blocknetdx", "mnfinalbudget", &mnfinalbudget, true, true, false},
         {"blocknetdx", "mnsync", &mnsync, true, true, false},
+        {"blocknetdx", "getschedulerinfo", &getschedulerinfo, true, true, false},
         {"blocknetdx", "spork", &spork, true, true, false},
 #ifdef ENABLE_WALLET
         {"blocknetdx", "obfuscation", &obfuscation, false, false, true}, /* not threadSafe because of SendMoney */
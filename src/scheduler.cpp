@@ -0,0 +1,181 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "scheduler.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <boost/thread.hpp>
+
+CScheduler scheduler;
+
+CScheduler::CScheduler(int64_t (*pGetTimeIn)()) : vWheel(WHEEL_SLOTS), nLastTick(0), pGetTime(pGetTimeIn)
+{
+}
+
+void CScheduler::Queue(CTaskEntry& entry, const std::string& strName, int64_t nTime)
+{
+    Unqueue(entry, strName);
+
+    // the slot of the current tick is scanned again on every pass, overdue tasks go there
+    int64_t nTick = std::max(nTime, nLastTick);
+    entry.nSlot = nTick % WHEEL_SLOTS;
+    entry.info.nNextRun = nTime;
+    vWheel[entry.nSlot].push_back(strName);
+}
+
+void CScheduler::Unqueue(CTaskEntry& entry, const std::string& strName)
+{
+    if (entry.nSlot >= 0)
+        vWheel[entry.nSlot].remove(strName);
+    entry.nSlot = -1;
+    entry.info.nNextRun = 0;
+}
+
+int64_t CScheduler::GetNextDeadline(int64_t nNow) const
+{
+    // a task in the slot of tick t is due at t, unless it waits for a later turn of the wheel
+    for (int64_t nTick = std::max(nLastTick, nNow - WHEEL_SLOTS + 1); nTick < nLastTick + WHEEL_SLOTS; nTick++) {
+        const std::list<std::string>& slot = vWheel[nTick % WHEEL_SLOTS];
+        for (std::list<std::string>::const_iterator it = slot.begin(); it != slot.end(); ++it) {
+            if (mapTasks.find(*it)->second.info.nNextRun <= nTick)
+                return nTick;
+        }
+    }
+    return nLastTick + WHEEL_SLOTS;
+}
+
+bool CScheduler::PopDueTask(int64_t nNow, std::string& strName, Task& task)
+{
+    // after a long sleep one turn of the wheel covers every slot
+    if (nNow - nLastTick >= WHEEL_SLOTS)
+        nLastTick = nNow - WHEEL_SLOTS + 1;
+
+    for (; nLastTick <= nNow; nLastTick++) {
+        std::list<std::string>& slot = vWheel[nLastTick % WHEEL_SLOTS];
+        for (std::list<std::string>::iterator it = slot.begin(); it != slot.end(); ++it) {
+            CTaskEntry& entry = mapTasks.find(*it)->second;
+            if (entry.fRunning || entry.info.nNextRun > nNow)
+                continue;
+
+            strName = *it;
+            task = entry.task;
+            slot.erase(it);
+            entry.nSlot = -1;
+            entry.fRunning = true;
+            return true;
+        }
+        if (nLastTick == nNow)
+            break;
+    }
+    return false;
+}
+
+void CScheduler::Schedule(const std::string& strName, const Task& task, int64_t nDelay)
+{
+    ScheduleEvery(strName, task, 0, nDelay);
+}
+
+void CScheduler::ScheduleEvery(const std::string& strName, const Task& task, int64_t nInterval, int64_t nDelay)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        std::map<std::string, CTaskEntry>::iterator it = mapTasks.find(strName);
+        if (it == mapTasks.end()) {
+            CTaskEntry entry;
+            entry.info.strName = strName;
+            entry.nSlot = -1;
+            entry.fRunning = false;
+            it = mapTasks.insert(std::make_pair(strName, entry)).first;
+        }
+        it->second.task = task;
+        it->second.info.nInterval = nInterval;
+        Queue(it->second, strName, pGetTime() + nDelay);
+    }
+    condition.notify_one();
+}
+
+bool CScheduler::Wake(const std::string& strName)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        std::map<std::string, CTaskEntry>::iterator it = mapTasks.find(strName);
+        if (it == mapTasks.end())
+            return false;
+        Queue(it->second, strName, pGetTime());
+    }
+    condition.notify_one();
+    return true;
+}
+
+void CScheduler::Cancel(const std::string& strName)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    std::map<std::string, CTaskEntry>::iterator it = mapTasks.find(strName);
+    if (it == mapTasks.end())
+        return;
+    Unqueue(it->second, strName);
+    it->second.info.nInterval = 0;
+}
+
+int CScheduler::RunDueTasks(int64_t nNow)
+{
+    int nRun = 0;
+    std::string strName;
+    Task task;
+    while (true) {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (!PopDueTask(nNow, strName, task))
+                break;
+        }
+
+        // tasks run without the lock, they may schedule or wake other tasks and themselves
+        int64_t nTimeStart = GetTimeMicros();
+        try {
+            task();
+        } catch (std::exception& e) {
+            PrintExceptionContinue(&e, strName.c_str());
+        }
+        int64_t nTime = GetTimeMicros() - nTimeStart;
+        nRun++;
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        CTaskEntry& entry = mapTasks.find(strName)->second;
+        entry.fRunning = false;
+        entry.info.nLastRun = nNow;
+        entry.info.nRuns++;
+        entry.info.nTimeTotal += nTime;
+        entry.info.nTimeMax = std::max(entry.info.nTimeMax, nTime);
+        // a periodic task keeps its pace unless it was rescheduled while it ran
+        if (entry.nSlot < 0 && entry.info.nInterval > 0)
+            Queue(entry, strName, nNow + entry.info.nInterval);
+        else if (entry.nSlot < 0)
+            entry.info.nNextRun = 0;
+    }
+    return nRun;
+}
+
+void CScheduler::ServiceQueue()
+{
+    while (true) {
+        boost::this_thread::interruption_point();
+        RunDueTasks(pGetTime());
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        int64_t nNow = pGetTime();
+        int64_t nDeadline = GetNextDeadline(nNow);
+        if (nDeadline > nNow)
+            condition.timed_wait(lock, boost::get_system_time() + boost::posix_time::seconds(nDeadline - nNow));
+    }
+}
+
+std::vector<CSchedulerTaskInfo> CScheduler::GetTasks() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    std::vector<CSchedulerTaskInfo> vTasks;
+    for (std::map<std::string, CTaskEntry>::const_iterator it = mapTasks.begin(); it != mapTasks.end(); ++it)
+        vTasks.push_back(it->second.info);
+    return vTasks;
+}
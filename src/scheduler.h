@@ -0,0 +1,97 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "utiltime.h"
+
+#include <list>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/** Run times of one scheduled task
+ */
+class CSchedulerTaskInfo
+{
+public:
+    std::string strName;
+    // seconds between runs, 0 for a task that runs once
+    int64_t nInterval;
+    // time of the next run, 0 when the task is not queued
+    int64_t nNextRun;
+    int64_t nLastRun;
+    uint64_t nRuns;
+    // microseconds
+    int64_t nTimeTotal;
+    int64_t nTimeMax;
+
+    CSchedulerTaskInfo() : nInterval(0), nNextRun(0), nLastRun(0), nRuns(0), nTimeTotal(0), nTimeMax(0) {}
+};
+
+/** Runs named maintenance tasks at their deadline from a single thread.
+ *  Tasks are kept in a timer wheel with one slot per second; a task due more than one turn
+ *  ahead stays in its slot and is skipped until its turn comes. The thread sleeps until the
+ *  next occupied slot or until a task is woken, so an idle node does not poll.
+ */
+class CScheduler
+{
+public:
+    typedef boost::function<void()> Task;
+
+    static const int WHEEL_SLOTS = 64;
+
+private:
+    struct CTaskEntry {
+        Task task;
+        CSchedulerTaskInfo info;
+        // wheel slot holding the task, -1 when it is not queued
+        int nSlot;
+        bool fRunning;
+    };
+
+    mutable boost::mutex mutex;
+    boost::condition_variable condition;
+    std::map<std::string, CTaskEntry> mapTasks;
+    std::vector<std::list<std::string> > vWheel;
+    // last second whose slot was processed
+    int64_t nLastTick;
+    // clock in seconds, not affected by -mocktime so a mocked time does not stall or flood the wheel
+    int64_t (*pGetTime)();
+
+    void Queue(CTaskEntry& entry, const std::string& strName, int64_t nTime);
+    void Unqueue(CTaskEntry& entry, const std::string& strName);
+    int64_t GetNextDeadline(int64_t nNow) const;
+    bool PopDueTask(int64_t nNow, std::string& strName, Task& task);
+
+public:
+    CScheduler(int64_t (*pGetTimeIn)() = GetSystemTime);
+
+    static int64_t GetSystemTime() { return GetTimeMillis() / 1000; }
+
+    /// Run a task once, nDelay seconds from now. Scheduling a known task again moves its deadline.
+    void Schedule(const std::string& strName, const Task& task, int64_t nDelay);
+    /// Run a task every nInterval seconds, the first time nDelay seconds from now
+    void ScheduleEvery(const std::string& strName, const Task& task, int64_t nInterval, int64_t nDelay);
+    /// Move the next run of a task to now, returns false when the task is unknown
+    bool Wake(const std::string& strName);
+    /// Stop running a task, its statistics are kept
+    void Cancel(const std::string& strName);
+
+    /// Run due tasks until the thread is interrupted
+    void ServiceQueue();
+    /// Run the tasks due at nNow, returns the number of tasks run
+    int RunDueTasks(int64_t nNow);
+
+    std::vector<CSchedulerTaskInfo> GetTasks() const;
+};
+
+extern CScheduler scheduler;
+
+#endif
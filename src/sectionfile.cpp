@@ -0,0 +1,328 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "sectionfile.h"
+#include "chainparams.h"
+#include "hash.h"
+#include "utilstrencodings.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+
+// old cache files start with the length of their magic message, which never matches this
+static const unsigned char pchSectionFileMagic[8] = {'s', 'e', 'c', 't', 'i', 'o', 'n', 's'};
+
+static void WriteRecord(CAutoFile& fileout, const std::string& strName, const std::vector<unsigned char>& vchData, const uint256& hash)
+{
+    fileout << strName;
+    fileout << (uint32_t)vchData.size();
+    fileout << hash;
+    if (!vchData.empty())
+        fileout.write((const char*)&vchData[0], vchData.size());
+}
+
+CSectionFile::CSectionFile(const boost::filesystem::path& pathIn, const std::string& strMagicMessageIn)
+    : path(pathIn), strMagicMessage(strMagicMessageIn), fOpened(false), fLegacy(false), nDataEnd(0)
+{
+}
+
+CSectionFile::ReadResult CSectionFile::Open()
+{
+    fOpened = false;
+    fLegacy = false;
+    nDataEnd = 0;
+    mapSections.clear();
+
+    FILE* file = fopen(path.string().c_str(), "rb");
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return FileError;
+
+    if (fseek(filein.Get(), 0, SEEK_END))
+        return FileError;
+    uint64_t nFileSize = ftell(filein.Get());
+    rewind(filein.Get());
+
+    unsigned char pchMagicTmp[sizeof(pchSectionFileMagic)];
+    try {
+        filein >> FLATDATA(pchMagicTmp);
+    } catch (std::exception& e) {
+        // too short to be a section file, the legacy reader reports what is wrong with it
+        fLegacy = true;
+        return Ok;
+    }
+    if (memcmp(pchMagicTmp, pchSectionFileMagic, sizeof(pchMagicTmp))) {
+        fLegacy = true;
+        return Ok;
+    }
+
+    unsigned char pchMsgTmp[4];
+    std::string strMagicMessageTmp;
+    try {
+        // de-serialize file header (cache file specific magic message) and ..
+        filein >> strMagicMessageTmp;
+
+        // ... verify the message matches predefined one
+        if (strMagicMessage != strMagicMessageTmp) {
+            error("%s : Invalid magic message in %s", __func__, path.string());
+            return IncorrectMagicMessage;
+        }
+
+        // de-serialize file header (network specific magic number) and ..
+        filein >> FLATDATA(pchMsgTmp);
+
+        // ... verify the network matches ours
+        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp))) {
+            error("%s : Invalid network magic number in %s", __func__, path.string());
+            return IncorrectMagicNumber;
+        }
+    } catch (std::exception& e) {
+        error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        return IncorrectFormat;
+    }
+    nDataEnd = ftell(filein.Get());
+
+    // a record cut short by an interrupted Commit ends the index, the next Commit overwrites it
+    while (true) {
+        std::string strName;
+        CSectionRecord record;
+        try {
+            filein >> strName;
+            filein >> record.nSize;
+            filein >> record.hash;
+        } catch (std::exception& e) {
+            break;
+        }
+        record.nPos = ftell(filein.Get());
+        if (record.nPos + record.nSize > nFileSize || fseek(filein.Get(), record.nSize, SEEK_CUR))
+            break;
+
+        // a later record replaces the earlier one
+        mapSections[strName] = record;
+        nDataEnd = record.nPos + record.nSize;
+    }
+
+    fOpened = true;
+    return Ok;
+}
+
+CSectionFile::ReadResult CSectionFile::ReadSectionData(const std::string& strName, std::vector<unsigned char>& vchData) const
+{
+    std::map<std::string, CSectionRecord>::const_iterator it = mapSections.find(strName);
+    if (it == mapSections.end()) {
+        error("%s : Missing section %s in %s", __func__, strName, path.string());
+        return IncorrectFormat;
+    }
+    const CSectionRecord& record = it->second;
+
+    FILE* file = fopen(path.string().c_str(), "rb");
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        error("%s : Failed to open file %s", __func__, path.string());
+        return FileError;
+    }
+
+    vchData.resize(record.nSize);
+    try {
+        if (fseek(filein.Get(), record.nPos, SEEK_SET))
+            throw std::ios_base::failure("fseek failed");
+        if (!vchData.empty())
+            filein.read((char*)&vchData[0], vchData.size());
+    } catch (std::exception& e) {
+        error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        return HashReadError;
+    }
+
+    // verify stored checksum matches section data
+    if (Hash(vchData.begin(), vchData.end()) != record.hash) {
+        error("%s : Checksum mismatch in section %s of %s, data corrupted", __func__, strName, path.string());
+        return IncorrectHash;
+    }
+
+    return Ok;
+}
+
+CSectionFile::ReadResult CSectionFile::Verify() const
+{
+    if (fLegacy) {
+        CDataStream ssObj(SER_DISK, CLIENT_VERSION);
+        return ReadLegacyData(ssObj);
+    }
+
+    std::vector<unsigned char> vchData;
+    BOOST_FOREACH (const PAIRTYPE(const std::string, CSectionRecord) & section, mapSections) {
+        ReadResult result = ReadSectionData(section.first, vchData);
+        if (result != Ok)
+            return result;
+    }
+    return Ok;
+}
+
+CSectionFile::ReadResult CSectionFile::ReadLegacyData(CDataStream& ssObj) const
+{
+    // open input file, and associate with CAutoFile
+    FILE* file = fopen(path.string().c_str(), "rb");
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        error("%s : Failed to open file %s", __func__, path.string());
+        return FileError;
+    }
+
+    // use file size to size memory buffer
+    int fileSize = boost::filesystem::file_size(path);
+    int dataSize = fileSize - sizeof(uint256);
+    // Don't try to resize to a negative number if file is small
+    if (dataSize < 0)
+        dataSize = 0;
+    std::vector<unsigned char> vchData;
+    vchData.resize(dataSize);
+    uint256 hashIn;
+
+    // read data and checksum from file
+    try {
+        if (dataSize > 0)
+            filein.read((char*)&vchData[0], dataSize);
+        filein >> hashIn;
+    } catch (std::exception& e) {
+        error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        return HashReadError;
+    }
+    filein.fclose();
+
+    ssObj.clear();
+    if (!vchData.empty())
+        ssObj.write((const char*)&vchData[0], vchData.size());
+
+    // verify stored checksum matches input data
+    uint256 hashTmp = Hash(ssObj.begin(), ssObj.end());
+    if (hashIn != hashTmp) {
+        error("%s : Checksum mismatch, data corrupted", __func__);
+        return IncorrectHash;
+    }
+
+    unsigned char pchMsgTmp[4];
+    std::string strMagicMessageTmp;
+    try {
+        ssObj >> strMagicMessageTmp;
+        if (strMagicMessage != strMagicMessageTmp) {
+            error("%s : Invalid magic message in %s", __func__, path.string());
+            return IncorrectMagicMessage;
+        }
+
+        ssObj >> FLATDATA(pchMsgTmp);
+        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp))) {
+            error("%s : Invalid network magic number in %s", __func__, path.string());
+            return IncorrectMagicNumber;
+        }
+    } catch (std::exception& e) {
+        error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        return IncorrectFormat;
+    }
+
+    return Ok;
+}
+
+bool CSectionFile::Rewrite()
+{
+    boost::filesystem::path pathTmp = path.string() + ".new";
+
+    FILE* file = fopen(pathTmp.string().c_str(), "wb");
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s : Failed to open file %s", __func__, pathTmp.string());
+
+    try {
+        fileout << FLATDATA(pchSectionFileMagic);
+        fileout << strMagicMessage;                   // cache file specific magic message
+        fileout << FLATDATA(Params().MessageStart()); // network specific magic number
+        BOOST_FOREACH (const PAIRTYPE(const std::string, std::vector<unsigned char>) & section, mapPending)
+            WriteRecord(fileout, section.first, section.second, Hash(section.second.begin(), section.second.end()));
+
+        // sections that were not staged are copied over from the current file
+        std::vector<unsigned char> vchData;
+        BOOST_FOREACH (const PAIRTYPE(const std::string, CSectionRecord) & section, mapSections) {
+            if (mapPending.count(section.first))
+                continue;
+            if (ReadSectionData(section.first, vchData) != Ok)
+                return error("%s : Failed to copy section %s of %s", __func__, section.first, path.string());
+            WriteRecord(fileout, section.first, vchData, section.second.hash);
+        }
+    } catch (std::exception& e) {
+        return error("%s : Serialize or I/O error - %s", __func__, e.what());
+    }
+    FileCommit(fileout.Get());
+    fileout.fclose();
+
+    if (!RenameOver(pathTmp, path))
+        return error("%s : Rename-into-place failed for %s", __func__, path.string());
+
+    return true;
+}
+
+bool CSectionFile::Commit()
+{
+    std::vector<std::pair<std::string, std::pair<CSectionVersion*, uint64_t> > > vVersions;
+    vVersions.swap(vPendingVersions);
+
+    // sections whose data did not change keep their record
+    std::vector<std::pair<const std::string*, uint256> > vChanged;
+    uint64_t nLiveSize = 0;
+    uint64_t nAppendSize = 0;
+    BOOST_FOREACH (const PAIRTYPE(const std::string, std::vector<unsigned char>) & section, mapPending) {
+        uint256 hash = Hash(section.second.begin(), section.second.end());
+        nLiveSize += section.second.size();
+
+        std::map<std::string, CSectionRecord>::const_iterator it = mapSections.find(section.first);
+        if (it != mapSections.end() && it->second.hash == hash)
+            continue;
+        vChanged.push_back(std::make_pair(&section.first, hash));
+        nAppendSize += section.second.size();
+    }
+    BOOST_FOREACH (const PAIRTYPE(const std::string, CSectionRecord) & section, mapSections) {
+        if (!mapPending.count(section.first))
+            nLiveSize += section.second.nSize;
+    }
+
+    bool fRet;
+    if (!fOpened || fLegacy || nDataEnd + nAppendSize > 2 * nLiveSize) {
+        fRet = Rewrite();
+    } else if (vChanged.empty()) {
+        fRet = true;
+    } else {
+        FILE* file = fopen(path.string().c_str(), "r+b");
+        CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+        if (fileout.IsNull())
+            return error("%s : Failed to open file %s", __func__, path.string());
+
+        // drop whatever an interrupted Commit left behind the last complete record
+        if (!TruncateFile(fileout.Get(), nDataEnd) || fseek(fileout.Get(), nDataEnd, SEEK_SET))
+            return error("%s : Failed to truncate file %s", __func__, path.string());
+
+        try {
+            for (unsigned int i = 0; i < vChanged.size(); i++)
+                WriteRecord(fileout, *vChanged[i].first, mapPending[*vChanged[i].first], vChanged[i].second);
+        } catch (std::exception& e) {
+            return error("%s : Serialize or I/O error - %s", __func__, e.what());
+        }
+        FileCommit(fileout.Get());
+        fileout.fclose();
+        fRet = true;
+
+        LogPrint("servicenode", "CSectionFile::Commit - appended %u of %u sections to %s\n", vChanged.size(), mapPending.size(), path.filename().string());
+    }
+
+    if (!fRet)
+        return false;
+
+    mapPending.clear();
+    if (Open() != Ok)
+        return false;
+
+    for (unsigned int i = 0; i < vVersions.size(); i++) {
+        std::map<std::string, CSectionRecord>::const_iterator it = mapSections.find(vVersions[i].first);
+        if (it != mapSections.end())
+            vVersions[i].second.first->SetStored(vVersions[i].second.second, it->second.hash);
+    }
+    return true;
+}
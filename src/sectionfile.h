@@ -0,0 +1,198 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef SECTIONFILE_H
+#define SECTIONFILE_H
+
+#include "clientversion.h"
+#include "serialize.h"
+#include "streams.h"
+#include "uint256.h"
+#include "util.h"
+
+#include <atomic>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+/** Change counter of one section of a cache file, kept by the manager that owns the data.
+ *
+ *  The owner calls Changed() whenever it modifies the data of the section. A section that did not change since it
+ *  was last read from or written to the file is not serialized again, its record is kept.
+ */
+class CSectionVersion
+{
+private:
+    std::atomic<uint64_t> nChanges;
+    // nChanges and hash of the record when the data last matched the file
+    uint64_t nChangesStored;
+    uint256 hashStored;
+
+public:
+    CSectionVersion() : nChanges(0), nChangesStored(std::numeric_limits<uint64_t>::max()) {}
+
+    void Changed() { nChanges++; }
+    uint64_t Get() const { return nChanges; }
+
+    /// Whether the record with this hash still holds the data
+    bool IsStored(const uint256& hash) const { return nChangesStored == nChanges && hashStored == hash; }
+    void SetStored(uint64_t nChangesIn, const uint256& hash)
+    {
+        nChangesStored = nChangesIn;
+        hashStored = hash;
+    }
+};
+
+/** Cache file made of named, checksummed sections (mncache.dat, mnpayments.dat, budget.dat).
+ *
+ *  A section is stored as a record: name, size, hash and data. Writing a section again appends a new
+ *  record that replaces the old one, so Commit only appends the sections that changed and rewrites
+ *  the file once stale records make up most of it. Open only reads the record headers, the data of
+ *  a section is read and checked when the section is decoded, which the owner may defer until it
+ *  needs the data (ReadSectionData, DecodeSection).
+ */
+class CSectionFile
+{
+public:
+    // same values as the ReadResult of the cache file classes
+    enum ReadResult {
+        Ok,
+        FileError,
+        HashReadError,
+        IncorrectHash,
+        IncorrectMagicMessage,
+        IncorrectMagicNumber,
+        IncorrectFormat
+    };
+
+private:
+    struct CSectionRecord {
+        uint64_t nPos;
+        uint32_t nSize;
+        uint256 hash;
+    };
+
+    boost::filesystem::path path;
+    std::string strMagicMessage;
+    bool fOpened;
+    // file written before sections were introduced
+    bool fLegacy;
+    // end of the last complete record
+    uint64_t nDataEnd;
+    std::map<std::string, CSectionRecord> mapSections;
+    std::map<std::string, std::vector<unsigned char> > mapPending;
+    // versions of the staged sections, marked stored once Commit wrote them
+    std::vector<std::pair<std::string, std::pair<CSectionVersion*, uint64_t> > > vPendingVersions;
+
+    ReadResult ReadLegacyData(CDataStream& ssObj) const;
+    bool Rewrite();
+
+public:
+    CSectionFile(const boost::filesystem::path& pathIn, const std::string& strMagicMessageIn);
+
+    /// Read the file header and the record index
+    ReadResult Open();
+    /// Check the data of every section without decoding it
+    ReadResult Verify() const;
+    /// Append the staged sections that changed, or rewrite the file when most of it would be stale. Sections that
+    /// were not staged keep their record.
+    bool Commit();
+
+    bool IsLegacy() const { return fLegacy; }
+    bool HasSection(const std::string& strName) const { return mapSections.count(strName); }
+    uint64_t GetDataEnd() const { return nDataEnd; }
+
+    /// Read and check the data of a section, to be decoded later by DecodeSection
+    ReadResult ReadSectionData(const std::string& strName, std::vector<unsigned char>& vchData) const;
+    /// Same, and mark the section as stored in version
+    ReadResult ReadSectionData(const std::string& strName, std::vector<unsigned char>& vchData, CSectionVersion& version) const
+    {
+        ReadResult result = ReadSectionData(strName, vchData);
+        if (result == Ok)
+            version.SetStored(version.Get(), mapSections.find(strName)->second.hash);
+        return result;
+    }
+
+    template <typename T>
+    static ReadResult DecodeSection(const std::string& strName, const std::vector<unsigned char>& vchData, T& obj)
+    {
+        try {
+            CDataStream ssObj(vchData, SER_DISK, CLIENT_VERSION);
+            ssObj >> obj;
+        } catch (std::exception& e) {
+            error("%s : Deserialize error in section %s - %s", __func__, strName, e.what());
+            return IncorrectFormat;
+        }
+        return Ok;
+    }
+
+    template <typename T>
+    ReadResult ReadSection(const std::string& strName, T& obj) const
+    {
+        std::vector<unsigned char> vchData;
+        ReadResult result = ReadSectionData(strName, vchData);
+        if (result != Ok)
+            return result;
+        return DecodeSection(strName, vchData, obj);
+    }
+
+    /// Same, and mark the section as stored in version
+    template <typename T>
+    ReadResult ReadSection(const std::string& strName, T& obj, CSectionVersion& version) const
+    {
+        std::vector<unsigned char> vchData;
+        ReadResult result = ReadSectionData(strName, vchData, version);
+        if (result != Ok)
+            return result;
+        return DecodeSection(strName, vchData, obj);
+    }
+
+    /// Stage a section for Commit
+    template <typename T>
+    void WriteSection(const std::string& strName, const T& obj)
+    {
+        CDataStream ssObj(SER_DISK, CLIENT_VERSION);
+        ssObj << obj;
+        mapPending[strName].assign(ssObj.begin(), ssObj.end());
+    }
+
+    /// Stage a section for Commit unless its record still holds the data, and mark it as stored once written
+    template <typename T>
+    void WriteSection(const std::string& strName, const T& obj, CSectionVersion& version)
+    {
+        if (IsStored(strName, version))
+            return;
+        vPendingVersions.push_back(std::make_pair(strName, std::make_pair(&version, version.Get())));
+        WriteSection(strName, obj);
+    }
+
+    /// Whether the record of a section still holds the data, so it does not need to be staged again
+    bool IsStored(const std::string& strName, const CSectionVersion& version) const
+    {
+        std::map<std::string, CSectionRecord>::const_iterator it = mapSections.find(strName);
+        return it != mapSections.end() && version.IsStored(it->second.hash);
+    }
+
+    /// Decode a file written before sections were introduced as a single object
+    template <typename T>
+    ReadResult ReadLegacy(T& obj) const
+    {
+        CDataStream ssObj(SER_DISK, CLIENT_VERSION);
+        ReadResult result = ReadLegacyData(ssObj);
+        if (result != Ok)
+            return result;
+
+        try {
+            ssObj >> obj;
+        } catch (std::exception& e) {
+            error("%s : Deserialize or I/O error - %s", __func__, e.what());
+            return IncorrectFormat;
+        }
+        return Ok;
+    }
+};
+
+#endif
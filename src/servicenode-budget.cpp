@@ -241,31 +241,16 @@ CBudgetDB::CBudgetDB()
 
 bool CBudgetDB::Write(const CBudgetManager& objToSave)
 {
-    LOCK(objToSave.cs);
-
     int64_t nStart = GetTimeMillis();
 
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssObj(SER_DISK, CLIENT_VERSION);
-    ssObj << strMagicMessage;                   // servicenode cache file specific magic message
-    ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssObj << objToSave;
-    uint256 hash = Hash(ssObj.begin(), ssObj.end());
-    ssObj << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathDB.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssObj;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    fileout.fclose();
+    // sections that did not change since the last write keep their record
+    CSectionFile file(pathDB, strMagicMessage);
+    CSectionFile::ReadResult result = file.Open();
+    if (result == CSectionFile::IncorrectMagicMessage || result == CSectionFile::IncorrectMagicNumber)
+        return error("%s : Refusing to overwrite %s", __func__, pathDB.string());
+    objToSave.WriteSections(file);
+    if (!file.Commit())
+        return error("%s : Failed to write %s", __func__, pathDB.string());
 
     LogPrintf("Written info to budget.dat  %dms\n", GetTimeMillis() - nStart);
 
@@ -277,72 +262,24 @@ CBudgetDB::ReadResult CBudgetDB::Read(CBudgetManager& objToLoad, bool fDryRun)
     LOCK(objToLoad.cs);
 
     int64_t nStart = GetTimeMillis();
-    // open input file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "rb");
-    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull()) {
-        error("%s : Failed to open file %s", __func__, pathDB.string());
-        return FileError;
-    }
 
-    // use file size to size memory buffer
-    int fileSize = boost::filesystem::file_size(pathDB);
-    int dataSize = fileSize - sizeof(uint256);
-    // Don't try to resize to a negative number if file is small
-    if (dataSize < 0)
-        dataSize = 0;
-    vector<unsigned char> vchData;
-    vchData.resize(dataSize);
-    uint256 hashIn;
-
-    // read data and checksum from file
-    try {
-        filein.read((char*)&vchData[0], dataSize);
-        filein >> hashIn;
-    } catch (std::exception& e) {
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return HashReadError;
-    }
-    filein.fclose();
-
-    CDataStream ssObj(vchData, SER_DISK, CLIENT_VERSION);
-
-    // verify stored checksum matches input data
-    uint256 hashTmp = Hash(ssObj.begin(), ssObj.end());
-    if (hashIn != hashTmp) {
-        error("%s : Checksum mismatch, data corrupted", __func__);
-        return IncorrectHash;
+    CSectionFile file(pathDB, strMagicMessage);
+    CSectionFile::ReadResult result = file.Open();
+    if (result == CSectionFile::FileError)
+        error("%s : Failed to open file %s", __func__, pathDB.string());
+    else if (result == CSectionFile::Ok) {
+        if (file.IsLegacy())
+            result = file.ReadLegacy(objToLoad);
+        else if (fDryRun)
+            // a dry run only checks the sections, nothing is decoded
+            result = file.Verify();
+        else
+            result = objToLoad.ReadSections(file);
     }
-
-
-    unsigned char pchMsgTmp[4];
-    std::string strMagicMessageTmp;
-    try {
-        // de-serialize file header (servicenode cache file specific magic message) and ..
-        ssObj >> strMagicMessageTmp;
-
-        // ... verify the message matches predefined one
-        if (strMagicMessage != strMagicMessageTmp) {
-            error("%s : Invalid servicenode cache magic message", __func__);
-            return IncorrectMagicMessage;
-        }
-
-
-        // de-serialize file header (network specific magic number) and ..
-        ssObj >> FLATDATA(pchMsgTmp);
-
-        // ... verify the network matches ours
-        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp))) {
-            error("%s : Invalid network magic number", __func__);
-            return IncorrectMagicNumber;
-        }
-
-        // de-serialize data into CBudgetManager object
-        ssObj >> objToLoad;
-    } catch (std::exception& e) {
-        objToLoad.Clear();
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return IncorrectFormat;
+    if (result != CSectionFile::Ok) {
+        if (result == CSectionFile::IncorrectFormat)
+            objToLoad.Clear();
+        return static_cast<ReadResult>(result);
     }
 
     LogPrintf("Loaded info from budget.dat  %dms\n", GetTimeMillis() - nStart);
@@ -946,8 +883,8 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
     if (fLiteMode) return;
     if (!servicenodeSync.IsBlockchainSynced()) return;
 
-    LOCK(cs_budget);
-
+    // runs concurrently with the other message handlers: the seen messages are skipped under cs_budget alone,
+    // the rest checks collaterals and servicenodes against the chain under cs_main
     if (strCommand == "mnvs") { //Servicenode vote sync
         uint256 nProp;
         vRecv >> nProp;
@@ -963,6 +900,7 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
             }
         }
 
+        LOCK(cs_budget);
         Sync(pfrom, nProp);
         LogPrint("mnbudget", "mnvs - Sent Servicenode votes to peer %i\n", pfrom->GetId());
     }
@@ -971,8 +909,19 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         CBudgetProposalBroadcast budgetProposalBroadcast;
         vRecv >> budgetProposalBroadcast;
 
+        bool fSeen = false;
+        {
+            LOCK(cs_budget);
+            fSeen = mapSeenServicenodeBudgetProposals.count(budgetProposalBroadcast.GetHash());
+        }
+        if (fSeen) {
+            servicenodeSync.AddedBudgetItem(budgetProposalBroadcast.GetHash(), pfrom);
+            return;
+        }
+
+        LOCK2(cs_main, cs_budget);
         if (mapSeenServicenodeBudgetProposals.count(budgetProposalBroadcast.GetHash())) {
-            servicenodeSync.AddedBudgetItem(budgetProposalBroadcast.GetHash());
+            servicenodeSync.AddedBudgetItem(budgetProposalBroadcast.GetHash(), pfrom);
             return;
         }
 
@@ -995,7 +944,7 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         if (AddProposal(budgetProposal)) {
             budgetProposalBroadcast.Relay();
         }
-        servicenodeSync.AddedBudgetItem(budgetProposalBroadcast.GetHash());
+        servicenodeSync.AddedBudgetItem(budgetProposalBroadcast.GetHash(), pfrom);
 
         LogPrintf("mprop - new budget - %s\n", budgetProposalBroadcast.GetHash().ToString());
 
@@ -1008,8 +957,19 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         vRecv >> vote;
         vote.fValid = true;
 
+        bool fSeen = false;
+        {
+            LOCK(cs_budget);
+            fSeen = mapSeenServicenodeBudgetVotes.count(vote.GetHash());
+        }
+        if (fSeen) {
+            servicenodeSync.AddedBudgetItem(vote.GetHash(), pfrom);
+            return;
+        }
+
+        LOCK2(cs_main, cs_budget);
         if (mapSeenServicenodeBudgetVotes.count(vote.GetHash())) {
-            servicenodeSync.AddedBudgetItem(vote.GetHash());
+            servicenodeSync.AddedBudgetItem(vote.GetHash(), pfrom);
             return;
         }
 
@@ -1033,7 +993,7 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         std::string strError = "";
         if (UpdateProposal(vote, pfrom, strError)) {
             vote.Relay();
-            servicenodeSync.AddedBudgetItem(vote.GetHash());
+            servicenodeSync.AddedBudgetItem(vote.GetHash(), pfrom);
         }
 
         LogPrint("mnbudget", "mvote - new budget vote - %s\n", vote.GetHash().ToString());
@@ -1043,8 +1003,19 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         CFinalizedBudgetBroadcast finalizedBudgetBroadcast;
         vRecv >> finalizedBudgetBroadcast;
 
+        bool fSeen = false;
+        {
+            LOCK(cs_budget);
+            fSeen = mapSeenFinalizedBudgets.count(finalizedBudgetBroadcast.GetHash());
+        }
+        if (fSeen) {
+            servicenodeSync.AddedBudgetItem(finalizedBudgetBroadcast.GetHash(), pfrom);
+            return;
+        }
+
+        LOCK2(cs_main, cs_budget);
         if (mapSeenFinalizedBudgets.count(finalizedBudgetBroadcast.GetHash())) {
-            servicenodeSync.AddedBudgetItem(finalizedBudgetBroadcast.GetHash());
+            servicenodeSync.AddedBudgetItem(finalizedBudgetBroadcast.GetHash(), pfrom);
             return;
         }
 
@@ -1070,7 +1041,7 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         if (AddFinalizedBudget(finalizedBudget)) {
             finalizedBudgetBroadcast.Relay();
         }
-        servicenodeSync.AddedBudgetItem(finalizedBudgetBroadcast.GetHash());
+        servicenodeSync.AddedBudgetItem(finalizedBudgetBroadcast.GetHash(), pfrom);
 
         //we might have active votes for this budget that are now valid
         CheckOrphanVotes();
@@ -1081,8 +1052,19 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         vRecv >> vote;
         vote.fValid = true;
 
+        bool fSeen = false;
+        {
+            LOCK(cs_budget);
+            fSeen = mapSeenFinalizedBudgetVotes.count(vote.GetHash());
+        }
+        if (fSeen) {
+            servicenodeSync.AddedBudgetItem(vote.GetHash(), pfrom);
+            return;
+        }
+
+        LOCK2(cs_main, cs_budget);
         if (mapSeenFinalizedBudgetVotes.count(vote.GetHash())) {
-            servicenodeSync.AddedBudgetItem(vote.GetHash());
+            servicenodeSync.AddedBudgetItem(vote.GetHash(), pfrom);
             return;
         }
 
@@ -1105,7 +1087,7 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         std::string strError = "";
         if (UpdateFinalizedBudget(vote, pfrom, strError)) {
             vote.Relay();
-            servicenodeSync.AddedBudgetItem(vote.GetHash());
+            servicenodeSync.AddedBudgetItem(vote.GetHash(), pfrom);
 
             LogPrintf("fbvote - new finalized budget vote - %s\n", vote.GetHash().ToString());
         } else {
@@ -1610,6 +1592,11 @@ void CBudgetVote::Relay()
     RelayInv(inv);
 }
 
+std::string CBudgetVote::GetSignatureMessage() const
+{
+    return vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+}
+
 bool CBudgetVote::Sign(CKey& keyServicenode, CPubKey& pubKeyServicenode)
 {
     // Choose coins to use
@@ -1617,7 +1604,7 @@ bool CBudgetVote::Sign(CKey& keyServicenode, CPubKey& pubKeyServicenode)
     CKey keyCollateralAddress;
 
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetSignatureMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyServicenode)) {
         LogPrintf("CBudgetVote::Sign - Error upon calling SignMessage");
@@ -1635,7 +1622,7 @@ bool CBudgetVote::Sign(CKey& keyServicenode, CPubKey& pubKeyServicenode)
 bool CBudgetVote::SignatureValid(bool fSignatureCheck)
 {
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetSignatureMessage();
 
     CServicenode* pmn = mnodeman.Find(vin);
 
@@ -2091,3 +2078,34 @@ std::string CBudgetManager::ToString() const
 
     return info.str();
 }
+
+void CBudgetManager::WriteSections(CSectionFile& file) const
+{
+    LOCK(cs);
+    file.WriteSection("seenproposals", mapSeenServicenodeBudgetProposals);
+    file.WriteSection("seenproposalvotes", mapSeenServicenodeBudgetVotes);
+    file.WriteSection("seenbudgets", mapSeenFinalizedBudgets);
+    file.WriteSection("seenbudgetvotes", mapSeenFinalizedBudgetVotes);
+    file.WriteSection("orphanproposalvotes", mapOrphanServicenodeBudgetVotes);
+    file.WriteSection("orphanbudgetvotes", mapOrphanFinalizedBudgetVotes);
+    file.WriteSection("proposals", mapProposals);
+    file.WriteSection("budgets", mapFinalizedBudgets);
+}
+
+CSectionFile::ReadResult CBudgetManager::ReadSections(const CSectionFile& file)
+{
+    LOCK(cs);
+    Clear();
+
+    CSectionFile::ReadResult result = file.ReadSection("seenproposals", mapSeenServicenodeBudgetProposals);
+    if (result == CSectionFile::Ok) result = file.ReadSection("seenproposalvotes", mapSeenServicenodeBudgetVotes);
+    if (result == CSectionFile::Ok) result = file.ReadSection("seenbudgets", mapSeenFinalizedBudgets);
+    if (result == CSectionFile::Ok) result = file.ReadSection("seenbudgetvotes", mapSeenFinalizedBudgetVotes);
+    if (result == CSectionFile::Ok) result = file.ReadSection("orphanproposalvotes", mapOrphanServicenodeBudgetVotes);
+    if (result == CSectionFile::Ok) result = file.ReadSection("orphanbudgetvotes", mapOrphanFinalizedBudgetVotes);
+    if (result == CSectionFile::Ok) result = file.ReadSection("proposals", mapProposals);
+    if (result == CSectionFile::Ok) result = file.ReadSection("budgets", mapFinalizedBudgets);
+    if (result != CSectionFile::Ok)
+        Clear();
+    return result;
+}
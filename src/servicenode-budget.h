@@ -12,6 +12,7 @@
 #include "main.h"
 #include "servicenode.h"
 #include "net.h"
+#include "sectionfile.h"
 #include "sync.h"
 #include "util.h"
 #include <boost/lexical_cast.hpp>
@@ -68,6 +69,8 @@ public:
 
     bool Sign(CKey& keyServicenode, CPubKey& pubKeyServicenode);
     bool SignatureValid(bool fSignatureCheck);
+    /// The message signed by vchSig
+    std::string GetSignatureMessage() const;
     void Relay();
 
     std::string GetVoteString()
@@ -257,6 +260,10 @@ public:
     void CheckAndRemove();
     std::string ToString() const;
 
+    /// Stage the sections of budget.dat
+    void WriteSections(CSectionFile& file) const;
+    /// Load the sections of budget.dat
+    CSectionFile::ReadResult ReadSections(const CSectionFile& file);
 
     ADD_SERIALIZE_METHODS;
 
@@ -33,31 +33,18 @@ CServicenodePaymentDB::CServicenodePaymentDB()
     strMagicMessage = "ServicenodePayments";
 }
 
-bool CServicenodePaymentDB::Write(const CServicenodePayments& objToSave)
+bool CServicenodePaymentDB::Write(CServicenodePayments& objToSave)
 {
     int64_t nStart = GetTimeMillis();
 
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssObj(SER_DISK, CLIENT_VERSION);
-    ssObj << strMagicMessage;                   // servicenode cache file specific magic message
-    ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssObj << objToSave;
-    uint256 hash = Hash(ssObj.begin(), ssObj.end());
-    ssObj << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathDB.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssObj;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    fileout.fclose();
+    // sections that did not change since the last write keep their record
+    CSectionFile file(pathDB, strMagicMessage);
+    CSectionFile::ReadResult result = file.Open();
+    if (result == CSectionFile::IncorrectMagicMessage || result == CSectionFile::IncorrectMagicNumber)
+        return error("%s : Refusing to overwrite %s", __func__, pathDB.string());
+    objToSave.WriteSections(file);
+    if (!file.Commit())
+        return error("%s : Failed to write %s", __func__, pathDB.string());
 
     LogPrintf("Written info to mnpayments.dat  %dms\n", GetTimeMillis() - nStart);
 
@@ -67,71 +54,24 @@ bool CServicenodePaymentDB::Write(const CServicenodePayments& objToSave)
 CServicenodePaymentDB::ReadResult CServicenodePaymentDB::Read(CServicenodePayments& objToLoad, bool fDryRun)
 {
     int64_t nStart = GetTimeMillis();
-    // open input file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "rb");
-    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull()) {
-        error("%s : Failed to open file %s", __func__, pathDB.string());
-        return FileError;
-    }
-
-    // use file size to size memory buffer
-    int fileSize = boost::filesystem::file_size(pathDB);
-    int dataSize = fileSize - sizeof(uint256);
-    // Don't try to resize to a negative number if file is small
-    if (dataSize < 0)
-        dataSize = 0;
-    vector<unsigned char> vchData;
-    vchData.resize(dataSize);
-    uint256 hashIn;
-
-    // read data and checksum from file
-    try {
-        filein.read((char*)&vchData[0], dataSize);
-        filein >> hashIn;
-    } catch (std::exception& e) {
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return HashReadError;
-    }
-    filein.fclose();
-
-    CDataStream ssObj(vchData, SER_DISK, CLIENT_VERSION);
-
-    // verify stored checksum matches input data
-    uint256 hashTmp = Hash(ssObj.begin(), ssObj.end());
-    if (hashIn != hashTmp) {
-        error("%s : Checksum mismatch, data corrupted", __func__);
-        return IncorrectHash;
-    }
-
-    unsigned char pchMsgTmp[4];
-    std::string strMagicMessageTmp;
-    try {
-        // de-serialize file header (servicenode cache file specific magic message) and ..
-        ssObj >> strMagicMessageTmp;
-
-        // ... verify the message matches predefined one
-        if (strMagicMessage != strMagicMessageTmp) {
-            error("%s : Invalid servicenode payement cache magic message", __func__);
-            return IncorrectMagicMessage;
-        }
-
-
-        // de-serialize file header (network specific magic number) and ..
-        ssObj >> FLATDATA(pchMsgTmp);
 
-        // ... verify the network matches ours
-        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp))) {
-            error("%s : Invalid network magic number", __func__);
-            return IncorrectMagicNumber;
-        }
-
-        // de-serialize data into CServicenodePayments object
-        ssObj >> objToLoad;
-    } catch (std::exception& e) {
-        objToLoad.Clear();
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return IncorrectFormat;
+    CSectionFile file(pathDB, strMagicMessage);
+    CSectionFile::ReadResult result = file.Open();
+    if (result == CSectionFile::FileError)
+        error("%s : Failed to open file %s", __func__, pathDB.string());
+    else if (result == CSectionFile::Ok) {
+        if (file.IsLegacy())
+            result = file.ReadLegacy(objToLoad);
+        else if (fDryRun)
+            // a dry run only checks the sections, nothing is decoded
+            result = file.Verify();
+        else
+            result = objToLoad.ReadSections(file);
+    }
+    if (result != CSectionFile::Ok) {
+        if (result == CSectionFile::IncorrectFormat)
+            objToLoad.Clear();
+        return static_cast<ReadResult>(result);
     }
 
     LogPrintf("Loaded info from mnpayments.dat  %dms\n", GetTimeMillis() - nStart);
@@ -370,7 +310,7 @@ void CServicenodePayments::ProcessMessageServicenodePayments(CNode* pfrom, std::
 
         if (servicenodePayments.mapServicenodePayeeVotes.count(winner.GetHash())) {
             LogPrint("mnpayments", "mnw - Already seen - %s bestHeight %d\n", winner.GetHash().ToString().c_str(), nHeight);
-            servicenodeSync.AddedServicenodeWinner(winner.GetHash());
+            servicenodeSync.AddedServicenodeWinner(winner.GetHash(), pfrom);
             return;
         }
 
@@ -407,7 +347,7 @@ void CServicenodePayments::ProcessMessageServicenodePayments(CNode* pfrom, std::
 
         if (servicenodePayments.AddWinningServicenode(winner)) {
             winner.Relay();
-            servicenodeSync.AddedServicenodeWinner(winner.GetHash());
+            servicenodeSync.AddedServicenodeWinner(winner.GetHash(), pfrom);
         }
     }
 }
@@ -417,9 +357,7 @@ bool CServicenodePaymentWinner::Sign(CKey& keyServicenode, CPubKey& pubKeyServic
     std::string errorMessage;
     std::string strServiceNodeSignMessage;
 
-    std::string strMessage = vinServicenode.prevout.ToStringShort() +
-                             boost::lexical_cast<std::string>(nBlockHeight) +
-                             payee.ToString();
+    std::string strMessage = GetSignatureMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyServicenode)) {
         LogPrintf("CServicenodePing::Sign() - Error: %s\n", errorMessage.c_str());
@@ -489,18 +427,66 @@ bool CServicenodePayments::AddWinningServicenode(CServicenodePaymentWinner& winn
         }
 
         mapServicenodePayeeVotes[winnerIn.GetHash()] = winnerIn;
-
-        if (!mapServicenodeBlocks.count(winnerIn.nBlockHeight)) {
-            CServicenodeBlockPayees blockPayees(winnerIn.nBlockHeight);
-            mapServicenodeBlocks[winnerIn.nBlockHeight] = blockPayees;
-        }
+        versionVotes.Changed();
     }
 
-    mapServicenodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, 1);
+    AddBlockPayee(winnerIn.nBlockHeight, winnerIn.payee);
 
     return true;
 }
 
+void CServicenodePayments::AddBlockPayee(int nBlockHeight, const CScript& payee)
+{
+    LOCK(cs_mapServicenodeBlocks);
+
+    if (!mapServicenodeBlocks.count(nBlockHeight)) {
+        CServicenodeBlockPayees blockPayees(nBlockHeight);
+        mapServicenodeBlocks[nBlockHeight] = blockPayees;
+    }
+
+    CServicenodeBlockPayees& blockPayees = mapServicenodeBlocks[nBlockHeight];
+    blockPayees.AddPayee(payee, 1);
+    versionBlocks.Changed();
+    if (blockPayees.HasPayeeWithVotes(payee, MNPAYMENTS_PAID_VOTES))
+        mapPayeePaidHeights[payee].insert(nBlockHeight);
+}
+
+void CServicenodePayments::IndexBlockPayees(const CServicenodeBlockPayees& blockPayees)
+{
+    LOCK2(cs_mapServicenodeBlocks, cs_vecPayments);
+
+    BOOST_FOREACH (const CServicenodePayee& payee, blockPayees.vecPayments) {
+        if (payee.nVotes >= MNPAYMENTS_PAID_VOTES)
+            mapPayeePaidHeights[payee.scriptPubKey].insert(blockPayees.nBlockHeight);
+    }
+}
+
+void CServicenodePayments::UnindexBlockPayees(const CServicenodeBlockPayees& blockPayees)
+{
+    LOCK2(cs_mapServicenodeBlocks, cs_vecPayments);
+
+    BOOST_FOREACH (const CServicenodePayee& payee, blockPayees.vecPayments) {
+        std::map<CScript, std::set<int> >::iterator it = mapPayeePaidHeights.find(payee.scriptPubKey);
+        if (it == mapPayeePaidHeights.end()) continue;
+        it->second.erase(blockPayees.nBlockHeight);
+        if (it->second.empty()) mapPayeePaidHeights.erase(it);
+    }
+}
+
+int CServicenodePayments::GetLastPaidHeight(const CScript& payee, int nMinHeight, int nMaxHeight)
+{
+    LOCK(cs_mapServicenodeBlocks);
+
+    std::map<CScript, std::set<int> >::iterator it = mapPayeePaidHeights.find(payee);
+    if (it == mapPayeePaidHeights.end()) return 0;
+
+    // last height not above nMaxHeight
+    std::set<int>::iterator itHeight = it->second.upper_bound(nMaxHeight);
+    if (itHeight == it->second.begin()) return 0;
+    --itHeight;
+    return *itHeight < nMinHeight ? 0 : *itHeight;
+}
+
 bool CServicenodeBlockPayees::IsTransactionValid(const CTransaction& txNew)
 {
     LOCK(cs_vecPayments);
@@ -618,7 +604,13 @@ void CServicenodePayments::CleanPaymentList()
             LogPrint("mnpayments", "CServicenodePayments::CleanPaymentList - Removing old Servicenode payment - block %d\n", winner.nBlockHeight);
             servicenodeSync.mapSeenSyncMNW.erase((*it).first);
             mapServicenodePayeeVotes.erase(it++);
-            mapServicenodeBlocks.erase(winner.nBlockHeight);
+            versionVotes.Changed();
+            std::map<int, CServicenodeBlockPayees>::iterator itBlock = mapServicenodeBlocks.find(winner.nBlockHeight);
+            if (itBlock != mapServicenodeBlocks.end()) {
+                UnindexBlockPayees(itBlock->second);
+                mapServicenodeBlocks.erase(itBlock);
+                versionBlocks.Changed();
+            }
         } else {
             ++it;
         }
@@ -736,14 +728,19 @@ void CServicenodePaymentWinner::Relay()
     RelayInv(inv);
 }
 
+std::string CServicenodePaymentWinner::GetSignatureMessage() const
+{
+    return vinServicenode.prevout.ToStringShort() +
+           boost::lexical_cast<std::string>(nBlockHeight) +
+           payee.ToString();
+}
+
 bool CServicenodePaymentWinner::SignatureValid()
 {
     CServicenode* pmn = mnodeman.Find(vinServicenode);
 
     if (pmn != NULL) {
-        std::string strMessage = vinServicenode.prevout.ToStringShort() +
-                                 boost::lexical_cast<std::string>(nBlockHeight) +
-                                 payee.ToString();
+        std::string strMessage = GetSignatureMessage();
 
         std::string errorMessage = "";
         if (!obfuScationSigner.VerifyMessage(pmn->pubKeyServicenode, vchSig, strMessage, errorMessage)) {
@@ -827,3 +824,27 @@ int CServicenodePayments::GetNewestBlock()
 
     return nNewestBlock;
 }
+
+void CServicenodePayments::WriteSections(CSectionFile& file)
+{
+    LOCK2(cs_mapServicenodeBlocks, cs_mapServicenodePayeeVotes);
+    file.WriteSection("votes", mapServicenodePayeeVotes, versionVotes);
+    file.WriteSection("blocks", mapServicenodeBlocks, versionBlocks);
+}
+
+CSectionFile::ReadResult CServicenodePayments::ReadSections(const CSectionFile& file)
+{
+    Clear();
+
+    LOCK2(cs_mapServicenodeBlocks, cs_mapServicenodePayeeVotes);
+    CSectionFile::ReadResult result = file.ReadSection("votes", mapServicenodePayeeVotes, versionVotes);
+    if (result == CSectionFile::Ok) result = file.ReadSection("blocks", mapServicenodeBlocks, versionBlocks);
+    if (result != CSectionFile::Ok) {
+        Clear();
+        return result;
+    }
+
+    for (std::map<int, CServicenodeBlockPayees>::iterator it = mapServicenodeBlocks.begin(); it != mapServicenodeBlocks.end(); ++it)
+        IndexBlockPayees(it->second);
+    return CSectionFile::Ok;
+}
@@ -8,6 +8,7 @@
 
 #include "key.h"
 #include "main.h"
+#include "sectionfile.h"
 #include "servicenode.h"
 #include <boost/lexical_cast.hpp>
 
@@ -25,6 +26,8 @@ extern CServicenodePayments servicenodePayments;
 
 #define MNPAYMENTS_SIGNATURES_REQUIRED 6
 #define MNPAYMENTS_SIGNATURES_TOTAL 10
+// votes a payee needs for a block to count as its last payment
+#define MNPAYMENTS_PAID_VOTES 2
 
 void ProcessMessageServicenodePayments(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 bool IsBlockPayeeValid(const CBlock& block, int nBlockHeight);
@@ -54,7 +57,7 @@ public:
     };
 
     CServicenodePaymentDB();
-    bool Write(const CServicenodePayments& objToSave);
+    bool Write(CServicenodePayments& objToSave);
     ReadResult Read(CServicenodePayments& objToLoad, bool fDryRun = false);
 };
 
@@ -195,6 +198,8 @@ public:
     bool Sign(CKey& keyServicenode, CPubKey& pubKeyServicenode);
     bool IsValid(CNode* pnode, std::string& strError);
     bool SignatureValid();
+    /// The message signed by vchSig
+    std::string GetSignatureMessage() const;
     void Relay();
 
     void AddPayee(CScript payeeIn)
@@ -236,10 +241,19 @@ private:
     int nSyncedFromPeer;
     int nLastBlockHeight;
 
+    // heights at which each payee has at least MNPAYMENTS_PAID_VOTES votes, an index on mapServicenodeBlocks (guarded by cs_mapServicenodeBlocks)
+    std::map<CScript, std::set<int> > mapPayeePaidHeights;
+
+    void IndexBlockPayees(const CServicenodeBlockPayees& blockPayees);
+    void UnindexBlockPayees(const CServicenodeBlockPayees& blockPayees);
+
 public:
     std::map<uint256, CServicenodePaymentWinner> mapServicenodePayeeVotes;
     std::map<int, CServicenodeBlockPayees> mapServicenodeBlocks;
     std::map<uint256, int> mapServicenodesLastVote; //prevout.hash + prevout.n, nBlockHeight
+    // bumped whenever the maps above change, so unchanged sections of mnpayments.dat keep their record
+    CSectionVersion versionVotes;
+    CSectionVersion versionBlocks;
 
     CServicenodePayments()
     {
@@ -252,9 +266,15 @@ public:
         LOCK2(cs_mapServicenodeBlocks, cs_mapServicenodePayeeVotes);
         mapServicenodeBlocks.clear();
         mapServicenodePayeeVotes.clear();
+        mapPayeePaidHeights.clear();
+        versionVotes.Changed();
+        versionBlocks.Changed();
     }
 
     bool AddWinningServicenode(CServicenodePaymentWinner& winner);
+    void AddBlockPayee(int nBlockHeight, const CScript& payee);
+    /// Most recent height in [nMinHeight, nMaxHeight] at which the payee counts as paid, or 0
+    int GetLastPaidHeight(const CScript& payee, int nMinHeight, int nMaxHeight);
     bool ProcessBlock(int nBlockHeight);
 
     void Sync(CNode* node, int nCountNeeded);
@@ -288,6 +308,11 @@ public:
     int GetOldestBlock();
     int GetNewestBlock();
 
+    /// Stage the sections of mnpayments.dat
+    void WriteSections(CSectionFile& file);
+    /// Load the sections of mnpayments.dat
+    CSectionFile::ReadResult ReadSections(const CSectionFile& file);
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
@@ -295,6 +320,12 @@ public:
     {
         READWRITE(mapServicenodePayeeVotes);
         READWRITE(mapServicenodeBlocks);
+        if (ser_action.ForRead()) {
+            LOCK(cs_mapServicenodeBlocks);
+            mapPayeePaidHeights.clear();
+            for (std::map<int, CServicenodeBlockPayees>::iterator it = mapServicenodeBlocks.begin(); it != mapServicenodeBlocks.end(); ++it)
+                IndexBlockPayees(it->second);
+        }
     }
 };
 
@@ -0,0 +1,105 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "servicenode-sigcheck.h"
+#include "checkqueue.h"
+#include "main.h"
+#include "net.h"
+#include "obfuscation.h"
+#include "servicenode-budget.h"
+#include "servicenode-payments.h"
+#include "servicenode-sync.h"
+#include "servicenodeman.h"
+#include "util.h"
+
+static CCheckQueue<CServicenodeSigCheck> sigcheckqueue(128);
+// the queue takes one batch at a time, from any of the message handler threads
+static CCriticalSection cs_sigcheckqueue;
+
+void ThreadServicenodeSigCheck()
+{
+    RenameThread("blocknetdx-mnsigch");
+    sigcheckqueue.Thread();
+}
+
+bool CServicenodeSigCheck::operator()()
+{
+    // a bad signature is rejected by the message handler, which verifies it again
+    CKeyID keyID;
+    obfuScationSigner.RecoverMessageKey(vchSig, strMessage, keyID);
+    return true;
+}
+
+static void AddSigChecks(const std::string& strCommand, CDataStream& vRecv, std::vector<CServicenodeSigCheck>& vChecks)
+{
+    // skip what the handlers skip before verifying, so replayed messages stay cheap
+    if (strCommand == "mnb") {
+        CServicenodeBroadcast mnb;
+        vRecv >> mnb;
+        if (mnodeman.IsBroadcastSeen(mnb.GetHash())) return;
+        vChecks.push_back(CServicenodeSigCheck(mnb.sig, mnb.GetSignatureMessage()));
+        if (mnb.lastPing != CServicenodePing())
+            vChecks.push_back(CServicenodeSigCheck(mnb.lastPing.vchSig, mnb.lastPing.GetSignatureMessage()));
+    } else if (strCommand == "mnp") {
+        CServicenodePing mnp;
+        vRecv >> mnp;
+        if (mnodeman.IsPingSeen(mnp.GetHash())) return;
+        vChecks.push_back(CServicenodeSigCheck(mnp.vchSig, mnp.GetSignatureMessage()));
+    } else if (strCommand == "mnw") {
+        CServicenodePaymentWinner winner;
+        vRecv >> winner;
+        {
+            LOCK(cs_mapServicenodePayeeVotes);
+            if (servicenodePayments.mapServicenodePayeeVotes.count(winner.GetHash())) return;
+        }
+        vChecks.push_back(CServicenodeSigCheck(winner.vchSig, winner.GetSignatureMessage()));
+    } else if (strCommand == "mvote") {
+        CBudgetVote vote;
+        vRecv >> vote;
+        {
+            LOCK(cs_budget);
+            if (budget.mapSeenServicenodeBudgetVotes.count(vote.GetHash())) return;
+        }
+        vChecks.push_back(CServicenodeSigCheck(vote.vchSig, vote.GetSignatureMessage()));
+    }
+}
+
+void PrecheckServicenodeSignatures(CNode* pfrom)
+{
+    if (fLiteMode || !nScriptCheckThreads) return;
+    if (!servicenodeSync.IsBlockchainSynced()) return;
+
+    // messages are checked in arrival order, so the unchecked ones follow the last checked one
+    std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.end();
+    while (it != pfrom->vRecvMsg.begin() && !(it - 1)->fSigPrechecked)
+        --it;
+
+    // each seen map is looked up under the lock its handler updates it with
+    std::vector<CServicenodeSigCheck> vChecks;
+    for (; it != pfrom->vRecvMsg.end() && it->complete(); ++it) {
+        CNetMessage& msg = *it;
+        msg.fSigPrechecked = true;
+
+        std::string strCommand = msg.hdr.GetCommand();
+        if (strCommand != "mnb" && strCommand != "mnp" && strCommand != "mnw" && strCommand != "mvote") continue;
+
+        try {
+            CDataStream vRecv(msg.vRecv.begin(), msg.vRecv.end(), msg.vRecv.GetType(), msg.vRecv.GetVersion());
+            AddSigChecks(strCommand, vRecv, vChecks);
+        } catch (std::exception& e) {
+            // malformed, left to the message handler
+        }
+    }
+
+    // a single signature is not worth handing to the queue
+    if (vChecks.size() < 2) return;
+
+    LOCK(cs_sigcheckqueue);
+    int64_t nTimeStart = GetTimeMicros();
+    unsigned int nChecks = vChecks.size();
+    CCheckQueueControl<CServicenodeSigCheck> control(&sigcheckqueue);
+    control.Add(vChecks);
+    control.Wait();
+    LogPrint("bench", "    - Precheck %u servicenode signatures: %.2fms\n", nChecks, (GetTimeMicros() - nTimeStart) * 0.001);
+}
@@ -0,0 +1,39 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef SERVICENODE_SIGCHECK_H
+#define SERVICENODE_SIGCHECK_H
+
+#include <string>
+#include <vector>
+
+class CNode;
+
+/** A servicenode message signature to recover ahead of the message handler.
+ *  The recovered key is cached by obfuScationSigner, where the handler finds it when it verifies the message.
+ */
+class CServicenodeSigCheck
+{
+private:
+    std::vector<unsigned char> vchSig;
+    std::string strMessage;
+
+public:
+    CServicenodeSigCheck() {}
+    CServicenodeSigCheck(const std::vector<unsigned char>& vchSigIn, const std::string& strMessageIn) : vchSig(vchSigIn), strMessage(strMessageIn) {}
+
+    bool operator()();
+
+    void swap(CServicenodeSigCheck& check)
+    {
+        vchSig.swap(check.vchSig);
+        strMessage.swap(check.strMessage);
+    }
+};
+
+/** Recover the signatures of the queued mnb, mnp, mnw and mvote messages of a peer in parallel (requires LOCK(cs_vRecvMsg)) */
+void PrecheckServicenodeSignatures(CNode* pfrom);
+/** Run a worker thread of the servicenode signature check queue */
+void ThreadServicenodeSigCheck();
+
+#endif
@@ -21,6 +21,7 @@ CServicenodeSync servicenodeSync;
 
 CServicenodeSync::CServicenodeSync()
 {
+    nTimeLastStep = 0;
     Reset();
 }
 
@@ -62,6 +63,8 @@ bool CServicenodeSync::IsBlockchainSynced()
 
 void CServicenodeSync::Reset()
 {
+    LOCK(cs);
+    mapSyncPeers.clear();
     lastServicenodeList = 0;
     lastServicenodeWinner = 0;
     lastBudgetItem = 0;
@@ -83,9 +86,11 @@ void CServicenodeSync::Reset()
     nAssetSyncStarted = GetTime();
 }
 
-void CServicenodeSync::AddedServicenodeList(uint256 hash)
+void CServicenodeSync::AddedServicenodeList(uint256 hash, CNode* pfrom)
 {
-    if (mnodeman.mapSeenServicenodeBroadcast.count(hash)) {
+    bool fSeen = mnodeman.IsBroadcastSeen(hash);
+    LOCK(cs);
+    if (fSeen) {
         if (mapSeenSyncMNB[hash] < SERVICENODE_SYNC_THRESHOLD) {
             lastServicenodeList = GetTime();
             mapSeenSyncMNB[hash]++;
@@ -94,11 +99,19 @@ void CServicenodeSync::AddedServicenodeList(uint256 hash)
         lastServicenodeList = GetTime();
         mapSeenSyncMNB.insert(make_pair(hash, 1));
     }
+    if (pfrom && mapSyncPeers.count(pfrom->GetId()))
+        mapSyncPeers[pfrom->GetId()].nItems++;
 }
 
-void CServicenodeSync::AddedServicenodeWinner(uint256 hash)
+void CServicenodeSync::AddedServicenodeWinner(uint256 hash, CNode* pfrom)
 {
-    if (servicenodePayments.mapServicenodePayeeVotes.count(hash)) {
+    bool fSeen;
+    {
+        LOCK(cs_mapServicenodePayeeVotes);
+        fSeen = servicenodePayments.mapServicenodePayeeVotes.count(hash);
+    }
+    LOCK(cs);
+    if (fSeen) {
         if (mapSeenSyncMNW[hash] < SERVICENODE_SYNC_THRESHOLD) {
             lastServicenodeWinner = GetTime();
             mapSeenSyncMNW[hash]++;
@@ -107,12 +120,20 @@ void CServicenodeSync::AddedServicenodeWinner(uint256 hash)
         lastServicenodeWinner = GetTime();
         mapSeenSyncMNW.insert(make_pair(hash, 1));
     }
+    if (pfrom && mapSyncPeers.count(pfrom->GetId()))
+        mapSyncPeers[pfrom->GetId()].nItems++;
 }
 
-void CServicenodeSync::AddedBudgetItem(uint256 hash)
+void CServicenodeSync::AddedBudgetItem(uint256 hash, CNode* pfrom)
 {
-    if (budget.mapSeenServicenodeBudgetProposals.count(hash) || budget.mapSeenServicenodeBudgetVotes.count(hash) ||
-        budget.mapSeenFinalizedBudgets.count(hash) || budget.mapSeenFinalizedBudgetVotes.count(hash)) {
+    bool fSeen = false;
+    {
+        LOCK(cs_budget);
+        fSeen = budget.mapSeenServicenodeBudgetProposals.count(hash) || budget.mapSeenServicenodeBudgetVotes.count(hash) ||
+                budget.mapSeenFinalizedBudgets.count(hash) || budget.mapSeenFinalizedBudgetVotes.count(hash);
+    }
+    LOCK(cs);
+    if (fSeen) {
         if (mapSeenSyncBudget[hash] < SERVICENODE_SYNC_THRESHOLD) {
             lastBudgetItem = GetTime();
             mapSeenSyncBudget[hash]++;
@@ -121,6 +142,8 @@ void CServicenodeSync::AddedBudgetItem(uint256 hash)
         lastBudgetItem = GetTime();
         mapSeenSyncBudget.insert(make_pair(hash, 1));
     }
+    if (pfrom && mapSyncPeers.count(pfrom->GetId()))
+        mapSyncPeers[pfrom->GetId()].nItems++;
 }
 
 bool CServicenodeSync::IsBudgetPropEmpty()
@@ -157,6 +180,104 @@ void CServicenodeSync::GetNextAsset()
     }
     RequestedServicenodeAttempt = 0;
     nAssetSyncStarted = GetTime();
+
+    LOCK(cs);
+    mapSyncPeers.clear();
+}
+
+void CServicenodeSync::FinishAsset()
+{
+    bool fBudget = RequestedServicenodeAssets == SERVICENODE_SYNC_BUDGET;
+    GetNextAsset();
+
+    //try to activate our servicenode if possible
+    if (fBudget) activeServicenode.ManageStatus();
+}
+
+void CServicenodeSync::AddSyncPeer(NodeId id)
+{
+    LOCK(cs);
+    mapSyncPeers[id] = CServicenodeSyncPeer(GetTime());
+}
+
+bool CServicenodeSync::IsSyncPeerPending(NodeId id) const
+{
+    LOCK(cs);
+    std::map<NodeId, CServicenodeSyncPeer>::const_iterator it = mapSyncPeers.find(id);
+    if (it == mapSyncPeers.end()) return false;
+
+    // budgets are reported in two parts, proposals and finalized budgets
+    int nReportsNeeded = RequestedServicenodeAssets == SERVICENODE_SYNC_BUDGET ? 2 : 1;
+    return it->second.nReports < nReportsNeeded && it->second.nTimeRequested > GetTime() - SERVICENODE_SYNC_TIMEOUT * 2;
+}
+
+void CServicenodeSync::GetAssetProgress(int& nItems, int& nExpected) const
+{
+    LOCK(cs);
+    nItems = 0;
+    nExpected = 0;
+    switch (RequestedServicenodeAssets) {
+    case (SERVICENODE_SYNC_LIST):
+        nItems = mapSeenSyncMNB.size();
+        break;
+    case (SERVICENODE_SYNC_MNW):
+        nItems = mapSeenSyncMNW.size();
+        break;
+    case (SERVICENODE_SYNC_BUDGET):
+        nItems = mapSeenSyncBudget.size();
+        break;
+    }
+    BOOST_FOREACH (const PAIRTYPE(const NodeId, CServicenodeSyncPeer) & peer, mapSyncPeers)
+        nExpected = std::max(nExpected, peer.second.nReported);
+}
+
+std::map<NodeId, CServicenodeSyncPeer> CServicenodeSync::GetSyncPeers() const
+{
+    LOCK(cs);
+    return mapSyncPeers;
+}
+
+bool CServicenodeSync::IsAssetConverged() const
+{
+    int nReportsNeeded = RequestedServicenodeAssets == SERVICENODE_SYNC_BUDGET ? 2 : 1;
+    int nPeersReported = 0;
+    {
+        LOCK(cs);
+        BOOST_FOREACH (const PAIRTYPE(const NodeId, CServicenodeSyncPeer) & peer, mapSyncPeers)
+            if (peer.second.nReports >= nReportsNeeded) nPeersReported++;
+    }
+    if (nPeersReported < SERVICENODE_SYNC_THRESHOLD) return false;
+
+    int nItems, nExpected;
+    GetAssetProgress(nItems, nExpected);
+
+    // peers without servicenodes or winners are not synced themselves, that is left to the timeouts
+    if (nExpected == 0) return RequestedServicenodeAssets == SERVICENODE_SYNC_BUDGET;
+
+    return nItems >= nExpected;
+}
+
+std::vector<CNode*> CServicenodeSync::SelectSyncPeers(const std::vector<CNode*>& vNodesIn, const std::string& strRequest, int nMinProto)
+{
+    // ask several peers at once, each inventory item is then fetched from whichever peer announced it first
+    int nPending = 0;
+    BOOST_FOREACH (CNode* pnode, vNodesIn)
+        if (IsSyncPeerPending(pnode->GetId())) nPending++;
+
+    std::vector<CNode*> vSelected;
+    BOOST_FOREACH (CNode* pnode, vNodesIn) {
+        if (nPending >= SERVICENODE_SYNC_PEERS || RequestedServicenodeAttempt >= SERVICENODE_SYNC_THRESHOLD * 3) break;
+        if (pnode->nVersion < nMinProto) continue;
+
+        if (pnode->HasFulfilledRequest(strRequest)) continue;
+        pnode->FulfilledRequest(strRequest);
+
+        AddSyncPeer(pnode->GetId());
+        RequestedServicenodeAttempt++;
+        nPending++;
+        vSelected.push_back(pnode);
+    }
+    return vSelected;
 }
 
 std::string CServicenodeSync::GetSyncStatus()
@@ -180,7 +301,7 @@ std::string CServicenodeSync::GetSyncStatus()
     return "";
 }
 
-void CServicenodeSync::ProcessMessage(CNode* /*pfrom*/, std::string& strCommand, CDataStream& vRecv)
+void CServicenodeSync::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
 {
     if (strCommand == "ssc") { //Sync status count
         int nItemID;
@@ -189,6 +310,8 @@ void CServicenodeSync::ProcessMessage(CNode* /*pfrom*/, std::string& strCommand,
 
         if (RequestedServicenodeAssets >= SERVICENODE_SYNC_FINISHED) return;
 
+        LOCK(cs);
+
         //this means we will receive no further communication
         switch (nItemID) {
         case (SERVICENODE_SYNC_LIST):
@@ -211,6 +334,14 @@ void CServicenodeSync::ProcessMessage(CNode* /*pfrom*/, std::string& strCommand,
             sumBudgetItemFin += nCount;
             countBudgetItemFin++;
             break;
+        default:
+            return;
+        }
+
+        std::map<NodeId, CServicenodeSyncPeer>::iterator it = mapSyncPeers.find(pfrom->GetId());
+        if (it != mapSyncPeers.end()) {
+            it->second.nReported += nCount;
+            it->second.nReports++;
         }
 
         LogPrint("servicenode", "CServicenodeSync:ProcessMessage - ssc - got inventory count %d %d\n", nItemID, nCount);
@@ -232,9 +363,14 @@ void CServicenodeSync::ClearFulfilledRequest()
 
 void CServicenodeSync::Process()
 {
-    static int tick = 0;
-
-    if (tick++ % SERVICENODE_SYNC_TIMEOUT != 0) return;
+    // the list, winners and budgets are checked on every call so they advance as soon as the data converged,
+    // everything else moves one step every SERVICENODE_SYNC_TIMEOUT seconds however often the task is woken
+    int64_t nNow = GetTime();
+    bool fStep = nNow - nTimeLastStep >= SERVICENODE_SYNC_TIMEOUT;
+    if (fStep) nTimeLastStep = nNow;
+    bool fAsset = RequestedServicenodeAssets == SERVICENODE_SYNC_LIST || RequestedServicenodeAssets == SERVICENODE_SYNC_MNW ||
+                  RequestedServicenodeAssets == SERVICENODE_SYNC_BUDGET;
+    if (!fStep && !fAsset) return;
 
     if (IsSynced()) {
         /* 
@@ -253,7 +389,7 @@ void CServicenodeSync::Process()
         return;
     }
 
-    LogPrint("servicenode", "CServicenodeSync::Process() - tick %d RequestedServicenodeAssets %d\n", tick, RequestedServicenodeAssets);
+    if (fStep) LogPrint("servicenode", "CServicenodeSync::Process() - RequestedServicenodeAssets %d\n", RequestedServicenodeAssets);
 
     if (RequestedServicenodeAssets == SERVICENODE_SYNC_INITIAL) GetNextAsset();
 
@@ -261,29 +397,31 @@ void CServicenodeSync::Process()
     if (Params().NetworkID() != CBaseChainParams::REGTEST &&
         !IsBlockchainSynced() && RequestedServicenodeAssets > SERVICENODE_SYNC_SPORKS) return;
 
-    TRY_LOCK(cs_vNodes, lockRecv);
-    if (!lockRecv) return;
-
-    BOOST_FOREACH (CNode* pnode, vNodes) {
-        if (Params().NetworkID() == CBaseChainParams::REGTEST) {
-            if (RequestedServicenodeAttempt <= 2) {
-                pnode->PushMessage("getsporks"); //get current network sporks
-            } else if (RequestedServicenodeAttempt < 4) {
-                mnodeman.DsegUpdate(pnode);
-            } else if (RequestedServicenodeAttempt < 6) {
-                int nMnCount = mnodeman.CountEnabled();
-                pnode->PushMessage("mnget", nMnCount); //sync payees
-                uint256 n = 0;
-                pnode->PushMessage("mnvs", n); //sync servicenode votes
-            } else {
-                RequestedServicenodeAssets = SERVICENODE_SYNC_FINISHED;
+    if (Params().NetworkID() == CBaseChainParams::REGTEST || RequestedServicenodeAssets == SERVICENODE_SYNC_SPORKS) {
+        if (!fStep) return;
+
+        TRY_LOCK(cs_vNodes, lockRecv);
+        if (!lockRecv) return;
+
+        BOOST_FOREACH (CNode* pnode, vNodes) {
+            if (Params().NetworkID() == CBaseChainParams::REGTEST) {
+                if (RequestedServicenodeAttempt <= 2) {
+                    pnode->PushMessage("getsporks"); //get current network sporks
+                } else if (RequestedServicenodeAttempt < 4) {
+                    mnodeman.DsegUpdate(pnode);
+                } else if (RequestedServicenodeAttempt < 6) {
+                    int nMnCount = mnodeman.CountEnabled();
+                    pnode->PushMessage("mnget", nMnCount); //sync payees
+                    uint256 n = 0;
+                    pnode->PushMessage("mnvs", n); //sync servicenode votes
+                } else {
+                    RequestedServicenodeAssets = SERVICENODE_SYNC_FINISHED;
+                }
+                RequestedServicenodeAttempt++;
+                return;
             }
-            RequestedServicenodeAttempt++;
-            return;
-        }
 
-        //set to synced
-        if (RequestedServicenodeAssets == SERVICENODE_SYNC_SPORKS) {
+            //set to synced
             if (pnode->HasFulfilledRequest("getspork")) continue;
             pnode->FulfilledRequest("getspork");
 
@@ -293,117 +431,75 @@ void CServicenodeSync::Process()
 
             return;
         }
+        return;
+    }
 
-        if (pnode->nVersion >= servicenodePayments.GetMinServicenodePaymentsProto()) {
-            if (RequestedServicenodeAssets == SERVICENODE_SYNC_LIST) {
-                LogPrint("servicenode", "CServicenodeSync::Process() - lastServicenodeList %lld (GetTime() - SERVICENODE_SYNC_TIMEOUT) %lld\n", lastServicenodeList, GetTime() - SERVICENODE_SYNC_TIMEOUT);
-                if (lastServicenodeList > 0 && lastServicenodeList < GetTime() - SERVICENODE_SYNC_TIMEOUT * 2 && RequestedServicenodeAttempt >= SERVICENODE_SYNC_THRESHOLD) { //hasn't received a new item in the last five seconds, so we'll move to the
-                    GetNextAsset();
-                    return;
-                }
-
-                if (pnode->HasFulfilledRequest("mnsync")) continue;
-                pnode->FulfilledRequest("mnsync");
-
-                // timeout
-                if (lastServicenodeList == 0 &&
-                    (RequestedServicenodeAttempt >= SERVICENODE_SYNC_THRESHOLD * 3 || GetTime() - nAssetSyncStarted > SERVICENODE_SYNC_TIMEOUT * 5)) {
-                    if (IsSporkActive(SPORK_8_SERVICENODE_PAYMENT_ENFORCEMENT)) {
-                        LogPrintf("CServicenodeSync::Process - ERROR - Sync has failed, will retry later\n");
-                        RequestedServicenodeAssets = SERVICENODE_SYNC_FAILED;
-                        RequestedServicenodeAttempt = 0;
-                        lastFailure = GetTime();
-                        nCountFailures++;
-                    } else {
-                        GetNextAsset();
-                    }
-                    return;
-                }
-
-                if (RequestedServicenodeAttempt >= SERVICENODE_SYNC_THRESHOLD * 3) return;
-
-                mnodeman.DsegUpdate(pnode);
-                RequestedServicenodeAttempt++;
-                return;
-            }
-
-            if (RequestedServicenodeAssets == SERVICENODE_SYNC_MNW) {
-                if (lastServicenodeWinner > 0 && lastServicenodeWinner < GetTime() - SERVICENODE_SYNC_TIMEOUT * 2 && RequestedServicenodeAttempt >= SERVICENODE_SYNC_THRESHOLD) { //hasn't received a new item in the last five seconds, so we'll move to the
-                    GetNextAsset();
-                    return;
-                }
-
-                if (pnode->HasFulfilledRequest("mnwsync")) continue;
-                pnode->FulfilledRequest("mnwsync");
-
-                // timeout
-                if (lastServicenodeWinner == 0 &&
-                    (RequestedServicenodeAttempt >= SERVICENODE_SYNC_THRESHOLD * 3 || GetTime() - nAssetSyncStarted > SERVICENODE_SYNC_TIMEOUT * 5)) {
-                    if (IsSporkActive(SPORK_8_SERVICENODE_PAYMENT_ENFORCEMENT)) {
-                        LogPrintf("CServicenodeSync::Process - ERROR - Sync has failed, will retry later\n");
-                        RequestedServicenodeAssets = SERVICENODE_SYNC_FAILED;
-                        RequestedServicenodeAttempt = 0;
-                        lastFailure = GetTime();
-                        nCountFailures++;
-                    } else {
-                        GetNextAsset();
-                    }
-                    return;
-                }
+    if (!fAsset) return;
 
-                if (RequestedServicenodeAttempt >= SERVICENODE_SYNC_THRESHOLD * 3) return;
+    int64_t nLastItem = 0;
+    std::string strRequest;
+    int nMinProto = servicenodePayments.GetMinServicenodePaymentsProto();
+    switch (RequestedServicenodeAssets) {
+    case (SERVICENODE_SYNC_LIST):
+        nLastItem = lastServicenodeList;
+        strRequest = "mnsync";
+        break;
+    case (SERVICENODE_SYNC_MNW):
+        nLastItem = lastServicenodeWinner;
+        strRequest = "mnwsync";
+        break;
+    case (SERVICENODE_SYNC_BUDGET):
+        nLastItem = lastBudgetItem;
+        strRequest = "busync";
+        nMinProto = ActiveProtocol();
+        break;
+    }
 
-                CBlockIndex* pindexPrev = chainActive.Tip();
-                if (pindexPrev == NULL) return;
+    // every peer that answered has been caught up with
+    if (IsAssetConverged()) {
+        LogPrint("servicenode", "CServicenodeSync::Process() - asset %d converged after %ds\n", RequestedServicenodeAssets, GetTime() - nAssetSyncStarted);
+        FinishAsset();
+        return;
+    }
 
-                int nMnCount = mnodeman.CountEnabled();
-                pnode->PushMessage("mnget", nMnCount); //sync payees
-                RequestedServicenodeAttempt++;
+    //hasn't received a new item in the last ten seconds, so we'll move to the next asset
+    if (nLastItem > 0 && nLastItem < GetTime() - SERVICENODE_SYNC_TIMEOUT * 2 && RequestedServicenodeAttempt >= SERVICENODE_SYNC_THRESHOLD) {
+        FinishAsset();
+        return;
+    }
 
-                return;
-            }
+    // timeout
+    if (nLastItem == 0 &&
+        (RequestedServicenodeAttempt >= SERVICENODE_SYNC_THRESHOLD * 3 || GetTime() - nAssetSyncStarted > SERVICENODE_SYNC_TIMEOUT * 5)) {
+        // maybe there is no budgets at all, so just finish syncing
+        if (RequestedServicenodeAssets != SERVICENODE_SYNC_BUDGET && IsSporkActive(SPORK_8_SERVICENODE_PAYMENT_ENFORCEMENT)) {
+            LogPrintf("CServicenodeSync::Process - ERROR - Sync has failed, will retry later\n");
+            RequestedServicenodeAssets = SERVICENODE_SYNC_FAILED;
+            RequestedServicenodeAttempt = 0;
+            lastFailure = GetTime();
+            nCountFailures++;
+        } else {
+            FinishAsset();
         }
+        return;
+    }
 
-        if (pnode->nVersion >= ActiveProtocol()) {
-            if (RequestedServicenodeAssets == SERVICENODE_SYNC_BUDGET) {
-                //we'll start rejecting votes if we accidentally get set as synced too soon
-                if (lastBudgetItem > 0 && lastBudgetItem < GetTime() - SERVICENODE_SYNC_TIMEOUT * 2 && RequestedServicenodeAttempt >= SERVICENODE_SYNC_THRESHOLD) { //hasn't received a new item in the last five seconds, so we'll move to the
-                                                                                                                                                                 //LogPrintf("CServicenodeSync::Process - HasNextFinalizedBudget %d nCountFailures %d IsBudgetPropEmpty %d\n", budget.HasNextFinalizedBudget(), nCountFailures, IsBudgetPropEmpty());
-                                                                                                                                                                 //if(budget.HasNextFinalizedBudget() || nCountFailures >= 2 || IsBudgetPropEmpty()) {
-                    GetNextAsset();
-
-                    //try to activate our servicenode if possible
-                    activeServicenode.ManageStatus();
-                    // } else { //we've failed to sync, this state will reject the next budget block
-                    //     LogPrintf("CServicenodeSync::Process - ERROR - Sync has failed, will retry later\n");
-                    //     RequestedServicenodeAssets = SERVICENODE_SYNC_FAILED;
-                    //     RequestedServicenodeAttempt = 0;
-                    //     lastFailure = GetTime();
-                    //     nCountFailures++;
-                    // }
-                    return;
-                }
-
-                // timeout
-                if (lastBudgetItem == 0 &&
-                    (RequestedServicenodeAttempt >= SERVICENODE_SYNC_THRESHOLD * 3 || GetTime() - nAssetSyncStarted > SERVICENODE_SYNC_TIMEOUT * 5)) {
-                    // maybe there is no budgets at all, so just finish syncing
-                    GetNextAsset();
-                    activeServicenode.ManageStatus();
-                    return;
-                }
-
-                if (pnode->HasFulfilledRequest("busync")) continue;
-                pnode->FulfilledRequest("busync");
+    if (RequestedServicenodeAttempt >= SERVICENODE_SYNC_THRESHOLD * 3) return;
 
-                if (RequestedServicenodeAttempt >= SERVICENODE_SYNC_THRESHOLD * 3) return;
+    if (RequestedServicenodeAssets == SERVICENODE_SYNC_MNW && chainActive.Tip() == NULL) return;
 
-                uint256 n = 0;
-                pnode->PushMessage("mnvs", n); //sync servicenode votes
-                RequestedServicenodeAttempt++;
+    TRY_LOCK(cs_vNodes, lockRecv);
+    if (!lockRecv) return;
 
-                return;
-            }
+    BOOST_FOREACH (CNode* pnode, SelectSyncPeers(vNodes, strRequest, nMinProto)) {
+        if (RequestedServicenodeAssets == SERVICENODE_SYNC_LIST) {
+            mnodeman.DsegUpdate(pnode);
+        } else if (RequestedServicenodeAssets == SERVICENODE_SYNC_MNW) {
+            int nMnCount = mnodeman.CountEnabled();
+            pnode->PushMessage("mnget", nMnCount); //sync payees
+        } else {
+            uint256 n = 0;
+            pnode->PushMessage("mnvs", n); //sync servicenode votes
         }
     }
 }
@@ -6,6 +6,9 @@
 #ifndef SERVICENODE_SYNC_H
 #define SERVICENODE_SYNC_H
 
+#include "net.h"
+#include "sync.h"
+
 #define SERVICENODE_SYNC_INITIAL 0
 #define SERVICENODE_SYNC_SPORKS 1
 #define SERVICENODE_SYNC_LIST 2
@@ -18,16 +21,47 @@
 
 #define SERVICENODE_SYNC_TIMEOUT 5
 #define SERVICENODE_SYNC_THRESHOLD 2
+#define SERVICENODE_SYNC_PEERS 3
 
 class CServicenodeSync;
 extern CServicenodeSync servicenodeSync;
 
+//
+// CServicenodeSyncPeer : Sync requests sent to one peer for the current asset
+//
+
+class CServicenodeSyncPeer
+{
+public:
+    int64_t nTimeRequested;
+    // inventory count the peer announced with ssc, and the number of ssc messages
+    int nReported;
+    int nReports;
+    // items from the peer that counted towards the sync
+    int nItems;
+
+    CServicenodeSyncPeer(int64_t nTimeRequestedIn = 0) : nTimeRequested(nTimeRequestedIn), nReported(0), nReports(0), nItems(0) {}
+};
+
 //
 // CServicenodeSync : Sync servicenode assets in stages
 //
 
 class CServicenodeSync
 {
+private:
+    // protects the seen maps and mapSyncPeers. Callers may hold cs_vNodes, cs_main, mnodeman.cs or cs_budget when
+    // taking it, so the lookups in the servicenode, payment and budget maps are done before it is taken.
+    mutable CCriticalSection cs;
+    // peers asked for the current asset
+    std::map<NodeId, CServicenodeSyncPeer> mapSyncPeers;
+    // time of the last step of the sporks and the regtest sync, Process runs more often than that
+    int64_t nTimeLastStep;
+
+    void AddSyncPeer(NodeId id);
+    bool IsSyncPeerPending(NodeId id) const;
+    void FinishAsset();
+
 public:
     std::map<uint256, int> mapSeenSyncMNB;
     std::map<uint256, int> mapSeenSyncMNW;
@@ -59,10 +93,18 @@ public:
 
     CServicenodeSync();
 
-    void AddedServicenodeList(uint256 hash);
-    void AddedServicenodeWinner(uint256 hash);
-    void AddedBudgetItem(uint256 hash);
+    /// Count a synced item, pfrom is the peer that sent it if known
+    void AddedServicenodeList(uint256 hash, CNode* pfrom = NULL);
+    void AddedServicenodeWinner(uint256 hash, CNode* pfrom = NULL);
+    void AddedBudgetItem(uint256 hash, CNode* pfrom = NULL);
     void GetNextAsset();
+    /// Items of the current asset received so far, and the most any peer announced
+    void GetAssetProgress(int& nItems, int& nExpected) const;
+    std::map<NodeId, CServicenodeSyncPeer> GetSyncPeers() const;
+    /// Whether enough of the peers asked have reported their counts, and all announced items arrived
+    bool IsAssetConverged() const;
+    /// Pick the peers to ask for the current asset next, so that up to SERVICENODE_SYNC_PEERS requests are pending
+    std::vector<CNode*> SelectSyncPeers(const std::vector<CNode*>& vNodesIn, const std::string& strRequest, int nMinProto);
     std::string GetSyncStatus();
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
     bool IsBudgetFinEmpty();
@@ -148,8 +148,9 @@ bool CServicenode::UpdateFromNewBroadcast(CServicenodeBroadcast& mnb)
         int nDoS = 0;
         if (mnb.lastPing == CServicenodePing() || (mnb.lastPing != CServicenodePing() && mnb.lastPing.CheckAndUpdate(nDoS, false))) {
             lastPing = mnb.lastPing;
-            mnodeman.mapSeenServicenodePing.insert(make_pair(lastPing.GetHash(), lastPing));
+            mnodeman.AddSeenPing(lastPing);
         }
+        mnodeman.UpdateIndexes(*this);
         return true;
     }
     return false;
@@ -194,10 +195,6 @@ void CServicenode::Check(bool forceCheck)
     lastTimeChecked = GetTime();
 
 
-    //once spent, stop doing the checks
-    if (activeState == SERVICENODE_VIN_SPENT) return;
-
-
     if (!IsPingedWithin(SERVICENODE_REMOVAL_SECONDS)) {
         activeState = SERVICENODE_REMOVE;
         return;
@@ -208,33 +205,22 @@ void CServicenode::Check(bool forceCheck)
         return;
     }
 
-    if (!unitTest) {
-        CValidationState state;
-        CMutableTransaction tx = CMutableTransaction();
-        CTxOut vout = CTxOut(SERVICENODE_ACCEPTABLE_INPUTS_CHECK_AMOUNT * COIN, obfuScationPool.collateralPubKey);
-        tx.vin.push_back(vin);
-        tx.vout.push_back(vout);
-
-        {
-            TRY_LOCK(cs_main, lockMain);
-            if (!lockMain) return;
-
-            if (!AcceptableInputs(mempool, state, CTransaction(tx), false, NULL)) {
-                activeState = SERVICENODE_VIN_SPENT;
-                return;
-            }
-        }
+    // spends of listed collaterals are tracked by mnodeman as transactions and blocks come in, and checked
+    // against the UTXO set again before CheckAndRemove acts on them
+    if (!unitTest && mnodeman.IsCollateralSpent(vin.prevout)) {
+        activeState = SERVICENODE_VIN_SPENT;
+        return;
     }
 
     activeState = SERVICENODE_ENABLED; // OK
 }
 
-int64_t CServicenode::SecondsSincePayment()
+int64_t CServicenode::SecondsSincePayment(int nEnabled)
 {
     CScript pubkeyScript;
     pubkeyScript = GetScriptForDestination(pubKeyCollateralAddress.GetID());
 
-    int64_t sec = (GetAdjustedTime() - GetLastPaid());
+    int64_t sec = (GetAdjustedTime() - GetLastPaid(nEnabled));
     int64_t month = 60 * 60 * 24 * 30;
     if (sec < month) return sec; //if it's less than 30 days, give seconds
 
@@ -247,7 +233,7 @@ int64_t CServicenode::SecondsSincePayment()
     return month + hash.GetCompact(false);
 }
 
-int64_t CServicenode::GetLastPaid()
+int64_t CServicenode::GetLastPaid(int nEnabled)
 {
     CBlockIndex* pindexPrev = chainActive.Tip();
     if (pindexPrev == NULL) return false;
@@ -263,36 +249,17 @@ int64_t CServicenode::GetLastPaid()
     // use a deterministic offset to break a tie -- 2.5 minutes
     int64_t nOffset = hash.GetCompact(false) % 150;
 
-    if (chainActive.Tip() == NULL) return false;
-
-    const CBlockIndex* BlockReading = chainActive.Tip();
+    if (nEnabled < 0) nEnabled = mnodeman.CountEnabled();
+    int nMnCount = nEnabled * 1.25;
 
-    int nMnCount = mnodeman.CountEnabled() * 1.25;
-    int n = 0;
-    for (unsigned int i = 1; BlockReading && BlockReading->nHeight > 0; i++) {
-        if (n >= nMnCount) {
-            return 0;
-        }
-        n++;
+    /*
+        Search the last nMnCount blocks (not the genesis block) for this payee, with at least 2 votes. This will aid
+        in consensus allowing the network to converge on the same payees quickly, then keep the same schedule.
+    */
+    int nHeight = servicenodePayments.GetLastPaidHeight(mnpayee, std::max(pindexPrev->nHeight - nMnCount + 1, 1), pindexPrev->nHeight);
+    if (nHeight == 0) return 0;
 
-        if (servicenodePayments.mapServicenodeBlocks.count(BlockReading->nHeight)) {
-            /*
-                Search for this payee, with at least 2 votes. This will aid in consensus allowing the network 
-                to converge on the same payees quickly, then keep the same schedule.
-            */
-            if (servicenodePayments.mapServicenodeBlocks[BlockReading->nHeight].HasPayeeWithVotes(mnpayee, 2)) {
-                return BlockReading->nTime + nOffset;
-            }
-        }
-
-        if (BlockReading->pprev == NULL) {
-            assert(BlockReading);
-            break;
-        }
-        BlockReading = BlockReading->pprev;
-    }
-
-    return 0;
+    return chainActive[nHeight]->nTime + nOffset;
 }
 
 std::string CServicenode::GetStatus()
@@ -476,9 +443,7 @@ bool CServicenodeBroadcast::CheckAndUpdate(int& nDos)
         return false;
     }
 
-    std::string vchPubKey(pubKeyCollateralAddress.begin(), pubKeyCollateralAddress.end());
-    std::string vchPubKey2(pubKeyServicenode.begin(), pubKeyServicenode.end());
-    std::string strMessage = addr.ToString() + boost::lexical_cast<std::string>(sigTime) + vchPubKey + vchPubKey2 + boost::lexical_cast<std::string>(protocolVersion);
+    std::string strMessage = GetSignatureMessage();
 
     if (protocolVersion < servicenodePayments.GetMinServicenodePaymentsProto()) {
         LogPrintf("mnb - ignoring outdated Servicenode %s protocol version %d\n", vin.prevout.hash.ToString(), protocolVersion);
@@ -577,45 +542,39 @@ bool CServicenodeBroadcast::CheckInputsAndAdd(int& nDoS)
     tx.vout.push_back(vout);
 
     {
-        TRY_LOCK(cs_main, lockMain);
-        if (!lockMain) {
-            // not mnb fault, let it to be checked again later
-            mnodeman.mapSeenServicenodeBroadcast.erase(GetHash());
-            servicenodeSync.mapSeenSyncMNB.erase(GetHash());
-            return false;
-        }
-
+        // the mnb handler runs without cs_main, wait for it rather than dropping the mnb
+        LOCK(cs_main);
         if (!AcceptableInputs(mempool, state, CTransaction(tx), false, NULL)) {
             //set nDos
             state.IsInvalid(nDoS);
             return false;
         }
-    }
 
-    LogPrint("servicenode", "mnb - Accepted Servicenode entry\n");
-
-    if (GetInputAge(vin) < SERVICENODE_MIN_CONFIRMATIONS) {
-        LogPrintf("mnb - Input must have at least %d confirmations\n", SERVICENODE_MIN_CONFIRMATIONS);
-        // maybe we miss few blocks, let this mnb to be checked again later
-        mnodeman.mapSeenServicenodeBroadcast.erase(GetHash());
-        servicenodeSync.mapSeenSyncMNB.erase(GetHash());
-        return false;
-    }
+        LogPrint("servicenode", "mnb - Accepted Servicenode entry\n");
 
-    // verify that sig time is legit in past
-    // should be at least not earlier than block when 1000 BLOCK tx got SERVICENODE_MIN_CONFIRMATIONS
-    uint256 hashBlock = 0;
-    CTransaction tx2;
-    GetTransaction(vin.prevout.hash, tx2, hashBlock, true);
-    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
-    if (mi != mapBlockIndex.end() && (*mi).second) {
-        CBlockIndex* pMNIndex = (*mi).second;                                                        // block for 1000 BlocknetDX tx -> 1 confirmation
-        CBlockIndex* pConfIndex = chainActive[pMNIndex->nHeight + SERVICENODE_MIN_CONFIRMATIONS - 1]; // block where tx got SERVICENODE_MIN_CONFIRMATIONS
-        if (pConfIndex->GetBlockTime() > sigTime) {
-            LogPrintf("mnb - Bad sigTime %d for Servicenode %s (%i conf block is at %d)\n",
-                sigTime, vin.prevout.hash.ToString(), SERVICENODE_MIN_CONFIRMATIONS, pConfIndex->GetBlockTime());
+        if (GetInputAge(vin) < SERVICENODE_MIN_CONFIRMATIONS) {
+            LogPrintf("mnb - Input must have at least %d confirmations\n", SERVICENODE_MIN_CONFIRMATIONS);
+            // maybe we miss few blocks, let this mnb to be checked again later
+            mnodeman.EraseSeenBroadcast(GetHash());
+            servicenodeSync.mapSeenSyncMNB.erase(GetHash());
             return false;
         }
+
+        // verify that sig time is legit in past
+        // should be at least not earlier than block when 1000 BLOCK tx got SERVICENODE_MIN_CONFIRMATIONS
+        uint256 hashBlock = 0;
+        CTransaction tx2;
+        GetTransaction(vin.prevout.hash, tx2, hashBlock, true);
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+        if (mi != mapBlockIndex.end() && (*mi).second) {
+            CBlockIndex* pMNIndex = (*mi).second;                                                        // block for 1000 BlocknetDX tx -> 1 confirmation
+            CBlockIndex* pConfIndex = chainActive[pMNIndex->nHeight + SERVICENODE_MIN_CONFIRMATIONS - 1]; // block where tx got SERVICENODE_MIN_CONFIRMATIONS
+            if (pConfIndex->GetBlockTime() > sigTime) {
+                LogPrintf("mnb - Bad sigTime %d for Servicenode %s (%i conf block is at %d)\n",
+                    sigTime, vin.prevout.hash.ToString(), SERVICENODE_MIN_CONFIRMATIONS, pConfIndex->GetBlockTime());
+                return false;
+            }
+        }
     }
 
     LogPrintf("mnb - Got NEW Servicenode entry - %s - %lli \n", vin.prevout.hash.ToString(), sigTime);
@@ -635,6 +594,13 @@ bool CServicenodeBroadcast::CheckInputsAndAdd(int& nDoS)
     return true;
 }
 
+std::string CServicenodeBroadcast::GetSignatureMessage() const
+{
+    std::string vchPubKey(pubKeyCollateralAddress.begin(), pubKeyCollateralAddress.end());
+    std::string vchPubKey2(pubKeyServicenode.begin(), pubKeyServicenode.end());
+    return addr.ToString() + boost::lexical_cast<std::string>(sigTime) + vchPubKey + vchPubKey2 + boost::lexical_cast<std::string>(protocolVersion);
+}
+
 void CServicenodeBroadcast::Relay()
 {
     CInv inv(MSG_SERVICENODE_ANNOUNCE, GetHash());
@@ -645,12 +611,9 @@ bool CServicenodeBroadcast::Sign(CKey& keyCollateralAddress)
 {
     std::string errorMessage;
 
-    std::string vchPubKey(pubKeyCollateralAddress.begin(), pubKeyCollateralAddress.end());
-    std::string vchPubKey2(pubKeyServicenode.begin(), pubKeyServicenode.end());
-
     sigTime = GetAdjustedTime();
 
-    std::string strMessage = addr.ToString() + boost::lexical_cast<std::string>(sigTime) + vchPubKey + vchPubKey2 + boost::lexical_cast<std::string>(protocolVersion);
+    std::string strMessage = GetSignatureMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, sig, keyCollateralAddress)) {
         LogPrintf("CServicenodeBroadcast::Sign() - Error: %s\n", errorMessage);
@@ -684,7 +647,7 @@ bool CServicenodePing::Sign(CKey& keyServicenode, CPubKey& pubKeyServicenode)
     std::string strServiceNodeSignMessage;
 
     sigTime = GetAdjustedTime();
-    std::string strMessage = vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+    std::string strMessage = GetSignatureMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyServicenode)) {
         LogPrintf("CServicenodePing::Sign() - Error: %s\n", errorMessage);
@@ -699,6 +662,11 @@ bool CServicenodePing::Sign(CKey& keyServicenode, CPubKey& pubKeyServicenode)
     return true;
 }
 
+std::string CServicenodePing::GetSignatureMessage() const
+{
+    return vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+}
+
 bool CServicenodePing::CheckAndUpdate(int& nDos, bool fRequireEnabled)
 {
     if (sigTime > GetAdjustedTime() + 60 * 60) {
@@ -724,7 +692,7 @@ bool CServicenodePing::CheckAndUpdate(int& nDos, bool fRequireEnabled)
         // update only if there is no known ping for this servicenode or
         // last ping was more then SERVICENODE_MIN_MNP_SECONDS-60 ago comparing to this one
         if (!pmn->IsPingedWithin(SERVICENODE_MIN_MNP_SECONDS - 60, sigTime)) {
-            std::string strMessage = vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+            std::string strMessage = GetSignatureMessage();
 
             std::string errorMessage = "";
             if (!obfuScationSigner.VerifyMessage(pmn->pubKeyServicenode, vchSig, strMessage, errorMessage)) {
@@ -733,21 +701,24 @@ bool CServicenodePing::CheckAndUpdate(int& nDos, bool fRequireEnabled)
                 return false;
             }
 
-            BlockMap::iterator mi = mapBlockIndex.find(blockHash);
-            if (mi != mapBlockIndex.end() && (*mi).second) {
-                if ((*mi).second->nHeight < chainActive.Height() - 24) {
-                    LogPrintf("CServicenodePing::CheckAndUpdate - Servicenode %s block hash %s is too old\n", vin.prevout.hash.ToString(), blockHash.ToString());
-                    // Do nothing here (no Servicenode update, no mnping relay)
-                    // Let this node to be visible but fail to accept mnping
+            {
+                LOCK(cs_main);
+                BlockMap::iterator mi = mapBlockIndex.find(blockHash);
+                if (mi != mapBlockIndex.end() && (*mi).second) {
+                    if ((*mi).second->nHeight < chainActive.Height() - 24) {
+                        LogPrintf("CServicenodePing::CheckAndUpdate - Servicenode %s block hash %s is too old\n", vin.prevout.hash.ToString(), blockHash.ToString());
+                        // Do nothing here (no Servicenode update, no mnping relay)
+                        // Let this node to be visible but fail to accept mnping
+
+                        return false;
+                    }
+                } else {
+                    if (fDebug) LogPrintf("CServicenodePing::CheckAndUpdate - Servicenode %s block hash %s is unknown\n", vin.prevout.hash.ToString(), blockHash.ToString());
+                    // maybe we stuck so we shouldn't ban this node, just fail to accept it
+                    // TODO: or should we also request this block?
 
                     return false;
                 }
-            } else {
-                if (fDebug) LogPrintf("CServicenodePing::CheckAndUpdate - Servicenode %s block hash %s is unknown\n", vin.prevout.hash.ToString(), blockHash.ToString());
-                // maybe we stuck so we shouldn't ban this node, just fail to accept it
-                // TODO: or should we also request this block?
-
-                return false;
             }
 
             pmn->lastPing = *this;
@@ -755,9 +726,7 @@ bool CServicenodePing::CheckAndUpdate(int& nDos, bool fRequireEnabled)
             //mnodeman.mapSeenServicenodeBroadcast.lastPing is probably outdated, so we'll update it
             CServicenodeBroadcast mnb(*pmn);
             uint256 hash = mnb.GetHash();
-            if (mnodeman.mapSeenServicenodeBroadcast.count(hash)) {
-                mnodeman.mapSeenServicenodeBroadcast[hash].lastPing = *this;
-            }
+            mnodeman.UpdateSeenBroadcastPing(hash, *this);
 
             pmn->Check(true);
             if (!pmn->IsEnabled()) return false;
@@ -61,6 +61,8 @@ public:
 
     bool CheckAndUpdate(int& nDos, bool fRequireEnabled = true);
     bool Sign(CKey& keyServicenode, CPubKey& pubKeyServicenode);
+    /// The message signed by vchSig
+    std::string GetSignatureMessage() const;
     void Relay();
 
     uint256 GetHash()
@@ -217,7 +219,7 @@ public:
         READWRITE(nLastScanningErrorBlockHeight);
     }
 
-    int64_t SecondsSincePayment();
+    int64_t SecondsSincePayment(int nEnabled = -1);
 
     bool UpdateFromNewBroadcast(CServicenodeBroadcast& mnb);
 
@@ -280,7 +282,8 @@ public:
         return strStatus;
     }
 
-    int64_t GetLastPaid();
+    /// Time of the last payment within the last nEnabled * 1.25 blocks (nEnabled defaults to CountEnabled())
+    int64_t GetLastPaid(int nEnabled = -1);
     bool IsValidNetAddr();
 };
 
@@ -299,6 +302,8 @@ public:
     bool CheckAndUpdate(int& nDoS);
     bool CheckInputsAndAdd(int& nDos);
     bool Sign(CKey& keyCollateralAddress);
+    /// The message signed by sig
+    std::string GetSignatureMessage() const;
     void Relay();
 
     ADD_SERIALIZE_METHODS;
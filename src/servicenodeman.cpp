@@ -50,32 +50,18 @@ CServicenodeDB::CServicenodeDB()
     strMagicMessage = "ServicenodeCache";
 }
 
-bool CServicenodeDB::Write(const CServicenodeMan& mnodemanToSave)
+bool CServicenodeDB::Write(CServicenodeMan& mnodemanToSave)
 {
     int64_t nStart = GetTimeMillis();
 
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssServicenodes(SER_DISK, CLIENT_VERSION);
-    ssServicenodes << strMagicMessage;                   // servicenode cache file specific magic message
-    ssServicenodes << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssServicenodes << mnodemanToSave;
-    uint256 hash = Hash(ssServicenodes.begin(), ssServicenodes.end());
-    ssServicenodes << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathMN.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathMN.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssServicenodes;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    //    FileCommit(fileout);
-    fileout.fclose();
+    // sections that did not change since the last write keep their record, a missing or broken file is rewritten
+    CSectionFile file(pathMN, strMagicMessage);
+    CSectionFile::ReadResult result = file.Open();
+    if (result == CSectionFile::IncorrectMagicMessage || result == CSectionFile::IncorrectMagicNumber)
+        return error("%s : Refusing to overwrite %s", __func__, pathMN.string());
+    mnodemanToSave.WriteSections(file);
+    if (!file.Commit())
+        return error("%s : Failed to write %s", __func__, pathMN.string());
 
     LogPrintf("Written info to mncache.dat  %dms\n", GetTimeMillis() - nStart);
     LogPrintf("  %s\n", mnodemanToSave.ToString());
@@ -86,70 +72,24 @@ bool CServicenodeDB::Write(const CServicenodeMan& mnodemanToSave)
 CServicenodeDB::ReadResult CServicenodeDB::Read(CServicenodeMan& mnodemanToLoad, bool fDryRun)
 {
     int64_t nStart = GetTimeMillis();
-    // open input file, and associate with CAutoFile
-    FILE* file = fopen(pathMN.string().c_str(), "rb");
-    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull()) {
-        error("%s : Failed to open file %s", __func__, pathMN.string());
-        return FileError;
-    }
 
-    // use file size to size memory buffer
-    int fileSize = boost::filesystem::file_size(pathMN);
-    int dataSize = fileSize - sizeof(uint256);
-    // Don't try to resize to a negative number if file is small
-    if (dataSize < 0)
-        dataSize = 0;
-    vector<unsigned char> vchData;
-    vchData.resize(dataSize);
-    uint256 hashIn;
-
-    // read data and checksum from file
-    try {
-        filein.read((char*)&vchData[0], dataSize);
-        filein >> hashIn;
-    } catch (std::exception& e) {
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return HashReadError;
+    CSectionFile file(pathMN, strMagicMessage);
+    CSectionFile::ReadResult result = file.Open();
+    if (result == CSectionFile::FileError)
+        error("%s : Failed to open file %s", __func__, pathMN.string());
+    else if (result == CSectionFile::Ok) {
+        if (file.IsLegacy())
+            result = file.ReadLegacy(mnodemanToLoad);
+        else if (fDryRun)
+            // a dry run only checks the sections, nothing is decoded
+            result = file.Verify();
+        else
+            result = mnodemanToLoad.ReadSections(file);
     }
-    filein.fclose();
-
-    CDataStream ssServicenodes(vchData, SER_DISK, CLIENT_VERSION);
-
-    // verify stored checksum matches input data
-    uint256 hashTmp = Hash(ssServicenodes.begin(), ssServicenodes.end());
-    if (hashIn != hashTmp) {
-        error("%s : Checksum mismatch, data corrupted", __func__);
-        return IncorrectHash;
-    }
-
-    unsigned char pchMsgTmp[4];
-    std::string strMagicMessageTmp;
-    try {
-        // de-serialize file header (servicenode cache file specific magic message) and ..
-
-        ssServicenodes >> strMagicMessageTmp;
-
-        // ... verify the message matches predefined one
-        if (strMagicMessage != strMagicMessageTmp) {
-            error("%s : Invalid servicenode cache magic message", __func__);
-            return IncorrectMagicMessage;
-        }
-
-        // de-serialize file header (network specific magic number) and ..
-        ssServicenodes >> FLATDATA(pchMsgTmp);
-
-        // ... verify the network matches ours
-        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp))) {
-            error("%s : Invalid network magic number", __func__);
-            return IncorrectMagicNumber;
-        }
-        // de-serialize data into CServicenodeMan object
-        ssServicenodes >> mnodemanToLoad;
-    } catch (std::exception& e) {
-        mnodemanToLoad.Clear();
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return IncorrectFormat;
+    if (result != CSectionFile::Ok) {
+        if (result == CSectionFile::IncorrectFormat)
+            mnodemanToLoad.Clear();
+        return static_cast<ReadResult>(result);
     }
 
     LogPrintf("Loaded info from mncache.dat  %dms\n", GetTimeMillis() - nStart);
@@ -194,6 +134,8 @@ void DumpServicenodes()
 CServicenodeMan::CServicenodeMan()
 {
     nDsqCount = 0;
+    nTimeRankTablesChecked = 0;
+    fSeenSectionsPending = false;
 }
 
 bool CServicenodeMan::Add(CServicenode& mn)
@@ -206,7 +148,10 @@ bool CServicenodeMan::Add(CServicenode& mn)
     CServicenode* pmn = Find(mn.vin);
     if (pmn == NULL) {
         LogPrint("servicenode", "CServicenodeMan: Adding new Servicenode %s - %i now\n", mn.vin.prevout.hash.ToString(), size() + 1);
-        vServicenodes.push_back(mn);
+        mapServicenodes.insert(make_pair(mn.vin.prevout, mn));
+        IndexServicenode(mn);
+        WatchCollateral(mn.vin.prevout);
+        mapRankTables.clear();
         return true;
     }
 
@@ -215,6 +160,7 @@ bool CServicenodeMan::Add(CServicenode& mn)
 
 void CServicenodeMan::AskForMN(CNode* pnode, CTxIn& vin)
 {
+    LOCK(cs);
     std::map<COutPoint, int64_t>::iterator i = mWeAskedForServicenodeListEntry.find(vin.prevout);
     if (i != mWeAskedForServicenodeListEntry.end()) {
         int64_t t = (*i).second;
@@ -227,28 +173,32 @@ void CServicenodeMan::AskForMN(CNode* pnode, CTxIn& vin)
     pnode->PushMessage("dseg", vin);
     int64_t askAgain = GetTime() + SERVICENODE_MIN_MNP_SECONDS;
     mWeAskedForServicenodeListEntry[vin.prevout] = askAgain;
+    versionWeAskedEntry.Changed();
 }
 
 void CServicenodeMan::Check()
 {
     LOCK(cs);
 
-    BOOST_FOREACH (CServicenode& mn, vServicenodes) {
+    BOOST_FOREACH (PAIRTYPE(const COutPoint, CServicenode) & mnpair, mapServicenodes) {
+        CServicenode& mn = mnpair.second;
         mn.Check();
     }
 }
 
 void CServicenodeMan::CheckAndRemove(bool forceExpiredRemoval)
 {
+    VerifyCollaterals();
     Check();
 
     LOCK(cs);
 
     //remove inactive and outdated
-    vector<CServicenode>::iterator it = vServicenodes.begin();
-    while (it != vServicenodes.end()) {
+    map<COutPoint, CServicenode>::iterator itMap = mapServicenodes.begin();
+    while (itMap != mapServicenodes.end()) {
+        CServicenode* it = &itMap->second;
         if ((*it).activeState == CServicenode::SERVICENODE_REMOVE ||
-            (*it).activeState == CServicenode::SERVICENODE_VIN_SPENT ||
+            ((*it).activeState == CServicenode::SERVICENODE_VIN_SPENT && IsCollateralSpent(itMap->first)) ||
             (forceExpiredRemoval && (*it).activeState == CServicenode::SERVICENODE_EXPIRED) ||
             (*it).protocolVersion < servicenodePayments.GetMinServicenodePaymentsProto()) {
             LogPrint("servicenode", "CServicenodeMan: Removing inactive Servicenode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
@@ -256,11 +206,16 @@ void CServicenodeMan::CheckAndRemove(bool forceExpiredRemoval)
             //erase all of the broadcasts we've seen from this vin
             // -- if we missed a few pings and the node was removed, this will allow is to get it back without them
             //    sending a brand new mnb
+            if (fSeenSectionsPending) {
+                setSeenSectionsRemoved.insert((*it).vin.prevout);
+                versionSeenBroadcasts.Changed();
+            }
             map<uint256, CServicenodeBroadcast>::iterator it3 = mapSeenServicenodeBroadcast.begin();
             while (it3 != mapSeenServicenodeBroadcast.end()) {
                 if ((*it3).second.vin == (*it).vin) {
                     servicenodeSync.mapSeenSyncMNB.erase((*it3).first);
                     mapSeenServicenodeBroadcast.erase(it3++);
+                    versionSeenBroadcasts.Changed();
                 } else {
                     ++it3;
                 }
@@ -271,14 +226,18 @@ void CServicenodeMan::CheckAndRemove(bool forceExpiredRemoval)
             while (it2 != mWeAskedForServicenodeListEntry.end()) {
                 if ((*it2).first == (*it).vin.prevout) {
                     mWeAskedForServicenodeListEntry.erase(it2++);
+                    versionWeAskedEntry.Changed();
                 } else {
                     ++it2;
                 }
             }
 
-            it = vServicenodes.erase(it);
+            UnindexServicenode(itMap->first);
+            UnwatchCollateral(itMap->first);
+            mapServicenodes.erase(itMap++);
+            mapRankTables.clear();
         } else {
-            ++it;
+            ++itMap;
         }
     }
 
@@ -287,6 +246,7 @@ void CServicenodeMan::CheckAndRemove(bool forceExpiredRemoval)
     while (it1 != mAskedUsForServicenodeList.end()) {
         if ((*it1).second < GetTime()) {
             mAskedUsForServicenodeList.erase(it1++);
+            versionAskedUs.Changed();
         } else {
             ++it1;
         }
@@ -297,6 +257,7 @@ void CServicenodeMan::CheckAndRemove(bool forceExpiredRemoval)
     while (it1 != mWeAskedForServicenodeList.end()) {
         if ((*it1).second < GetTime()) {
             mWeAskedForServicenodeList.erase(it1++);
+            versionWeAsked.Changed();
         } else {
             ++it1;
         }
@@ -307,6 +268,7 @@ void CServicenodeMan::CheckAndRemove(bool forceExpiredRemoval)
     while (it2 != mWeAskedForServicenodeListEntry.end()) {
         if ((*it2).second < GetTime()) {
             mWeAskedForServicenodeListEntry.erase(it2++);
+            versionWeAskedEntry.Changed();
         } else {
             ++it2;
         }
@@ -318,6 +280,7 @@ void CServicenodeMan::CheckAndRemove(bool forceExpiredRemoval)
         if ((*it3).second.lastPing.sigTime < GetTime() - (SERVICENODE_REMOVAL_SECONDS * 2)) {
             mapSeenServicenodeBroadcast.erase(it3++);
             servicenodeSync.mapSeenSyncMNB.erase((*it3).second.GetHash());
+            versionSeenBroadcasts.Changed();
         } else {
             ++it3;
         }
@@ -328,6 +291,7 @@ void CServicenodeMan::CheckAndRemove(bool forceExpiredRemoval)
     while (it4 != mapSeenServicenodePing.end()) {
         if ((*it4).second.sigTime < GetTime() - (SERVICENODE_REMOVAL_SECONDS * 2)) {
             mapSeenServicenodePing.erase(it4++);
+            versionSeenPings.Changed();
         } else {
             ++it4;
         }
@@ -337,13 +301,111 @@ void CServicenodeMan::CheckAndRemove(bool forceExpiredRemoval)
 void CServicenodeMan::Clear()
 {
     LOCK(cs);
-    vServicenodes.clear();
+    mapServicenodes.clear();
+    mapServicenodesByPubKey.clear();
+    mapServicenodesByPayee.clear();
+    mapIndexedKeys.clear();
+    mapRankTables.clear();
+    {
+        LOCK(cs_collaterals);
+        mapCollaterals.clear();
+        setCollateralsToVerify.clear();
+    }
     mAskedUsForServicenodeList.clear();
     mWeAskedForServicenodeList.clear();
     mWeAskedForServicenodeListEntry.clear();
     mapSeenServicenodeBroadcast.clear();
     mapSeenServicenodePing.clear();
+    vchSeenBroadcastSection.clear();
+    vchSeenPingSection.clear();
+    fSeenSectionsPending = false;
+    setSeenSectionsRemoved.clear();
     nDsqCount = 0;
+
+    versionAskedUs.Changed();
+    versionWeAsked.Changed();
+    versionWeAskedEntry.Changed();
+    versionDsqCount.Changed();
+    versionSeenBroadcasts.Changed();
+    versionSeenPings.Changed();
+}
+
+void CServicenodeMan::WriteSections(CSectionFile& file)
+{
+    LOCK(cs);
+    // seen maps that were not touched since they were read keep their record without being decoded
+    if (!file.IsStored("seenmnb", versionSeenBroadcasts) || !file.IsStored("seenmnp", versionSeenPings))
+        LoadSeenSections();
+
+    file.WriteSection("servicenodes", GetServicenodeVector());
+    file.WriteSection("askedus", mAskedUsForServicenodeList, versionAskedUs);
+    file.WriteSection("weasked", mWeAskedForServicenodeList, versionWeAsked);
+    file.WriteSection("weaskedentry", mWeAskedForServicenodeListEntry, versionWeAskedEntry);
+    file.WriteSection("dsqcount", nDsqCount, versionDsqCount);
+    file.WriteSection("seenmnb", mapSeenServicenodeBroadcast, versionSeenBroadcasts);
+    file.WriteSection("seenmnp", mapSeenServicenodePing, versionSeenPings);
+}
+
+CSectionFile::ReadResult CServicenodeMan::ReadSections(const CSectionFile& file)
+{
+    LOCK(cs);
+    Clear();
+
+    // the seen maps are only checked here, they are decoded once the message handler needs them
+    std::vector<CServicenode> vServicenodes;
+    CSectionFile::ReadResult result = file.ReadSection("servicenodes", vServicenodes);
+    if (result == CSectionFile::Ok) result = file.ReadSection("askedus", mAskedUsForServicenodeList, versionAskedUs);
+    if (result == CSectionFile::Ok) result = file.ReadSection("weasked", mWeAskedForServicenodeList, versionWeAsked);
+    if (result == CSectionFile::Ok) result = file.ReadSection("weaskedentry", mWeAskedForServicenodeListEntry, versionWeAskedEntry);
+    if (result == CSectionFile::Ok) result = file.ReadSection("dsqcount", nDsqCount, versionDsqCount);
+    if (result == CSectionFile::Ok) result = file.ReadSectionData("seenmnb", vchSeenBroadcastSection, versionSeenBroadcasts);
+    if (result == CSectionFile::Ok) result = file.ReadSectionData("seenmnp", vchSeenPingSection, versionSeenPings);
+    if (result != CSectionFile::Ok) {
+        Clear();
+        return result;
+    }
+    fSeenSectionsPending = true;
+
+    SetServicenodeVector(vServicenodes);
+    return CSectionFile::Ok;
+}
+
+void CServicenodeMan::LoadSeenSections()
+{
+    LOCK(cs);
+    if (!fSeenSectionsPending) return;
+    fSeenSectionsPending = false;
+
+    int64_t nStart = GetTimeMillis();
+    std::map<uint256, CServicenodeBroadcast> mapBroadcasts;
+    std::map<uint256, CServicenodePing> mapPings;
+    if (CSectionFile::DecodeSection("seenmnb", vchSeenBroadcastSection, mapBroadcasts) != CSectionFile::Ok ||
+        CSectionFile::DecodeSection("seenmnp", vchSeenPingSection, mapPings) != CSectionFile::Ok) {
+        // only a cache, start over with what was seen since startup
+        mapBroadcasts.clear();
+        mapPings.clear();
+        versionSeenBroadcasts.Changed();
+        versionSeenPings.Changed();
+    }
+    std::vector<unsigned char>().swap(vchSeenBroadcastSection);
+    std::vector<unsigned char>().swap(vchSeenPingSection);
+
+    // apply what CheckAndRemove did in the meantime, entries seen since startup are newer than the stored ones
+    for (std::map<uint256, CServicenodeBroadcast>::iterator it = mapBroadcasts.begin(); it != mapBroadcasts.end(); ++it) {
+        if (setSeenSectionsRemoved.count(it->second.vin.prevout) || it->second.lastPing.sigTime < GetTime() - (SERVICENODE_REMOVAL_SECONDS * 2))
+            versionSeenBroadcasts.Changed();
+        else
+            mapSeenServicenodeBroadcast.insert(*it);
+    }
+    for (std::map<uint256, CServicenodePing>::iterator it = mapPings.begin(); it != mapPings.end(); ++it) {
+        if (it->second.sigTime < GetTime() - (SERVICENODE_REMOVAL_SECONDS * 2))
+            versionSeenPings.Changed();
+        else
+            mapSeenServicenodePing.insert(*it);
+    }
+    setSeenSectionsRemoved.clear();
+
+    LogPrint("servicenode", "CServicenodeMan::LoadSeenSections - %u broadcasts, %u pings  %dms\n", mapSeenServicenodeBroadcast.size(), mapSeenServicenodePing.size(), GetTimeMillis() - nStart);
 }
 
 int CServicenodeMan::CountEnabled(int protocolVersion)
@@ -351,7 +413,8 @@ int CServicenodeMan::CountEnabled(int protocolVersion)
     int i = 0;
     protocolVersion = protocolVersion == -1 ? servicenodePayments.GetMinServicenodePaymentsProto() : protocolVersion;
 
-    BOOST_FOREACH (CServicenode& mn, vServicenodes) {
+    BOOST_FOREACH (PAIRTYPE(const COutPoint, CServicenode) & mnpair, mapServicenodes) {
+        CServicenode& mn = mnpair.second;
         mn.Check();
         if (mn.protocolVersion < protocolVersion || !mn.IsEnabled()) continue;
         i++;
@@ -379,30 +442,27 @@ void CServicenodeMan::DsegUpdate(CNode* pnode)
     pnode->PushMessage("dseg", CTxIn());
     int64_t askAgain = GetTime() + SERVICENODES_DSEG_SECONDS;
     mWeAskedForServicenodeList[pnode->addr] = askAgain;
+    versionWeAsked.Changed();
 }
 
 CServicenode* CServicenodeMan::Find(const CScript& payee)
 {
     LOCK(cs);
-    CScript payee2;
 
-    BOOST_FOREACH (CServicenode& mn, vServicenodes) {
-        payee2 = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
-        if (payee2 == payee)
-            return &mn;
-    }
-    return NULL;
+    std::multimap<CScript, COutPoint>::iterator it = mapServicenodesByPayee.find(payee);
+    if (it == mapServicenodesByPayee.end())
+        return NULL;
+    return &mapServicenodes[it->second];
 }
 
 CServicenode* CServicenodeMan::Find(const CTxIn& vin)
 {
     LOCK(cs);
 
-    BOOST_FOREACH (CServicenode& mn, vServicenodes) {
-        if (mn.vin.prevout == vin.prevout)
-            return &mn;
-    }
-    return NULL;
+    std::map<COutPoint, CServicenode>::iterator it = mapServicenodes.find(vin.prevout);
+    if (it == mapServicenodes.end())
+        return NULL;
+    return &it->second;
 }
 
 
@@ -410,11 +470,245 @@ CServicenode* CServicenodeMan::Find(const CPubKey& pubKeyServicenode)
 {
     LOCK(cs);
 
-    BOOST_FOREACH (CServicenode& mn, vServicenodes) {
-        if (mn.pubKeyServicenode == pubKeyServicenode)
-            return &mn;
+    std::multimap<CPubKey, COutPoint>::iterator it = mapServicenodesByPubKey.find(pubKeyServicenode);
+    if (it == mapServicenodesByPubKey.end())
+        return NULL;
+    return &mapServicenodes[it->second];
+}
+
+void CServicenodeMan::IndexServicenode(const CServicenode& mn)
+{
+    CScript payee = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
+    mapServicenodesByPubKey.insert(make_pair(mn.pubKeyServicenode, mn.vin.prevout));
+    mapServicenodesByPayee.insert(make_pair(payee, mn.vin.prevout));
+    mapIndexedKeys[mn.vin.prevout] = make_pair(mn.pubKeyServicenode, payee);
+}
+
+template <typename K>
+static void EraseIndexEntry(std::multimap<K, COutPoint>& mapIndex, const K& key, const COutPoint& outpoint)
+{
+    typename std::multimap<K, COutPoint>::iterator it = mapIndex.lower_bound(key);
+    while (it != mapIndex.end() && !(key < it->first)) {
+        if (it->second == outpoint) {
+            mapIndex.erase(it);
+            return;
+        }
+        ++it;
+    }
+}
+
+void CServicenodeMan::UnindexServicenode(const COutPoint& outpoint)
+{
+    std::map<COutPoint, std::pair<CPubKey, CScript> >::iterator it = mapIndexedKeys.find(outpoint);
+    if (it == mapIndexedKeys.end())
+        return;
+    EraseIndexEntry(mapServicenodesByPubKey, it->second.first, outpoint);
+    EraseIndexEntry(mapServicenodesByPayee, it->second.second, outpoint);
+    mapIndexedKeys.erase(it);
+}
+
+void CServicenodeMan::UpdateIndexes(const CServicenode& mn)
+{
+    LOCK(cs);
+
+    // only entries owned by the list are indexed, a broadcast with the same vin is not
+    std::map<COutPoint, CServicenode>::iterator it = mapServicenodes.find(mn.vin.prevout);
+    if (it == mapServicenodes.end() || &it->second != &mn)
+        return;
+    UnindexServicenode(mn.vin.prevout);
+    IndexServicenode(mn);
+    mapRankTables.clear();
+}
+
+void CServicenodeMan::WatchCollateral(const COutPoint& outpoint)
+{
+    LOCK(cs_collaterals);
+    if (mapCollaterals.insert(make_pair(outpoint, false)).second)
+        setCollateralsToVerify.insert(outpoint);
+}
+
+void CServicenodeMan::UnwatchCollateral(const COutPoint& outpoint)
+{
+    LOCK(cs_collaterals);
+    mapCollaterals.erase(outpoint);
+    setCollateralsToVerify.erase(outpoint);
+}
+
+bool CServicenodeMan::IsCollateralSpent(const COutPoint& outpoint)
+{
+    LOCK(cs_collaterals);
+    std::map<COutPoint, bool>::const_iterator it = mapCollaterals.find(outpoint);
+    return it != mapCollaterals.end() && it->second;
+}
+
+bool CServicenodeMan::IsBroadcastSeen(const uint256& hash)
+{
+    LOCK(cs);
+    LoadSeenSections();
+    return mapSeenServicenodeBroadcast.count(hash);
+}
+
+bool CServicenodeMan::IsPingSeen(const uint256& hash)
+{
+    LOCK(cs);
+    LoadSeenSections();
+    return mapSeenServicenodePing.count(hash);
+}
+
+bool CServicenodeMan::GetSeenBroadcast(const uint256& hash, CServicenodeBroadcast& mnbRet)
+{
+    LOCK(cs);
+    LoadSeenSections();
+    std::map<uint256, CServicenodeBroadcast>::iterator it = mapSeenServicenodeBroadcast.find(hash);
+    if (it == mapSeenServicenodeBroadcast.end())
+        return false;
+    mnbRet = it->second;
+    return true;
+}
+
+bool CServicenodeMan::GetSeenPing(const uint256& hash, CServicenodePing& mnpRet)
+{
+    LOCK(cs);
+    LoadSeenSections();
+    std::map<uint256, CServicenodePing>::iterator it = mapSeenServicenodePing.find(hash);
+    if (it == mapSeenServicenodePing.end())
+        return false;
+    mnpRet = it->second;
+    return true;
+}
+
+bool CServicenodeMan::GetSeenBroadcastPingHash(const uint256& hash, uint256& nPingHashRet)
+{
+    LOCK(cs);
+    LoadSeenSections();
+    std::map<uint256, CServicenodeBroadcast>::iterator it = mapSeenServicenodeBroadcast.find(hash);
+    if (it == mapSeenServicenodeBroadcast.end())
+        return false;
+    nPingHashRet = it->second.lastPing.GetHash();
+    return true;
+}
+
+void CServicenodeMan::AddSeenBroadcast(CServicenodeBroadcast mnb)
+{
+    LOCK(cs);
+    LoadSeenSections();
+    mapSeenServicenodeBroadcast.insert(make_pair(mnb.GetHash(), mnb));
+    versionSeenBroadcasts.Changed();
+}
+
+void CServicenodeMan::AddSeenPing(CServicenodePing mnp)
+{
+    LOCK(cs);
+    LoadSeenSections();
+    mapSeenServicenodePing.insert(make_pair(mnp.GetHash(), mnp));
+    versionSeenPings.Changed();
+}
+
+void CServicenodeMan::EraseSeenBroadcast(const uint256& hash)
+{
+    LOCK(cs);
+    LoadSeenSections();
+    if (mapSeenServicenodeBroadcast.erase(hash))
+        versionSeenBroadcasts.Changed();
+}
+
+void CServicenodeMan::UpdateSeenBroadcastPing(const uint256& hash, const CServicenodePing& mnp)
+{
+    LOCK(cs);
+    LoadSeenSections();
+    std::map<uint256, CServicenodeBroadcast>::iterator it = mapSeenServicenodeBroadcast.find(hash);
+    if (it != mapSeenServicenodeBroadcast.end()) {
+        it->second.lastPing = mnp;
+        versionSeenBroadcasts.Changed();
+    }
+}
+
+//
+// Collaterals may have been spent before they were watched (e.g. while the node was down), check those once
+// against the UTXO set and the mempool. A spend flagged by SyncTransaction is checked again on every call, it
+// is cleared when the spending transaction was disconnected or dropped from the mempool. Locks are taken in the
+// order cs_main, mempool.cs, cs_collaterals; cs is never held here.
+//
+void CServicenodeMan::VerifyCollaterals()
+{
+    // most calls have nothing to check, don't wait for cs_main then
+    {
+        LOCK(cs_collaterals);
+        bool fFlagged = false;
+        for (std::map<COutPoint, bool>::const_iterator it = mapCollaterals.begin(); it != mapCollaterals.end() && !fFlagged; ++it)
+            fFlagged = it->second;
+        if (setCollateralsToVerify.empty() && !fFlagged) return;
+    }
+
+    LOCK2(cs_main, mempool.cs);
+
+    std::set<COutPoint> setToVerify;
+    {
+        LOCK(cs_collaterals);
+        setToVerify.swap(setCollateralsToVerify);
+        for (std::map<COutPoint, bool>::const_iterator it = mapCollaterals.begin(); it != mapCollaterals.end(); ++it)
+            if (it->second) setToVerify.insert(it->first);
+    }
+    if (setToVerify.empty()) return;
+
+    std::vector<std::pair<COutPoint, bool> > vVerified;
+    BOOST_FOREACH (const COutPoint& outpoint, setToVerify) {
+        CCoins coins;
+        bool fSpent = !pcoinsTip->GetCoins(outpoint.hash, coins) || !coins.IsAvailable(outpoint.n) || mempool.mapNextTx.count(outpoint);
+        vVerified.push_back(std::make_pair(outpoint, fSpent));
+    }
+
+    // still under cs_main, no spend can be synced in between
+    LOCK(cs_collaterals);
+    for (unsigned int i = 0; i < vVerified.size(); i++) {
+        std::map<COutPoint, bool>::iterator it = mapCollaterals.find(vVerified[i].first);
+        if (it == mapCollaterals.end() || it->second == vVerified[i].second) continue;
+        LogPrint("servicenode", "CServicenodeMan::VerifyCollaterals - collateral %s is %s\n", it->first.ToStringShort(), vVerified[i].second ? "spent" : "unspent again");
+        it->second = vVerified[i].second;
+    }
+}
+
+void CServicenodeMan::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
+{
+    if (tx.IsCoinBase()) return;
+
+    LOCK(cs_collaterals);
+    BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+        std::map<COutPoint, bool>::iterator it = mapCollaterals.find(txin.prevout);
+        if (it != mapCollaterals.end() && !it->second) {
+            LogPrint("servicenode", "CServicenodeMan::SyncTransaction - collateral %s spent by %s\n", txin.prevout.ToStringShort(), tx.GetHash().ToString());
+            it->second = true;
+        }
+    }
+}
+
+std::vector<CServicenode> CServicenodeMan::GetServicenodeVector() const
+{
+    std::vector<CServicenode> vServicenodes;
+    vServicenodes.reserve(mapServicenodes.size());
+    for (std::map<COutPoint, CServicenode>::const_iterator it = mapServicenodes.begin(); it != mapServicenodes.end(); ++it)
+        vServicenodes.push_back(it->second);
+    return vServicenodes;
+}
+
+void CServicenodeMan::SetServicenodeVector(const std::vector<CServicenode>& vServicenodes)
+{
+    mapServicenodes.clear();
+    mapServicenodesByPubKey.clear();
+    mapServicenodesByPayee.clear();
+    mapIndexedKeys.clear();
+    mapRankTables.clear();
+    {
+        LOCK(cs_collaterals);
+        mapCollaterals.clear();
+        setCollateralsToVerify.clear();
+    }
+    BOOST_FOREACH (const CServicenode& mn, vServicenodes) {
+        if (mapServicenodes.insert(make_pair(mn.vin.prevout, mn)).second) {
+            IndexServicenode(mn);
+            WatchCollateral(mn.vin.prevout);
+        }
     }
-    return NULL;
 }
 
 //
@@ -432,7 +726,8 @@ CServicenode* CServicenodeMan::GetNextServicenodeInQueueForPayment(int nBlockHei
     */
 
     int nMnCount = CountEnabled();
-    BOOST_FOREACH (CServicenode& mn, vServicenodes) {
+    BOOST_FOREACH (PAIRTYPE(const COutPoint, CServicenode) & mnpair, mapServicenodes) {
+        CServicenode& mn = mnpair.second;
         mn.Check();
         if (!mn.IsEnabled()) continue;
 
@@ -448,7 +743,7 @@ CServicenode* CServicenodeMan::GetNextServicenodeInQueueForPayment(int nBlockHei
         //make sure it has as many confirmations as there are servicenodes
         if (mn.GetServicenodeInputAge() < nMnCount) continue;
 
-        vecServicenodeLastPaid.push_back(make_pair(mn.SecondsSincePayment(), mn.vin));
+        vecServicenodeLastPaid.push_back(make_pair(mn.SecondsSincePayment(nMnCount), mn.vin));
     }
 
     nCount = (int)vecServicenodeLastPaid.size();
@@ -495,7 +790,8 @@ CServicenode* CServicenodeMan::FindRandomNotInVec(std::vector<CTxIn>& vecToExclu
     LogPrint("servicenode", "CServicenodeMan::FindRandomNotInVec - rand %d\n", rand);
     bool found;
 
-    BOOST_FOREACH (CServicenode& mn, vServicenodes) {
+    BOOST_FOREACH (PAIRTYPE(const COutPoint, CServicenode) & mnpair, mapServicenodes) {
+        CServicenode& mn = mnpair.second;
         if (mn.protocolVersion < protocolVersion || !mn.IsEnabled()) continue;
         found = false;
         BOOST_FOREACH (CTxIn& usedVin, vecToExclude) {
@@ -513,45 +809,66 @@ CServicenode* CServicenodeMan::FindRandomNotInVec(std::vector<CTxIn>& vecToExclu
     return NULL;
 }
 
-CServicenode* CServicenodeMan::GetCurrentServiceNode(int mod, int64_t nBlockHeight, int minProtocol)
+int CServicenodeRankTable::GetRank(const COutPoint& outpoint) const
 {
-    int64_t score = 0;
-    CServicenode* winner = NULL;
-
-    // scan for winner
-    BOOST_FOREACH (CServicenode& mn, vServicenodes) {
-        mn.Check();
-        if (mn.protocolVersion < minProtocol || !mn.IsEnabled()) continue;
+    std::vector<std::pair<COutPoint, int> >::const_iterator it =
+        std::lower_bound(vecRankByOutPoint.begin(), vecRankByOutPoint.end(), std::make_pair(outpoint, 0));
+    if (it == vecRankByOutPoint.end() || it->first != outpoint)
+        return -1;
+    return it->second;
+}
 
-        // calculate the score for each Servicenode
-        uint256 n = mn.CalculateScore(mod, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
+//
+// Re-check the servicenodes every SERVICENODE_CHECK_SECONDS and drop the rank tables when the enabled set changed.
+// Servicenodes themselves only re-check that often, so this sees the same states as checking on every rank query.
+//
+void CServicenodeMan::CheckRankTables()
+{
+    if (GetTime() - nTimeRankTablesChecked < SERVICENODE_CHECK_SECONDS) return;
+    nTimeRankTablesChecked = GetTime();
 
-        // determine the winner
-        if (n2 > score) {
-            score = n2;
-            winner = &mn;
-        }
+    std::vector<COutPoint> vecEnabled;
+    BOOST_FOREACH (PAIRTYPE(const COutPoint, CServicenode) & mnpair, mapServicenodes) {
+        CServicenode& mn = mnpair.second;
+        mn.Check();
+        if (mn.IsEnabled()) vecEnabled.push_back(mnpair.first);
     }
 
-    return winner;
+    if (vecEnabled != vecRankTablesEnabled) {
+        vecRankTablesEnabled.swap(vecEnabled);
+        mapRankTables.clear();
+    }
 }
 
-int CServicenodeMan::GetServicenodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+//
+// Scores only depend on the block hash and the vin, so the ranking for a height is calculated once
+// and kept until the list changes
+//
+const CServicenodeRankTable* CServicenodeMan::GetRankTable(int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecServicenodeScores;
-
     //make sure we know about this block
     uint256 hash = 0;
-    if (!GetBlockHash(hash, nBlockHeight)) return -1;
+    if (!GetBlockHash(hash, nBlockHeight)) return NULL;
+    // height 0 is the tip for GetBlockHash
+    if (nBlockHeight == 0) nBlockHeight = chainActive.Tip()->nHeight;
+
+    CheckRankTables();
 
-    // scan for winner
-    BOOST_FOREACH (CServicenode& mn, vServicenodes) {
+    RankTableKey key = make_pair(nBlockHeight, make_pair(minProtocol, fOnlyActive));
+    std::map<RankTableKey, CServicenodeRankTable>::iterator it = mapRankTables.find(key);
+    if (it != mapRankTables.end()) {
+        if (it->second.blockHash == hash) return &it->second;
+        mapRankTables.erase(it);
+    }
+
+    int64_t nTimeStart = GetTimeMicros();
+    std::vector<pair<int64_t, CTxIn> > vecServicenodeScores;
+
+    BOOST_FOREACH (PAIRTYPE(const COutPoint, CServicenode) & mnpair, mapServicenodes) {
+        CServicenode& mn = mnpair.second;
         if (mn.protocolVersion < minProtocol) continue;
-        if (fOnlyActive) {
-            mn.Check();
-            if (!mn.IsEnabled()) continue;
-        }
+        if (fOnlyActive && !mn.IsEnabled()) continue;
+
         uint256 n = mn.CalculateScore(1, nBlockHeight);
         int64_t n2 = n.GetCompact(false);
 
@@ -560,49 +877,66 @@ int CServicenodeMan::GetServicenodeRank(const CTxIn& vin, int64_t nBlockHeight,
 
     sort(vecServicenodeScores.rbegin(), vecServicenodeScores.rend(), CompareScoreTxIn());
 
+    // keep the most recent heights
+    while (mapRankTables.size() >= SERVICENODE_RANK_TABLES)
+        mapRankTables.erase(mapRankTables.begin());
+
+    CServicenodeRankTable& table = mapRankTables[key];
+    table.blockHash = hash;
+    table.vecRanked.reserve(vecServicenodeScores.size());
+    table.vecRankByOutPoint.reserve(vecServicenodeScores.size());
     int rank = 0;
     BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecServicenodeScores) {
         rank++;
-        if (s.second.prevout == vin.prevout) {
-            return rank;
-        }
+        table.vecRanked.push_back(make_pair(s.first, s.second.prevout));
+        table.vecRankByOutPoint.push_back(make_pair(s.second.prevout, rank));
     }
+    sort(table.vecRankByOutPoint.begin(), table.vecRankByOutPoint.end());
 
-    return -1;
+    LogPrint("servicenode", "CServicenodeMan::GetRankTable - ranked %d servicenodes for height %d in %.2fms\n",
+        rank, nBlockHeight, (GetTimeMicros() - nTimeStart) * 0.001);
+    return &table;
 }
 
-std::vector<pair<int, CServicenode> > CServicenodeMan::GetServicenodeRanks(int64_t nBlockHeight, int minProtocol)
+CServicenode* CServicenodeMan::GetCurrentServiceNode(int mod, int64_t nBlockHeight, int minProtocol)
 {
-    std::vector<pair<int64_t, CServicenode> > vecServicenodeScores;
-    std::vector<pair<int, CServicenode> > vecServicenodeRanks;
+    LOCK(cs);
 
-    //make sure we know about this block
-    uint256 hash = 0;
-    if (!GetBlockHash(hash, nBlockHeight)) return vecServicenodeRanks;
+    const CServicenodeRankTable* table = GetRankTable(nBlockHeight, minProtocol, true);
+    if (table == NULL || table->vecRanked.empty() || table->vecRanked[0].first <= 0) return NULL;
 
-    // scan for winner
-    BOOST_FOREACH (CServicenode& mn, vServicenodes) {
-        mn.Check();
+    std::map<COutPoint, CServicenode>::iterator it = mapServicenodes.find(table->vecRanked[0].second);
+    return it == mapServicenodes.end() ? NULL : &it->second;
+}
 
-        if (mn.protocolVersion < minProtocol) continue;
+int CServicenodeMan::GetServicenodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+{
+    LOCK(cs);
 
-        if (!mn.IsEnabled()) {
-            vecServicenodeScores.push_back(make_pair(9999, mn));
-            continue;
-        }
+    const CServicenodeRankTable* table = GetRankTable(nBlockHeight, minProtocol, fOnlyActive);
+    if (table == NULL) return -1;
 
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
+    return table->GetRank(vin.prevout);
+}
 
-        vecServicenodeScores.push_back(make_pair(n2, mn));
-    }
+std::vector<pair<int, CServicenode> > CServicenodeMan::GetServicenodeRanks(int64_t nBlockHeight, int minProtocol)
+{
+    LOCK(cs);
 
-    sort(vecServicenodeScores.rbegin(), vecServicenodeScores.rend(), CompareScoreMN());
+    std::vector<pair<int, CServicenode> > vecServicenodeRanks;
 
+    const CServicenodeRankTable* table = GetRankTable(nBlockHeight, minProtocol, false);
+    if (table == NULL) return vecServicenodeRanks;
+
+    // enabled servicenodes by score, followed by the others
     int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CServicenode) & s, vecServicenodeScores) {
-        rank++;
-        vecServicenodeRanks.push_back(make_pair(rank, s.second));
+    for (int fEnabled = 1; fEnabled >= 0; fEnabled--) {
+        for (unsigned int i = 0; i < table->vecRanked.size(); i++) {
+            std::map<COutPoint, CServicenode>::iterator it = mapServicenodes.find(table->vecRanked[i].second);
+            if (it == mapServicenodes.end() || it->second.IsEnabled() != (bool)fEnabled) continue;
+            rank++;
+            vecServicenodeRanks.push_back(make_pair(rank, it->second));
+        }
     }
 
     return vecServicenodeRanks;
@@ -610,33 +944,13 @@ std::vector<pair<int, CServicenode> > CServicenodeMan::GetServicenodeRanks(int64
 
 CServicenode* CServicenodeMan::GetServicenodeByRank(int nRank, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecServicenodeScores;
-
-    // scan for winner
-    BOOST_FOREACH (CServicenode& mn, vServicenodes) {
-        if (mn.protocolVersion < minProtocol) continue;
-        if (fOnlyActive) {
-            mn.Check();
-            if (!mn.IsEnabled()) continue;
-        }
-
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecServicenodeScores.push_back(make_pair(n2, mn.vin));
-    }
-
-    sort(vecServicenodeScores.rbegin(), vecServicenodeScores.rend(), CompareScoreTxIn());
+    LOCK(cs);
 
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecServicenodeScores) {
-        rank++;
-        if (rank == nRank) {
-            return Find(s.second);
-        }
-    }
+    const CServicenodeRankTable* table = GetRankTable(nBlockHeight, minProtocol, fOnlyActive);
+    if (table == NULL || nRank < 1 || nRank > (int)table->vecRanked.size()) return NULL;
 
-    return NULL;
+    std::map<COutPoint, CServicenode>::iterator it = mapServicenodes.find(table->vecRanked[nRank - 1].second);
+    return it == mapServicenodes.end() ? NULL : &it->second;
 }
 
 void CServicenodeMan::ProcessServicenodeConnections()
@@ -660,17 +974,20 @@ void CServicenodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
     if (fLiteMode) return; //disable all Obfuscation/Servicenode related functionality
     if (!servicenodeSync.IsBlockchainSynced()) return;
 
+    LoadSeenSections();
+
+    // runs concurrently with the other message handlers, cs_main is taken after this where the chain is read
     LOCK(cs_process_message);
 
     if (strCommand == "mnb") { //Servicenode Broadcast
         CServicenodeBroadcast mnb;
         vRecv >> mnb;
 
-        if (mapSeenServicenodeBroadcast.count(mnb.GetHash())) { //seen
-            servicenodeSync.AddedServicenodeList(mnb.GetHash());
+        if (IsBroadcastSeen(mnb.GetHash())) { //seen
+            servicenodeSync.AddedServicenodeList(mnb.GetHash(), pfrom);
             return;
         }
-        mapSeenServicenodeBroadcast.insert(make_pair(mnb.GetHash(), mnb));
+        AddSeenBroadcast(mnb);
 
         int nDoS = 0;
         if (!mnb.CheckAndUpdate(nDoS)) {
@@ -690,11 +1007,11 @@ void CServicenodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
         }
 
         // make sure it's still unspent
-        //  - this is checked later by .check() in many places and by ThreadCheckObfuScationPool()
+        //  - this is checked later by .check() in many places and by the scheduled servicenode checks
         if (mnb.CheckInputsAndAdd(nDoS)) {
             // use this as a peer
             addrman.Add(CAddress(mnb.addr), pfrom->addr, 2 * 60 * 60);
-            servicenodeSync.AddedServicenodeList(mnb.GetHash());
+            servicenodeSync.AddedServicenodeList(mnb.GetHash(), pfrom);
         } else {
             LogPrintf("mnb - Rejected Servicenode entry %s\n", mnb.vin.prevout.hash.ToString());
 
@@ -709,8 +1026,8 @@ void CServicenodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
 
         LogPrint("servicenode", "mnp - Servicenode ping, vin: %s\n", mnp.vin.prevout.hash.ToString());
 
-        if (mapSeenServicenodePing.count(mnp.GetHash())) return; //seen
-        mapSeenServicenodePing.insert(make_pair(mnp.GetHash(), mnp));
+        if (IsPingSeen(mnp.GetHash())) return; //seen
+        AddSeenPing(mnp);
 
         int nDoS = 0;
         if (mnp.CheckAndUpdate(nDoS)) return;
@@ -739,24 +1056,34 @@ void CServicenodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
             bool isLocal = (pfrom->addr.IsRFC1918() || pfrom->addr.IsLocal());
 
             if (!isLocal && Params().NetworkID() == CBaseChainParams::MAIN) {
-                std::map<CNetAddr, int64_t>::iterator i = mAskedUsForServicenodeList.find(pfrom->addr);
-                if (i != mAskedUsForServicenodeList.end()) {
-                    int64_t t = (*i).second;
-                    if (GetTime() < t) {
-                        Misbehaving(pfrom->GetId(), 34);
-                        LogPrintf("dseg - peer already asked me for the list\n");
-                        return;
+                bool fAskedRecently = false;
+                {
+                    LOCK(cs);
+                    std::map<CNetAddr, int64_t>::iterator i = mAskedUsForServicenodeList.find(pfrom->addr);
+                    if (i != mAskedUsForServicenodeList.end()) {
+                        int64_t t = (*i).second;
+                        fAskedRecently = GetTime() < t;
                     }
+                    if (!fAskedRecently) {
+                        int64_t askAgain = GetTime() + SERVICENODES_DSEG_SECONDS;
+                        mAskedUsForServicenodeList[pfrom->addr] = askAgain;
+                        versionAskedUs.Changed();
+                    }
+                }
+                if (fAskedRecently) {
+                    Misbehaving(pfrom->GetId(), 34);
+                    LogPrintf("dseg - peer already asked me for the list\n");
+                    return;
                 }
-                int64_t askAgain = GetTime() + SERVICENODES_DSEG_SECONDS;
-                mAskedUsForServicenodeList[pfrom->addr] = askAgain;
             }
         } //else, asking for a specific node which is ok
 
 
         int nInvCount = 0;
 
-        BOOST_FOREACH (CServicenode& mn, vServicenodes) {
+        LOCK(cs);
+        BOOST_FOREACH (PAIRTYPE(const COutPoint, CServicenode) & mnpair, mapServicenodes) {
+            CServicenode& mn = mnpair.second;
             if (mn.addr.IsRFC1918()) continue; //local network
 
             if (mn.IsEnabled()) {
@@ -767,7 +1094,10 @@ void CServicenodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
                     pfrom->PushInventory(CInv(MSG_SERVICENODE_ANNOUNCE, hash));
                     nInvCount++;
 
-                    if (!mapSeenServicenodeBroadcast.count(hash)) mapSeenServicenodeBroadcast.insert(make_pair(hash, mnb));
+                    if (!mapSeenServicenodeBroadcast.count(hash)) {
+                        mapSeenServicenodeBroadcast.insert(make_pair(hash, mnb));
+                        versionSeenBroadcasts.Changed();
+                    }
 
                     if (vin == mn.vin) {
                         LogPrint("servicenode", "dseg - Sent 1 Servicenode entry to peer %i\n", pfrom->GetId());
@@ -863,38 +1193,43 @@ void CServicenodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
             return;
 
         //search existing Servicenode list, this is where we update existing Servicenodes with new dsee broadcasts
-        CServicenode* pmn = this->Find(vin);
-        if (pmn != NULL) {
-            // count == -1 when it's a new entry
-            //   e.g. We don't want the entry relayed/time updated when we're syncing the list
-            // mn.pubkey = pubkey, IsVinAssociatedWithPubkey is validated once below,
-            //   after that they just need to match
-            if (count == -1 && pmn->pubKeyCollateralAddress == pubkey && (GetAdjustedTime() - pmn->nLastDsee > SERVICENODE_MIN_MNB_SECONDS)) {
-                if (pmn->protocolVersion > GETHEADERS_VERSION && sigTime - pmn->lastPing.sigTime < SERVICENODE_MIN_MNB_SECONDS) return;
-                if (pmn->nLastDsee < sigTime) { //take the newest entry
-                    LogPrint("servicenode", "dsee - Got updated entry for %s\n", vin.prevout.hash.ToString());
-                    if (pmn->protocolVersion < GETHEADERS_VERSION) {
-                        pmn->pubKeyServicenode = pubkey2;
-                        pmn->sigTime = sigTime;
-                        pmn->sig = vchSig;
-                        pmn->protocolVersion = protocolVersion;
-                        pmn->addr = addr;
-                        //fake ping
-                        pmn->lastPing = CServicenodePing(vin);
-                    }
-                    pmn->nLastDsee = sigTime;
-                    pmn->Check();
-                    if (pmn->IsEnabled()) {
-                        TRY_LOCK(cs_vNodes, lockNodes);
-                        if (!lockNodes) return;
-                        BOOST_FOREACH (CNode* pnode, vNodes)
-                            if (pnode->nVersion >= servicenodePayments.GetMinServicenodePaymentsProto())
-                                pnode->PushMessage("dsee", vin, addr, vchSig, sigTime, pubkey, pubkey2, count, current, lastUpdated, protocolVersion, donationAddress, donationPercentage);
+        //  - the fake ping reads the chain
+        {
+            LOCK2(cs_main, cs);
+            CServicenode* pmn = this->Find(vin);
+            if (pmn != NULL) {
+                // count == -1 when it's a new entry
+                //   e.g. We don't want the entry relayed/time updated when we're syncing the list
+                // mn.pubkey = pubkey, IsVinAssociatedWithPubkey is validated once below,
+                //   after that they just need to match
+                if (count == -1 && pmn->pubKeyCollateralAddress == pubkey && (GetAdjustedTime() - pmn->nLastDsee > SERVICENODE_MIN_MNB_SECONDS)) {
+                    if (pmn->protocolVersion > GETHEADERS_VERSION && sigTime - pmn->lastPing.sigTime < SERVICENODE_MIN_MNB_SECONDS) return;
+                    if (pmn->nLastDsee < sigTime) { //take the newest entry
+                        LogPrint("servicenode", "dsee - Got updated entry for %s\n", vin.prevout.hash.ToString());
+                        if (pmn->protocolVersion < GETHEADERS_VERSION) {
+                            pmn->pubKeyServicenode = pubkey2;
+                            pmn->sigTime = sigTime;
+                            pmn->sig = vchSig;
+                            pmn->protocolVersion = protocolVersion;
+                            pmn->addr = addr;
+                            //fake ping
+                            pmn->lastPing = CServicenodePing(vin);
+                            UpdateIndexes(*pmn);
+                        }
+                        pmn->nLastDsee = sigTime;
+                        pmn->Check();
+                        if (pmn->IsEnabled()) {
+                            TRY_LOCK(cs_vNodes, lockNodes);
+                            if (!lockNodes) return;
+                            BOOST_FOREACH (CNode* pnode, vNodes)
+                                if (pnode->nVersion >= servicenodePayments.GetMinServicenodePaymentsProto())
+                                    pnode->PushMessage("dsee", vin, addr, vchSig, sigTime, pubkey, pubkey2, count, current, lastUpdated, protocolVersion, donationAddress, donationPercentage);
+                        }
                     }
                 }
-            }
 
-            return;
+                return;
+            }
         }
 
         static std::map<COutPoint, CPubKey> mapSeenDsee;
@@ -915,7 +1250,7 @@ void CServicenodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
         LogPrint("servicenode", "dsee - Got NEW OLD Servicenode entry %s\n", vin.prevout.hash.ToString());
 
         // make sure it's still unspent
-        //  - this is checked later by .check() in many places and by ThreadCheckObfuScationPool()
+        //  - this is checked later by .check() in many places and by the scheduled servicenode checks
 
         CValidationState state;
         CMutableTransaction tx = CMutableTransaction();
@@ -923,14 +1258,9 @@ void CServicenodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
         tx.vin.push_back(vin);
         tx.vout.push_back(vout);
 
-        bool fAcceptable = false;
-        {
-            TRY_LOCK(cs_main, lockMain);
-            if (!lockMain) return;
-            fAcceptable = AcceptableInputs(mempool, state, CTransaction(tx), false, NULL);
-        }
-
-        if (fAcceptable) {
+        // the input checks and the fake ping read the chain
+        LOCK(cs_main);
+        if (AcceptableInputs(mempool, state, CTransaction(tx), false, NULL)) {
             if (GetInputAge(vin) < SERVICENODE_MIN_CONFIRMATIONS) {
                 LogPrintf("dsee - Input must have least %d confirmations\n", SERVICENODE_MIN_CONFIRMATIONS);
                 Misbehaving(pfrom->GetId(), 20);
@@ -1017,6 +1347,8 @@ void CServicenodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
             return;
         }
 
+        // the fake ping reads the chain
+        LOCK2(cs_main, cs);
         std::map<COutPoint, int64_t>::iterator i = mWeAskedForServicenodeListEntry.find(vin.prevout);
         if (i != mWeAskedForServicenodeListEntry.end()) {
             int64_t t = (*i).second;
@@ -1068,22 +1400,25 @@ void CServicenodeMan::Remove(CTxIn vin)
 {
     LOCK(cs);
 
-    vector<CServicenode>::iterator it = vServicenodes.begin();
-    while (it != vServicenodes.end()) {
-        if ((*it).vin == vin) {
-            LogPrint("servicenode", "CServicenodeMan: Removing Servicenode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
-            vServicenodes.erase(it);
-            break;
-        }
-        ++it;
+    map<COutPoint, CServicenode>::iterator it = mapServicenodes.find(vin.prevout);
+    if (it != mapServicenodes.end() && it->second.vin == vin) {
+        LogPrint("servicenode", "CServicenodeMan: Removing Servicenode %s - %i now\n", vin.prevout.hash.ToString(), size() - 1);
+        UnindexServicenode(vin.prevout);
+        UnwatchCollateral(vin.prevout);
+        mapServicenodes.erase(it);
+        mapRankTables.clear();
     }
 }
 
 void CServicenodeMan::UpdateServicenodeList(CServicenodeBroadcast mnb)
 {
-    LOCK(cs);
+    // the ping of the broadcast is checked against the chain
+    LOCK2(cs_main, cs);
+    LoadSeenSections();
     mapSeenServicenodePing.insert(std::make_pair(mnb.lastPing.GetHash(), mnb.lastPing));
     mapSeenServicenodeBroadcast.insert(std::make_pair(mnb.GetHash(), mnb));
+    versionSeenPings.Changed();
+    versionSeenBroadcasts.Changed();
 
     LogPrintf("CServicenodeMan::UpdateServicenodeList -- servicenode=%s\n", mnb.vin.prevout.ToStringShort());
 
@@ -1102,7 +1437,7 @@ std::string CServicenodeMan::ToString() const
 {
     std::ostringstream info;
 
-    info << "Servicenodes: " << (int)vServicenodes.size() << ", peers who asked us for Servicenode list: " << (int)mAskedUsForServicenodeList.size() << ", peers we asked for Servicenode list: " << (int)mWeAskedForServicenodeList.size() << ", entries in Servicenode list we asked for: " << (int)mWeAskedForServicenodeListEntry.size() << ", nDsqCount: " << (int)nDsqCount;
+    info << "Servicenodes: " << (int)mapServicenodes.size() << ", peers who asked us for Servicenode list: " << (int)mAskedUsForServicenodeList.size() << ", peers we asked for Servicenode list: " << (int)mWeAskedForServicenodeList.size() << ", entries in Servicenode list we asked for: " << (int)mWeAskedForServicenodeListEntry.size() << ", nDsqCount: " << (int)nDsqCount;
 
     return info.str();
 }
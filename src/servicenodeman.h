@@ -11,11 +11,14 @@
 #include "main.h"
 #include "servicenode.h"
 #include "net.h"
+#include "sectionfile.h"
 #include "sync.h"
 #include "util.h"
+#include "validationinterface.h"
 
 #define SERVICENODES_DUMP_SECONDS (15 * 60)
 #define SERVICENODES_DSEG_SECONDS (3 * 60 * 60)
+#define SERVICENODE_RANK_TABLES 32
 
 using namespace std;
 
@@ -44,11 +47,26 @@ public:
     };
 
     CServicenodeDB();
-    bool Write(const CServicenodeMan& mnodemanToSave);
+    bool Write(CServicenodeMan& mnodemanToSave);
     ReadResult Read(CServicenodeMan& mnodemanToLoad, bool fDryRun = false);
 };
 
-class CServicenodeMan
+/** Servicenodes ordered by their score for one block height, best first
+ */
+class CServicenodeRankTable
+{
+public:
+    // hash the scores were calculated against
+    uint256 blockHash;
+    std::vector<std::pair<int64_t, COutPoint> > vecRanked;
+    // 1-based rank of each entry, sorted by outpoint
+    std::vector<std::pair<COutPoint, int> > vecRankByOutPoint;
+
+    /// Return the rank of an outpoint or -1 when it is not in the table
+    int GetRank(const COutPoint& outpoint) const;
+};
+
+class CServicenodeMan : public CValidationInterface
 {
 private:
     // critical section to protect the inner data structures
@@ -57,8 +75,13 @@ private:
     // critical section to protect the inner data structures specifically on messaging
     mutable CCriticalSection cs_process_message;
 
-    // map to hold all MNs
-    std::vector<CServicenode> vServicenodes;
+    // map to hold all MNs, by collateral outpoint; entries keep their address until they are removed
+    std::map<COutPoint, CServicenode> mapServicenodes;
+    // lookup indexes on the servicenode key and the payee script (kept in sync by IndexServicenode)
+    std::multimap<CPubKey, COutPoint> mapServicenodesByPubKey;
+    std::multimap<CScript, COutPoint> mapServicenodesByPayee;
+    // keys each MN is currently indexed under, so they can be removed after the MN changed
+    std::map<COutPoint, std::pair<CPubKey, CScript> > mapIndexedKeys;
     // who's asked for the Servicenode list and the last time
     std::map<CNetAddr, int64_t> mAskedUsForServicenodeList;
     // who we asked for the Servicenode list and the last time
@@ -66,6 +89,42 @@ private:
     // which Servicenodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForServicenodeListEntry;
 
+    // ranks by block height, min protocol and whether only enabled entries are ranked
+    typedef std::pair<int64_t, std::pair<int, bool> > RankTableKey;
+    std::map<RankTableKey, CServicenodeRankTable> mapRankTables;
+    // enabled entries the rank tables were last validated against
+    std::vector<COutPoint> vecRankTablesEnabled;
+    int64_t nTimeRankTablesChecked;
+
+    // seenmnb and seenmnp as read from mncache.dat, decoded by LoadSeenSections when they are first needed
+    std::vector<unsigned char> vchSeenBroadcastSection;
+    std::vector<unsigned char> vchSeenPingSection;
+    bool fSeenSectionsPending;
+    // servicenodes removed before the seen broadcasts were decoded, their broadcasts are dropped on decoding
+    std::set<COutPoint> setSeenSectionsRemoved;
+
+    void IndexServicenode(const CServicenode& mn);
+    void UnindexServicenode(const COutPoint& outpoint);
+    std::vector<CServicenode> GetServicenodeVector() const;
+    void SetServicenodeVector(const std::vector<CServicenode>& vServicenodes);
+    const CServicenodeRankTable* GetRankTable(int64_t nBlockHeight, int minProtocol, bool fOnlyActive);
+    void CheckRankTables();
+
+    // critical section for the collateral watch, no other lock is taken while it is held
+    mutable CCriticalSection cs_collaterals;
+    // collateral outpoints of the list, true while a transaction spending it is in the mempool or the chain
+    std::map<COutPoint, bool> mapCollaterals;
+    // collaterals not yet checked against the UTXO set and the mempool
+    std::set<COutPoint> setCollateralsToVerify;
+
+    void WatchCollateral(const COutPoint& outpoint);
+    void UnwatchCollateral(const COutPoint& outpoint);
+    void VerifyCollaterals();
+
+protected:
+    // CValidationInterface
+    void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
+
 public:
     // Keep track of all broadcasts I've seen
     map<uint256, CServicenodeBroadcast> mapSeenServicenodeBroadcast;
@@ -75,13 +134,33 @@ public:
     // keep track of dsq count to prevent servicenodes from gaming obfuscation queue
     int64_t nDsqCount;
 
+    // changes to the sections of mncache.dat, the servicenodes themselves are updated in place and always written
+    CSectionVersion versionAskedUs;
+    CSectionVersion versionWeAsked;
+    CSectionVersion versionWeAskedEntry;
+    CSectionVersion versionDsqCount;
+    CSectionVersion versionSeenBroadcasts;
+    CSectionVersion versionSeenPings;
+
+    /// Stage the sections of mncache.dat that changed since it was read or written
+    void WriteSections(CSectionFile& file);
+    /// Load the sections of mncache.dat
+    CSectionFile::ReadResult ReadSections(const CSectionFile& file);
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
     {
         LOCK(cs);
+        LoadSeenSections();
+        // stored as a plain list, the indexes are rebuilt on load
+        std::vector<CServicenode> vServicenodes;
+        if (!ser_action.ForRead())
+            vServicenodes = GetServicenodeVector();
         READWRITE(vServicenodes);
+        if (ser_action.ForRead())
+            SetServicenodeVector(vServicenodes);
         READWRITE(mAskedUsForServicenodeList);
         READWRITE(mWeAskedForServicenodeList);
         READWRITE(mWeAskedForServicenodeListEntry);
@@ -103,6 +182,29 @@ public:
     /// Check all Servicenodes
     void Check();
 
+    /// Whether a transaction spending the collateral of a listed Servicenode was seen
+    bool IsCollateralSpent(const COutPoint& outpoint);
+
+    /// Whether the broadcast or the ping was seen already, the message handler skips those
+    bool IsBroadcastSeen(const uint256& hash);
+    bool IsPingSeen(const uint256& hash);
+    /// Copy of a seen broadcast or ping, for the peers asking for it
+    bool GetSeenBroadcast(const uint256& hash, CServicenodeBroadcast& mnbRet);
+    bool GetSeenPing(const uint256& hash, CServicenodePing& mnpRet);
+    /// Hash of the last ping of a seen broadcast, it changes whenever the broadcast does
+    bool GetSeenBroadcastPingHash(const uint256& hash, uint256& nPingHashRet);
+
+    /// Keep track of a broadcast or ping seen
+    void AddSeenBroadcast(CServicenodeBroadcast mnb);
+    void AddSeenPing(CServicenodePing mnp);
+    /// Forget a broadcast so it is checked again when it comes in
+    void EraseSeenBroadcast(const uint256& hash);
+    /// Store a newer ping in a seen broadcast
+    void UpdateSeenBroadcastPing(const uint256& hash, const CServicenodePing& mnp);
+
+    /// Decode the seen broadcasts and pings deferred by ReadSections
+    void LoadSeenSections();
+
     /// Check all Servicenodes and remove inactive
     void CheckAndRemove(bool forceExpiredRemoval = false);
 
@@ -130,7 +232,7 @@ public:
     std::vector<CServicenode> GetFullServicenodeVector()
     {
         Check();
-        return vServicenodes;
+        return GetServicenodeVector();
     }
 
     std::vector<pair<int, CServicenode> > GetServicenodeRanks(int64_t nBlockHeight, int minProtocol = 0);
@@ -142,7 +244,7 @@ public:
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 
     /// Return the number of (unique) Servicenodes
-    int size() { return vServicenodes.size(); }
+    int size() { return mapServicenodes.size(); }
 
     std::string ToString() const;
 
@@ -150,6 +252,9 @@ public:
 
     /// Update servicenode list and maps using provided CServicenodeBroadcast
     void UpdateServicenodeList(CServicenodeBroadcast mnb);
+
+    /// Re-index an entry after its servicenode key, collateral address or protocol version changed
+    void UpdateIndexes(const CServicenode& mn);
 };
 
 #endif
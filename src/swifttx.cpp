@@ -17,6 +17,7 @@
 using namespace std;
 using namespace boost;
 
+CCriticalSection cs_swifttx;
 std::map<uint256, CTransaction> mapTxLockReq;
 std::map<uint256, CTransaction> mapTxLockReqRejected;
 std::map<uint256, CConsensusVote> mapTxLockVote;
@@ -47,8 +48,11 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
         CInv inv(MSG_TXLOCK_REQUEST, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        if (mapTxLockReq.count(tx.GetHash()) || mapTxLockReqRejected.count(tx.GetHash())) {
-            return;
+        {
+            LOCK(cs_swifttx);
+            if (mapTxLockReq.count(tx.GetHash()) || mapTxLockReqRejected.count(tx.GetHash())) {
+                return;
+            }
         }
 
         if (!IsIXTXValid(tx)) {
@@ -64,16 +68,18 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
             }
         }
 
+        // the lock is created from the chain and the transaction goes to the mempool
+        LOCK2(cs_main, cs_swifttx);
+        if (mapTxLockReq.count(tx.GetHash()) || mapTxLockReqRejected.count(tx.GetHash())) {
+            return;
+        }
+
         int nBlockHeight = CreateNewLock(tx);
 
         bool fMissingInputs = false;
         CValidationState state;
 
-        bool fAccepted = false;
-        {
-            LOCK(cs_main);
-            fAccepted = AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs);
-        }
+        bool fAccepted = AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs);
         if (fAccepted) {
             RelayInv(inv);
 
@@ -127,6 +133,15 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
         CInv inv(MSG_TXLOCK_VOTE, ctx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
+        {
+            LOCK(cs_swifttx);
+            if (mapTxLockVote.count(ctx.GetHash())) {
+                return;
+            }
+        }
+
+        // the servicenode ranks and the reprocessed blocks read the chain
+        LOCK2(cs_main, cs_swifttx);
         if (mapTxLockVote.count(ctx.GetHash())) {
             return;
         }
@@ -419,6 +434,7 @@ int64_t GetAverageVoteTime()
 
 void CleanTransactionLocksList()
 {
+    LOCK2(cs_main, cs_swifttx);
     if (chainActive.Tip() == NULL) return;
 
     std::map<uint256, CTransactionLock>::iterator it = mapTxLocks.begin();
@@ -35,6 +35,8 @@ class CTransactionLock;
 
 static const int MIN_SWIFTTX_PROTO_VERSION = 70103;
 
+// guards the maps below. They are changed under cs_main and cs_swifttx, so code holding cs_main may read them
+extern CCriticalSection cs_swifttx;
 extern map<uint256, CTransaction> mapTxLockReq;
 extern map<uint256, CTransaction> mapTxLockReqRejected;
 extern map<uint256, CConsensusVote> mapTxLockVote;
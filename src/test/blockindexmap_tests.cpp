@@ -0,0 +1,69 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockindexmap.h"
+#include "random.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockindexmap_tests)
+
+BOOST_AUTO_TEST_CASE(blockindexmap_insert_find)
+{
+    CBlockIndexMap map;
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex*> vIndex;
+
+    // enough entries to fill several slabs and resize the table, the last slab is full
+    // so the memory comparison below is not skewed by a mostly empty one
+    const int nCount = 3 * 4096;
+    for (int i = 0; i < nCount; i++) {
+        uint256 hash = GetRandHash();
+        CBlockIndex index;
+        index.nHeight = i;
+        index.pprev = vIndex.empty() ? NULL : vIndex.back();
+        CBlockIndex* pindex = map.insert(hash, index);
+        BOOST_CHECK(pindex->nHeight == i);
+        BOOST_CHECK(pindex->GetBlockHash() == hash);
+        vHashes.push_back(hash);
+        vIndex.push_back(pindex);
+    }
+    BOOST_CHECK_EQUAL(map.size(), vHashes.size());
+
+    for (size_t i = 0; i < vHashes.size(); i++) {
+        // entries never move, so earlier pointers are still the ones returned
+        BOOST_CHECK(map[vHashes[i]] == vIndex[i]);
+        BOOST_CHECK_EQUAL(map.count(vHashes[i]), 1U);
+        CBlockIndexMap::iterator it = map.find(vHashes[i]);
+        BOOST_CHECK(it != map.end());
+        BOOST_CHECK(it->first == vHashes[i]);
+        BOOST_CHECK(it->second == vIndex[i]);
+        BOOST_CHECK(vIndex[i]->pprev == (i ? vIndex[i - 1] : NULL));
+    }
+
+    uint256 unknown = GetRandHash();
+    BOOST_CHECK(map.find(unknown) == map.end());
+    BOOST_CHECK_EQUAL(map.count(unknown), 0U);
+    BOOST_CHECK(map[unknown] == NULL);
+    BOOST_CHECK_EQUAL(map.size(), vHashes.size());
+
+    // iteration visits every entry once, in insertion order
+    int nHeight = 0;
+    for (CBlockIndexMap::const_iterator it = map.begin(); it != map.end(); ++it) {
+        BOOST_CHECK(it->second->nHeight == nHeight);
+        BOOST_CHECK(it->first == vHashes[nHeight]);
+        nHeight++;
+    }
+    BOOST_CHECK_EQUAL(nHeight, nCount);
+
+    BOOST_CHECK(map.DynamicMemoryUsage() < map.NodeBasedMemoryUsage());
+
+    map.clear();
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.find(vHashes[0]) == map.end());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
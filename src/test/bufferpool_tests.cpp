@@ -0,0 +1,108 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Unit tests for the message payload buffer pool
+//
+
+#include "bufferpool.h"
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(bufferpool_tests)
+
+BOOST_AUTO_TEST_CASE(bufferpool_classes)
+{
+    BOOST_CHECK_EQUAL(CBufferPool::GetClass(0), 0);
+    BOOST_CHECK_EQUAL(CBufferPool::GetClass(256), 0);
+    BOOST_CHECK_EQUAL(CBufferPool::GetClass(257), 1);
+    BOOST_CHECK_EQUAL(CBufferPool::GetClass(2 * 1024 * 1024), 13);
+    BOOST_CHECK_EQUAL(CBufferPool::GetClass(4 * 1024 * 1024), 14);
+    BOOST_CHECK_EQUAL(CBufferPool::GetClass(4 * 1024 * 1024 + 1), -1);
+}
+
+BOOST_AUTO_TEST_CASE(bufferpool_reuse)
+{
+    CBufferPool pool;
+    CSerializeData data;
+    BOOST_CHECK(!pool.Acquire(data, 1000));
+    BOOST_CHECK(data.empty());
+    BOOST_CHECK_EQUAL(data.capacity(), 1024U);
+    data.insert(data.end(), 1000, 'x');
+    const char* pchBuffer = data.data();
+
+    pool.Release(data);
+    BOOST_CHECK_EQUAL(data.capacity(), 0U);
+
+    // the same buffer comes back, empty, for any size of its class
+    BOOST_CHECK(pool.Acquire(data, 600));
+    BOOST_CHECK(data.empty());
+    BOOST_CHECK(data.data() == pchBuffer);
+
+    // a smaller class does not get it
+    CSerializeData small;
+    BOOST_CHECK(!pool.Acquire(small, 100));
+    pool.Release(data);
+    pool.Release(small);
+
+    // nor a larger one
+    BOOST_CHECK(!pool.Acquire(data, 2000));
+    pool.Release(data);
+
+    // too large to pool
+    BOOST_CHECK(!pool.Acquire(data, 16 * 1024 * 1024));
+    pool.Release(data);
+
+    CBufferPoolStats stats = pool.GetStats();
+    BOOST_CHECK_EQUAL(stats.nAcquired, 5U);
+    BOOST_CHECK_EQUAL(stats.nReused, 1U);
+    BOOST_CHECK_EQUAL(stats.nReleased, 5U);
+    BOOST_CHECK_EQUAL(stats.nFreed, 1U);
+}
+
+static void ReleaseBuffers(CBufferPool* ppool, std::vector<CSerializeData>* pvBuffers)
+{
+    for (unsigned int i = 0; i < pvBuffers->size(); i++)
+        ppool->Release((*pvBuffers)[i]);
+}
+
+BOOST_AUTO_TEST_CASE(bufferpool_threads)
+{
+    // buffers taken by one thread and given back by another reach the first one through the depot
+    CBufferPool pool;
+    size_t nSize = 1024 * 1024;
+    std::vector<CSerializeData> vBuffers(4);
+    for (unsigned int i = 0; i < vBuffers.size(); i++)
+        BOOST_CHECK(!pool.Acquire(vBuffers[i], nSize));
+
+    boost::thread thread(boost::bind(&ReleaseBuffers, &pool, &vBuffers));
+    thread.join();
+    BOOST_CHECK(pool.GetStats().nDepotBytes > 0);
+
+    CSerializeData data;
+    BOOST_CHECK(pool.Acquire(data, nSize));
+    BOOST_CHECK(data.capacity() >= nSize);
+}
+
+BOOST_AUTO_TEST_CASE(bufferpool_thread_cap)
+{
+    // one buffer of each size class from 64 KiB to 4 MiB: each class has room, all of them together do not
+    CBufferPool pool;
+    std::vector<CSerializeData> vBuffers(7);
+    for (unsigned int i = 0; i < vBuffers.size(); i++)
+        BOOST_CHECK(!pool.Acquire(vBuffers[i], (64 * 1024) << i));
+    for (unsigned int i = 0; i < vBuffers.size(); i++)
+        pool.Release(vBuffers[i]);
+
+    // the largest buffer went to the depot, the others stay with the thread
+    BOOST_CHECK_EQUAL(pool.GetStats().nDepotBytes, 4 * 1024 * 1024U);
+    for (unsigned int i = 0; i < vBuffers.size(); i++)
+        BOOST_CHECK(pool.Acquire(vBuffers[i], (64 * 1024) << i));
+    BOOST_CHECK_EQUAL(pool.GetStats().nDepotBytes, 0U);
+    BOOST_CHECK_EQUAL(pool.GetStats().nFreed, 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
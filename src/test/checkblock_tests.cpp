@@ -8,6 +8,7 @@
 
 
 
+#include "chainparams.h"
 #include "clientversion.h"
 #include "main.h"
 #include "utiltime.h"
@@ -66,4 +67,70 @@ BOOST_AUTO_TEST_CASE(May15)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(CheckBlock_memo)
+{
+    CBlock block = Params().GenesisBlock();
+    CValidationState state;
+    BOOST_CHECK(!block.fChecked);
+
+    // A check without the merkle root is not remembered
+    BOOST_CHECK(CheckBlock(block, state, true, false));
+    BOOST_CHECK(!block.fChecked);
+    BOOST_CHECK(CheckBlock(block, state));
+    BOOST_CHECK(block.fChecked);
+
+    block.SetNull();
+    BOOST_CHECK(!block.fChecked);
+}
+
+BOOST_AUTO_TEST_CASE(CBlock_hash_cache)
+{
+    CBlock block = Params().GenesisBlock();
+    const CBlockHeader& header = block;
+    uint256 hashGenesis = header.CBlockHeader::GetHash();
+    BOOST_CHECK(block.GetHash() == hashGenesis);
+    BOOST_CHECK(block.GetHash() == Params().HashGenesisBlock());
+
+    // A header change is picked up once the cache is invalidated
+    block.nNonce++;
+    block.InvalidateHash();
+    BOOST_CHECK(block.GetHash() != hashGenesis);
+    BOOST_CHECK(block.GetHash() == header.CBlockHeader::GetHash());
+    block.hashMerkleRoot = uint256();
+    block.InvalidateHash();
+    BOOST_CHECK(block.GetHash() == header.CBlockHeader::GetHash());
+
+    // Copies keep a valid cache
+    CBlock copy = block;
+    BOOST_CHECK(copy.GetHash() == block.GetHash());
+    copy.nNonce--;
+    copy.InvalidateHash();
+    BOOST_CHECK(copy.GetHash() != block.GetHash());
+
+    // Reading a block over another one drops the cache
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << copy;
+    ss >> block;
+    BOOST_CHECK(block.GetHash() == copy.GetHash());
+
+    block.SetNull();
+    BOOST_CHECK(block.GetHash() == header.CBlockHeader::GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(PreCheckBlocks_parallel)
+{
+    std::vector<CBlock> vBlocks(32, Params().GenesisBlock());
+    vBlocks[7].hashMerkleRoot = uint256();
+    vBlocks[7].InvalidateHash();
+    vBlocks[20].vtx.clear();
+    PreCheckBlocks(vBlocks);
+    for (size_t i = 0; i < vBlocks.size(); i++)
+        BOOST_CHECK_EQUAL(vBlocks[i].fChecked, i != 7 && i != 20);
+
+    // The failed blocks still get the full check and its error
+    CValidationState state;
+    BOOST_CHECK(!CheckBlock(vBlocks[7], state));
+    BOOST_CHECK(state.CorruptionPossible());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -131,6 +131,25 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors) {
     TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+BOOST_AUTO_TEST_CASE(sha256d_short_batch) {
+    // The multi-lane kernel must match CSHA256 applied twice, including for
+    // counts that do not fill the last group of lanes.
+    for (size_t len = 0; len <= 55; len += 11) {
+        for (size_t count = 1; count <= 17; count++) {
+            std::vector<unsigned char> in(len * count + 1), out(count * CSHA256::OUTPUT_SIZE);
+            for (size_t i = 0; i < in.size(); i++)
+                in[i] = insecure_rand();
+            SHA256DShort(&out[0], &in[0], len, count);
+            for (size_t n = 0; n < count; n++) {
+                unsigned char hash[CSHA256::OUTPUT_SIZE];
+                CSHA256().Write(&in[n * len], len).Finalize(hash);
+                CSHA256().Write(hash, sizeof(hash)).Finalize(hash);
+                BOOST_CHECK(memcmp(hash, &out[n * CSHA256::OUTPUT_SIZE], sizeof(hash)) == 0);
+            }
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
     TestSHA512("",
                "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
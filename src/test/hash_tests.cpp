@@ -46,4 +46,23 @@ BOOST_AUTO_TEST_CASE(murmurhash3)
 #undef T
 }
 
+BOOST_AUTO_TEST_CASE(quark_selftest)
+{
+    // Reference results before the self-test can enable any other kernel
+    std::vector<uint256> vExpected;
+    std::vector<unsigned char> vData;
+    for (int i = 0; i < 200; i++) {
+        vExpected.push_back(HashQuark(vData.begin(), vData.end()));
+        vData.push_back(i * 7);
+    }
+
+    BOOST_CHECK(QuarkSelfTest());
+
+    vData.clear();
+    for (int i = 0; i < 200; i++) {
+        BOOST_CHECK(HashQuark(vData.begin(), vData.end()) == vExpected[i]);
+        vData.push_back(i * 7);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,100 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Unit tests for the P2P command dispatch table
+//
+
+#include "clientversion.h"
+#include "messagedispatch.h"
+#include "streams.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(messagedispatch_tests)
+
+static std::string strLastHandled;
+
+static void TestHandler(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
+{
+    strLastHandled = strCommand;
+}
+
+BOOST_AUTO_TEST_CASE(messagedispatch_route)
+{
+    CMessageDispatcher dispatcher;
+    dispatcher.Register("core");
+    dispatcher.Register("ext", &TestHandler);
+
+    CDataStream vRecv(SER_NETWORK, CLIENT_VERSION);
+    std::string strCommand = "ext";
+    strLastHandled.clear();
+    BOOST_CHECK(dispatcher.Dispatch(NULL, strCommand, vRecv));
+    BOOST_CHECK_EQUAL(strLastHandled, "ext");
+
+    // registered without a handler, or not registered at all
+    strLastHandled.clear();
+    strCommand = "core";
+    BOOST_CHECK(!dispatcher.Dispatch(NULL, strCommand, vRecv));
+    strCommand = "junk";
+    BOOST_CHECK(!dispatcher.Dispatch(NULL, strCommand, vRecv));
+    BOOST_CHECK(strLastHandled.empty());
+}
+
+BOOST_AUTO_TEST_CASE(messagedispatch_concurrent)
+{
+    CMessageDispatcher dispatcher;
+    dispatcher.Register("core");
+    dispatcher.Register("ping", CMessageDispatcher::Handler(), true);
+    dispatcher.Register("ext", &TestHandler, true);
+
+    BOOST_CHECK(dispatcher.IsConcurrent("ping"));
+    BOOST_CHECK(dispatcher.IsConcurrent("ext"));
+    BOOST_CHECK(!dispatcher.IsConcurrent("core"));
+    BOOST_CHECK(!dispatcher.IsConcurrent("junk"));
+}
+
+BOOST_AUTO_TEST_CASE(messagedispatch_stats)
+{
+    CMessageDispatcher dispatcher;
+    dispatcher.Register("core");
+    dispatcher.Register("ext", &TestHandler);
+
+    dispatcher.Record("ext", 100, 5);
+    dispatcher.Record("ext", 50, 2500);
+    dispatcher.Record("core", 10, 2000000);
+    dispatcher.Record("junk1", 1, 1);
+    dispatcher.Record("junk2", 1, 1);
+
+    std::map<std::string, CMessageStats> mapStats = dispatcher.GetStats();
+    BOOST_CHECK_EQUAL(mapStats.size(), 3U);
+
+    const CMessageStats& ext = mapStats["ext"];
+    BOOST_CHECK_EQUAL(ext.nCount, 2U);
+    BOOST_CHECK_EQUAL(ext.nBytes, 150U);
+    BOOST_CHECK_EQUAL(ext.nTimeTotal, 2505);
+    BOOST_CHECK_EQUAL(ext.nTimeMax, 2500);
+    BOOST_CHECK_EQUAL(ext.vHistogram[0], 1U);
+    BOOST_CHECK_EQUAL(ext.vHistogram[3], 1U);
+
+    BOOST_CHECK_EQUAL(mapStats["core"].vHistogram[CMessageStats::HISTOGRAM_BUCKETS - 1], 1U);
+    // unregistered commands share one entry
+    BOOST_CHECK_EQUAL(mapStats["unknown"].nCount, 2U);
+}
+
+BOOST_AUTO_TEST_CASE(messagedispatch_buckets)
+{
+    BOOST_CHECK_EQUAL(CMessageStats::GetBucket(0), 0);
+    BOOST_CHECK_EQUAL(CMessageStats::GetBucket(9), 0);
+    BOOST_CHECK_EQUAL(CMessageStats::GetBucket(10), 1);
+    BOOST_CHECK_EQUAL(CMessageStats::GetBucket(999), 2);
+    BOOST_CHECK_EQUAL(CMessageStats::GetBucket(1000), 3);
+    BOOST_CHECK_EQUAL(CMessageStats::GetBucket(999999), 5);
+    BOOST_CHECK_EQUAL(CMessageStats::GetBucket(1000000), 6);
+    BOOST_CHECK_EQUAL(CMessageStats::GetBucket(100000000), 6);
+    BOOST_CHECK_EQUAL(CMessageStats::GetBucketName(0), "<10us");
+    BOOST_CHECK_EQUAL(CMessageStats::GetBucketName(CMessageStats::HISTOGRAM_BUCKETS - 1), ">=1s");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
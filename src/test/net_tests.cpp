@@ -0,0 +1,137 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Unit tests for writing the send queue of a peer
+//
+
+#include "net.h"
+#include "protocol.h"
+#include "random.h"
+#include "utiltime.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(net_tests)
+
+BOOST_AUTO_TEST_CASE(getdata_cache_refresh)
+{
+    CGetDataCache cache;
+    CInv inv(MSG_SERVICENODE_ANNOUNCE, GetRandHash());
+    CInv invOther(MSG_SERVICENODE_PING, GetRandHash());
+    boost::shared_ptr<const CDataStream> payload1(new CDataStream(SER_NETWORK, PROTOCOL_VERSION));
+    boost::shared_ptr<const CDataStream> payload2(new CDataStream(SER_NETWORK, PROTOCOL_VERSION));
+
+    int64_t nStart = GetTime();
+    SetMockTime(nStart);
+    cache.Add(inv, 1, payload1);
+
+    // added again shortly before it expires, the refreshed payload outlives the first expiry
+    SetMockTime(nStart + GETDATA_CACHE_SECONDS - 1);
+    cache.Add(inv, 2, payload2);
+    SetMockTime(nStart + GETDATA_CACHE_SECONDS + 1);
+    cache.Add(invOther, 0, payload1);
+    BOOST_CHECK(cache.Get(inv, 2) == payload2);
+    BOOST_CHECK(!cache.Get(inv, 1));
+    BOOST_CHECK_EQUAL(cache.size(), 2U);
+
+    // and expires in its own time
+    SetMockTime(nStart + 2 * GETDATA_CACHE_SECONDS);
+    cache.Add(invOther, 0, payload1);
+    BOOST_CHECK(!cache.Get(inv, 2));
+    BOOST_CHECK_EQUAL(cache.size(), 1U);
+
+    SetMockTime(0);
+}
+
+#ifndef WIN32
+static size_t ReadAll(SOCKET hSocket, size_t nSize)
+{
+    std::vector<char> vBuf(nSize);
+    size_t nRead = 0;
+    while (nRead < nSize) {
+        int nBytes = recv(hSocket, &vBuf[nRead], nSize - nRead, 0);
+        if (nBytes <= 0)
+            break;
+        nRead += nBytes;
+    }
+    return nRead;
+}
+
+BOOST_AUTO_TEST_CASE(net_send_coalesced)
+{
+    int vSockets[2];
+    BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, vSockets) == 0);
+    CNode node(vSockets[0], CAddress(), "", true);
+
+    // messages queued while corked are written by one call
+    {
+        LOCK(node.cs_vSend);
+        node.CorkSend();
+        for (uint64_t nonce = 1; nonce <= 10; nonce++)
+            node.PushMessage("ping", nonce);
+        BOOST_CHECK_EQUAL(node.nSendCalls, 0U);
+        BOOST_CHECK_EQUAL(node.vSendMsg.size(), 10U);
+        node.UncorkSend();
+    }
+    BOOST_CHECK_EQUAL(node.nSendCalls, 1U);
+    BOOST_CHECK_EQUAL(node.nSendMsgs, 10U);
+    BOOST_CHECK(node.vSendMsg.empty());
+    BOOST_CHECK_EQUAL(node.nSendSize, 0U);
+    BOOST_CHECK_EQUAL(ReadAll(vSockets[1], 10 * (CMessageHeader::HEADER_SIZE + 8)), 10 * (CMessageHeader::HEADER_SIZE + 8U));
+
+    // without the cork each message is written as it comes
+    node.PushMessage("ping", (uint64_t)11);
+    node.PushMessage("ping", (uint64_t)12);
+    BOOST_CHECK_EQUAL(node.nSendCalls, 3U);
+    BOOST_CHECK_EQUAL(node.nSendMsgs, 12U);
+    BOOST_CHECK_EQUAL(ReadAll(vSockets[1], 2 * (CMessageHeader::HEADER_SIZE + 8)), 2 * (CMessageHeader::HEADER_SIZE + 8U));
+
+    // the bytes sent are accounted to their command
+    BOOST_CHECK_EQUAL(node.mapSendBytesPerCmd.size(), 1U);
+    BOOST_CHECK_EQUAL(node.mapSendBytesPerCmd["ping"], 12 * (CMessageHeader::HEADER_SIZE + 8U));
+
+    close(vSockets[1]);
+}
+
+BOOST_AUTO_TEST_CASE(net_send_partial)
+{
+    int vSockets[2];
+    BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, vSockets) == 0);
+    CNode node(vSockets[0], CAddress(), "", true);
+
+    // more than the socket buffer takes: the rest stays queued, from where the write stopped
+    std::vector<unsigned char> vData(1024 * 1024);
+    size_t nTotal = 0;
+    {
+        LOCK(node.cs_vSend);
+        node.CorkSend();
+        for (int i = 0; i < 4; i++)
+            node.PushMessage("block", vData);
+        nTotal = node.nSendSize;
+        node.UncorkSend();
+    }
+    BOOST_CHECK(!node.vSendMsg.empty());
+    BOOST_CHECK(node.nSendBytes > 0);
+    BOOST_CHECK_EQUAL(node.nSendBytes + node.nSendSize, nTotal + node.nSendOffset);
+
+    // the reader drains the socket while the rest is written
+    size_t nRead = 0;
+    while (!node.vSendMsg.empty()) {
+        nRead += ReadAll(vSockets[1], node.nSendBytes - nRead);
+        LOCK(node.cs_vSend);
+        SocketSendData(&node);
+    }
+    nRead += ReadAll(vSockets[1], node.nSendBytes - nRead);
+    BOOST_CHECK_EQUAL(nRead, nTotal);
+    BOOST_CHECK_EQUAL(node.nSendMsgs, 4U);
+    BOOST_CHECK_EQUAL(node.nSendBytes, nTotal);
+
+    close(vSockets[1]);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,93 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Unit tests for the maintenance task scheduler
+//
+
+#include "scheduler.h"
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(scheduler_tests)
+
+static void Count(int* pnCount)
+{
+    (*pnCount)++;
+}
+
+// the scheduler ignores -mocktime, the tests drive its clock directly
+static int64_t nTestTime = 0;
+
+static int64_t GetTestTime()
+{
+    return nTestTime;
+}
+
+static CSchedulerTaskInfo GetTask(const CScheduler& sched, const std::string& strName)
+{
+    std::vector<CSchedulerTaskInfo> vTasks = sched.GetTasks();
+    for (unsigned int i = 0; i < vTasks.size(); i++) {
+        if (vTasks[i].strName == strName)
+            return vTasks[i];
+    }
+    return CSchedulerTaskInfo();
+}
+
+BOOST_AUTO_TEST_CASE(scheduler_periodic)
+{
+    int64_t nStart = 1500000000;
+    nTestTime = nStart;
+
+    CScheduler sched(GetTestTime);
+    int nFast = 0, nSlow = 0;
+    sched.ScheduleEvery("fast", boost::bind(&Count, &nFast), 1, 1);
+    // longer than one turn of the wheel
+    sched.ScheduleEvery("slow", boost::bind(&Count, &nSlow), 100, 100);
+
+    BOOST_CHECK_EQUAL(sched.RunDueTasks(nStart), 0);
+    for (int64_t nTime = nStart + 1; nTime <= nStart + 250; nTime++)
+        sched.RunDueTasks(nTime);
+    BOOST_CHECK_EQUAL(nFast, 250);
+    BOOST_CHECK_EQUAL(nSlow, 2);
+
+    CSchedulerTaskInfo info = GetTask(sched, "slow");
+    BOOST_CHECK_EQUAL(info.nRuns, 2U);
+    BOOST_CHECK_EQUAL(info.nLastRun, nStart + 200);
+    BOOST_CHECK_EQUAL(info.nNextRun, nStart + 300);
+
+    // a long sleep runs what is overdue once
+    BOOST_CHECK_EQUAL(sched.RunDueTasks(nStart + 1000), 2);
+    BOOST_CHECK_EQUAL(nSlow, 3);
+}
+
+BOOST_AUTO_TEST_CASE(scheduler_deadline)
+{
+    int64_t nStart = 1500000000;
+    nTestTime = nStart;
+
+    CScheduler sched(GetTestTime);
+    int nCount = 0;
+    sched.Schedule("once", boost::bind(&Count, &nCount), 10);
+    BOOST_CHECK_EQUAL(sched.RunDueTasks(nStart + 9), 0);
+    BOOST_CHECK_EQUAL(sched.RunDueTasks(nStart + 10), 1);
+    BOOST_CHECK_EQUAL(sched.RunDueTasks(nStart + 100), 0);
+    BOOST_CHECK_EQUAL(nCount, 1);
+    BOOST_CHECK_EQUAL(GetTask(sched, "once").nNextRun, 0);
+
+    // woken tasks run on the next pass, known or not
+    nTestTime = nStart + 200;
+    BOOST_CHECK(sched.Wake("once"));
+    BOOST_CHECK(!sched.Wake("unknown"));
+    BOOST_CHECK_EQUAL(sched.RunDueTasks(nStart + 200), 1);
+    BOOST_CHECK_EQUAL(nCount, 2);
+
+    // cancelled tasks do not run
+    sched.ScheduleEvery("every", boost::bind(&Count, &nCount), 1, 1);
+    sched.Cancel("every");
+    BOOST_CHECK_EQUAL(sched.RunDueTasks(nStart + 300), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
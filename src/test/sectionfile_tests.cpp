@@ -0,0 +1,228 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Unit tests for the sectioned cache files
+//
+
+#include "chainparams.h"
+#include "clientversion.h"
+#include "hash.h"
+#include "sectionfile.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(sectionfile_tests)
+
+static boost::filesystem::path SectionFilePath(const std::string& strName)
+{
+    boost::filesystem::path path = GetDataDir() / strName;
+    boost::filesystem::remove(path);
+    return path;
+}
+
+BOOST_AUTO_TEST_CASE(sectionfile_roundtrip)
+{
+    boost::filesystem::path path = SectionFilePath("sectionfile_roundtrip.dat");
+
+    std::map<int, std::string> mapIn;
+    for (int i = 0; i < 1000; i++)
+        mapIn[i] = strprintf("entry %d", i);
+    std::vector<int> vecIn(5000, 7);
+
+    CSectionFile file(path, "SectionTest");
+    BOOST_CHECK(file.Open() == CSectionFile::FileError);
+    file.WriteSection("map", mapIn);
+    file.WriteSection("vector", vecIn);
+    BOOST_CHECK(file.Commit());
+
+    CSectionFile filein(path, "SectionTest");
+    BOOST_CHECK(filein.Open() == CSectionFile::Ok);
+    BOOST_CHECK(!filein.IsLegacy());
+    BOOST_CHECK(filein.Verify() == CSectionFile::Ok);
+
+    std::map<int, std::string> mapOut;
+    std::vector<int> vecOut;
+    BOOST_CHECK(filein.ReadSection("map", mapOut) == CSectionFile::Ok);
+    BOOST_CHECK(filein.ReadSection("vector", vecOut) == CSectionFile::Ok);
+    BOOST_CHECK(mapOut == mapIn);
+    BOOST_CHECK(vecOut == vecIn);
+    BOOST_CHECK(filein.ReadSection("missing", vecOut) == CSectionFile::IncorrectFormat);
+
+    // a file of another kind is refused
+    CSectionFile fileOther(path, "OtherTest");
+    BOOST_CHECK(fileOther.Open() == CSectionFile::IncorrectMagicMessage);
+}
+
+BOOST_AUTO_TEST_CASE(sectionfile_append)
+{
+    boost::filesystem::path path = SectionFilePath("sectionfile_append.dat");
+
+    std::vector<int> vecLarge(10000, 1);
+    std::vector<int> vecSmall(10, 2);
+
+    CSectionFile file(path, "SectionTest");
+    file.WriteSection("large", vecLarge);
+    file.WriteSection("small", vecSmall);
+    BOOST_CHECK(file.Commit());
+    uint64_t nSize = boost::filesystem::file_size(path);
+    BOOST_CHECK_EQUAL(file.GetDataEnd(), nSize);
+
+    // nothing changed, nothing is written
+    file.WriteSection("large", vecLarge);
+    file.WriteSection("small", vecSmall);
+    BOOST_CHECK(file.Commit());
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(path), nSize);
+
+    // only the changed section is appended
+    vecSmall.push_back(3);
+    file.WriteSection("large", vecLarge);
+    file.WriteSection("small", vecSmall);
+    BOOST_CHECK(file.Commit());
+    uint64_t nSizeAppended = boost::filesystem::file_size(path);
+    BOOST_CHECK(nSizeAppended > nSize);
+    BOOST_CHECK(nSizeAppended < nSize + 200);
+
+    CSectionFile filein(path, "SectionTest");
+    BOOST_CHECK(filein.Open() == CSectionFile::Ok);
+    std::vector<int> vecOut;
+    BOOST_CHECK(filein.ReadSection("small", vecOut) == CSectionFile::Ok);
+    BOOST_CHECK(vecOut == vecSmall);
+
+    // once most of the file is stale it is rewritten
+    vecLarge[0] = 0;
+    file.WriteSection("large", vecLarge);
+    file.WriteSection("small", vecSmall);
+    BOOST_CHECK(file.Commit());
+    BOOST_CHECK(boost::filesystem::file_size(path) < nSizeAppended);
+    BOOST_CHECK(filein.Open() == CSectionFile::Ok);
+    BOOST_CHECK(filein.ReadSection("large", vecOut) == CSectionFile::Ok);
+    BOOST_CHECK(vecOut == vecLarge);
+}
+
+BOOST_AUTO_TEST_CASE(sectionfile_versions)
+{
+    boost::filesystem::path path = SectionFilePath("sectionfile_versions.dat");
+
+    std::vector<int> vecLarge(10000, 1);
+    std::vector<int> vecSmall(10, 2);
+    CSectionVersion versionLarge, versionSmall;
+
+    CSectionFile file(path, "SectionTest");
+    file.WriteSection("large", vecLarge, versionLarge);
+    file.WriteSection("small", vecSmall, versionSmall);
+    BOOST_CHECK(file.Commit());
+    BOOST_CHECK(file.IsStored("large", versionLarge));
+    BOOST_CHECK(file.IsStored("small", versionSmall));
+
+    // a section read with its version is not staged again until it changes
+    CSectionFile filein(path, "SectionTest");
+    CSectionVersion versionIn;
+    std::vector<unsigned char> vchData;
+    std::vector<int> vecOut;
+    BOOST_CHECK(filein.Open() == CSectionFile::Ok);
+    BOOST_CHECK(!filein.IsStored("small", versionIn));
+    BOOST_CHECK(filein.ReadSectionData("small", vchData, versionIn) == CSectionFile::Ok);
+    BOOST_CHECK(filein.IsStored("small", versionIn));
+    BOOST_CHECK(CSectionFile::DecodeSection("small", vchData, vecOut) == CSectionFile::Ok);
+    BOOST_CHECK(vecOut == vecSmall);
+    versionIn.Changed();
+    BOOST_CHECK(!filein.IsStored("small", versionIn));
+
+    // the large section changes, the small one is not staged: the rewrite copies its record over
+    uint64_t nSize = boost::filesystem::file_size(path);
+    vecLarge[0] = 0;
+    versionLarge.Changed();
+    file.WriteSection("large", vecLarge, versionLarge);
+    file.WriteSection("small", std::vector<int>(), versionSmall);
+    BOOST_CHECK(file.Commit());
+    BOOST_CHECK(boost::filesystem::file_size(path) <= nSize);
+    BOOST_CHECK(file.IsStored("large", versionLarge));
+    BOOST_CHECK(file.IsStored("small", versionSmall));
+    BOOST_CHECK(filein.Open() == CSectionFile::Ok);
+    BOOST_CHECK(filein.Verify() == CSectionFile::Ok);
+    BOOST_CHECK(filein.ReadSection("small", vecOut) == CSectionFile::Ok);
+    BOOST_CHECK(vecOut == vecSmall);
+    BOOST_CHECK(filein.ReadSection("large", vecOut) == CSectionFile::Ok);
+    BOOST_CHECK(vecOut == vecLarge);
+}
+
+BOOST_AUTO_TEST_CASE(sectionfile_damage)
+{
+    boost::filesystem::path path = SectionFilePath("sectionfile_damage.dat");
+
+    std::vector<int> vecA(100, 1);
+    std::vector<int> vecB(100, 2);
+    CSectionFile file(path, "SectionTest");
+    file.WriteSection("a", vecA);
+    file.WriteSection("b", vecB);
+    BOOST_CHECK(file.Commit());
+    uint64_t nSize = boost::filesystem::file_size(path);
+
+    // a record cut short is ignored and overwritten by the next commit
+    FILE* f = fopen(path.string().c_str(), "ab");
+    BOOST_CHECK(f != NULL);
+    unsigned char pchPartial[] = {1, 'a', 0xff, 0xff};
+    fwrite(pchPartial, 1, sizeof(pchPartial), f);
+    fclose(f);
+    BOOST_CHECK(file.Open() == CSectionFile::Ok);
+    BOOST_CHECK_EQUAL(file.GetDataEnd(), nSize);
+    vecA.push_back(1);
+    file.WriteSection("a", vecA);
+    file.WriteSection("b", vecB);
+    BOOST_CHECK(file.Commit());
+    std::vector<int> vecOut;
+    BOOST_CHECK(file.ReadSection("a", vecOut) == CSectionFile::Ok);
+    BOOST_CHECK(vecOut == vecA);
+    BOOST_CHECK_EQUAL(file.GetDataEnd(), boost::filesystem::file_size(path));
+
+    // a flipped byte fails the checksum of its section
+    f = fopen(path.string().c_str(), "r+b");
+    BOOST_CHECK(f != NULL);
+    fseek(f, -1, SEEK_END);
+    unsigned char ch = 0x55;
+    fwrite(&ch, 1, 1, f);
+    fclose(f);
+    BOOST_CHECK(file.Open() == CSectionFile::Ok);
+    BOOST_CHECK(file.Verify() == CSectionFile::IncorrectHash);
+    BOOST_CHECK(file.ReadSection("a", vecOut) == CSectionFile::IncorrectHash);
+}
+
+BOOST_AUTO_TEST_CASE(sectionfile_legacy)
+{
+    boost::filesystem::path path = SectionFilePath("sectionfile_legacy.dat");
+
+    // single blob written by the old cache file classes
+    std::vector<int> vecIn(100, 9);
+    CDataStream ssObj(SER_DISK, CLIENT_VERSION);
+    ssObj << std::string("SectionTest");
+    ssObj << FLATDATA(Params().MessageStart());
+    ssObj << vecIn;
+    uint256 hash = Hash(ssObj.begin(), ssObj.end());
+    ssObj << hash;
+    FILE* f = fopen(path.string().c_str(), "wb");
+    CAutoFile fileout(f, SER_DISK, CLIENT_VERSION);
+    fileout << ssObj;
+    fileout.fclose();
+
+    CSectionFile file(path, "SectionTest");
+    BOOST_CHECK(file.Open() == CSectionFile::Ok);
+    BOOST_CHECK(file.IsLegacy());
+    BOOST_CHECK(file.Verify() == CSectionFile::Ok);
+    std::vector<int> vecOut;
+    BOOST_CHECK(file.ReadLegacy(vecOut) == CSectionFile::Ok);
+    BOOST_CHECK(vecOut == vecIn);
+
+    // the first commit replaces it with a section file
+    file.WriteSection("vector", vecIn);
+    BOOST_CHECK(file.Commit());
+    BOOST_CHECK(!file.IsLegacy());
+    vecOut.clear();
+    BOOST_CHECK(file.ReadSection("vector", vecOut) == CSectionFile::Ok);
+    BOOST_CHECK(vecOut == vecIn);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,171 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Unit tests for syncing the servicenode assets from several peers
+//
+
+#include "net.h"
+#include "random.h"
+#include "servicenode-sync.h"
+#include "utiltime.h"
+#include "version.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(servicenode_sync_tests)
+
+static void ReportCount(CServicenodeSync& sync, CNode* pnode, int nItemID, int nCount)
+{
+    CDataStream vRecv(SER_NETWORK, PROTOCOL_VERSION);
+    vRecv << nItemID << nCount;
+    std::string strCommand = "ssc";
+    sync.ProcessMessage(pnode, strCommand, vRecv);
+}
+
+static std::vector<CNode*> CreateNodes(int nCount)
+{
+    std::vector<CNode*> vNodesOut;
+    for (int i = 0; i < nCount; i++) {
+        vNodesOut.push_back(new CNode(INVALID_SOCKET, CAddress(), "", true));
+        vNodesOut.back()->nVersion = PROTOCOL_VERSION;
+    }
+    return vNodesOut;
+}
+
+static void DeleteNodes(std::vector<CNode*>& vNodesIn)
+{
+    BOOST_FOREACH (CNode* pnode, vNodesIn)
+        delete pnode;
+    vNodesIn.clear();
+}
+
+BOOST_AUTO_TEST_CASE(servicenode_sync_peer)
+{
+    CServicenodeSyncPeer peer;
+    BOOST_CHECK_EQUAL(peer.nTimeRequested, 0);
+    BOOST_CHECK_EQUAL(peer.nReported, 0);
+    BOOST_CHECK_EQUAL(peer.nReports, 0);
+    BOOST_CHECK_EQUAL(peer.nItems, 0);
+
+    CServicenodeSync sync;
+    sync.RequestedServicenodeAssets = SERVICENODE_SYNC_LIST;
+    std::vector<CNode*> vPeers = CreateNodes(1);
+    int64_t nNow = GetTime();
+    SetMockTime(nNow);
+    BOOST_CHECK_EQUAL(sync.SelectSyncPeers(vPeers, "mnsync", PROTOCOL_VERSION).size(), 1U);
+
+    // reports and items are accounted to the peer that sent them
+    ReportCount(sync, vPeers[0], SERVICENODE_SYNC_LIST, 5);
+    ReportCount(sync, vPeers[0], SERVICENODE_SYNC_MNW, 7);
+    sync.AddedServicenodeList(GetRandHash(), vPeers[0]);
+    sync.AddedServicenodeList(GetRandHash());
+    std::map<NodeId, CServicenodeSyncPeer> mapPeers = sync.GetSyncPeers();
+    BOOST_CHECK_EQUAL(mapPeers.size(), 1U);
+    CServicenodeSyncPeer& peerSynced = mapPeers[vPeers[0]->GetId()];
+    BOOST_CHECK_EQUAL(peerSynced.nTimeRequested, nNow);
+    BOOST_CHECK_EQUAL(peerSynced.nReported, 5);
+    BOOST_CHECK_EQUAL(peerSynced.nReports, 1);
+    BOOST_CHECK_EQUAL(peerSynced.nItems, 1);
+
+    // moving on to the next asset forgets the peers
+    sync.GetNextAsset();
+    BOOST_CHECK(sync.GetSyncPeers().empty());
+
+    SetMockTime(0);
+    DeleteNodes(vPeers);
+}
+
+BOOST_AUTO_TEST_CASE(servicenode_sync_select_peers)
+{
+    CServicenodeSync sync;
+    sync.RequestedServicenodeAssets = SERVICENODE_SYNC_LIST;
+    std::vector<CNode*> vPeers = CreateNodes(6);
+    vPeers[1]->nVersion = PROTOCOL_VERSION - 1;
+    int64_t nNow = GetTime();
+    SetMockTime(nNow);
+
+    // up to SERVICENODE_SYNC_PEERS peers are asked at once, peers too old are skipped
+    std::vector<CNode*> vSelected = sync.SelectSyncPeers(vPeers, "mnsync", PROTOCOL_VERSION);
+    BOOST_CHECK_EQUAL(vSelected.size(), (size_t)SERVICENODE_SYNC_PEERS);
+    BOOST_CHECK(vSelected[0] == vPeers[0]);
+    BOOST_CHECK(vSelected[1] == vPeers[2]);
+    BOOST_CHECK(vSelected[2] == vPeers[3]);
+    BOOST_CHECK(vPeers[0]->HasFulfilledRequest("mnsync"));
+    BOOST_CHECK(!vPeers[1]->HasFulfilledRequest("mnsync"));
+    BOOST_CHECK(sync.SelectSyncPeers(vPeers, "mnsync", PROTOCOL_VERSION).empty());
+
+    // a peer that reported its count is done, the next one takes its place
+    ReportCount(sync, vPeers[0], SERVICENODE_SYNC_LIST, 1);
+    vSelected = sync.SelectSyncPeers(vPeers, "mnsync", PROTOCOL_VERSION);
+    BOOST_CHECK_EQUAL(vSelected.size(), 1U);
+    BOOST_CHECK(vSelected[0] == vPeers[4]);
+
+    // a peer that did not answer in time no longer counts as pending, a peer is only asked once
+    SetMockTime(nNow + SERVICENODE_SYNC_TIMEOUT * 2 + 1);
+    vSelected = sync.SelectSyncPeers(vPeers, "mnsync", PROTOCOL_VERSION);
+    BOOST_CHECK_EQUAL(vSelected.size(), 1U);
+    BOOST_CHECK(vSelected[0] == vPeers[5]);
+    BOOST_CHECK_EQUAL(sync.RequestedServicenodeAttempt, 5);
+    BOOST_CHECK_EQUAL(sync.GetSyncPeers().size(), 5U);
+
+    // no more requests once the attempts are used up
+    std::vector<CNode*> vMore = CreateNodes(3);
+    BOOST_CHECK_EQUAL(sync.SelectSyncPeers(vMore, "mnsync", PROTOCOL_VERSION).size(), 1U);
+    BOOST_CHECK(sync.SelectSyncPeers(vMore, "mnsync", PROTOCOL_VERSION).empty());
+    BOOST_CHECK_EQUAL(sync.RequestedServicenodeAttempt, SERVICENODE_SYNC_THRESHOLD * 3);
+
+    SetMockTime(0);
+    DeleteNodes(vPeers);
+    DeleteNodes(vMore);
+}
+
+BOOST_AUTO_TEST_CASE(servicenode_sync_converged)
+{
+    CServicenodeSync sync;
+    sync.RequestedServicenodeAssets = SERVICENODE_SYNC_LIST;
+    std::vector<CNode*> vPeers = CreateNodes(3);
+    BOOST_CHECK_EQUAL(sync.SelectSyncPeers(vPeers, "mnsync", PROTOCOL_VERSION).size(), 3U);
+    BOOST_CHECK(!sync.IsAssetConverged());
+
+    // SERVICENODE_SYNC_THRESHOLD peers have to report
+    ReportCount(sync, vPeers[0], SERVICENODE_SYNC_LIST, 2);
+    BOOST_CHECK(!sync.IsAssetConverged());
+    ReportCount(sync, vPeers[1], SERVICENODE_SYNC_LIST, 3);
+    BOOST_CHECK(!sync.IsAssetConverged());
+
+    // and the most any of them announced has to arrive, from whichever peer
+    sync.AddedServicenodeList(GetRandHash(), vPeers[0]);
+    sync.AddedServicenodeList(GetRandHash(), vPeers[2]);
+    BOOST_CHECK(!sync.IsAssetConverged());
+    sync.AddedServicenodeList(GetRandHash(), vPeers[1]);
+    BOOST_CHECK(sync.IsAssetConverged());
+    int nItems, nExpected;
+    sync.GetAssetProgress(nItems, nExpected);
+    BOOST_CHECK_EQUAL(nItems, 3);
+    BOOST_CHECK_EQUAL(nExpected, 3);
+
+    // peers without winners leave the asset to the timeouts
+    sync.GetNextAsset();
+    BOOST_CHECK_EQUAL(sync.RequestedServicenodeAssets, SERVICENODE_SYNC_MNW);
+    BOOST_CHECK_EQUAL(sync.SelectSyncPeers(vPeers, "mnwsync", PROTOCOL_VERSION).size(), 3U);
+    ReportCount(sync, vPeers[0], SERVICENODE_SYNC_MNW, 0);
+    ReportCount(sync, vPeers[1], SERVICENODE_SYNC_MNW, 0);
+    BOOST_CHECK(!sync.IsAssetConverged());
+
+    // budgets are reported in two parts and may well be empty
+    sync.GetNextAsset();
+    BOOST_CHECK_EQUAL(sync.RequestedServicenodeAssets, SERVICENODE_SYNC_BUDGET);
+    BOOST_CHECK_EQUAL(sync.SelectSyncPeers(vPeers, "busync", PROTOCOL_VERSION).size(), 3U);
+    ReportCount(sync, vPeers[0], SERVICENODE_SYNC_BUDGET_PROP, 0);
+    ReportCount(sync, vPeers[1], SERVICENODE_SYNC_BUDGET_PROP, 0);
+    BOOST_CHECK(!sync.IsAssetConverged());
+    ReportCount(sync, vPeers[0], SERVICENODE_SYNC_BUDGET_FIN, 0);
+    ReportCount(sync, vPeers[1], SERVICENODE_SYNC_BUDGET_FIN, 0);
+    BOOST_CHECK(sync.IsAssetConverged());
+
+    DeleteNodes(vPeers);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,544 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Unit tests for the indexed lookups of CServicenodeMan
+//
+
+#include "clientversion.h"
+#include "key.h"
+#include "obfuscation.h"
+#include "random.h"
+#include "script/standard.h"
+#include "servicenode-payments.h"
+#include "servicenode-sigcheck.h"
+#include "servicenode-sync.h"
+#include "servicenode.h"
+#include "servicenodeman.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <algorithm>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(servicenodeman_tests)
+
+static CPubKey RandomPubKey()
+{
+    // only the serialized bytes matter for the indexes, no valid point is needed
+    std::vector<unsigned char> vch(33);
+    vch[0] = 0x02;
+    GetRandBytes(&vch[1], 32);
+    return CPubKey(vch);
+}
+
+static CServicenode RandomServicenode()
+{
+    CServicenode mn;
+    mn.vin = CTxIn(COutPoint(GetRandHash(), 0));
+    mn.pubKeyCollateralAddress = RandomPubKey();
+    mn.pubKeyServicenode = RandomPubKey();
+    return mn;
+}
+
+static CScript Payee(const CServicenode& mn)
+{
+    return GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
+}
+
+BOOST_AUTO_TEST_CASE(servicenodeman_find)
+{
+    CServicenodeMan man;
+    std::vector<CServicenode> vNodes;
+    for (int i = 0; i < 5000; i++) {
+        vNodes.push_back(RandomServicenode());
+        BOOST_CHECK(man.Add(vNodes.back()));
+    }
+    BOOST_CHECK_EQUAL(man.size(), 5000);
+    // the same vin is not added twice
+    BOOST_CHECK(!man.Add(vNodes[0]));
+    BOOST_CHECK_EQUAL(man.size(), 5000);
+
+    int64_t nStart = GetTimeMicros();
+    BOOST_FOREACH (const CServicenode& mn, vNodes) {
+        CServicenode* pmn = man.Find(mn.vin);
+        BOOST_CHECK(pmn != NULL && pmn->vin == mn.vin);
+        BOOST_CHECK(man.Find(mn.pubKeyServicenode) == pmn);
+        BOOST_CHECK(man.Find(Payee(mn)) == pmn);
+    }
+    BOOST_TEST_MESSAGE("15000 lookups in " << (GetTimeMicros() - nStart) << "us");
+
+    CServicenode unknown = RandomServicenode();
+    BOOST_CHECK(man.Find(unknown.vin) == NULL);
+    BOOST_CHECK(man.Find(unknown.pubKeyServicenode) == NULL);
+    BOOST_CHECK(man.Find(Payee(unknown)) == NULL);
+}
+
+BOOST_AUTO_TEST_CASE(servicenodeman_reindex)
+{
+    CServicenodeMan man;
+    CServicenode mn = RandomServicenode();
+    BOOST_CHECK(man.Add(mn));
+    CPubKey oldKey = mn.pubKeyServicenode;
+    CScript oldPayee = Payee(mn);
+
+    // a copy with new keys is not the managed entry and must not touch the indexes
+    CServicenode copy = mn;
+    copy.pubKeyServicenode = RandomPubKey();
+    copy.pubKeyCollateralAddress = RandomPubKey();
+    man.UpdateIndexes(copy);
+    BOOST_CHECK(man.Find(oldKey) != NULL);
+    BOOST_CHECK(man.Find(copy.pubKeyServicenode) == NULL);
+
+    CServicenode* pmn = man.Find(mn.vin);
+    BOOST_REQUIRE(pmn != NULL);
+    pmn->pubKeyServicenode = copy.pubKeyServicenode;
+    pmn->pubKeyCollateralAddress = copy.pubKeyCollateralAddress;
+    man.UpdateIndexes(*pmn);
+    BOOST_CHECK(man.Find(oldKey) == NULL);
+    BOOST_CHECK(man.Find(oldPayee) == NULL);
+    BOOST_CHECK(man.Find(copy.pubKeyServicenode) == pmn);
+    BOOST_CHECK(man.Find(Payee(copy)) == pmn);
+
+    man.Remove(mn.vin);
+    BOOST_CHECK_EQUAL(man.size(), 0);
+    BOOST_CHECK(man.Find(copy.pubKeyServicenode) == NULL);
+    BOOST_CHECK(man.Find(Payee(copy)) == NULL);
+}
+
+BOOST_AUTO_TEST_CASE(servicenodeman_serialize)
+{
+    CServicenodeMan man;
+    std::vector<CServicenode> vNodes;
+    for (int i = 0; i < 100; i++) {
+        vNodes.push_back(RandomServicenode());
+        man.Add(vNodes.back());
+    }
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << man;
+    CServicenodeMan man2;
+    ss >> man2;
+    BOOST_CHECK_EQUAL(man2.size(), 100);
+    BOOST_FOREACH (const CServicenode& mn, vNodes) {
+        CServicenode* pmn = man2.Find(mn.pubKeyServicenode);
+        BOOST_CHECK(pmn != NULL && pmn->vin == mn.vin);
+        BOOST_CHECK(man2.Find(Payee(mn)) == pmn);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(servicenodeman_sections)
+{
+    boost::filesystem::path path = GetDataDir() / "servicenodeman_sections.dat";
+    boost::filesystem::remove(path);
+
+    CServicenodeMan man;
+    std::vector<uint256> vPings;
+    for (int i = 0; i < 10; i++) {
+        CServicenode mn = RandomServicenode();
+        man.Add(mn);
+        CServicenodePing mnp;
+        mnp.vin = mn.vin;
+        mnp.sigTime = GetAdjustedTime();
+        man.AddSeenPing(mnp);
+        vPings.push_back(mnp.GetHash());
+    }
+    // expired while the file was not in use
+    CServicenodePing mnpOld;
+    mnpOld.vin = CTxIn(COutPoint(GetRandHash(), 0));
+    mnpOld.sigTime = GetAdjustedTime() - SERVICENODE_REMOVAL_SECONDS * 3;
+    man.AddSeenPing(mnpOld);
+
+    CSectionFile file(path, "ServicenodeCache");
+    BOOST_CHECK(file.Open() == CSectionFile::FileError);
+    man.WriteSections(file);
+    BOOST_CHECK(file.Commit());
+
+    // the seen pings are decoded when they are first looked up
+    CSectionFile filein(path, "ServicenodeCache");
+    BOOST_CHECK(filein.Open() == CSectionFile::Ok);
+    CServicenodeMan man2;
+    BOOST_CHECK(man2.ReadSections(filein) == CSectionFile::Ok);
+    BOOST_CHECK_EQUAL(man2.size(), 10);
+    BOOST_CHECK(man2.mapSeenServicenodePing.empty());
+    BOOST_FOREACH (const uint256& hash, vPings)
+        BOOST_CHECK(man2.IsPingSeen(hash));
+    BOOST_CHECK(!man2.IsPingSeen(mnpOld.GetHash()));
+    BOOST_CHECK_EQUAL(man2.mapSeenServicenodePing.size(), 10U);
+
+    // unchanged seen maps are neither decoded nor staged again
+    CServicenodeMan man3;
+    BOOST_CHECK(man3.ReadSections(filein) == CSectionFile::Ok);
+    uint64_t nSize = boost::filesystem::file_size(path);
+    man3.WriteSections(filein);
+    BOOST_CHECK(filein.Commit());
+    BOOST_CHECK(man3.mapSeenServicenodePing.empty());
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(path), nSize);
+
+    // a change decodes them first, so nothing read from the file is lost
+    CServicenodePing mnpNew;
+    mnpNew.vin = CTxIn(COutPoint(GetRandHash(), 0));
+    mnpNew.sigTime = GetAdjustedTime();
+    man3.AddSeenPing(mnpNew);
+    man3.WriteSections(filein);
+    BOOST_CHECK(filein.Commit());
+    CServicenodeMan man4;
+    BOOST_CHECK(man4.ReadSections(filein) == CSectionFile::Ok);
+    BOOST_CHECK(man4.IsPingSeen(mnpNew.GetHash()));
+    BOOST_CHECK_EQUAL(man4.mapSeenServicenodePing.size(), 11U);
+}
+
+BOOST_AUTO_TEST_CASE(servicenodeman_rank_table)
+{
+    CServicenodeRankTable table;
+    std::vector<COutPoint> vOutPoints;
+    for (int i = 0; i < 100; i++) {
+        vOutPoints.push_back(COutPoint(GetRandHash(), i));
+        table.vecRanked.push_back(std::make_pair(1000 - i, vOutPoints.back()));
+        table.vecRankByOutPoint.push_back(std::make_pair(vOutPoints.back(), i + 1));
+    }
+    std::sort(table.vecRankByOutPoint.begin(), table.vecRankByOutPoint.end());
+
+    for (int i = 0; i < 100; i++)
+        BOOST_CHECK_EQUAL(table.GetRank(vOutPoints[i]), i + 1);
+    BOOST_CHECK_EQUAL(table.GetRank(COutPoint(GetRandHash(), 0)), -1);
+}
+
+// every listed node has a distinct rank from 1 on, in order of their scores for the height
+static void CheckRanks(CServicenodeMan& man, std::vector<CServicenode>& vNodes, int64_t nBlockHeight, bool fOnlyActive)
+{
+    std::vector<std::pair<int, int64_t> > vRanks;
+    BOOST_FOREACH (CServicenode& mn, vNodes)
+        vRanks.push_back(std::make_pair(man.GetServicenodeRank(mn.vin, nBlockHeight, 0, fOnlyActive), mn.CalculateScore(1, nBlockHeight).GetCompact(false)));
+    std::sort(vRanks.begin(), vRanks.end());
+    for (unsigned int i = 0; i < vRanks.size(); i++) {
+        BOOST_CHECK_EQUAL(vRanks[i].first, (int)i + 1);
+        if (i > 0)
+            BOOST_CHECK(vRanks[i - 1].second >= vRanks[i].second);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(servicenodeman_rank_tables)
+{
+    CBlockIndex* pindexOldTip = chainActive.Tip();
+    std::vector<uint256> vHashes(102);
+    std::vector<CBlockIndex> vIndex(vHashes.size());
+    for (unsigned int i = 0; i < vIndex.size(); i++) {
+        vHashes[i] = GetRandHash();
+        vIndex[i].nHeight = i;
+        vIndex[i].phashBlock = &vHashes[i];
+        vIndex[i].pprev = (i == 0) ? NULL : &vIndex[i - 1];
+    }
+    chainActive.SetTip(&vIndex[100]);
+    mapCacheBlockHashes.clear();
+    int64_t nTime = GetTime();
+    SetMockTime(nTime);
+
+    CServicenodeMan man;
+    std::vector<CServicenode> vNodes;
+    for (int i = 0; i < 20; i++) {
+        vNodes.push_back(RandomServicenode());
+        vNodes.back().lastPing.sigTime = nTime;
+        vNodes.back().unitTest = true;
+        BOOST_CHECK(man.Add(vNodes.back()));
+    }
+
+    // tables built through the manager, asked for again from the cache
+    for (int nRound = 0; nRound < 2; nRound++) {
+        CheckRanks(man, vNodes, 90, true);
+        CheckRanks(man, vNodes, 101, true);
+        CheckRanks(man, vNodes, 101, false);
+    }
+    CServicenode* pmnFirst = man.GetServicenodeByRank(1, 100);
+    BOOST_REQUIRE(pmnFirst != NULL);
+    BOOST_CHECK(man.GetCurrentServiceNode(1, 100) == pmnFirst);
+    // height 0 is the tip
+    BOOST_CHECK_EQUAL(man.GetServicenodeRank(pmnFirst->vin, 0), 1);
+    // a height more than one block above the tip has no table yet
+    BOOST_CHECK_EQUAL(man.GetServicenodeRank(pmnFirst->vin, 102), -1);
+
+    // after a new block the tip and the next height are ranked as well
+    chainActive.SetTip(&vIndex[101]);
+    CheckRanks(man, vNodes, 102, true);
+    BOOST_FOREACH (CServicenode& mn, vNodes)
+        BOOST_CHECK_EQUAL(man.GetServicenodeRank(mn.vin, 0), man.GetServicenodeRank(mn.vin, 101));
+    BOOST_CHECK(man.GetServicenodeByRank(1, 0) == man.GetServicenodeByRank(1, 101));
+
+    // a servicenode that stops pinging drops out of the enabled tables once the list is checked again
+    CServicenode* pmnExpired = man.Find(vNodes[0].vin);
+    BOOST_REQUIRE(pmnExpired != NULL);
+    pmnExpired->lastPing.sigTime = nTime - SERVICENODE_EXPIRATION_SECONDS;
+    SetMockTime(nTime + SERVICENODE_CHECK_SECONDS);
+    BOOST_CHECK_EQUAL(man.GetServicenodeRank(vNodes[0].vin, 102), -1);
+    std::vector<CServicenode> vEnabled(vNodes.begin() + 1, vNodes.end());
+    CheckRanks(man, vEnabled, 102, true);
+    CheckRanks(man, vNodes, 102, false);
+
+    // added and removed entries are ranked right away
+    man.Remove(vNodes[1].vin);
+    BOOST_CHECK_EQUAL(man.GetServicenodeRank(vNodes[1].vin, 102, 0, false), -1);
+    vNodes.erase(vNodes.begin() + 1);
+    vNodes.push_back(RandomServicenode());
+    vNodes.back().lastPing.sigTime = nTime;
+    vNodes.back().unitTest = true;
+    BOOST_CHECK(man.Add(vNodes.back()));
+    CheckRanks(man, vNodes, 102, false);
+
+    SetMockTime(0);
+    mapCacheBlockHashes.clear();
+    chainActive.SetTip(pindexOldTip);
+}
+
+// keeps a validation interface registered for the lifetime of the scope
+struct ValidationInterfaceScope {
+    CValidationInterface* pinterface;
+    ValidationInterfaceScope(CValidationInterface* pinterfaceIn) : pinterface(pinterfaceIn) { RegisterValidationInterface(pinterface); }
+    ~ValidationInterfaceScope() { UnregisterValidationInterface(pinterface); }
+};
+
+BOOST_AUTO_TEST_CASE(servicenodeman_collateral_spent)
+{
+    CServicenodeMan man;
+    CServicenode mn = RandomServicenode();
+    CServicenode mn2 = RandomServicenode();
+    CServicenode* vpmn[] = {&mn, &mn2};
+    BOOST_FOREACH (CServicenode* pmn, vpmn) {
+        pmn->lastPing.sigTime = GetAdjustedTime();
+        pmn->protocolVersion = PROTOCOL_VERSION;
+        pmn->unitTest = true;
+        BOOST_CHECK(man.Add(*pmn));
+    }
+    ValidationInterfaceScope scope(&man);
+
+    // only the collateral of mn is in the UTXO set
+    {
+        LOCK(cs_main);
+        CCoinsModifier coins = pcoinsTip->ModifyCoins(mn.vin.prevout.hash);
+        coins->vout.resize(mn.vin.prevout.n + 1);
+        coins->vout[mn.vin.prevout.n] = CTxOut(1, CScript());
+        coins->nHeight = 1;
+    }
+
+    CMutableTransaction tx;
+    tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+    tx.vout.push_back(CTxOut(1, CScript()));
+    SyncWithWallets(tx, NULL);
+    BOOST_CHECK(!man.IsCollateralSpent(mn.vin.prevout));
+
+    // a spend seen in the mempool or in a block marks the collateral
+    tx.vin.push_back(mn.vin);
+    SyncWithWallets(tx, NULL);
+    BOOST_CHECK(man.IsCollateralSpent(mn.vin.prevout));
+    BOOST_CHECK(!man.IsCollateralSpent(mn2.vin.prevout));
+
+    CBlock block;
+    CMutableTransaction tx2;
+    tx2.vin.push_back(mn2.vin);
+    tx2.vout.push_back(CTxOut(1, CScript()));
+    block.vtx.push_back(tx2);
+    SyncWithWallets(tx2, &block);
+    BOOST_CHECK(man.IsCollateralSpent(mn2.vin.prevout));
+
+    // the spend of mn is neither in the mempool nor in the UTXO set, the flag is cleared before acting on it;
+    // the collateral of mn2 is really gone
+    man.CheckAndRemove();
+    BOOST_CHECK(!man.IsCollateralSpent(mn.vin.prevout));
+    BOOST_CHECK(man.Find(mn.vin) != NULL);
+    BOOST_CHECK(man.IsCollateralSpent(mn2.vin.prevout));
+
+    // removed entries are no longer watched
+    man.Remove(mn2.vin);
+    BOOST_CHECK(!man.IsCollateralSpent(mn2.vin.prevout));
+
+    {
+        LOCK(cs_main);
+        pcoinsTip->ModifyCoins(mn.vin.prevout.hash)->Clear();
+    }
+}
+
+static void ReceiveMessage(CNode& node, const char* pszCommand, const CDataStream& ssPayload)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << CMessageHeader(pszCommand, ssPayload.size());
+    ss.write(&ssPayload[0], ssPayload.size());
+    BOOST_CHECK(node.ReceiveMsgBytes(&ss[0], ss.size()));
+}
+
+BOOST_AUTO_TEST_CASE(servicenode_sigcheck)
+{
+    CKey key, key2;
+    key.MakeNewKey(true);
+    key2.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    std::string strError;
+
+    // the precheck only runs once the chain is synced
+    SetMockTime(chainActive.Tip()->nTime + 60);
+    BOOST_REQUIRE(servicenodeSync.IsBlockchainSynced());
+
+    std::vector<CServicenodePing> vPings;
+    for (int i = 0; i < 10; i++) {
+        CServicenodePing mnp;
+        mnp.vin = CTxIn(COutPoint(GetRandHash(), 0));
+        mnp.blockHash = GetRandHash();
+        mnp.sigTime = GetAdjustedTime();
+        // CServicenodePing::Sign verifies the signature as well, which would fill the cache
+        BOOST_CHECK(obfuScationSigner.SignMessage(mnp.GetSignatureMessage(), strError, mnp.vchSig, key));
+        vPings.push_back(mnp);
+    }
+    // a ping seen before is skipped by the handler, so it is not worth a precheck either
+    mnodeman.mapSeenServicenodePing.insert(std::make_pair(vPings[0].GetHash(), vPings[0]));
+
+    CNode node(INVALID_SOCKET, CAddress(), "", true);
+    BOOST_FOREACH (const CServicenodePing& mnp, vPings) {
+        BOOST_CHECK(!obfuScationSigner.IsMessageKeyCached(mnp.vchSig, mnp.GetSignatureMessage()));
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << mnp;
+        ReceiveMessage(node, "mnp", ss);
+    }
+    // a message still being received is left for the next round
+    CDataStream ssPartial(SER_NETWORK, PROTOCOL_VERSION);
+    ssPartial << CMessageHeader("mnp", 1000);
+    BOOST_CHECK(node.ReceiveMsgBytes(&ssPartial[0], ssPartial.size()));
+
+    {
+        LOCK(node.cs_vRecvMsg);
+        PrecheckServicenodeSignatures(&node);
+        BOOST_CHECK_EQUAL(node.vRecvMsg.size(), vPings.size() + 1);
+        for (unsigned int i = 0; i < vPings.size(); i++)
+            BOOST_CHECK(node.vRecvMsg[i].fSigPrechecked);
+        BOOST_CHECK(!node.vRecvMsg.back().fSigPrechecked);
+    }
+
+    // the handler finds the recovered keys in the cache, and still gets the same answers
+    BOOST_CHECK(!obfuScationSigner.IsMessageKeyCached(vPings[0].vchSig, vPings[0].GetSignatureMessage()));
+    for (unsigned int i = 1; i < vPings.size(); i++) {
+        std::string strMessage = vPings[i].GetSignatureMessage();
+        BOOST_CHECK(obfuScationSigner.IsMessageKeyCached(vPings[i].vchSig, strMessage));
+        BOOST_CHECK(obfuScationSigner.VerifyMessage(pubkey, vPings[i].vchSig, strMessage, strError));
+        BOOST_CHECK(!obfuScationSigner.VerifyMessage(key2.GetPubKey(), vPings[i].vchSig, strMessage, strError));
+        BOOST_CHECK(!obfuScationSigner.VerifyMessage(pubkey, vPings[i].vchSig, strMessage + "x", strError));
+    }
+
+    mnodeman.mapSeenServicenodePing.erase(vPings[0].GetHash());
+    // an idle hour resets the sync state, the old tip leaves it unsynced for the tests that follow
+    SetMockTime(GetTime() + 2 * 60 * 60);
+    BOOST_CHECK(!servicenodeSync.IsBlockchainSynced());
+    SetMockTime(0);
+}
+
+// CServicenode::GetLastPaid before the paid-height index: walk back through the chain
+static int64_t GetLastPaidByWalk(const CServicenode& mn, int nEnabled)
+{
+    CScript mnpayee = Payee(mn);
+
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << mn.vin;
+    ss << mn.sigTime;
+    int64_t nOffset = ss.GetHash().GetCompact(false) % 150;
+
+    const CBlockIndex* BlockReading = chainActive.Tip();
+    int nMnCount = nEnabled * 1.25;
+    int n = 0;
+    while (BlockReading && BlockReading->nHeight > 0) {
+        if (n >= nMnCount) return 0;
+        n++;
+        if (servicenodePayments.mapServicenodeBlocks.count(BlockReading->nHeight) &&
+            servicenodePayments.mapServicenodeBlocks[BlockReading->nHeight].HasPayeeWithVotes(mnpayee, 2))
+            return BlockReading->nTime + nOffset;
+        BlockReading = BlockReading->pprev;
+    }
+    return 0;
+}
+
+// SecondsSincePayment on top of the walk above
+static int64_t SecondsSincePaymentByWalk(const CServicenode& mn, int nEnabled)
+{
+    int64_t sec = GetAdjustedTime() - GetLastPaidByWalk(mn, nEnabled);
+    int64_t month = 60 * 60 * 24 * 30;
+    if (sec < month) return sec;
+
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << mn.vin;
+    ss << mn.sigTime;
+    return month + ss.GetHash().GetCompact(false);
+}
+
+BOOST_AUTO_TEST_CASE(servicenodeman_last_paid)
+{
+    CBlockIndex* pindexOldTip = chainActive.Tip();
+    std::vector<uint256> vHashes(400);
+    std::vector<CBlockIndex> vIndex(vHashes.size());
+    for (unsigned int i = 0; i < vIndex.size(); i++) {
+        vHashes[i] = GetRandHash();
+        vIndex[i].nHeight = i;
+        vIndex[i].nTime = 1500000000 + i * 60;
+        vIndex[i].phashBlock = &vHashes[i];
+        vIndex[i].pprev = (i == 0) ? NULL : &vIndex[i - 1];
+    }
+    chainActive.SetTip(&vIndex.back());
+    mapCacheBlockHashes.clear();
+    int64_t nTime = vIndex.back().nTime + 60;
+    SetMockTime(nTime);
+
+    CServicenodeMan man;
+    std::vector<CServicenode> vNodes;
+    for (int i = 0; i < 50; i++) {
+        vNodes.push_back(RandomServicenode());
+        vNodes.back().sigTime = i;
+        vNodes.back().lastPing.sigTime = nTime;
+        vNodes.back().protocolVersion = PROTOCOL_VERSION;
+        vNodes.back().cacheInputAge = 1000;
+        vNodes.back().cacheInputAgeBlock = vIndex.back().nHeight;
+        vNodes.back().unitTest = true;
+        BOOST_CHECK(man.Add(vNodes.back()));
+    }
+    // up to three votes for a random payee per block, some of them for blocks above the tip
+    for (int nHeight = 1; nHeight < 420; nHeight++) {
+        int nVotes = insecure_rand() % 4;
+        for (int i = 0; i < nVotes; i++)
+            servicenodePayments.AddBlockPayee(nHeight, Payee(vNodes[insecure_rand() % 10 == 0 ? 0 : insecure_rand() % vNodes.size()]));
+    }
+
+    int vEnabled[] = {0, 1, 10, 50, 200, 1000};
+    BOOST_FOREACH (int nEnabled, vEnabled) {
+        BOOST_FOREACH (CServicenode& mn, vNodes)
+            BOOST_CHECK_EQUAL(GetLastPaidByWalk(mn, nEnabled), mn.GetLastPaid(nEnabled));
+    }
+
+    // the payment queue looks at the tenth of the unscheduled nodes paid longest ago and picks the best score
+    for (int nBlockHeight = vIndex.back().nHeight - 5; nBlockHeight <= vIndex.back().nHeight + 1; nBlockHeight++) {
+        std::vector<std::pair<int64_t, unsigned int> > vecLastPaid;
+        for (unsigned int i = 0; i < vNodes.size(); i++) {
+            if (servicenodePayments.IsScheduled(vNodes[i], nBlockHeight)) continue;
+            vecLastPaid.push_back(std::make_pair(SecondsSincePaymentByWalk(vNodes[i], vNodes.size()), i));
+        }
+        std::sort(vecLastPaid.rbegin(), vecLastPaid.rend());
+        vecLastPaid.resize(std::min(vecLastPaid.size(), vNodes.size() / 10));
+
+        const CServicenode* pmnExpected = NULL;
+        uint256 nHigh = 0;
+        for (unsigned int i = 0; i < vecLastPaid.size(); i++) {
+            uint256 n = vNodes[vecLastPaid[i].second].CalculateScore(1, nBlockHeight - 100);
+            if (n > nHigh) {
+                nHigh = n;
+                pmnExpected = &vNodes[vecLastPaid[i].second];
+            }
+        }
+
+        int nCount = 0;
+        CServicenode* pmn = man.GetNextServicenodeInQueueForPayment(nBlockHeight, false, nCount);
+        BOOST_REQUIRE(pmnExpected != NULL && pmn != NULL);
+        BOOST_CHECK(pmn->vin == pmnExpected->vin);
+    }
+
+    servicenodePayments.Clear();
+    SetMockTime(0);
+    mapCacheBlockHashes.clear();
+    chainActive.SetTip(pindexOldTip);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,7 @@
 
 #include "main.h"
 #include "random.h"
+#include "servicenode-sigcheck.h"
 #include "txdb.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -52,8 +53,11 @@ struct TestingSetup {
         RegisterValidationInterface(pwalletMain);
 #endif
         nScriptCheckThreads = 3;
-        for (int i=0; i < nScriptCheckThreads-1; i++)
+        for (int i=0; i < nScriptCheckThreads-1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadBlockPreCheck);
+            threadGroup.create_thread(&ThreadServicenodeSigCheck);
+        }
         RegisterNodeSignals(GetNodeSignals());
     }
     ~TestingSetup()
@@ -0,0 +1,170 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Unit tests for the per-peer work queue of the message handler threads
+//
+
+#include "workqueue.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <map>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(workqueue_tests)
+
+BOOST_AUTO_TEST_CASE(workqueue_serial)
+{
+    CSerialWorkQueue<int> queue;
+    BOOST_CHECK(queue.Push(1));
+    BOOST_CHECK(!queue.Push(1));
+    BOOST_CHECK(queue.Push(2));
+    BOOST_CHECK_EQUAL(queue.size(), 2U);
+
+    BOOST_CHECK_EQUAL(queue.Pop(), 1);
+    // held by a thread: not handed out again, but remembered
+    BOOST_CHECK(!queue.Push(1));
+    BOOST_CHECK_EQUAL(queue.size(), 1U);
+    BOOST_CHECK(queue.Done(1, false));
+    BOOST_CHECK_EQUAL(queue.Pop(), 2);
+    BOOST_CHECK_EQUAL(queue.Pop(), 1);
+
+    BOOST_CHECK(!queue.Done(1, false));
+    BOOST_CHECK(!queue.Done(2, false));
+    BOOST_CHECK_EQUAL(queue.size(), 0U);
+}
+
+/** Simulated peers: each one has a backlog of messages, those of the downloading peer hold the
+ *  shared lock for a while like a block does with cs_main, the others are pings and invs.
+ */
+struct CSimulatedPeers {
+    static const int BLOCK_MILLIS = 20;
+
+    boost::mutex csMain;
+    boost::mutex mutex;
+    std::map<int, std::vector<int64_t> > mapBacklog;
+    std::map<int, int> mapNext;
+    std::map<int, int> mapRunning;
+    bool fOrdered;
+    bool fSerial;
+    int64_t nPingMax;
+    int64_t nPingTotal;
+    int nPings;
+    int64_t nInvMax;
+    // blocks of the downloading peer done, and the fewest that were done when a ping ran
+    int nBlocksDone;
+    int nPingBlocksMin;
+
+    CSimulatedPeers() : fOrdered(true), fSerial(true), nPingMax(0), nPingTotal(0), nPings(0), nInvMax(0), nBlocksDone(0), nPingBlocksMin(-1) {}
+
+    void Add(int nPeer, int nMessages)
+    {
+        for (int i = 0; i < nMessages; i++)
+            mapBacklog[nPeer].push_back(GetTimeMicros());
+        mapNext[nPeer] = 0;
+    }
+
+    // processes the next message of a peer, returns true when it has more
+    bool Process(int nPeer)
+    {
+        int nMessage;
+        int64_t nQueued;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (mapRunning[nPeer]++)
+                fSerial = false;
+            nMessage = mapNext[nPeer]++;
+            nQueued = mapBacklog[nPeer][nMessage];
+        }
+
+        int64_t nLatency = GetTimeMicros() - nQueued;
+        if (nPeer == 0) {
+            boost::unique_lock<boost::mutex> lockMain(csMain);
+            MilliSleep(BLOCK_MILLIS);
+        } else if (nMessage % 2) {
+            // inv
+            boost::unique_lock<boost::mutex> lockMain(csMain);
+            nLatency = GetTimeMicros() - nQueued;
+        }
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (nPeer == 0) {
+            nBlocksDone++;
+        } else if (nMessage % 2) {
+            nInvMax = std::max(nInvMax, nLatency);
+        } else {
+            nPingMax = std::max(nPingMax, nLatency);
+            nPingTotal += nLatency;
+            nPings++;
+            if (nPingBlocksMin < 0 || nBlocksDone < nPingBlocksMin)
+                nPingBlocksMin = nBlocksDone;
+        }
+        mapRunning[nPeer]--;
+        if (mapNext[nPeer] != nMessage + 1)
+            fOrdered = false;
+        return mapNext[nPeer] < (int)mapBacklog[nPeer].size();
+    }
+};
+
+static void Work(CSerialWorkQueue<int>* pqueue, CSimulatedPeers* ppeers)
+{
+    while (true) {
+        int nPeer = pqueue->Pop();
+        pqueue->Done(nPeer, ppeers->Process(nPeer));
+    }
+}
+
+static void RunPeers(int nThreads, CSimulatedPeers& peers)
+{
+    static const int PEERS = 8;
+    static const int MESSAGES = 10;
+
+    // one peer downloading blocks, the others sending a few pings and invs
+    peers.Add(0, MESSAGES);
+    for (int nPeer = 1; nPeer < PEERS; nPeer++)
+        peers.Add(nPeer, 2);
+
+    CSerialWorkQueue<int> queue;
+    boost::thread_group threadGroup;
+    for (int i = 0; i < nThreads; i++)
+        threadGroup.create_thread(boost::bind(&Work, &queue, &peers));
+
+    for (int nPeer = 0; nPeer < PEERS; nPeer++)
+        queue.Push(nPeer);
+    while (true) {
+        {
+            boost::unique_lock<boost::mutex> lock(peers.mutex);
+            if (peers.mapNext[0] == MESSAGES && peers.nPings == PEERS - 1 && peers.mapRunning[0] == 0)
+                break;
+        }
+        MilliSleep(1);
+    }
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    BOOST_TEST_MESSAGE(strprintf("%d threads: ping latency avg %.2fms max %.2fms, inv latency max %.2fms", nThreads,
+        peers.nPingTotal * 0.001 / peers.nPings, peers.nPingMax * 0.001, peers.nInvMax * 0.001));
+    BOOST_CHECK(peers.fOrdered);
+    BOOST_CHECK(peers.fSerial);
+}
+
+BOOST_AUTO_TEST_CASE(workqueue_latency)
+{
+    // the latencies depend on the machine, they are only reported
+    CSimulatedPeers peersSingle;
+    RunPeers(1, peersSingle);
+    BOOST_CHECK(peersSingle.nPingBlocksMin >= 1);
+
+    // pings do not wait for the block being processed when another thread is free
+    CSimulatedPeers peersPool;
+    RunPeers(4, peersPool);
+    BOOST_CHECK_EQUAL(peersPool.nPingBlocksMin, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -181,6 +181,20 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo, const std::map<uint256, CDiskTxPos>& txindex)
+{
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<int, const CBlockFileInfo*> >::const_iterator it = fileInfo.begin(); it != fileInfo.end(); it++)
+        batch.Write(make_pair('f', it->first), *it->second);
+    if (!fileInfo.empty())
+        batch.Write('l', nLastFile);
+    for (std::vector<const CBlockIndex*>::const_iterator it = blockinfo.begin(); it != blockinfo.end(); it++)
+        batch.Write(make_pair('b', (*it)->GetBlockHash()), CDiskBlockIndex(*it));
+    for (std::map<uint256, CDiskTxPos>::const_iterator it = txindex.begin(); it != txindex.end(); it++)
+        batch.Write(make_pair('t', it->first), it->second);
+    return WriteBatch(batch, true);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string& name, bool fValue)
 {
     return Write(std::make_pair('F', name), fValue ? '1' : '0');
@@ -201,9 +215,12 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
 
     CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
     ssKeySet << make_pair('b', uint256());
-    pcursor->Seek(ssKeySet.str());
 
-    // Load mapBlockIndex
+    // Decode every entry in one pass, then create the entries in height
+    // order, so ancestors end up next to each other
+    vector<pair<uint256, CDiskBlockIndex> > vEntries;
+    vector<pair<int, size_t> > vOrder;
+    pcursor->Seek(ssKeySet.str());
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
@@ -212,43 +229,16 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
             char chType;
             ssKey >> chType;
             if (chType == 'b') {
+                // The block hash is the rest of the key, so the header does
+                // not have to be hashed again (HashQuark is expensive)
+                uint256 hash;
+                ssKey >> hash;
+
                 leveldb::Slice slValue = pcursor->value();
                 CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                CDiskBlockIndex diskindex;
-                ssValue >> diskindex;
-
-                // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->pnext = InsertBlockIndex(diskindex.hashNext);
-                pindexNew->nHeight = diskindex.nHeight;
-                pindexNew->nFile = diskindex.nFile;
-                pindexNew->nDataPos = diskindex.nDataPos;
-                pindexNew->nUndoPos = diskindex.nUndoPos;
-                pindexNew->nVersion = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime = diskindex.nTime;
-                pindexNew->nBits = diskindex.nBits;
-                pindexNew->nNonce = diskindex.nNonce;
-                pindexNew->nStatus = diskindex.nStatus;
-                pindexNew->nTx = diskindex.nTx;
-
-                //Proof Of Stake
-                pindexNew->nMint = diskindex.nMint;
-                pindexNew->nMoneySupply = diskindex.nMoneySupply;
-                pindexNew->nFlags = diskindex.nFlags;
-                pindexNew->nStakeModifier = diskindex.nStakeModifier;
-                pindexNew->prevoutStake = diskindex.prevoutStake;
-                pindexNew->nStakeTime = diskindex.nStakeTime;
-                pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
-
-                if (pindexNew->nHeight <= Params().LAST_POW_BLOCK()) {
-                    if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
-                        return error("LoadBlockIndex() : CheckProofOfWork failed: %s", pindexNew->ToString());
-                }
-                // ppcoin: build setStakeSeen
-                if (pindexNew->IsProofOfStake())
-                    setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+                vEntries.push_back(make_pair(hash, CDiskBlockIndex()));
+                ssValue >> vEntries.back().second;
+                vOrder.push_back(make_pair(vEntries.back().second.nHeight, vEntries.size() - 1));
 
                 pcursor->Next();
             } else {
@@ -258,6 +248,48 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
             return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
     }
+    sort(vOrder.begin(), vOrder.end());
+    mapBlockIndex.reserve(vEntries.size());
+    for (vector<pair<int, size_t> >::const_iterator it = vOrder.begin(); it != vOrder.end(); it++)
+        InsertBlockIndex(vEntries[it->second].first);
+
+    // Load mapBlockIndex
+    for (vector<pair<int, size_t> >::const_iterator it = vOrder.begin(); it != vOrder.end(); it++) {
+        const CDiskBlockIndex& diskindex = vEntries[it->second].second;
+
+        // Construct block index object
+        CBlockIndex* pindexNew = InsertBlockIndex(vEntries[it->second].first);
+        pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
+        pindexNew->pnext = InsertBlockIndex(diskindex.hashNext);
+        pindexNew->nHeight = diskindex.nHeight;
+        pindexNew->nFile = diskindex.nFile;
+        pindexNew->nDataPos = diskindex.nDataPos;
+        pindexNew->nUndoPos = diskindex.nUndoPos;
+        pindexNew->nVersion = diskindex.nVersion;
+        pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+        pindexNew->nTime = diskindex.nTime;
+        pindexNew->nBits = diskindex.nBits;
+        pindexNew->nNonce = diskindex.nNonce;
+        pindexNew->nStatus = diskindex.nStatus;
+        pindexNew->nTx = diskindex.nTx;
+
+        //Proof Of Stake
+        pindexNew->nMint = diskindex.nMint;
+        pindexNew->nMoneySupply = diskindex.nMoneySupply;
+        pindexNew->nFlags = diskindex.nFlags;
+        pindexNew->nStakeModifier = diskindex.nStakeModifier;
+        pindexNew->prevoutStake = diskindex.prevoutStake;
+        pindexNew->nStakeTime = diskindex.nStakeTime;
+        pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
+
+        if (pindexNew->nHeight <= Params().LAST_POW_BLOCK()) {
+            if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
+                return error("LoadBlockIndex() : CheckProofOfWork failed: %s", pindexNew->ToString());
+        }
+        // ppcoin: build setStakeSeen
+        if (pindexNew->IsProofOfStake())
+            setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+    }
 
     return true;
 }
@@ -0,0 +1,87 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include <deque>
+#include <set>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+
+/** Hands items with pending work to a pool of threads, one thread per item at a time.
+ *  An item pushed while it is queued stays queued once; an item pushed while a thread holds
+ *  it is queued again when that thread is done, so the work of one item runs in order and
+ *  independent items run concurrently.
+ */
+template <typename T>
+class CSerialWorkQueue
+{
+private:
+    mutable boost::mutex mutex;
+    boost::condition_variable condition;
+    std::deque<T> queue;
+    std::set<T> setQueued;
+    // held by a thread
+    std::set<T> setBusy;
+    // pushed while held by a thread
+    std::set<T> setPending;
+
+public:
+    /// Queue an item, returns false when it is already queued or held by a thread
+    bool Push(const T& item)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (setQueued.count(item))
+                return false;
+            if (setBusy.count(item)) {
+                setPending.insert(item);
+                return false;
+            }
+            queue.push_back(item);
+            setQueued.insert(item);
+        }
+        condition.notify_one();
+        return true;
+    }
+
+    /// Take the next item, waiting until there is one. The wait is an interruption point.
+    T Pop()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (queue.empty())
+            condition.wait(lock);
+        T item = queue.front();
+        queue.pop_front();
+        setQueued.erase(item);
+        setBusy.insert(item);
+        return item;
+    }
+
+    /// Give back an item taken with Pop, fMore queues it again behind the others.
+    /// Returns true when the item was queued again, false when nobody holds it any more.
+    bool Done(const T& item, bool fMore)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            setBusy.erase(item);
+            if (!setPending.erase(item) && !fMore)
+                return false;
+            queue.push_back(item);
+            setQueued.insert(item);
+        }
+        condition.notify_one();
+        return true;
+    }
+
+    size_t size() const
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        return queue.size();
+    }
+};
+
+#endif